@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// CONTADORES DE ASIGNACIONES DE MEMORIA DINÁMICA
+// -------------------------------------------------------------------------
+// malloc/calloc/realloc/free se envuelven en el enlazado
+// (-Wl,--wrap=malloc ..., ver platformio.ini): cada llamada pasa por aquí,
+// se cuenta y sigue hacia el asignador real. Cubre `new`, `String`,
+// ArduinoJson dinámico y las librerías precompiladas del framework; no ve
+// lo que llama directo a heap_caps_malloc (eso se nota igual en la memoria
+// libre, y los pedidos fallidos los cuenta heap_monitor.h).
+//
+// Por lo mismo allocs - frees ("live_malloc" en el diagnóstico) es solo de
+// malloc: no son los bloques vivos del heap. Un bloque de heap_caps_malloc
+// liberado con free() resta sin haber sumado, así que el valor absoluto no
+// dice nada; lo que delata una fuga es que crezca entre diagnósticos.
+//
+// Además del total se cuentan aparte las asignaciones de una tarea elegida
+// (el loop): así se atribuyen a las etapas del ciclo sin mezclar lo que
+// hacen en paralelo las tareas de Wi-Fi y MQTT.
+//
+// Régimen estable: mientras la tarea vigilada está en un tramo marcado con
+// allocCounterSetSteady(true) (el ciclo de telemetría y los manejadores de
+// comandos, pasado el arranque) no debería asignar nada. Cada asignación
+// ahí se cuenta aparte con su tamaño y la dirección que llamó a malloc
+// (addr2line), y la herramienta del host (tools/steady_state_check.cpp)
+// falla si aparece alguna.
+
+struct AllocCounters {
+  uint32_t allocs;          // malloc/calloc/realloc que crearon un bloque (todas las tareas)
+  uint32_t frees;           // Llamadas a free() (también de bloques pedidos con heap_caps_malloc)
+  uint32_t tracked_allocs;  // Asignaciones de la tarea vigilada (incluye los realloc que crecen un bloque)
+  uint64_t tracked_bytes;   // Bytes pedidos por la tarea vigilada
+  uint32_t steady_allocs;   // Asignaciones de la tarea vigilada dentro de un tramo de régimen estable
+  uint32_t steady_last_size;
+  uintptr_t steady_last_caller;  // Dirección desde donde se llamó a malloc/calloc/realloc
+};
+
+// Vigila las asignaciones de la tarea (o hilo, en el host) que la llama
+void allocCounterTrackCurrentTask();
+
+void allocCounterRead(AllocCounters& out);
+
+// Asignaciones de la tarea vigilada desde el arranque (lectura barata para marcar etapas)
+uint32_t allocCounterTracked();
+
+// Marca si la tarea vigilada está en régimen estable (solo desde esa tarea); devuelve el estado anterior
+bool allocCounterSetSteady(bool steady);
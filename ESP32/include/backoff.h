@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// REINTENTOS CON BACKOFF EXPONENCIAL Y JITTER
+// -------------------------------------------------------------------------
+// Tras cada fallo la espera máxima se duplica (base, 2*base, 4*base, ...)
+// hasta `cap_ms`. Con jitter completo la espera real es un valor aleatorio
+// entre 0 y ese máximo: si el broker se reinicia, los equipos de la flota
+// no reconectan todos en el mismo instante.
+//
+// No depende de Arduino: el simulador de flota (tools/reconnect_sim.cpp)
+// usa exactamente el mismo código.
+
+enum BackoffJitter {
+  BACKOFF_JITTER_NONE = 0,  // Espera determinista (todos los equipos sincronizados)
+  BACKOFF_JITTER_FULL       // Espera uniforme en [0, tope]
+};
+
+struct BackoffConfig {
+  uint32_t base_ms;     // Tope de la espera tras el primer fallo
+  uint32_t cap_ms;      // Tope máximo de la espera
+  BackoffJitter jitter;
+};
+
+struct Backoff {
+  BackoffConfig cfg;
+  uint32_t failures;       // Fallos consecutivos
+  uint32_t next_ms;        // Instante a partir del cual se puede reintentar
+  uint32_t last_delay_ms;  // Última espera calculada (diagnóstico)
+  uint32_t rng;            // Estado del generador (xorshift32), distinto en cada equipo
+};
+
+// `seed` debe variar entre equipos (ej. esp_random() o derivado de la MAC)
+void backoffInit(Backoff& b, const BackoffConfig& cfg, uint32_t seed);
+
+// true si ya se puede intentar de nuevo
+bool backoffReady(const Backoff& b, uint32_t now_ms);
+
+// Registra un intento fallido y programa el siguiente. Devuelve la espera elegida.
+uint32_t backoffFailure(Backoff& b, uint32_t now_ms);
+
+// Conexión establecida: se vuelve a la espera base
+void backoffSuccess(Backoff& b);
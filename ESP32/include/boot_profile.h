@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// PERFIL DE ARRANQUE (FASES DE setup() EN MICROSEGUNDOS)
+// -------------------------------------------------------------------------
+// Cada fase se abre con bootPhaseBegin(); abrir la siguiente cierra la
+// anterior y bootPhaseEnd() cierra la última. Los nombres deben ser literales
+// (solo se guarda el puntero). Las fases que no caben se descartan.
+
+#define BOOT_PHASES_MAX 12
+
+struct BootPhase {
+  const char* name;
+  uint32_t start_us;     // Desde el encendido
+  uint32_t duration_us;
+};
+
+struct BootProfile {
+  BootPhase phases[BOOT_PHASES_MAX];
+  uint8_t count;
+  bool open;             // La última fase sigue abierta
+};
+
+void bootProfileInit(BootProfile& profile);
+void bootPhaseBegin(BootProfile& profile, const char* name, uint32_t now_us);
+void bootPhaseEnd(BootProfile& profile, uint32_t now_us);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// LISTA DE BROKERS CON CONMUTACIÓN POR FALLA
+// -------------------------------------------------------------------------
+// Lista priorizada ("host:puerto,host:puerto", en orden de preferencia)
+// guardada en NVS. Se conecta al broker sano de menor latencia; si varios
+// están dentro de BROKER_RTT_TIE_MS del mejor, gana el de mayor prioridad.
+//
+// Se cambia de broker cuando el activo acumula BROKER_FAILOVER_FAILURES
+// fallos MQTT seguidos, o antes si el sondeo de latencia muestra que ni
+// siquiera acepta conexiones TCP y hay otro que sí.
+//
+// No depende de Arduino: tools/failover_bench.cpp usa esta misma lógica.
+
+#define BROKER_LIST_MAX 4
+#define BROKER_HOST_MAX 64
+#define BROKER_LIST_TEXT_MAX (BROKER_LIST_MAX * (BROKER_HOST_MAX + 7))
+#define BROKER_FAILOVER_FAILURES 3
+#define BROKER_RTT_TIE_MS 20
+
+struct BrokerEndpoint {
+  char host[BROKER_HOST_MAX];
+  uint16_t port;
+  int32_t rtt_ms;    // Última latencia de conexión TCP medida (-1 = no responde o sin medir)
+  uint8_t failures;  // Fallos MQTT seguidos contra este broker
+};
+
+struct BrokerList {
+  BrokerEndpoint endpoints[BROKER_LIST_MAX];
+  uint8_t count;
+  int8_t active;     // Índice del broker en uso (-1 = ninguno elegido)
+};
+
+// Interpreta "host[:puerto],host[:puerto]". Las entradas que no caben se descartan.
+// Devuelve false si no quedó ningún broker válido (la lista no se modifica).
+bool brokerListParse(BrokerList& list, const char* text, uint16_t default_port);
+
+// Formato inverso de brokerListParse (para guardarla en NVS)
+size_t brokerListFormat(const BrokerList& list, char* out, size_t size);
+
+// Elige el broker a usar y lo deja como activo. Devuelve su índice.
+int brokerListSelect(BrokerList& list);
+
+const BrokerEndpoint* brokerListActive(const BrokerList& list);
+
+// Resultados de un intento MQTT contra el broker activo
+void brokerListReportFailure(BrokerList& list);
+void brokerListReportConnected(BrokerList& list);
+
+// Latencia medida por el sondeo (-1 si no aceptó la conexión)
+void brokerListSetRtt(BrokerList& list, int index, int32_t rtt_ms);
+
+// true si conviene cambiar de broker (ver criterio arriba)
+bool brokerListShouldFailover(const BrokerList& list);
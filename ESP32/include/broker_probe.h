@@ -0,0 +1,19 @@
+#pragma once
+
+#include "broker_list.h"
+
+// -------------------------------------------------------------------------
+// SONDEO DE LATENCIA DE LOS BROKERS
+// -------------------------------------------------------------------------
+// Mide el tiempo de conexión TCP a cada broker de la lista en una tarea de
+// FreeRTOS aparte, para no bloquear el loop (cada intento puede tardar
+// hasta BROKER_PROBE_TIMEOUT_MS).
+
+#define BROKER_PROBE_TIMEOUT_MS 1000
+#define BROKER_PROBE_STACK 4096
+
+// Lanza el sondeo de todos los brokers. false si ya hay uno en curso.
+bool brokerProbeStart(const BrokerList& list);
+
+// true (una sola vez) cuando el sondeo terminó; copia las latencias en `list`
+bool brokerProbeDone(BrokerList& list);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "device_identity.h"
+
+// -------------------------------------------------------------------------
+// COMANDOS DE CONTROL DE BOMBA
+// -------------------------------------------------------------------------
+// Interpreta el payload de {sitio}/{controlador}/pumps/{id}/control
+// ({"command": "START" | "STOP", ...}). Solo se conserva el campo
+// "command" (filtro de ArduinoJson), así el documento es chico y de
+// tamaño fijo aunque el mensaje traiga otros campos; no usa memoria
+// dinámica. La acción la ejecuta main.cpp (ControlPumpFn); las
+// herramientas del host pasan por las mismas funciones con la suya.
+
+#define CONTROL_COMMAND_MAX 16  // Texto del comando más largo aceptado (incluye '\0')
+#define CONTROL_REPLY_MAX 128   // Respuesta {"pump_id", "result", "ts_ms"}
+#define CONTROL_PUMP_NONE -1    // Comando rechazado antes de leer la bomba del tópico (0 es una bomba válida)
+
+enum ControlAction : uint8_t {
+  CONTROL_START = 0,
+  CONTROL_STOP
+};
+
+// nullptr si el comando es válido; si no, el resultado que se informa en la respuesta
+// ("INVALID_JSON", "MISSING_COMMAND" o "UNKNOWN_COMMAND")
+const char* controlCommandParse(const uint8_t* payload, size_t length, ControlAction& action);
+
+// Ejecuta la acción sobre la bomba `pump_id`: "APPLIED" o el motivo del rechazo (p. ej. "UNKNOWN_PUMP")
+typedef const char* (*ControlPumpFn)(int pump_id, ControlAction action);
+
+// Comando recibido en {sitio}/{controlador}/pumps/{id}/control: interpreta el payload, saca la
+// bomba del tópico y llama a `apply`. Devuelve el resultado para la respuesta ("INVALID_TOPIC" si
+// el tópico no es de una bomba); `pump_id` queda en CONTROL_PUMP_NONE si no se llegó a leer.
+const char* controlCommandHandle(const DeviceIdentity& identity, const char* topic, const uint8_t* payload,
+                                 size_t length, ControlPumpFn apply, int& pump_id);
+
+// Respuesta MQTT 5 a un comando (sin "pump_id" si es CONTROL_PUMP_NONE). `stamp`: TIME_STAMP_WIDTH
+// caracteres de timeServiceFormatStamp().
+// Devuelve el largo escrito (sin '\0') o 0 si no cupo en `size`.
+size_t controlCommandWriteReply(int pump_id, const char* result, const char* stamp, char* out, size_t size);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// PERFILADOR DE CPU POR MUESTREO
+// -------------------------------------------------------------------------
+// Mientras corre, un temporizador de hardware por núcleo interrumpe
+// rate_hz veces por segundo en nivel 3 (por encima de las
+// interrupciones comunes y del planificador) y anota dónde estaba la CPU:
+// el PC interrumpido (EPC3), la tarea en curso y si se estaba dentro de
+// otra interrupción. Así se ve también el tiempo de WiFi, lwIP y los ISR.
+//
+// Las muestras se acumulan por (PC, tarea) en una tabla por núcleo: una
+// sesión puede durar minutos con memoria fija. Las tablas se piden al
+// arrancar y se liberan tras el volcado (sin perfilar no ocupan RAM). Si
+// una tabla se llena, la muestra se cuenta como perdida.
+//
+// Volcado en texto, una línea por llamada a profilerNextLine():
+//   P <rate_hz> <duration_ms> <samples> <lost>   encabezado
+//   T <core> <task> <nombre>                     tareas vistas en cada núcleo
+//   S <core> <task> <pc hex> <count> <isr>       muestras acumuladas
+//   E                                            fin
+// tools/profile_fold.cpp lo simboliza contra el ELF y arma las pilas para
+// un flame graph.
+//
+// Solo Xtensa (ESP32) con ESP-IDF 4.x o 5.1 en adelante: hace falta fijar
+// la prioridad de la interrupción del temporizador.
+
+#define PROFILER_DEFAULT_HZ 997   // Primo: no se sincroniza con el tick de 1 kHz ni con los ciclos del loop
+#define PROFILER_MAX_HZ 5000
+#define PROFILER_TABLE_SIZE 512   // (PC, tarea) distintos por núcleo
+#define PROFILER_MAX_TASKS 16     // Tareas distintas por núcleo
+#define PROFILER_LINE_MAX 48
+
+struct ProfilerSummary {
+  uint32_t rate_hz;
+  uint32_t duration_ms;
+  uint32_t samples;
+  uint32_t lost;       // Tabla llena
+  uint16_t entries;    // (PC, tarea) distintos
+};
+
+struct ProfilerCursor {
+  uint8_t phase;
+  uint8_t core;
+  uint16_t index;
+};
+
+// Pide las tablas y arranca el muestreo en los dos núcleos. false si ya corre o no se pudo.
+bool profilerStart(uint32_t rate_hz);
+void profilerStop();
+bool profilerRunning();
+
+// Hay una sesión terminada sin liberar
+bool profilerHasData();
+void profilerSummary(ProfilerSummary& out);
+
+void profilerCursorInit(ProfilerCursor& cursor);
+// Escribe la siguiente línea del volcado (sin salto de línea). false cuando ya no quedan.
+bool profilerNextLine(ProfilerCursor& cursor, char* line, size_t size);
+
+// Libera las tablas de la última sesión
+void profilerRelease();
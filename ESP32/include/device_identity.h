@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// IDENTIDAD DEL CONTROLADOR Y JERARQUÍA DE TÓPICOS
+// -------------------------------------------------------------------------
+// Cada controlador tiene un sitio y un identificador propio (el client ID
+// MQTT). Por defecto el identificador sale de la MAC ("ctl-a1b2c3d4e5f6");
+// se puede provisionar otro por NVS. Todos los tópicos cuelgan de
+// "{sitio}/{controlador}/...", así varios controladores y sitios comparten
+// broker sin expulsarse ni mezclar los IDs de bomba:
+//
+//   {sitio}/{controlador}/pumps/{bomba}/telemetry
+//   {sitio}/{controlador}/pumps/{bomba}/control
+//   {sitio}/{controlador}/tank/alerts | tank/level_events
+//   {sitio}/{controlador}/config | info
+//   {sitio}/sample                       (difusión a todos los controladores del sitio)
+//
+// Los segmentos solo admiten [A-Za-z0-9_-] (nada de '/', '+' ni '#').
+
+#define DEVICE_SITE_MAX 24
+#define DEVICE_CONTROLLER_MAX 32
+#define DEVICE_DEFAULT_SITE "caracas"
+
+struct DeviceIdentity {
+  char site[DEVICE_SITE_MAX];
+  char controller[DEVICE_CONTROLLER_MAX];
+  bool provisioned;  // false = identificador derivado de la MAC
+};
+
+bool deviceIdentityValidSegment(const char* segment, size_t max_size);
+
+// Identidad por defecto a partir de la MAC de fábrica
+void deviceIdentityFromMac(DeviceIdentity& id, const uint8_t mac[6], const char* site);
+
+// Devuelve false (y no toca `id`) si algún segmento no es válido
+bool deviceIdentitySet(DeviceIdentity& id, const char* site, const char* controller);
+
+// "{sitio}/{controlador}/{suffix}". Devuelve la longitud o 0 si no cabe.
+size_t deviceTopic(const DeviceIdentity& id, const char* suffix, char* out, size_t size);
+
+// "{sitio}/{suffix}" (tópicos comunes a todo el sitio). Devuelve la longitud o 0 si no cabe.
+size_t deviceSiteTopic(const DeviceIdentity& id, const char* suffix, char* out, size_t size);
+
+// "{sitio}/{controlador}/pumps/{bomba}/{leaf}"; con pump_id < 0 se usa el comodín '+'
+size_t devicePumpTopic(const DeviceIdentity& id, int pump_id, const char* leaf, char* out, size_t size);
+
+// Extrae el ID de bomba de un tópico de este controlador que termina en `leaf`
+bool deviceParsePumpTopic(const DeviceIdentity& id, const char* topic, const char* leaf, int& pump_id);
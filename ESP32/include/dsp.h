@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// NÚCLEOS DE PROCESAMIENTO DE SEÑAL
+// -------------------------------------------------------------------------
+// Funciones puras (sin dependencias de Arduino) para poder reutilizarlas
+// tanto en el firmware como en una compilación nativa del host.
+
+// Calcula el valor RMS de la componente alterna de un bloque de muestras del ADC.
+// Se resta el promedio (offset DC del divisor de polarización del CT) antes de
+// elevar al cuadrado. `units_per_count` convierte cuentas del ADC a la unidad
+// física deseada (ej. amperios por cuenta).
+float dspAcRms(const uint16_t* samples, size_t count, float units_per_count);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// MEDIDOR DE ENERGÍA POR BOMBA (kWh)
+// -------------------------------------------------------------------------
+// Integra la potencia activa P = V * I_rms * FP en cada lectura del sensor de
+// corriente (regla del trapecio) y acumula el volumen bombeado estimado a partir
+// del caudal nominal de la bomba, para reportar la eficiencia en kWh/m3.
+// El módulo no toca el hardware ni la NVS: main.cpp le entrega las lecturas y
+// se encarga de persistir los totales.
+
+// Si el intervalo entre dos lecturas supera este valor (ej. el loop estuvo
+// bloqueado reconectando), no se integra el tramo para no inventar energía.
+#define ENERGY_MAX_GAP_MS 60000
+
+struct EnergyMeterConfig {
+  float voltage_v;       // Tensión nominal de alimentación de la bomba (V)
+  float power_factor;    // Factor de potencia del motor (0..1)
+  float nominal_flow_lpm; // Caudal nominal de la bomba (L/min) para estimar m3 bombeados
+};
+
+struct EnergyMeter {
+  EnergyMeterConfig cfg;
+
+  double total_kwh;      // Acumulado histórico (se persiste en NVS)
+  double total_m3;       // Volumen bombeado acumulado (se persiste en NVS)
+  double interval_kwh;   // Acumulado desde el último cierre de intervalo (publicación)
+  double interval_m3;
+  double unsaved_kwh;    // Energía acumulada que todavía no se guardó en NVS
+
+  float last_power_w;    // Potencia de la última muestra
+  uint32_t last_sample_ms;
+  bool has_sample;
+};
+
+// Inicializa el medidor con los totales recuperados de la NVS
+void energyMeterInit(EnergyMeter& meter, const EnergyMeterConfig& cfg, double stored_kwh, double stored_m3);
+
+// Integra una nueva lectura de corriente RMS. `running` indica si el relé de la bomba está activo.
+void energyMeterSample(EnergyMeter& meter, float amps_rms, bool running, uint32_t now_ms);
+
+// Devuelve la energía del intervalo actual y lo reinicia (se llama al publicar)
+double energyMeterCloseInterval(EnergyMeter& meter, double* interval_m3 = nullptr);
+
+// Eficiencia acumulada en kWh por metro cúbico bombeado (0 si aún no hay volumen)
+float energyMeterKwhPerM3(const EnergyMeter& meter);
+
+// Indica que los totales se guardaron en NVS
+void energyMeterMarkPersisted(EnergyMeter& meter);
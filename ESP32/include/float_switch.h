@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// ANTIRREBOTE DE FLOTADORES POR TIEMPO
+// -------------------------------------------------------------------------
+// La interrupción del pin solo guarda el instante del último flanco. Un cambio
+// de estado se acepta cuando el nivel crudo difiere del estado estable y no ha
+// habido flancos durante FLOAT_DEBOUNCE_US (el oleaje hace rebotar el flotador).
+// Módulo puro: la lectura del pin y la ISR quedan en main.cpp.
+
+#define FLOAT_DEBOUNCE_US 100000UL // 100 ms sin flancos para aceptar un cambio
+
+enum FloatSwitchId {
+  FLOAT_SWITCH_HIGH = 0,
+  FLOAT_SWITCH_LOW,
+  FLOAT_SWITCH_COUNT
+};
+
+struct FloatDebouncer {
+  bool stable_wet;        // Estado aceptado (true = flotador sumergido)
+  bool initialized;
+  uint32_t changed_us;    // Instante del flanco que originó el último cambio aceptado
+};
+
+// Evento de cruce de nivel generado por un cambio de estado aceptado
+struct FloatLevelEvent {
+  FloatSwitchId id;
+  bool wet;
+  uint32_t edge_us;       // Instante del flanco (marcado en la ISR)
+  uint32_t detected_us;   // Instante en que se confirmó tras el antirrebote
+};
+
+void floatDebouncerInit(FloatDebouncer& debouncer);
+
+// Evalúa el nivel crudo actual. Devuelve true (y llena `event`) si se acepta un cambio de estado.
+bool floatDebouncerUpdate(FloatDebouncer& debouncer, FloatSwitchId id, bool raw_wet,
+                          uint32_t last_edge_us, uint32_t now_us, FloatLevelEvent& event);
+
+// Nombre del evento para el tópico de eventos de nivel (ej. "TANK_FULL")
+const char* floatLevelEventName(const FloatLevelEvent& event);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// ESTADO DE LA MEMORIA: HEAP, FRAGMENTACIÓN Y PILAS DE LAS TAREAS
+// -------------------------------------------------------------------------
+// Foto barata del heap interno (libre, mínimo histórico, bloque libre más
+// grande) y del margen de pila que le queda a cada tarea conocida. La
+// fragmentación es la parte de la memoria libre que no se puede pedir de
+// una vez: 100 - (bloque más grande * 100 / libre).
+//
+// Los umbrales avisan antes de que una asignación falle: poca memoria
+// libre, ningún bloque del tamaño de un buffer de MQTT, heap muy partido o
+// una pila casi llena. Un pedido que ya falló se avisa siempre.
+
+#define HEAP_MONITOR_TASKS 9
+#define HEAP_WARN_FREE_BYTES 24576          // Memoria libre mínima aceptable
+#define HEAP_WARN_LARGEST_BLOCK_BYTES 8192  // Debe caber al menos un buffer de MQTT (con holgura)
+#define HEAP_WARN_FRAGMENTATION_PCT 60
+#define HEAP_WARN_STACK_BYTES 512           // Margen de pila mínimo de cualquier tarea
+
+enum HeapWarning : uint8_t {
+  HEAP_WARN_LOW_FREE = 1 << 0,
+  HEAP_WARN_SMALL_BLOCK = 1 << 1,
+  HEAP_WARN_FRAGMENTED = 1 << 2,
+  HEAP_WARN_STACK = 1 << 3,
+  HEAP_WARN_ALLOC_FAILED = 1 << 4,
+  HEAP_WARN_STEADY_ALLOC = 1 << 5,  // Asignación en régimen estable (lo detecta main.cpp, ver alloc_counter.h)
+};
+#define HEAP_WARNING_COUNT 6
+
+struct TaskStackInfo {
+  const char* name;
+  uint32_t free_bytes;  // Mínimo de pila libre que tuvo la tarea desde que arrancó
+};
+
+struct HeapSnapshot {
+  uint32_t free_bytes;
+  uint32_t min_free_bytes;      // Mínimo desde el arranque
+  uint32_t largest_block;
+  uint8_t fragmentation_pct;
+  uint32_t failed_allocs;       // Pedidos fallidos desde el arranque
+  uint32_t last_failed_size;    // Tamaño del último pedido fallido
+  TaskStackInfo stacks[HEAP_MONITOR_TASKS];
+  uint8_t stack_count;          // Tareas encontradas (las que no existen se omiten)
+};
+
+// En setup(): registra el aviso de pedidos fallidos del asignador
+void heapMonitorBegin();
+
+void heapMonitorSample(HeapSnapshot& out);
+
+// Avisos que dispara la foto (HeapWarning); `failed_seen` son los pedidos fallidos ya avisados
+uint8_t heapMonitorWarnings(const HeapSnapshot& snapshot, uint32_t failed_seen);
+
+const char* heapWarningName(HeapWarning warning);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// ESCRITOR DE JSON EN STREAMING
+// -------------------------------------------------------------------------
+// Escribe el JSON campo por campo directamente en el buffer de destino (por
+// ejemplo, el lugar reservado en la cola de salida MQTT): no arma un
+// documento intermedio ni copia el resultado. No usa memoria dinámica.
+//
+// Si el buffer se llena se llama a `grow` (opcional), que puede mover lo
+// escrito a un buffer más grande; si no hay o no puede, el escritor queda
+// en error y el resto de las escrituras se ignoran (nunca se publica un
+// JSON cortado: ver jsonWriterOk()).
+//
+// Los números con decimales se escriben con una cantidad fija de decimales
+// (sin ceros finales) y NaN/infinito como null, que JSON no admite. Los
+// anchos máximos de cada tipo de valor están abajo para acotar mensajes al
+// compilar.
+
+#define JSON_INT_MAX_CHARS 20                     // int64_t con signo
+#define JSON_FLOAT_MAX_CHARS(decimals) (13 + (decimals)) // Signo, 10 enteros, punto (o notación e)
+#define JSON_BOOL_MAX_CHARS 5
+#define JSON_FIELD_OVERHEAD 4                     // Comillas de la clave, dos puntos y coma
+
+constexpr size_t jsonKeyLength(const char* key) {
+  return *key == '\0' ? 0 : 1 + jsonKeyLength(key + 1);
+}
+
+// Cota de un campo con su clave (literal) y valor: se suma al compilar para dimensionar buffers
+constexpr size_t jsonFieldMax(const char* key, size_t value_chars) {
+  return jsonKeyLength(key) + JSON_FIELD_OVERHEAD + value_chars;
+}
+
+// Mueve lo escrito (`used` bytes) a un buffer más grande; actualiza `buf` y `capacity`
+typedef bool (*JsonGrowFn)(void* ctx, char*& buf, size_t& capacity, size_t used);
+
+struct JsonWriter {
+  char* buf;
+  size_t capacity;
+  size_t length;
+  bool failed;       // Se llenó sin poder crecer
+  bool need_comma;   // El próximo valor del objeto/arreglo actual va precedido de coma
+  JsonGrowFn grow;
+  void* grow_ctx;
+};
+
+void jsonWriterInit(JsonWriter& w, char* buf, size_t capacity, JsonGrowFn grow = nullptr, void* grow_ctx = nullptr);
+
+// true si todo lo escrito entró
+inline bool jsonWriterOk(const JsonWriter& w) { return !w.failed; }
+
+// `key` nullptr = elemento de arreglo (o el valor raíz)
+void jsonBeginObject(JsonWriter& w, const char* key = nullptr);
+void jsonEndObject(JsonWriter& w);
+void jsonBeginArray(JsonWriter& w, const char* key = nullptr);
+void jsonEndArray(JsonWriter& w);
+
+void jsonInt(JsonWriter& w, const char* key, int64_t value);
+void jsonFloat(JsonWriter& w, const char* key, double value, uint8_t decimals);
+void jsonBool(JsonWriter& w, const char* key, bool value);
+void jsonNull(JsonWriter& w, const char* key);
+void jsonString(JsonWriter& w, const char* key, const char* value);
+
+// Valor ya formateado que se copia tal cual (ej. la marca "ts_ms" de ancho fijo). Devuelve la
+// posición del valor dentro de lo escrito (para completarlo después) o 0 si no entró.
+size_t jsonRaw(JsonWriter& w, const char* key, const char* value, size_t length);
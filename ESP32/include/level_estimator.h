@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "tank_geometry.h"
+
+// -------------------------------------------------------------------------
+// ESTIMADOR DE NIVEL (FILTRO DE KALMAN ULTRASÓNICO + FLOTADORES)
+// -------------------------------------------------------------------------
+// Estado: altura de agua h (cm) y su varianza P.
+//
+// Predicción: el caudal neto (entrada de la calle - bombas) dividido entre el
+//   área libre del tanque (dV/dh de la tabla de geometría) mueve h; el consumo
+//   no medido se modela como ruido de proceso que crece con dt.
+// Corrección ultrasónica: medición continua pero ruidosa, con rechazo de
+//   valores atípicos por distancia de Mahalanobis.
+// Flotadores: en el instante en que un flotador cambia de estado el nivel
+//   está exactamente a su altura (medición muy precisa); en régimen
+//   permanente definen un intervalo válido al que se recorta la estimación.
+
+struct LevelEstimatorConfig {
+  float high_float_cm;        // Altura de montaje del flotador superior
+  float low_float_cm;         // Altura de montaje del flotador inferior
+  float ultrasonic_sigma_cm;  // Desviación estándar de la medición ultrasónica
+  float float_sigma_cm;       // Desviación estándar de un cruce de flotador
+  float process_sigma_cm;     // Ruido de proceso por minuto (consumo no medido)
+};
+
+struct LevelEstimator {
+  LevelEstimatorConfig cfg;
+  const TankVolumeTable* table;
+
+  float height_cm;
+  float variance_cm2;
+  bool initialized;
+  uint32_t last_ms;
+
+  int8_t last_high_wet;       // -1 = desconocido
+  int8_t last_low_wet;
+  uint8_t rejected_streak;    // Mediciones ultrasónicas rechazadas seguidas
+};
+
+void levelEstimatorInit(LevelEstimator& est, const TankVolumeTable* table, const LevelEstimatorConfig& cfg);
+
+// Propaga el estado hasta `now_ms` con el caudal neto (L/min, positivo = llenando)
+void levelEstimatorPredict(LevelEstimator& est, float net_inflow_lpm, uint32_t now_ms);
+
+// Corrige con una altura medida por ultrasonido. Devuelve false si se rechazó como atípica.
+bool levelEstimatorUpdateUltrasonic(LevelEstimator& est, float height_cm);
+
+// Corrige con el estado de los flotadores (true = flotador sumergido)
+void levelEstimatorUpdateFloats(LevelEstimator& est, bool high_wet, bool low_wet);
+
+float levelEstimatorPercent(const LevelEstimator& est);
+float levelEstimatorSigmaPercent(const LevelEstimator& est); // Incertidumbre (1 sigma) en % de altura
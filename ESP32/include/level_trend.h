@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// TENDENCIA DEL VOLUMEN Y TIEMPO ESTIMADO HASTA VACÍO / LLENO
+// -------------------------------------------------------------------------
+// Regresión lineal por mínimos cuadrados sobre las últimas muestras de
+// volumen. La pendiente (L/min) se extrapola hasta 0 L o hasta la capacidad.
+
+#define LEVEL_TREND_SAMPLES 24          // 24 muestras x 5 s = 2 minutos de historia
+#define LEVEL_TREND_MIN_SLOPE_LPM 0.5f  // Por debajo de esto el nivel se considera estable
+
+struct LevelTrend {
+  uint32_t t_ms[LEVEL_TREND_SAMPLES];
+  float liters[LEVEL_TREND_SAMPLES];
+  uint8_t head;
+  uint8_t count;
+};
+
+struct LevelTrendEstimate {
+  float slope_lpm;          // Pendiente de la regresión (L/min, negativa = vaciando)
+  float minutes_to_empty;   // -1 si el tanque no se está vaciando
+  float minutes_to_full;    // -1 si el tanque no se está llenando
+};
+
+void levelTrendInit(LevelTrend& trend);
+void levelTrendAdd(LevelTrend& trend, float liters, uint32_t now_ms);
+
+// Devuelve false si no hay suficientes muestras para una regresión
+bool levelTrendEstimate(const LevelTrend& trend, float capacity_liters, LevelTrendEstimate& out);
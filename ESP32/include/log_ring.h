@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// -------------------------------------------------------------------------
+// LOG ASÍNCRONO POR NIVELES
+// -------------------------------------------------------------------------
+// LOG_E / LOG_W / LOG_I / LOG_D no formatean ni tocan el puerto serie: guardan
+// un registro binario (puntero al formato literal + argumentos crudos, las
+// cadenas copiadas) en un anillo sin bloqueo y vuelven. Una tarea de baja
+// prioridad (main.cpp) vacía el anillo, formatea y escribe; así el loop no
+// espera al UART (a 115200 baudios una línea de 100 bytes son ~9 ms).
+//
+//  - Nivel al compilar: lo que está por encima de LOG_COMPILE_LEVEL queda
+//    tras una condición constante y el optimizador lo elimina junto con el
+//    formato. El formato se sigue comprobando como en printf.
+//  - El anillo es de varios productores y un consumidor (cola acotada con
+//    número de secuencia por lugar): cualquier tarea puede registrar, sin
+//    secciones críticas. Si está lleno el registro se descarta y se cuenta.
+//  - Sin memoria dinámica. Módulo puro: corre igual en el host.
+//
+// Límites por registro: LOG_MAX_ARGS argumentos y LOG_TEXT_MAX bytes para
+// todas sus cadenas (lo que no entra se corta). LOG_TEXT_MAX es el largo de
+// línea del logPrintf anterior, así un %s largo (la lista de brokers, una
+// línea de volcado) sale igual que antes.
+//
+// Lo que sigue en el anillo al reiniciar se pierde salvo que quien lo vacía
+// lo escriba antes (main.cpp lo hace en esp_restart(); un pánico o el
+// watchdog no dan esa oportunidad).
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO // Producción: -DLOG_COMPILE_LEVEL=LOG_LEVEL_WARN
+#endif
+
+#define LOG_MAX_ARGS 6
+#define LOG_TEXT_MAX 192 // Cabe en text_used (uint8_t)
+#define LOG_TEXT_NONE 0xFFFF // Cadena que no entró en el registro
+
+union LogArg {
+  int64_t i;
+  uint64_t u;
+  double f;
+  const void* p;
+};
+
+struct LogRecord {
+  const char* format;   // Literal: vive mientras corra el programa
+  uint32_t time_ms;
+  uint8_t level;
+  uint8_t argc;
+  uint8_t text_used;
+  bool truncated;       // Hubo más argumentos que LOG_MAX_ARGS
+  LogArg args[LOG_MAX_ARGS];
+  char text[LOG_TEXT_MAX];
+};
+
+struct LogSlot {
+  std::atomic<uint32_t> seq;
+  LogRecord record;
+};
+
+struct LogRing {
+  LogSlot* slots;       // nullptr = sin iniciar (se descarta todo)
+  uint32_t mask;        // Cantidad de lugares - 1 (potencia de 2)
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail; // Solo la escribe el consumidor
+  std::atomic<uint32_t> written;
+  std::atomic<uint32_t> dropped;
+};
+
+// `count` debe ser potencia de 2
+void logRingInit(LogRing& ring, LogSlot* slots, uint32_t count);
+
+// Productor: reserva un lugar (nullptr si está lleno) y lo publica al terminar de escribirlo
+LogRecord* logRingReserve(LogRing& ring);
+void logRingCommit(LogRing& ring, LogRecord* record);
+
+// Consumidor (uno solo): el registro más antiguo sin copiarlo, o nullptr; luego liberarlo
+const LogRecord* logRingPeek(LogRing& ring);
+void logRingRelease(LogRing& ring);
+
+// Registros esperando al consumidor (para no llenar el anillo con salidas largas, ej. volcados)
+uint32_t logRingPending(const LogRing& ring);
+inline uint32_t logRingCapacity(const LogRing& ring) { return ring.slots != nullptr ? ring.mask + 1 : 0; }
+
+// Copia un registro en otro anillo (ej. el de la salida MQTT). false si está lleno.
+bool logRingForward(LogRing& ring, const LogRecord& record);
+
+// Formatea el registro como lo haría printf. Devuelve la longitud escrita (cortada a `size` - 1).
+size_t logFormat(const LogRecord& record, char* out, size_t size);
+
+const char* logLevelName(uint8_t level);
+
+// Anillo de los macros y reloj de las marcas (ms desde el arranque; nullptr = 0)
+extern LogRing logRing;
+extern uint32_t (*logClock)();
+
+// --- Empaquetado de argumentos (lo usan los macros) ---
+
+inline LogArg* logNextArg(LogRecord& record) {
+  if (record.argc >= LOG_MAX_ARGS) {
+    record.truncated = true;
+    return nullptr;
+  }
+  return &record.args[record.argc++];
+}
+
+inline void logPackText(LogRecord& record, const char* value) {
+  LogArg* arg = logNextArg(record);
+  if (arg == nullptr) return;
+  if (value == nullptr) value = "(null)";
+  size_t room = LOG_TEXT_MAX - record.text_used;
+  if (room == 0) {
+    arg->u = LOG_TEXT_NONE;
+    return;
+  }
+  size_t n = strnlen(value, room - 1);
+  memcpy(record.text + record.text_used, value, n);
+  record.text[record.text_used + n] = '\0';
+  arg->u = record.text_used;
+  record.text_used += n + 1;
+}
+
+template <typename T>
+inline void logPack(LogRecord& record, T value) {
+  if constexpr (std::is_same<T, const char*>::value || std::is_same<T, char*>::value) {
+    logPackText(record, value);
+  } else {
+    LogArg* arg = logNextArg(record);
+    if (arg == nullptr) return;
+    if constexpr (std::is_floating_point<T>::value) arg->f = value;
+    else if constexpr (std::is_pointer<T>::value) arg->p = (const void*)value;
+    else if constexpr (std::is_enum<T>::value) arg->i = (int64_t)value;
+    else if constexpr (std::is_signed<T>::value) arg->i = value;
+    else arg->u = value;
+  }
+}
+
+template <typename... Args>
+inline void logWrite(uint8_t level, const char* format, Args... args) {
+  LogRecord* record = logRingReserve(logRing);
+  if (record == nullptr) return;
+  record->format = format;
+  record->time_ms = logClock != nullptr ? logClock() : 0;
+  record->level = level;
+  record->argc = 0;
+  record->text_used = 0;
+  record->truncated = false;
+  (logPack(*record, args), ...);
+  logRingCommit(logRing, record);
+}
+
+// Solo para que el compilador revise el formato contra los argumentos
+inline void logCheckFormat(const char*, ...) __attribute__((format(printf, 1, 2)));
+inline void logCheckFormat(const char*, ...) {}
+
+#define LOG_AT(level, ...)                          \
+  do {                                              \
+    if ((level) <= LOG_COMPILE_LEVEL) {             \
+      if (false) logCheckFormat(__VA_ARGS__);       \
+      logWrite((level), __VA_ARGS__);               \
+    }                                               \
+  } while (0)
+
+#define LOG_E(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_W(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_I(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_D(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// Salida pedida explícitamente (ej. volcados por el puerto serie): se compila con cualquier nivel
+#define LOG_OUT(...) LOG_AT(LOG_LEVEL_NONE, __VA_ARGS__)
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <mqtt_client.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include "mqtt_transport.h"
+
+// -------------------------------------------------------------------------
+// TRANSPORTE MQTT SOBRE esp-mqtt (ESP-IDF)
+// -------------------------------------------------------------------------
+// esp-mqtt corre en su propia tarea: conecta, envía y retransmite los QoS1
+// sin bloquear el loop. Es el único que retransmite: cada QoS1 queda en su
+// outbox hasta el PUBACK y se reenvía con el mismo msg_id, también tras
+// reconectar (ver mqtt_publisher.h). Los reintentos de conexión los programa la
+// aplicación con reconnect() (backoff con jitter); la reconexión automática
+// del cliente queda solo como red de seguridad, con un intervalo largo.
+// Su manejador de eventos solo copia cada evento a una cola de FreeRTOS;
+// poll() la vacía en el contexto del loop.
+//
+// MQTT 5 se usa cuando el framework lo trae habilitado (CONFIG_MQTT_PROTOCOL_5,
+// ESP-IDF >= 5.1 / Arduino-ESP32 3.x); si no, se conecta con MQTT 3.1.1 y las
+// propiedades se descartan.
+//
+// Sin alias de tópico: todo sale por esp_mqtt_client_enqueue() (publish() no
+// bloquea) y un mensaje puede quedar en el outbox a través de un corte y
+// escribirse en la conexión siguiente, donde el broker no conoce el alias.
+// Desde el loop no hay forma de saber en qué conexión se escribió cada uno.
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+  #define ESP_MQTT_USE_V5 1
+#else
+  #define ESP_MQTT_USE_V5 0
+#endif
+
+#define ESP_MQTT_EVENT_QUEUE_LEN 8
+#define ESP_MQTT_RETRANSMIT_MS 2000      // Retransmisión de QoS1 sin PUBACK dentro del cliente
+#define ESP_MQTT_FALLBACK_RECONNECT_MS 600000 // Solo si la aplicación deja de llamar a reconnect()
+#define ESP_MQTT_SESSION_EXPIRY_S 600    // El broker guarda la sesión (y los comandos QoS1) 10 min
+#define ESP_MQTT_PROFILES 4              // Perfiles distintos con propiedades de usuario en caché
+#define ESP_MQTT_HOST_MAX 64             // Como BROKER_HOST_MAX
+// enqueue arma el paquete entero en el buffer de salida antes de pasarlo al outbox: tiene que
+// entrar el mayor payload de la cola (MQTT_JUMBO_PAYLOAD_MAX) con su tópico y sus propiedades
+#define ESP_MQTT_PUBLISH_OVERHEAD 192    // Encabezado fijo, largo del tópico, msg_id y propiedades MQTT 5
+
+class EspMqttTransport : public MqttTransport {
+ public:
+  bool begin(const MqttConnectConfig& config, const MqttTransportHandler& handler) override;
+  bool connected() const override;
+  bool reconnect() override;
+  bool setBroker(const char* host, uint16_t port) override;
+  int publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos,
+              const MqttPublishProperties* props) override;
+  bool subscribe(const char* filter, uint8_t qos) override;
+  void poll() override;
+
+ private:
+  static void onEvent(void* arg, esp_event_base_t base, int32_t event_id, void* event_data);
+
+#if ESP_MQTT_USE_V5
+  mqtt5_user_property_handle_t userProperties(const MqttPublishProfile* profile);
+
+  const MqttPublishProfile* profileKeys_[ESP_MQTT_PROFILES] = {};
+  mqtt5_user_property_handle_t profileProps_[ESP_MQTT_PROFILES] = {};
+#endif
+
+  // Copia propia del host: el de la aplicación apunta a la lista de brokers, que se reescribe
+  // cuando llega una nueva por MQTT, y fillClientConfig vuelve a leerlo en cada setBroker()
+  bool copyHost(const char* host);
+
+  char host_[ESP_MQTT_HOST_MAX] = {};
+  MqttConnectConfig config_ = {};
+  esp_mqtt_client_handle_t client_ = nullptr;
+  QueueHandle_t events_ = nullptr;
+  MqttTransportHandler handler_ = {};
+  volatile bool connected_ = false;
+};
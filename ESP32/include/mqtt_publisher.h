@@ -0,0 +1,161 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mqtt_transport.h"
+
+// -------------------------------------------------------------------------
+// COLA DE SALIDA MQTT CON PRIORIDADES Y VENTANA QoS1
+// -------------------------------------------------------------------------
+// Todas las publicaciones pasan por una cola acotada en memoria estática:
+//  - Se despacha primero por prioridad (alarmas antes que telemetría) y,
+//    dentro de la misma prioridad, por orden de llegada.
+//  - Si la cola está llena se descarta el mensaje más antiguo de menor
+//    prioridad; un mensaje nuevo solo se rechaza si todo lo encolado es más
+//    importante que él.
+//  - Como máximo MQTT_INFLIGHT_WINDOW mensajes QoS1 esperan PUBACK a la vez.
+//  - Los QoS1 los retransmite solo el transporte (el outbox de esp-mqtt, con
+//    el mismo msg_id y DUP, también después de reconectar): la cola nunca
+//    vuelve a publicar un mensaje ya entregado al transporte, porque saldría
+//    como otro PUBLISH con otro msg_id y el broker no lo reconocería como
+//    duplicado. Aquí solo se sigue el PUBACK por ese msg_id. Si el
+//    transporte avisa que lo descartó (outbox vencido) cuenta como
+//    descartado; si en MQTT_ACK_TIMEOUT_MS de conexión no hay noticias, se
+//    deja de esperar y cuenta en `unconfirmed` (puede llegar igual).
+//  - Un mensaje con marca de tiempo (MqttSampleStamp) se vuelve a marcar
+//    justo antes de cada envío con `stamp_fn`: lo encolado antes de tener
+//    hora NTP sale con la hora real de la muestra.
+//  - Publicación sin copia: mqttPublisherReserve() entrega el lugar de la
+//    cola para escribir el payload directamente en él (ver json_writer.h) y
+//    mqttPublisherCommit() lo encola. Un payload que no entra en el lugar
+//    pasa con mqttPublisherGrow() al buffer grande compartido
+//    (MQTT_JUMBO_PAYLOAD_MAX, uno solo: lo usa un mensaje a la vez).
+// Módulo puro: solo depende de la interfaz MqttTransport.
+
+#define MQTT_OUTBOUND_SLOTS 12
+#define MQTT_PAYLOAD_MAX 1024
+#define MQTT_JUMBO_PAYLOAD_MAX 4096 // Buffer compartido para payloads que no entran en un lugar
+#define MQTT_INFLIGHT_WINDOW 4
+#define MQTT_ACK_TIMEOUT_MS 60000  // Con conexión; más que el vencimiento del outbox de esp-mqtt (30 s)
+#define MQTT_STAMP_WIDTH 16   // Ancho fijo del valor de la marca de tiempo dentro del payload
+
+enum MqttPriority : uint8_t {
+  MQTT_PRIO_ALARM = 0,      // Fugas, tanque vacío, fallas
+  MQTT_PRIO_EVENT,          // Eventos de nivel, respuestas a comandos
+  MQTT_PRIO_TELEMETRY,      // Telemetría periódica
+  MQTT_PRIO_BULK,           // Diagnóstico y volcados de baja prioridad
+  MQTT_PRIO_COUNT
+};
+
+enum MqttSlotState : uint8_t {
+  MQTT_SLOT_FREE = 0,
+  MQTT_SLOT_QUEUED,
+  MQTT_SLOT_INFLIGHT,
+  MQTT_SLOT_WRITING      // Reservado: se está escribiendo el payload
+};
+
+struct MqttOutboundMessage {
+  char topic[MQTT_TOPIC_MAX];
+  uint8_t payload[MQTT_PAYLOAD_MAX];
+  uint16_t length;
+  bool jumbo;                                  // El payload está en el buffer grande compartido
+  const MqttPublishProfile* profile;           // Propiedades MQTT 5 del tipo de mensaje (puede ser nullptr)
+  uint8_t correlation[MQTT_CORRELATION_MAX];  // Correlation Data propia del mensaje
+  uint8_t correlation_length;
+  uint8_t qos;
+  uint8_t priority;
+  uint8_t state;
+  int msg_id;
+  int64_t stamp_mono_us;   // Instante monótono de la muestra
+  uint16_t stamp_offset;   // Posición del valor de la marca en el payload (0 = sin marca)
+  uint32_t seq;            // Orden de llegada
+  uint32_t tag;            // Identificador de la aplicación para done_fn (0 = sin aviso)
+  uint32_t enqueued_ms;
+  uint32_t sent_ms;
+};
+
+struct MqttPublisherStats {
+  uint16_t queue_depth;        // Mensajes esperando envío
+  uint16_t queue_high_water;   // Máximo histórico de queue_depth
+  uint16_t inflight;           // QoS1 esperando PUBACK
+  uint32_t enqueued;
+  uint32_t sent;
+  uint32_t sent_by_priority[MQTT_PRIO_COUNT]; // Aceptados por el transporte con conexión
+  uint32_t acked;
+  uint32_t dropped;            // Expulsados por cola llena o descartados por el transporte
+  uint32_t unconfirmed;        // QoS1 que se dejaron de esperar sin PUBACK
+  uint32_t jumbo_used;         // Mensajes que necesitaron el buffer grande
+  uint32_t jumbo_busy;         // Veces que hizo falta y estaba ocupado
+  uint32_t ack_latency_last_ms;
+  uint32_t ack_latency_avg_ms; // Promedio móvil exponencial (1/8)
+  uint32_t ack_latency_max_ms;
+};
+
+// Marca de tiempo de una muestra: `offset` apunta a MQTT_STAMP_WIDTH caracteres del payload
+struct MqttSampleStamp {
+  int64_t mono_us;
+  uint16_t offset;
+};
+
+// Escribe MQTT_STAMP_WIDTH caracteres con la hora de `mono_us`; devuelve false si aún no se conoce
+typedef bool (*MqttStampFn)(int64_t mono_us, char* field);
+
+// Un mensaje con `tag` dejó la cola: `delivered` si llegó el PUBACK (o, en QoS0, si se envió);
+// false si se expulsó, venció o el transporte lo descartó
+typedef void (*MqttDoneFn)(uint32_t tag, bool delivered);
+
+struct MqttPublisher {
+  MqttTransport* transport;
+  MqttStampFn stamp_fn;    // nullptr = los mensajes se envían tal como se encolaron
+  MqttDoneFn done_fn;      // Opcional: aviso por cada mensaje con tag al salir de la cola
+  MqttOutboundMessage slots[MQTT_OUTBOUND_SLOTS];
+  uint8_t jumbo[MQTT_JUMBO_PAYLOAD_MAX];
+  MqttOutboundMessage* jumbo_owner; // nullptr = libre
+  uint32_t next_seq;
+  bool offline;            // Sin conexión: los plazos de PUBACK se reinician al volver
+  MqttPublisherStats stats;
+};
+
+void mqttPublisherInit(MqttPublisher& pub, MqttTransport* transport, MqttStampFn stamp_fn = nullptr);
+
+// Encola un mensaje. No bloquea. Devuelve false si se descartó.
+// `props` (opcional) se copia: la Correlation Data no necesita sobrevivir a la llamada.
+// `stamp` (opcional): marca de tiempo a completar en cada envío.
+// `tag` (opcional): se informa a done_fn cuando el mensaje sale de la cola, entregado o no.
+bool mqttPublisherEnqueue(MqttPublisher& pub, const char* topic, const uint8_t* payload, size_t length,
+                          MqttPriority priority, uint8_t qos, uint32_t now_ms,
+                          const MqttPublishProperties* props = nullptr,
+                          const MqttSampleStamp* stamp = nullptr, uint32_t tag = 0);
+
+// Publicación sin copia. Reserva un lugar con las mismas reglas de expulsión que
+// mqttPublisherEnqueue() y devuelve nullptr si se descartó. El lugar no se despacha ni se
+// expulsa hasta cerrarlo con mqttPublisherCommit() o mqttPublisherAbort().
+MqttOutboundMessage* mqttPublisherReserve(MqttPublisher& pub, const char* topic, MqttPriority priority,
+                                          uint8_t qos, uint32_t now_ms,
+                                          const MqttPublishProperties* props = nullptr);
+
+// Payload del mensaje: su propio buffer o el grande compartido
+uint8_t* mqttPublisherPayload(MqttPublisher& pub, MqttOutboundMessage& msg);
+inline size_t mqttPublisherCapacity(const MqttOutboundMessage& msg) {
+  return msg.jumbo ? MQTT_JUMBO_PAYLOAD_MAX : MQTT_PAYLOAD_MAX;
+}
+
+// Pasa los `used` bytes ya escritos de un mensaje reservado al buffer grande compartido.
+// Devuelve false si está ocupado por otro mensaje.
+bool mqttPublisherGrow(MqttPublisher& pub, MqttOutboundMessage& msg, size_t used);
+
+// Encola el mensaje reservado con `length` bytes de payload. Devuelve false (y libera el lugar)
+// si la marca no cae dentro del payload.
+bool mqttPublisherCommit(MqttPublisher& pub, MqttOutboundMessage& msg, size_t length,
+                         const MqttSampleStamp* stamp = nullptr);
+void mqttPublisherAbort(MqttPublisher& pub, MqttOutboundMessage& msg);
+
+// Despacha la cola hacia el transporte respetando la ventana y revisa los vencimientos de PUBACK
+void mqttPublisherService(MqttPublisher& pub, uint32_t now_ms);
+
+// Notificaciones del transporte
+void mqttPublisherOnPublished(MqttPublisher& pub, int msg_id, uint32_t now_ms);
+void mqttPublisherOnDeleted(MqttPublisher& pub, int msg_id);  // El transporte descartó el QoS1 sin PUBACK
+// Lo que está en vuelo sigue en vuelo: el transporte lo reenvía al reconectar
+void mqttPublisherOnDisconnected(MqttPublisher& pub);
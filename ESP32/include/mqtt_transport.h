@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// ABSTRACCIÓN DEL TRANSPORTE MQTT
+// -------------------------------------------------------------------------
+// El resto del firmware no conoce la librería MQTT concreta. Una
+// implementación debe cumplir:
+//  - `publish()` y `subscribe()` no bloquean: solo encolan en el cliente.
+//  - Los eventos (conexión, PUBACK, mensajes entrantes) se entregan al
+//    handler únicamente dentro de `poll()`, es decir, en el contexto del
+//    loop. Así la lógica de control nunca corre en la tarea de red.
+
+#define MQTT_TOPIC_MAX 96        // Longitud máxima de un tópico (incluye '\0')
+#define MQTT_INBOUND_MAX 512     // Payload máximo de un mensaje entrante (comandos)
+#define MQTT_CORRELATION_MAX 40  // Correlation Data máximo (ej. un UUID en texto)
+#define MQTT_CONTENT_TYPE_MAX 32
+
+struct MqttConnectConfig {
+  const char* host;
+  uint16_t port;
+  const char* client_id;
+  const char* username;
+  const char* password;
+};
+
+// --- Propiedades MQTT 5 ---
+// Con MQTT 3.1.1 el transporte simplemente las ignora (salvo `retain`, que existe en ambas versiones).
+
+// Perfil fijo de un tipo de mensaje (se definen como constantes estáticas)
+struct MqttPublishProfile {
+  const char* content_type;    // Content Type (ej. "application/json")
+  const char* schema_version;  // Propiedad de usuario "schema_version"
+  uint32_t expiry_s;           // Message Expiry Interval (0 = no vence)
+  bool retain;                 // El broker guarda el último mensaje (ej. ficha del controlador)
+};
+
+// Propiedades de una publicación concreta
+struct MqttPublishProperties {
+  const MqttPublishProfile* profile;
+  const uint8_t* correlation_data;   // Correlation Data (respuestas a comandos)
+  uint16_t correlation_length;
+};
+
+// Propiedades recibidas con un mensaje entrante (punteros válidos solo durante on_message)
+struct MqttMessageProperties {
+  const char* content_type;          // nullptr si no vino
+  const char* response_topic;        // nullptr si no vino
+  const uint8_t* correlation_data;
+  uint16_t correlation_length;
+};
+
+// Callbacks del transporte (se invocan desde poll())
+struct MqttTransportHandler {
+  void (*on_connected)(bool session_present);
+  void (*on_disconnected)();
+  void (*on_published)(int msg_id);  // PUBACK recibido para un mensaje QoS1
+  void (*on_message)(const char* topic, const uint8_t* payload, size_t length, const MqttMessageProperties& props);
+  void (*on_deleted)(int msg_id);    // El transporte descartó un QoS1 sin PUBACK (opcional)
+};
+
+class MqttTransport {
+ public:
+  virtual ~MqttTransport() {}
+
+  // Inicia el cliente y el primer intento de conexión en segundo plano
+  virtual bool begin(const MqttConnectConfig& config, const MqttTransportHandler& handler) = 0;
+
+  virtual bool connected() const = 0;
+
+  // Pide un nuevo intento de conexión. Cuándo reintentar lo decide la aplicación (ver backoff.h);
+  // devuelve false si el cliente no está esperando para reconectar (ya conectado o intentando).
+  virtual bool reconnect() = 0;
+
+  // Cambia de broker (conmutación por falla). Si hay conexión con el anterior se corta;
+  // el intento contra el nuevo lo pide la aplicación con reconnect(). El transporte copia `host`.
+  virtual bool setBroker(const char* host, uint16_t port) = 0;
+
+  // Encola una publicación. Devuelve el msg_id (> 0 para QoS1, 0 para QoS0) o -1 si no se pudo encolar.
+  // `props` puede ser nullptr.
+  virtual int publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos,
+                      const MqttPublishProperties* props) = 0;
+
+  virtual bool subscribe(const char* filter, uint8_t qos) = 0;
+
+  // Entrega los eventos pendientes al handler (llamar en cada vuelta del loop)
+  virtual void poll() = 0;
+};
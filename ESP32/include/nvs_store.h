@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// PERSISTENCIA EN NVS (Preferences)
+// -------------------------------------------------------------------------
+// Punto único de acceso a la memoria no volátil del ESP32. Cada subsistema
+// usa su propio namespace para que borrar uno no afecte a los demás.
+
+// Totales del medidor de energía de una bomba (namespace "energy")
+bool nvsLoadEnergy(int pump_id, double& total_kwh, double& total_m3);
+void nvsSaveEnergy(int pump_id, double total_kwh, double total_m3);
+
+// Lista priorizada de brokers MQTT, "host:puerto,host:puerto" (namespace "mqtt")
+bool nvsLoadBrokers(char* text, size_t size);
+void nvsSaveBrokers(const char* text);
+
+// Identidad provisionada del controlador (namespace "identity"). false si no hay ninguna guardada.
+bool nvsLoadIdentity(char* site, size_t site_size, char* controller, size_t controller_size);
+void nvsSaveIdentity(const char* site, const char* controller);
+
+// Contador de arranques (namespace "boot"): suma uno y devuelve el número de este arranque.
+// A diferencia de la memoria RTC, sobrevive a los cortes de energía.
+uint32_t nvsNextBootCount();
+
+// Caché de la última conexión Wi-Fi (namespace "wifi", ver wifi_cache.h)
+bool nvsLoadWifiCache(void* data, size_t size);
+void nvsSaveWifiCache(const void* data, size_t size);
+void nvsClearWifiCache();
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "tank_controller.h"
+#include "tank_geometry.h"
+
+// -------------------------------------------------------------------------
+// CONFIGURACIÓN DE LA PLANTA (TANQUE, SENSORES Y BOMBAS)
+// -------------------------------------------------------------------------
+// Lo físico de la instalación: geometría del tanque, montaje de flotadores
+// y ultrasonido, escalas de los sensores y datos de las bombas. La usan el
+// firmware y las herramientas de host que corren el mismo controlador
+// (tools/sensor_replay.cpp), así una captura se reproduce con la
+// configuración con la que se tomó.
+
+// --- Geometría del tanque ---
+// Se elige un modelo y la tabla nivel -> litros se calcula al compilar (ver tank_geometry.h)
+#define TANK_GEOMETRY_VERTICAL_CYLINDER 0
+#define TANK_GEOMETRY_HORIZONTAL_CYLINDER 1
+#define TANK_GEOMETRY_RECTANGULAR 2
+#define TANK_GEOMETRY_CALIBRATED 3
+
+#define TANK_GEOMETRY TANK_GEOMETRY_RECTANGULAR
+
+#if TANK_GEOMETRY == TANK_GEOMETRY_VERTICAL_CYLINDER
+  constexpr TankVolumeTable TANK_TABLE = tankMakeVerticalCylinder(250.0, 200.0); // Diámetro, altura (cm)
+#elif TANK_GEOMETRY == TANK_GEOMETRY_HORIZONTAL_CYLINDER
+  constexpr TankVolumeTable TANK_TABLE = tankMakeHorizontalCylinder(200.0, 320.0); // Diámetro, largo (cm)
+#elif TANK_GEOMETRY == TANK_GEOMETRY_RECTANGULAR
+  constexpr TankVolumeTable TANK_TABLE = tankMakeRectangular(250.0, 200.0, 200.0); // Ancho, largo, alto (cm)
+#elif TANK_GEOMETRY == TANK_GEOMETRY_CALIBRATED
+  // Aforo medido en sitio: altura de agua (cm) -> litros
+  constexpr TankCalibrationPoint TANK_CALIBRATION[] = {
+    {0.0, 0.0}, {20.0, 700.0}, {60.0, 2900.0}, {120.0, 6400.0}, {200.0, 10000.0}
+  };
+  constexpr TankVolumeTable TANK_TABLE = tankMakeCalibrated(TANK_CALIBRATION);
+#else
+  #error "TANK_GEOMETRY no reconocido"
+#endif
+
+const float TANK_HEIGHT_CM = TANK_TABLE.height_cm; // Altura útil del tanque (nivel 100%)
+const float TANK_CAPACITY_LITERS = tankCapacityLiters(TANK_TABLE);
+
+// --- Montaje de los sensores de nivel ---
+const float EMPTY_DISTANCE_CM = 180.0; // Distancia desde el ultrasonido hasta el nivel "0%" (fondo del tanque)
+// Alturas de montaje de los flotadores, medidas desde el fondo del tanque
+const float HIGH_FLOAT_HEIGHT_CM = TANK_HEIGHT_CM * 0.8;
+const float LOW_FLOAT_HEIGHT_CM = TANK_HEIGHT_CM * 0.2;
+// Tubo de rebalse, por debajo del ultrasonido (que no ve más arriba de EMPTY_DISTANCE_CM)
+const float OVERFLOW_HEIGHT_CM = TANK_HEIGHT_CM * 0.85;
+
+// --- Escalas de los sensores ---
+#define FLOW_LITERS_PER_PULSE 0.00225f      // Constante K del caudalímetro (depende del sensor)
+#define CT_AMPS_PER_COUNT (25.0f / 4095.0f) // CT de 25 A a fondo de escala del ADC
+#define PUMP_AMPS_SHARE 0.8f                // Un solo CT: parte de la corriente que se atribuye a cada bomba
+#define FLOW_DETECT_LPM 0.5f                // Entrada mínima para considerar que hay flujo
+
+// Muestras por lectura RMS: ~2 ciclos de red a 60 Hz con ~100 µs entre muestras
+#define CURRENT_RMS_SAMPLES 320
+#define CURRENT_RMS_SAMPLE_US 100
+
+const TankControllerConfig PLANT_CONTROLLER_CONFIG = {
+  &TANK_TABLE,
+  {
+    HIGH_FLOAT_HEIGHT_CM,
+    LOW_FLOAT_HEIGHT_CM,
+    3.0,  // Ruido del ultrasonido (cm, 1 sigma): oleaje y rebotes en las paredes
+    1.0,  // Precisión del punto de conmutación de un flotador (cm)
+    2.0   // Consumo no medido: incertidumbre que se acumula por minuto (cm)
+  },
+  // Tensión, factor de potencia y caudal nominal de cada bomba para el medidor de kWh
+  {{220.0, 0.85, 120.0}, {220.0, 0.85, 120.0}},
+  EMPTY_DISTANCE_CM,
+  FLOW_LITERS_PER_PULSE,
+  CT_AMPS_PER_COUNT,
+  PUMP_AMPS_SHARE,
+  FLOW_DETECT_LPM,
+  OVERFLOW_HEIGHT_CM
+};
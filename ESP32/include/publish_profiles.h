@@ -0,0 +1,16 @@
+#pragma once
+
+#include "mqtt_transport.h"
+
+// -------------------------------------------------------------------------
+// PERFILES DE PUBLICACIÓN MQTT 5
+// -------------------------------------------------------------------------
+// Propiedades por tipo de mensaje: Content Type, versión de esquema,
+// vencimiento y retención. Los usan main.cpp y las
+// herramientas del host que publican lo mismo que el firmware, así el
+// backend ve los mismos esquemas en el equipo y en las simulaciones.
+
+const MqttPublishProfile TELEMETRY_PROFILE = {"application/json", "3", 300, false};
+const MqttPublishProfile EVENT_PROFILE = {"application/json", "1", 0, false};
+const MqttPublishProfile INFO_PROFILE = {"application/json", "1", 0, true};   // Ficha del controlador
+const MqttPublishProfile TEXT_PROFILE = {"text/plain", "1", 0, false};       // Volcados (perfil de CPU, traza)
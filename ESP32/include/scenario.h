@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim_plant.h"
+#include "tank_controller.h"
+
+// -------------------------------------------------------------------------
+// ESCENARIOS DE SIMULACIÓN (GUION, FALLAS Y EXPECTATIVAS)
+// -------------------------------------------------------------------------
+// Un escenario es un guion de texto con la línea de tiempo de lo que le
+// pasa a la planta simulada (sim_plant.h) y de lo que se espera del
+// controlador. Lo corre el firmware en modo simulación (guion por defecto
+// o el que llegue por {sitio}/{controlador}/scenario/set) y
+// tools/scenario_runner.cpp en el host, en tiempo virtual y de a cientos.
+//
+// Una directiva por línea; '#' comenta. Tiempos: 250ms, 90s, 1.5m, 2h
+// (sin unidad = segundos). Bombas por su número (1, 2).
+//
+//   name <texto>                    duration <t>           level <% inicial>
+//   seed <n>                        loop   (repite la línea de tiempo; sin expectativas)
+//
+//   at <t> inflow <L/min>           entrada de la calle
+//   at <t> leak <L/min>             fuga (salida no medida)
+//   at <t> temp <bomba> <°C|auto>   temperatura del DS18B20
+//   at <t> start|stop <bomba>       comando, con las mismas reglas que por MQTT
+//   at <t> fault temp <bomba>       DS18B20 desconectado (-127 °C)
+//   at <t> fault float high|low [wet|dry]   flotador trabado (sin posición: donde está)
+//   at <t> fault pump <bomba>       bomba atascada: consume y no mueve agua
+//   at <t> fault echo               ultrasonido sin eco
+//   at <t> clear temp|float|pump|echo ...   quita la falla
+//   at <t> broker down|up           corte y vuelta del broker
+//   at <t> power loss               corte de energía: reinicio sin guardar nada
+//
+//   expect <t> pump <bomba> on|off
+//   expect <t> level <min> <max>             nivel estimado (%)
+//   expect <t> amps <bomba> <min> <max>
+//   expect <t> energy <bomba> <min> <max>    kWh acumulados
+//   expect <t> queue <máx>                   mensajes en la cola de salida
+//   expect <t> sent <mín>                    mensajes entregados al broker (acumulado)
+//   expect <t> dropped <máx>                 mensajes descartados (acumulado)
+//   expect <t1>..<t2> event <EVENTO>         el evento ocurre en la ventana
+//   expect <t1>..<t2> no <EVENTO>            no ocurre en la ventana
+//
+// Eventos: TANK_FULL, BELOW_FULL, ABOVE_EMPTY, TANK_EMPTY (flotadores),
+// PUMP_STOP (apagado por tanque vacío), LEAK_SUSPECTED, LEAK_CLEARED,
+// TEMP_FAULT, TEMP_OK, APPLIED, REJECTED_TANK_EMPTY (comandos) y BOOT.
+//
+// Las expectativas de un instante se evalúan en la primera observación a
+// partir de ese instante. Módulo puro: el tiempo lo pasa quien llama.
+
+#define SCENARIO_NAME_MAX 32
+#define SCENARIO_MAX_STEPS 48
+#define SCENARIO_MAX_EXPECTS 32
+#define SCENARIO_EVENT_MAX 24
+#define SCENARIO_LINE_MAX 96
+
+enum ScenarioStepType : uint8_t {
+  SCENARIO_STEP_INFLOW,
+  SCENARIO_STEP_LEAK,
+  SCENARIO_STEP_TEMPERATURE,   // value NAN = automática
+  SCENARIO_STEP_COMMAND,       // value 1 = START, 0 = STOP
+  SCENARIO_STEP_TEMP_FAULT,    // value 1 = falla, 0 = normal
+  SCENARIO_STEP_FLOAT_FAULT,   // value = SimFloatFault; -1 = trabado donde está
+  SCENARIO_STEP_PUMP_FAULT,
+  SCENARIO_STEP_ECHO_FAULT,
+  SCENARIO_STEP_BROKER,        // value 1 = disponible, 0 = caído
+  SCENARIO_STEP_POWER_LOSS
+};
+
+struct ScenarioStep {
+  uint32_t at_ms;
+  uint16_t line;
+  ScenarioStepType type;
+  int8_t target;  // Índice de bomba o flotador
+  float value;
+};
+
+enum ScenarioCheckType : uint8_t {
+  SCENARIO_CHECK_PUMP,
+  SCENARIO_CHECK_LEVEL,
+  SCENARIO_CHECK_AMPS,
+  SCENARIO_CHECK_ENERGY,
+  SCENARIO_CHECK_QUEUE,
+  SCENARIO_CHECK_SENT,
+  SCENARIO_CHECK_DROPPED,
+  SCENARIO_CHECK_EVENT,
+  SCENARIO_CHECK_NO_EVENT
+};
+
+enum ScenarioExpectState : uint8_t {
+  SCENARIO_EXPECT_PENDING,
+  SCENARIO_EXPECT_PASSED,
+  SCENARIO_EXPECT_FAILED
+};
+
+struct ScenarioExpect {
+  uint32_t from_ms;
+  uint32_t to_ms;      // = from_ms en las de un instante
+  uint16_t line;
+  ScenarioCheckType type;
+  int8_t target;
+  float min;
+  float max;
+  char event[SCENARIO_EVENT_MAX];
+  ScenarioExpectState state;
+  float observed;      // Lo que se vio al decidir (o NAN)
+  uint32_t observed_ms;
+};
+
+struct Scenario {
+  char name[SCENARIO_NAME_MAX];
+  uint32_t duration_ms;
+  float level_percent;
+  uint32_t seed;
+  bool loop;
+  ScenarioStep steps[SCENARIO_MAX_STEPS];
+  uint8_t step_count;
+  ScenarioExpect expects[SCENARIO_MAX_EXPECTS];
+  uint8_t expect_count;
+
+  // Corrida
+  uint32_t start_ms;
+  uint8_t next_step;
+};
+
+// Lo que se puede afirmar del equipo en un instante
+struct ScenarioObservation {
+  bool pump_on[TANK_PUMPS];
+  float level_percent;
+  float pump_amps[TANK_PUMPS];
+  double energy_kwh[TANK_PUMPS];
+  uint16_t queue_depth;
+  uint32_t sent;
+  uint32_t dropped;
+};
+
+// nullptr si el guion es válido; si no, el motivo (y en `error_line` la línea, desde 1)
+const char* scenarioParse(Scenario& scn, const char* text, int* error_line);
+
+void scenarioStart(Scenario& scn, uint32_t now_ms);
+uint32_t scenarioElapsedMs(const Scenario& scn, uint32_t now_ms);
+// Terminó la línea de tiempo (nunca en los que se repiten)
+bool scenarioFinished(const Scenario& scn, uint32_t now_ms);
+
+// Siguiente paso vencido (llamar hasta que devuelva false)
+bool scenarioNextStep(Scenario& scn, uint32_t now_ms, ScenarioStep& step);
+// Aplica a la planta los pasos que son de la planta; false si le toca a quien llama
+// (comandos, broker, corte de energía)
+bool scenarioApplyToPlant(const ScenarioStep& step, SimPlant& plant, uint32_t now_us);
+
+void scenarioObserve(Scenario& scn, uint32_t now_ms, const ScenarioObservation& obs);
+void scenarioEvent(Scenario& scn, uint32_t now_ms, const char* name);
+// Cierra la corrida: lo que quedó pendiente se decide (un evento que no llegó, falla)
+void scenarioFinish(Scenario& scn, uint32_t now_ms);
+
+uint8_t scenarioFailures(const Scenario& scn);
+// Una expectativa en texto ("línea 12: pump 1 off a los 61 s, se vio on")
+void scenarioDescribe(const ScenarioExpect& expect, char* out, size_t size);
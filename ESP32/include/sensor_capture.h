@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// CAPTURA DE LECTURAS CRUDAS DE LOS SENSORES
+// -------------------------------------------------------------------------
+// Registra lo que entregan los sensores, antes de cualquier cálculo, para
+// reproducirlo en el host contra el mismo controlador
+// (tools/sensor_replay.cpp): lo que pasa en campo (caudal raro, flotador
+// que rebota) se puede repetir en el banco las veces que haga falta.
+//
+// Las lecturas se guardan como líneas de texto en un buffer circular que
+// el loop vacía hacia el puerto serie o MQTT. Si el buffer se llena la
+// lectura se descarta entera y se avisa con una línea D. Un solo
+// productor y un solo consumidor (la tarea del loop): sin bloqueos. No
+// reserva memoria: el buffer lo da quien llama.
+//
+// Formato (una lectura por línea, t_us = micros() de 32 bits, bomba = índice):
+//   H <versión> <bombas> <ms>                 comienzo de la captura
+//   L <t_us> <cuentas>                        lectura suelta del CT (corriente de línea)
+//   A <t_us> <bomba> <desde> <total> <hex>... bloque del CT de una bomba, CAPTURE_ADC_PER_LINE
+//                                             muestras de 3 dígitos hex por línea
+//   P <t_us> <pulsos> <ms>                    pulsos del caudalímetro y ms desde la lectura anterior
+//   U <t_us> <eco_us>                         duración del eco (0 = sin eco)
+//   T <t_us> <bomba> <centésimas de °C>       DS18B20 (-12700 = desconectado)
+//   F <t_us> <ms> <flotador> <crudo> <flanco_us>  nivel crudo o flanco nuevo de un flotador
+//   C <t_us> <ms> <bomba> <START|STOP>        comando recibido
+//   K <t_us> <ms>                             fin de las lecturas de un ciclo de telemetría
+//   D <perdidas>                              lecturas descartadas (buffer lleno)
+//   Z                                         fin de la captura
+//
+// El flujo se guarda como pulsos por lectura (lo que usa el cálculo del
+// caudal), no un instante por pulso: a caudal nominal son más de mil por
+// segundo.
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_LINE_MAX 64
+#define CAPTURE_ADC_PER_LINE 10
+
+struct SensorCapture {
+  char* buf;
+  size_t size;
+  size_t head;      // Próximo byte a escribir
+  size_t tail;      // Próximo byte a leer
+  size_t used;
+  uint32_t lines;
+  uint32_t dropped;
+  uint32_t dropped_reported;
+  bool active;
+  bool ended;       // Ya salió la línea Z
+};
+
+void captureInit(SensorCapture& cap, char* buf, size_t size);
+void captureStart(SensorCapture& cap, uint8_t pumps, uint32_t now_ms);
+void captureStop(SensorCapture& cap);
+inline bool captureActive(const SensorCapture& cap) { return cap.active; }
+// La captura sigue en curso o todavía no salió todo (hasta la Z)
+inline bool capturePending(const SensorCapture& cap) { return cap.active || cap.used > 0 || !cap.ended; }
+
+// Las funciones de registro no hacen nada si la captura no está activa
+void captureLineAdc(SensorCapture& cap, uint32_t t_us, uint16_t counts);
+void captureAdcBlock(SensorCapture& cap, uint32_t t_us, uint8_t pump, const uint16_t* samples, size_t count);
+void captureFlow(SensorCapture& cap, uint32_t t_us, uint32_t pulses, uint32_t elapsed_ms);
+void captureEcho(SensorCapture& cap, uint32_t t_us, uint32_t echo_us);
+void captureTemperature(SensorCapture& cap, uint32_t t_us, uint8_t pump, float celsius);
+void captureFloat(SensorCapture& cap, uint32_t t_us, uint32_t now_ms, uint8_t id, bool raw_wet, uint32_t edge_us);
+void captureCommand(SensorCapture& cap, uint32_t t_us, uint32_t now_ms, uint8_t pump, bool start);
+void captureCycle(SensorCapture& cap, uint32_t t_us, uint32_t now_ms);
+
+// Siguiente línea (sin salto de línea); false si no hay ninguna por ahora
+bool captureNextLine(SensorCapture& cap, char* line, size_t size);
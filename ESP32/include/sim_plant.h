@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "float_switch.h"
+#include "tank_controller.h"
+
+// -------------------------------------------------------------------------
+// PLANTA SIMULADA (TANQUE, BOMBAS Y SENSORES CON FALLAS)
+// -------------------------------------------------------------------------
+// Modelo mínimo de la instalación para el modo simulación y las
+// herramientas de host. El tanque se llena con la entrada de la calle y se
+// vacía con las bombas en marcha y con una fuga no medida; lo que pasa del
+// rebalse (overflow_cm) se pierde. Los sensores
+// entregan lo mismo que el hardware: cuentas del ADC del CT, pulsos del
+// caudalímetro, duración del eco, DS18B20 y flotadores con su flanco. La
+// simulación recorre así las mismas conversiones y el mismo controlador
+// que el equipo (tank_controller.h), y también se puede capturar
+// (sensor_capture.h).
+//
+// Fallas: DS18B20 desconectado (-127 °C), flotador trabado, bomba atascada
+// (consume más y no mueve agua) y ultrasonido sin eco. Las decide un
+// escenario (scenario.h). El ruido sale de un generador con semilla:
+// misma semilla, mismas lecturas. Módulo puro: el tiempo lo pasa quien
+// llama.
+
+#define SIM_PUMP_RUN_AMPS 6.0f          // Corriente atribuida a una bomba en marcha
+#define SIM_PUMP_SEIZED_AMPS 9.0f       // Rotor bloqueado: más corriente y nada de caudal
+#define SIM_ULTRASONIC_NOISE_CM 3.0f    // Oleaje y rebotes (± uniforme)
+#define SIM_TEMPERATURE_IDLE_C 25.0f
+#define SIM_TEMPERATURE_RUN_C 60.0f
+#define SIM_DS18B20_DISCONNECTED_C -127.0f
+#define SIM_MAINS_HZ 60.0f
+#define SIM_ADC_MIDSCALE 2048           // Polarización del CT (mitad del ADC de 12 bits)
+#define SIM_ADC_MAX 4095
+
+enum SimFloatFault : uint8_t {
+  SIM_FLOAT_OK = 0,
+  SIM_FLOAT_STUCK_DRY,
+  SIM_FLOAT_STUCK_WET
+};
+
+struct SimPlant {
+  TankControllerConfig cfg;
+  double height_cm;                // Nivel real del agua (double: a 1 ms por paso una fuga chica no entra en un float)
+  float inflow_lpm;                // Entrada de la calle (la mide el caudalímetro)
+  float leak_lpm;                  // Salida que no mide nadie
+  bool relay[TANK_PUMPS];
+  bool seized[TANK_PUMPS];
+  bool temperature_fault[TANK_PUMPS];
+  float temperature_c[TANK_PUMPS]; // NAN = la que corresponde a la marcha
+  SimFloatFault float_fault[FLOAT_SWITCH_COUNT];
+  bool float_wet[FLOAT_SWITCH_COUNT];
+  uint32_t float_edge_us[FLOAT_SWITCH_COUNT];
+  bool echo_lost;
+  double pending_pulses;           // Pulsos del caudalímetro todavía no leídos (con fracción)
+  uint32_t last_ms;
+  uint32_t last_flow_ms;
+  uint32_t seed;
+};
+
+void simPlantInit(SimPlant& plant, const TankControllerConfig& cfg, float level_percent, uint32_t seed,
+                  uint32_t now_ms, uint32_t now_us);
+// Integra el nivel hasta `now_ms` y actualiza los flotadores (un cambio marca su flanco en `now_us`)
+void simPlantAdvance(SimPlant& plant, uint32_t now_ms, uint32_t now_us);
+
+void simPlantSetRelay(SimPlant& plant, int pump, bool on);
+// `fault` = SIM_FLOAT_OK para soltarlo; trabado sin posición explícita: donde está ahora
+void simPlantSetFloatFault(SimPlant& plant, FloatSwitchId id, SimFloatFault fault, uint32_t now_us);
+
+// --- Lo que leería el hardware ---
+uint16_t simPlantLineAdc(SimPlant& plant, uint32_t now_us);
+void simPlantAdcBlock(SimPlant& plant, int pump, uint32_t start_us, uint32_t sample_us, uint16_t* samples,
+                      size_t count);
+uint32_t simPlantFlowPulses(SimPlant& plant, uint32_t now_ms, uint32_t* elapsed_ms);
+uint32_t simPlantEchoUs(SimPlant& plant);  // 0 = sin eco
+float simPlantTemperature(SimPlant& plant, int pump);
+bool simPlantFloatRaw(const SimPlant& plant, FloatSwitchId id, uint32_t* edge_us);
+
+float simPlantLevelPercent(const SimPlant& plant);
+float simPlantPumpAmps(const SimPlant& plant, int pump);  // 0 con el relé abierto
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// HISTOGRAMAS DE LATENCIA POR ETAPA
+// -------------------------------------------------------------------------
+// Cada etapa del ciclo (lectura de sensores, serialización, despacho MQTT,
+// manejadores de mensajes...) acumula sus duraciones en un histograma de
+// cubetas fijas en escala log2: la cubeta i cuenta las duraciones menores
+// que STAGE_BUCKET_BASE_US << i y la última todo lo demás. Registrar cuesta
+// un par de comparaciones; no usa memoria dinámica.
+//
+// Los percentiles salen de las cubetas (cota superior de la cubeta), lo
+// que basta para ver regresiones entre versiones de firmware.
+
+#define STAGE_BUCKETS 12          // < 16 us, < 32 us, ... , < 32.8 ms, resto
+#define STAGE_BUCKET_BASE_US 16
+
+enum MetricStage : uint8_t {
+  STAGE_SENSORS = 0,     // read_or_mock_sensors()
+  STAGE_TELEMETRY,       // Ciclo completo de publishTelemetry()
+  STAGE_SERIALIZE,       // serializeJson de la telemetría
+  STAGE_MQTT_DISPATCH,   // Despacho de la cola de salida hacia el cliente MQTT
+  STAGE_MQTT_POLL,       // Eventos del transporte (incluye los manejadores de abajo)
+  STAGE_HANDLER_CONTROL, // Comando a una bomba
+  STAGE_HANDLER_CONFIG,  // Configuración del controlador
+  STAGE_HANDLER_SAMPLE,  // "Muestrear ahora"
+  STAGE_LOOP,            // Vuelta completa del loop
+  STAGE_WIFI,            // Mantenimiento del Wi-Fi (reconexión)
+  STAGE_MQTT_RECONNECT,  // Mantenimiento del MQTT (sondeo de brokers, reconexión, conmutación)
+  STAGE_ULTRASONIC,      // pulseIn del sensor ultrasónico
+  STAGE_TEMPERATURE,     // requestTemperatures de un DS18B20
+  STAGE_NVS,             // Guardado de acumulados en la NVS
+  STAGE_COUNT
+};
+
+struct StageHistogram {
+  uint32_t buckets[STAGE_BUCKETS];
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t sum_us;
+};
+
+struct StageMetrics {
+  StageHistogram stages[STAGE_COUNT];
+  uint32_t window_start_ms;
+};
+
+void stageMetricsInit(StageMetrics& metrics, uint32_t now_ms);
+
+// Empieza una ventana nueva (tras publicarla)
+void stageMetricsReset(StageMetrics& metrics, uint32_t now_ms);
+
+void stageMetricsRecord(StageMetrics& metrics, MetricStage stage, uint32_t duration_us);
+
+const char* stageName(MetricStage stage);
+
+// Cota superior (us) de la cubeta que contiene el percentil `p` (0..100); 0 si no hay muestras.
+// Para la última cubeta (sin cota) devuelve el máximo observado.
+uint32_t stageHistogramPercentile(const StageHistogram& hist, uint8_t p);
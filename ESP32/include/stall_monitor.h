@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// DETECTOR DE BLOQUEOS DEL LOOP Y WATCHDOG DE TAREAS
+// -------------------------------------------------------------------------
+// Una tarea de FreeRTOS en el otro núcleo vigila cada vuelta del loop. Si
+// una vuelta pasa de STALL_BUDGET_MS se abre un registro con la pila de
+// etapas activas (ver stageBegin() en main.cpp): qué etapa estaba corriendo
+// y, por cada nivel, la dirección desde donde se entró (se traduce a
+// archivo:línea con addr2line sobre el .elf de esa versión). El registro se
+// actualiza mientras dure el bloqueo y se cierra cuando el loop vuelve.
+//
+// Los registros viven en un anillo en memoria RTC: sobreviven al reinicio
+// por watchdog, así que si el bloqueo terminó en reinicio (STALL_FATAL) se
+// sabe igual dónde estaba el loop. Se suben en la siguiente conexión.
+//
+// Como respaldo, el loop queda suscrito al watchdog de tareas del ESP-IDF:
+// si no vuelve en STALL_WDT_TIMEOUT_S el ESP32 se reinicia (y el pánico
+// imprime la traza completa por el puerto serie). La suscripción se hace al
+// final de setup(): las esperas del arranque (Wi-Fi hasta WIFI_TIMEOUT_MS)
+// duran más que el plazo y nadie alimenta al watchdog mientras tanto.
+
+#define STALL_BUDGET_MS 1000
+#define STALL_MONITOR_PERIOD_MS 100
+#define STALL_MONITOR_STACK 2048
+#define STALL_WDT_TIMEOUT_S 30
+#define STALL_RING_SIZE 8
+#define STALL_TRACE_DEPTH 4
+#define STALL_TASK_NAME_MAX 16
+
+enum StallState : uint8_t {
+  STALL_ONGOING = 0,   // El loop sigue bloqueado
+  STALL_ENDED,         // El loop volvió
+  STALL_FATAL          // Seguía abierto al reiniciar (watchdog, pánico, corte)
+};
+
+struct StallRecord {
+  uint32_t seq;                       // Creciente entre reinicios (0 = registro vacío)
+  uint32_t boot;                      // Número de arranque en que ocurrió (contador de la NVS)
+  uint32_t uptime_ms;                 // Inicio de la vuelta bloqueada
+  uint32_t duration_ms;               // Duración (la última vista si terminó en reinicio)
+  uint32_t pcs[STALL_TRACE_DEPTH];    // Dirección de entrada a cada etapa activa
+  uint8_t stages[STALL_TRACE_DEPTH];  // Etapa activa de cada nivel (MetricStage)
+  uint8_t depth;                      // Niveles guardados en stages/pcs
+  uint8_t state;                      // StallState
+  bool uploaded;
+  char task[STALL_TASK_NAME_MAX];
+};
+
+// Al comienzo de setup(), desde el loop: recupera el anillo de RTC y arranca la tarea de vigilancia.
+// `boot` es el número de este arranque guardado en la NVS: seq vuelve a 1 cuando un corte de
+// energía borra el anillo, así que (boot, seq) solo identifica un registro si boot no se pierde.
+void stallMonitorBegin(uint32_t boot);
+
+// Al final de setup(): suscribe el loop al watchdog de tareas
+void stallWatchdogBegin();
+
+// Dirección de código a partir de __builtin_return_address(). En Xtensa los dos bits altos de la
+// dirección de retorno guardan el tamaño de ventana de la llamada (call4/8/12), no la dirección:
+// se reponen los del segmento de instrucciones (0x4xxxxxxx) para que addr2line la encuentre.
+inline uintptr_t stallCodeAddress(const void* return_address) {
+  uintptr_t ra = (uintptr_t)return_address;
+#if defined(__XTENSA__)
+  return (ra & 0x3FFFFFFFu) | 0x40000000u;
+#else
+  return ra;
+#endif
+}
+
+// Al comienzo y al final de cada vuelta del loop (el comienzo también alimenta el watchdog)
+void stallLoopBegin();
+void stallLoopEnd();
+
+// Pila de etapas del loop (solo desde el loop)
+void stallPush(uint8_t stage, uint32_t pc);
+void stallPop();
+
+// Número de este arranque (el que se pasó a stallMonitorBegin)
+uint32_t stallBootCount();
+
+// Copia el registro cerrado más antiguo que falta subir; false si no hay
+bool stallNextPending(StallRecord& out);
+void stallMarkUploaded(uint32_t seq);  // Con el PUBACK: encolado todavía puede perderse
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// TOTALIZADOR DE ENTRADA Y BALANCE DE MASA DEL TANQUE
+// -------------------------------------------------------------------------
+// Relaciona el caudal de entrada de la calle con el volumen del tanque:
+//
+//   salida_implícita = entrada - Δvolumen
+//   no_contabilizado = salida_implícita - volumen_bombeado
+//
+// Con las bombas paradas, todo lo que sale del tanque es consumo directo o
+// una fuga. Si el volumen no contabilizado se mantiene por encima del umbral
+// durante varias evaluaciones seguidas, se levanta la alerta de fuga.
+// Con el tanque lleno el nivel no puede subir (lo que entra rebalsa o lo
+// corta la válvula de flotante): esas ventanas no se evalúan.
+// Módulo puro: no depende de Arduino.
+
+#define TANK_BALANCE_RING 64                // Muestras del historial (64 x 30 s = 32 min)
+#define TANK_BALANCE_SAMPLE_MS 30000        // Cada cuánto se guarda una muestra en el historial
+#define TANK_BALANCE_MAX_GAP_MS 60000       // Tramos más largos no se integran (loop bloqueado)
+
+#define LEAK_WINDOW_MS (20UL * 60UL * 1000UL) // Ventana de evaluación de fuga (20 minutos en reposo)
+#define LEAK_THRESHOLD_LPM 1.0f              // Pérdida mínima sostenida para sospechar fuga (L/min)
+#define LEAK_CONFIRM_EVALS 6                 // Evaluaciones consecutivas para confirmar (6 x 30 s)
+
+// Muestra del historial: acumulados en el instante `t_ms`
+struct TankBalanceSample {
+  uint32_t t_ms;
+  double inflow_l;  // Volumen de entrada acumulado (L)
+  double pumped_l;  // Volumen bombeado acumulado (L)
+  float volume_l;   // Volumen del tanque (L)
+  bool pumps_on;    // Alguna bomba estaba encendida
+  bool saturated;   // El tanque estuvo lleno
+};
+
+// Resultado del balance sobre una ventana deslizante
+struct TankBalanceWindow {
+  float minutes;          // Duración real de la ventana
+  float inflow_lpm;       // Entrada promedio
+  float outflow_lpm;      // Salida implícita (entrada - Δvolumen)
+  float pumped_lpm;       // Salida explicada por las bombas
+  float unaccounted_lpm;  // Salida no explicada (consumo directo / fuga)
+  bool idle;              // Ninguna bomba funcionó en toda la ventana
+  bool saturated;         // El tanque estuvo lleno en algún momento de la ventana
+};
+
+enum TankLeakEvent {
+  LEAK_EVENT_NONE = 0,
+  LEAK_EVENT_RAISED,
+  LEAK_EVENT_CLEARED
+};
+
+struct TankBalance {
+  double inflow_total_l;     // Totalizador de entrada de la calle
+  float last_inflow_lpm;
+  uint32_t last_ms;
+  bool has_sample;
+
+  TankBalanceSample ring[TANK_BALANCE_RING];
+  uint8_t head;              // Próxima posición a escribir
+  uint8_t count;
+  bool pumps_on_since_push;  // Alguna bomba encendida desde la última muestra del historial
+  bool saturated_since_push; // Tanque lleno desde la última muestra del historial
+
+  uint8_t leak_streak;
+  bool leak_active;
+  float leak_rate_lpm;       // Pérdida estimada mientras la alerta está activa
+};
+
+void tankBalanceInit(TankBalance& balance);
+
+// Integra el caudal de entrada y, cada TANK_BALANCE_SAMPLE_MS, guarda una muestra y evalúa la fuga.
+// `pumped_total_l` es el volumen bombeado acumulado por todas las bombas; `saturated`, que el
+// nivel está en el tope (el volumen ya no refleja la entrada).
+TankLeakEvent tankBalanceUpdate(TankBalance& balance, float inflow_lpm, float volume_l,
+                                double pumped_total_l, bool pumps_on, bool saturated, uint32_t now_ms);
+
+// Calcula el balance sobre los últimos `window_ms`. Devuelve false si aún no hay historial suficiente.
+bool tankBalanceWindow(const TankBalance& balance, uint32_t window_ms, TankBalanceWindow& out);
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "control_command.h"
+#include "energy_meter.h"
+#include "float_switch.h"
+#include "level_estimator.h"
+#include "level_trend.h"
+#include "tank_balance.h"
+#include "tank_geometry.h"
+
+// -------------------------------------------------------------------------
+// CONTROLADOR DEL TANQUE (LECTURAS -> ESTADO -> DECISIONES)
+// -------------------------------------------------------------------------
+// Lo que el firmware hace con las lecturas de los sensores, sin tocar el
+// hardware:
+//
+//  - conversión de lecturas crudas (cuentas del ADC, pulsos del
+//    caudalímetro, duración del eco) a unidades
+//  - fusión del nivel, balance del tanque, tendencia y energía por bomba
+//  - antirrebote de flotadores y reglas de control: no arrancar una bomba
+//    con el tanque vacío y apagarlas todas cuando se vacía
+//
+// main.cpp lee los sensores y acciona los relés según lo que decide este
+// módulo; tools/sensor_replay.cpp le entrega en el host las mismas
+// lecturas crudas de una captura (ver sensor_capture.h). Módulo puro: el
+// tiempo lo pasa quien llama.
+
+#define TANK_PUMPS 2
+#define TANK_TEMPERATURE_DISCONNECTED_C -127.0f // Lo que entrega el DS18B20 cuando no responde
+#define TANK_SATURATED_MARGIN_CM 4.0f           // Tan cerca del rebalse el nivel ya no sigue a la entrada
+
+struct TankControllerConfig {
+  const TankVolumeTable* table;
+  LevelEstimatorConfig level;
+  EnergyMeterConfig energy[TANK_PUMPS];
+  float empty_distance_cm;  // Del ultrasonido al fondo del tanque (nivel 0%)
+  float liters_per_pulse;   // Constante K del caudalímetro
+  float amps_per_count;     // Escala del CT (A por cuenta del ADC)
+  float pump_amps_share;    // Parte de la corriente RMS del CT que se atribuye a cada bomba
+  float flow_detect_lpm;    // Entrada mínima para considerar que hay flujo
+  float overflow_cm;        // Altura del rebalse desde el fondo: el agua no pasa de ahí
+};
+
+// Lecturas de un ciclo de telemetría, ya en unidades
+struct TankReadings {
+  uint32_t now_ms;
+  float line_amps;
+  float inflow_lpm;
+  float ultrasonic_height_cm;   // NAN = sin eco válido (el estimador la descarta)
+  float pump_amps[TANK_PUMPS];  // 0 con la bomba apagada
+  float temperature_c[TANK_PUMPS];
+};
+
+struct TankController {
+  TankControllerConfig cfg;
+  LevelEstimator level;
+  LevelTrend trend;
+  TankBalance balance;
+  FloatDebouncer floats[FLOAT_SWITCH_COUNT];
+  bool float_raw[FLOAT_SWITCH_COUNT];  // Último nivel crudo visto (hasta que el antirrebote tenga estado)
+  EnergyMeter meters[TANK_PUMPS];
+  bool pump_on[TANK_PUMPS];
+
+  // Resultado del último ciclo
+  TankReadings last;
+  bool flow_detected;
+  float level_percent;
+  float level_sigma_percent;
+  float tank_volume_l;
+  bool temperature_fault[TANK_PUMPS];  // DS18B20 sin respuesta: la temperatura no se publica
+  uint8_t temperature_changed;         // Bit i: la bomba i entró o salió de falla en este ciclo
+};
+
+// `stored_kwh` / `stored_m3`: acumulados recuperados de la NVS (uno por bomba)
+void tankControllerInit(TankController& ctl, const TankControllerConfig& cfg, const double* stored_kwh,
+                        const double* stored_m3);
+
+// --- Lecturas crudas -> unidades ---
+float tankLineAmps(const TankControllerConfig& cfg, uint16_t adc);                         // Lectura suelta del CT
+float tankPumpAmps(const TankControllerConfig& cfg, const uint16_t* samples, size_t count); // Bloque del CT (RMS)
+float tankInflowLpm(const TankControllerConfig& cfg, uint32_t pulses, uint32_t elapsed_ms);
+float tankEchoHeightCm(const TankControllerConfig& cfg, uint32_t echo_us);                 // NAN sin eco válido
+
+// Ciclo de telemetría: nivel, balance, tendencia y energía de cada bomba.
+// Devuelve el cambio de la alerta de fuga (LEAK_EVENT_NONE si no cambió).
+TankLeakEvent tankControllerSample(TankController& ctl, const TankReadings& readings);
+
+// Evalúa un flotador (en cada vuelta del loop). true si se confirmó un cruce de nivel (`event`);
+// en `stop_mask` las bombas que se apagaron (bit i = bomba de índice i): ya quedan apagadas en el
+// estado, quien llama acciona los relés.
+bool tankControllerFloat(TankController& ctl, FloatSwitchId id, bool raw_wet, uint32_t last_edge_us,
+                         uint32_t now_us, uint32_t now_ms, FloatLevelEvent& event, uint8_t& stop_mask);
+
+// nullptr si el comando se acepta: quien llama acciona el relé y registra el estado con
+// tankControllerSetPump(). Si no, el resultado que se informa ("REJECTED_TANK_EMPTY").
+const char* tankControllerCommand(const TankController& ctl, int pump, ControlAction action);
+void tankControllerSetPump(TankController& ctl, int pump, bool on);
+
+// Estado de un flotador para el estimador: el estable si ya pasó el antirrebote, si no el crudo
+bool tankControllerFloatWet(const TankController& ctl, FloatSwitchId id);
+// Tanque vacío según el flotador inferior (protección contra marcha en seco)
+bool tankControllerTankEmpty(const TankController& ctl);
+// Entrada de la calle menos lo que extraen las bombas encendidas (L/min)
+float tankControllerNetInflowLpm(const TankController& ctl);
+bool tankControllerPumpsOn(const TankController& ctl);
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stddef.h>
+
+// -------------------------------------------------------------------------
+// GEOMETRÍA DEL TANQUE (TABLAS NIVEL -> VOLUMEN EN TIEMPO DE COMPILACIÓN)
+// -------------------------------------------------------------------------
+// Cada modelo de tanque se convierte en una tabla de TANK_LUT_POINTS litros
+// equiespaciados en altura. La tabla se calcula con `constexpr`, de modo que
+// en el firmware solo queda un arreglo en flash y convertir una lectura es una
+// interpolación lineal (sin raíces ni trigonometría por muestra).
+
+#define TANK_LUT_POINTS 65
+
+struct TankVolumeTable {
+  double height_cm;                   // Altura útil del tanque (nivel 100%)
+  double liters[TANK_LUT_POINTS];     // liters[i] = volumen a i/(N-1) de la altura
+};
+
+// Punto de una tabla de calibración medida en sitio (aforo del tanque)
+struct TankCalibrationPoint {
+  double height_cm;
+  double liters;
+};
+
+// --- Utilidades constexpr ---
+
+constexpr double tankSqrt(double x) {
+  if (x <= 0.0) return 0.0;
+  double guess = x > 1.0 ? x : 1.0;
+  for (int i = 0; i < 64; i++) {
+    guess = 0.5 * (guess + x / guess);
+  }
+  return guess;
+}
+
+// --- Modelos ---
+
+// Cilindro vertical: volumen lineal con la altura
+constexpr TankVolumeTable tankMakeVerticalCylinder(double diameter_cm, double height_cm) {
+  TankVolumeTable table{};
+  table.height_cm = height_cm;
+  double area_cm2 = 3.14159265358979 * diameter_cm * diameter_cm / 4.0;
+  for (int i = 0; i < TANK_LUT_POINTS; i++) {
+    double h = height_cm * i / (TANK_LUT_POINTS - 1);
+    table.liters[i] = area_cm2 * h / 1000.0;
+  }
+  return table;
+}
+
+// Tanque rectangular (cisterna de concreto regular): volumen lineal con la altura
+constexpr TankVolumeTable tankMakeRectangular(double width_cm, double length_cm, double height_cm) {
+  TankVolumeTable table{};
+  table.height_cm = height_cm;
+  for (int i = 0; i < TANK_LUT_POINTS; i++) {
+    double h = height_cm * i / (TANK_LUT_POINTS - 1);
+    table.liters[i] = width_cm * length_cm * h / 1000.0;
+  }
+  return table;
+}
+
+// Cilindro horizontal: el ancho de la superficie libre es 2*sqrt(r^2 - (r-y)^2).
+// Se integra el área del segmento circular con la regla de Simpson por tramo.
+constexpr TankVolumeTable tankMakeHorizontalCylinder(double diameter_cm, double length_cm) {
+  TankVolumeTable table{};
+  table.height_cm = diameter_cm;
+  double r = diameter_cm / 2.0;
+  double step = diameter_cm / (TANK_LUT_POINTS - 1);
+  double area_cm2 = 0.0;
+  table.liters[0] = 0.0;
+  for (int i = 1; i < TANK_LUT_POINTS; i++) {
+    double y0 = step * (i - 1);
+    double y1 = step * i;
+    double ym = 0.5 * (y0 + y1);
+    double w0 = 2.0 * tankSqrt(r * r - (r - y0) * (r - y0));
+    double wm = 2.0 * tankSqrt(r * r - (r - ym) * (r - ym));
+    double w1 = 2.0 * tankSqrt(r * r - (r - y1) * (r - y1));
+    area_cm2 += step / 6.0 * (w0 + 4.0 * wm + w1);
+    table.liters[i] = area_cm2 * length_cm / 1000.0;
+  }
+  return table;
+}
+
+// Tabla de calibración (tanques irregulares): se remuestrea por interpolación lineal.
+// Los puntos deben estar ordenados por altura; el último define la altura útil.
+template <size_t N>
+constexpr TankVolumeTable tankMakeCalibrated(const TankCalibrationPoint (&points)[N]) {
+  static_assert(N >= 2, "La tabla de calibración necesita al menos dos puntos");
+  TankVolumeTable table{};
+  table.height_cm = points[N - 1].height_cm;
+  size_t seg = 0;
+  for (int i = 0; i < TANK_LUT_POINTS; i++) {
+    double h = table.height_cm * i / (TANK_LUT_POINTS - 1);
+    while (seg + 2 < N && h > points[seg + 1].height_cm) seg++;
+    const TankCalibrationPoint& a = points[seg];
+    const TankCalibrationPoint& b = points[seg + 1];
+    double span = b.height_cm - a.height_cm;
+    double t = span > 0.0 ? (h - a.height_cm) / span : 0.0;
+    if (t < 0.0) t = 0.0;
+    table.liters[i] = a.liters + t * (b.liters - a.liters);
+  }
+  return table;
+}
+
+// --- Consultas (tiempo de ejecución) ---
+
+inline double tankCapacityLiters(const TankVolumeTable& table) {
+  return table.liters[TANK_LUT_POINTS - 1];
+}
+
+// Litros para una altura de agua dada (interpolación en la tabla)
+inline float tankLitersAtHeight(const TankVolumeTable& table, float height_cm) {
+  if (height_cm <= 0.0f) return 0.0f;
+  if (height_cm >= table.height_cm) return (float)tankCapacityLiters(table);
+  float pos = height_cm / (float)table.height_cm * (TANK_LUT_POINTS - 1);
+  int index = (int)pos;
+  // Una altura apenas menor que la del tanque puede redondear a pos == TANK_LUT_POINTS - 1 en float
+  if (index > TANK_LUT_POINTS - 2) index = TANK_LUT_POINTS - 2;
+  float frac = pos - (float)index;
+  return (float)table.liters[index] + frac * (float)(table.liters[index + 1] - table.liters[index]);
+}
+
+// Área de la superficie libre expresada en litros por cm de altura (dV/dh)
+inline float tankLitersPerCm(const TankVolumeTable& table, float height_cm) {
+  float step = (float)table.height_cm / (TANK_LUT_POINTS - 1);
+  int index = (int)(height_cm / step);
+  if (index < 0) index = 0;
+  if (index > TANK_LUT_POINTS - 2) index = TANK_LUT_POINTS - 2;
+  return (float)(table.liters[index + 1] - table.liters[index]) / step;
+}
+
+// Litros para un nivel expresado como porcentaje de la altura
+inline float tankLitersAtPercent(const TankVolumeTable& table, float level_percent) {
+  return tankLitersAtHeight(table, level_percent / 100.0f * (float)table.height_cm);
+}
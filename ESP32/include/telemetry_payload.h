@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json_writer.h"
+#include "level_trend.h"
+#include "mqtt_publisher.h"
+#include "tank_balance.h"
+#include "time_service.h"
+
+// -------------------------------------------------------------------------
+// PAYLOAD DE TELEMETRÍA DE UNA BOMBA
+// -------------------------------------------------------------------------
+// Arma el JSON de {sitio}/{controlador}/pumps/{id}/telemetry a partir de
+// una muestra ya leída, en streaming (json_writer.h) y directamente en el
+// lugar de la cola de salida MQTT: sin documento intermedio, sin copia y
+// sin memoria dinámica. Separado de main.cpp para que las herramientas de
+// host (tools/steady_state_check.cpp, tools/serialize_bench.cpp) corran el
+// mismo código que el firmware.
+//
+// TELEMETRY_JSON_MAX es el JSON más largo posible (todos los campos con el
+// valor más ancho de su tipo), calculado al compilar a partir de las claves
+// y comprobado contra el lugar de la cola.
+
+// Decimales de cada magnitud
+#define TELEMETRY_DECIMALS 2         // Corriente, temperatura, caudales, nivel
+#define TELEMETRY_POWER_DECIMALS 1
+#define TELEMETRY_KWH_DECIMALS 4     // Acumulado y eficiencia
+#define TELEMETRY_INTERVAL_DECIMALS 6 // Energía y volumen de un solo intervalo (valores chicos)
+#define TELEMETRY_VOLUME_DECIMALS 1  // Litros y minutos
+
+#define TELEMETRY_FLOAT(decimals) JSON_FLOAT_MAX_CHARS(TELEMETRY_##decimals)
+
+constexpr size_t TELEMETRY_JSON_MAX =
+  2 // Llaves
+  + jsonFieldMax("pump_id", JSON_INT_MAX_CHARS)
+  + jsonFieldMax("current_amps", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("pump_temperature_celsius", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("current_inflow_rate", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax(TIME_STAMP_FIELD, TIME_STAMP_WIDTH)
+  + jsonFieldMax("slot_ms", JSON_INT_MAX_CHARS)
+  + jsonFieldMax("water_level_percent", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("water_level_sigma_percent", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("mqtt_queue_depth", JSON_INT_MAX_CHARS)
+  + jsonFieldMax("mqtt_ack_latency_ms", JSON_INT_MAX_CHARS)
+  + jsonFieldMax("street_flow_status", 9) // "FLOWING" / "STOPPED"
+  + jsonFieldMax("power_watts", TELEMETRY_FLOAT(POWER_DECIMALS))
+  + jsonFieldMax("energy_kwh_total", TELEMETRY_FLOAT(KWH_DECIMALS))
+  + jsonFieldMax("energy_kwh_interval", TELEMETRY_FLOAT(INTERVAL_DECIMALS))
+  + jsonFieldMax("pumped_m3_interval", TELEMETRY_FLOAT(INTERVAL_DECIMALS))
+  + jsonFieldMax("energy_kwh_per_m3", TELEMETRY_FLOAT(KWH_DECIMALS))
+  + jsonFieldMax("tank_volume_liters", TELEMETRY_FLOAT(VOLUME_DECIMALS))
+  + jsonFieldMax("tank_trend_lpm", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("minutes_to_empty", TELEMETRY_FLOAT(VOLUME_DECIMALS))
+  + jsonFieldMax("minutes_to_full", TELEMETRY_FLOAT(VOLUME_DECIMALS))
+  + jsonFieldMax("inflow_total_liters", TELEMETRY_FLOAT(VOLUME_DECIMALS))
+  + jsonFieldMax("tank_outflow_lpm_5min", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("tank_unaccounted_lpm_5min", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("tank_outflow_lpm_15min", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("tank_unaccounted_lpm_15min", TELEMETRY_FLOAT(DECIMALS))
+  + jsonFieldMax("leak_suspected", JSON_BOOL_MAX_CHARS)
+  + jsonFieldMax("leak_rate_lpm", TELEMETRY_FLOAT(DECIMALS));
+
+static_assert(TELEMETRY_JSON_MAX <= MQTT_PAYLOAD_MAX, "La telemetría debe caber en un lugar de la cola de salida");
+
+struct TelemetrySample {
+  int pump_id;
+  float amps;
+  float temperature_c;
+  float inflow_rate;             // Entrada de la calle (común a todas las bombas)
+  int64_t slot_ms;               // Límite de la hora real de la muestra (0 = muestreo libre)
+  float level_percent;
+  float level_sigma_percent;
+  uint16_t queue_depth;          // Cola de salida MQTT
+  uint32_t ack_latency_ms;
+  float power_w;
+  double energy_kwh_total;
+  double energy_kwh_interval;
+  double pumped_m3_interval;
+  float energy_kwh_per_m3;
+  float tank_volume_l;
+  double inflow_total_l;
+  const LevelTrendEstimate* trend;   // nullptr si todavía no hay tendencia
+  const TankBalanceWindow* balance5; // nullptr si la ventana no está completa
+  const TankBalanceWindow* balance15;
+  bool leak_suspected;
+  float leak_rate_lpm;
+};
+
+// Escribe el JSON en `out`. `stamp` es el valor de "ts_ms" ya formateado (TIME_STAMP_WIDTH
+// caracteres, ver time_service.h). Devuelve la longitud o 0 si no cabe (nunca lo trunca).
+// `stamp_offset` (opcional) recibe la posición del valor de "ts_ms".
+size_t telemetryPayloadWrite(const TelemetrySample& sample, const char* stamp, char* out, size_t size,
+                             size_t* stamp_offset = nullptr);
+
+// Escribe el JSON directamente en un lugar reservado de la cola de salida y lo encola con la
+// marca de `mono_us` para que el publicador rehaga "ts_ms" en cada envío. Devuelve false si la
+// cola lo descartó.
+bool telemetryPayloadPublish(MqttPublisher& pub, const char* topic, uint8_t qos, const MqttPublishProperties* props,
+                             const TelemetrySample& sample, const char* stamp, int64_t mono_us, uint32_t now_ms);
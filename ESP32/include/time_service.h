@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// SERVICIO DE HORA: RELOJ MONÓTONO + CORRESPONDENCIA CON LA HORA NTP
+// -------------------------------------------------------------------------
+// Las muestras se marcan con el reloj monótono en microsegundos (no salta
+// ni depende de la red). Cada sincronización NTP fija la diferencia entre
+// ese reloj y la hora real; desde la primera, cualquier marca monótona de
+// este arranque se puede convertir a hora real, incluso las tomadas antes
+// de sincronizar.
+//
+// En el JSON la hora va en "ts_ms" con ancho fijo (TIME_STAMP_WIDTH): o
+// los ms desde 1970 o `null`, rellenos con espacios (JSON válido en ambos
+// casos). Así un mensaje encolado antes de la sincronización se vuelve a
+// marcar en el mismo lugar antes de enviarse (ver mqtt_publisher.h).
+
+#define TIME_STAMP_FIELD "ts_ms"
+#define TIME_STAMP_WIDTH 16
+
+struct TimeService {
+  bool synced;
+  int64_t offset_us;          // hora real (us desde 1970) = reloj monótono + offset_us
+  int64_t last_sync_mono_us;
+  int64_t last_step_us;       // Corrección aplicada en la última sincronización (deriva del reloj)
+  uint32_t syncs;
+};
+
+void timeServiceInit(TimeService& ts);
+
+// Nueva sincronización: `wall_us` es la hora real leída en el instante monótono `mono_us`
+void timeServiceSync(TimeService& ts, int64_t mono_us, int64_t wall_us);
+
+// Devuelve false si todavía no hubo sincronización
+bool timeServiceToWall(const TimeService& ts, int64_t mono_us, int64_t& wall_us);
+
+// Instante monótono de una hora real. Devuelve false si todavía no hubo sincronización.
+bool timeServiceToMono(const TimeService& ts, int64_t wall_us, int64_t& mono_us);
+
+// Próximo múltiplo de `period_ms` de la hora real posterior a `mono_us` (muestreo alineado entre
+// controladores): `boundary_mono_us` es cuándo ocurre y `boundary_wall_ms` su hora real.
+// Devuelve false si todavía no hubo sincronización.
+bool timeServiceNextBoundary(const TimeService& ts, int64_t mono_us, uint32_t period_ms,
+                             int64_t& boundary_mono_us, int64_t& boundary_wall_ms);
+
+// Escribe exactamente TIME_STAMP_WIDTH caracteres (sin '\0') con la hora en ms o `null`.
+// Devuelve true si la hora es real.
+bool timeServiceFormatStamp(const TimeService& ts, int64_t mono_us, char* out);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// REGISTRO DE TRAZA (LÍNEA DE TIEMPO POR TAREA)
+// -------------------------------------------------------------------------
+// Grabadora continua de eventos en un anillo en RAM: cuando algo parece
+// lento se vuelca lo último que pasó y tools/trace_to_chrome.cpp lo
+// convierte al formato de chrome://tracing / Perfetto, con una fila por
+// tarea.
+//
+// Cada lugar del anillo ocupa 20 bytes en el ESP32: número de secuencia y
+// evento, con marca en us (32 bits: da la vuelta cada ~71 min, el
+// convertidor la desenrolla), nombre (literal: se guarda el puntero),
+// argumento, tipo y tarea (índice en una tabla de tareas vistas).
+// Tipos: comienzo/fin de un tramo, instante y tramo completo (comienzo +
+// duración en el argumento, para registrarlo solo al terminar si fue largo).
+//
+// Cualquier tarea puede registrar sin bloqueos: el índice se toma con una
+// operación atómica y cada lugar lleva su número de secuencia para que el
+// volcado descarte lo que se estaba escribiendo. Al llenarse se pisa lo
+// más viejo. No usa memoria dinámica. Módulo puro: el reloj y la tarea
+// actual los da quien lo usa (FreeRTOS en el firmware, hilos en el host).
+//
+// Volcado en texto (traceNextLine(), el registro se pausa mientras dura):
+//   R <eventos> <pisados>              encabezado
+//   T <tarea> <nombre>                 tareas vistas
+//   <B|E|i|X> <ts_us> <tarea> <nombre> <arg>
+//   Z                                  fin
+
+#define TRACE_RING_EVENTS 512   // Potencia de 2
+#define TRACE_MAX_TASKS 16
+#define TRACE_TASK_NAME_MAX 16
+#define TRACE_LINE_MAX 64
+
+enum TraceType : uint8_t {
+  TRACE_BEGIN = 'B',
+  TRACE_END = 'E',
+  TRACE_INSTANT = 'i',
+  TRACE_COMPLETE = 'X'   // `arg` = duración en us
+};
+
+// Reloj en us (puede dar la vuelta)
+typedef uint32_t (*TraceClockFn)();
+// Clave única de la tarea actual; en `name` su nombre (solo se pide la primera vez que se ve)
+typedef uintptr_t (*TraceTaskFn)(const char** name);
+
+// Arranca el registro (hasta aquí todo se ignora)
+void traceInit(TraceClockFn clock, TraceTaskFn task);
+void traceSetEnabled(bool enabled);
+bool traceEnabled();
+uint32_t traceNow();
+
+// `name` debe ser un literal sin espacios
+void traceBegin(const char* name, int32_t arg = 0);
+void traceEnd(const char* name, int32_t arg = 0);
+void traceInstant(const char* name, int32_t arg = 0);
+void traceComplete(const char* name, uint32_t start_us, uint32_t duration_us);
+
+struct TraceCursor {
+  uint32_t next;
+  uint32_t end;
+  uint8_t phase;
+  uint8_t task;
+  bool was_enabled;
+};
+
+// Pausa el registro y fija la ventana a volcar
+void traceCursorInit(TraceCursor& cursor);
+// Siguiente línea del volcado (sin salto de línea). false al terminar: el registro se reanuda.
+bool traceNextLine(TraceCursor& cursor, char* line, size_t size);
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// CACHÉ DE LA ÚLTIMA CONEXIÓN WI-FI (ARRANQUE RÁPIDO)
+// -------------------------------------------------------------------------
+// Guarda BSSID, canal y configuración IP de la última asociación buena.
+// Al arrancar se intenta primero una asociación directa (sin escaneo ni
+// DHCP) y solo si falla se hace la conexión completa.
+//
+// Se guarda en memoria RTC (sobrevive a reinicios por software, watchdog
+// y brownout leve) y en NVS (sobrevive a cortes de energía). La NVS solo
+// se escribe cuando los datos cambian, para cuidar la flash.
+
+struct WifiCache {
+  uint32_t magic;        // WIFI_CACHE_MAGIC (incluye la versión del formato)
+  uint32_t ssid_hash;    // La caché no vale si el firmware se compiló con otra red
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t crc;
+};
+
+// Busca una caché válida para `ssid`: primero en RTC, después en NVS.
+// `from_rtc` indica de dónde salió (diagnóstico).
+bool wifiCacheLoad(WifiCache& cache, const char* ssid, bool& from_rtc);
+
+// Guarda la asociación actual (completa magic, ssid_hash y crc)
+void wifiCacheSave(WifiCache& cache, const char* ssid);
+
+// Descarta la caché (la asociación directa falló: el AP cambió de canal, etc.)
+void wifiCacheClear();
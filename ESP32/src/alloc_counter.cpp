@@ -0,0 +1,116 @@
+#include "alloc_counter.h"
+
+#include <stdlib.h>
+
+#include "stall_monitor.h"
+
+#ifdef ESP_PLATFORM
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/task.h>
+  typedef TaskHandle_t AllocOwner;
+  static inline AllocOwner currentOwner() { return xTaskGetCurrentTaskHandle(); }
+#else
+  #include <pthread.h>
+  #include <new>
+  typedef pthread_t AllocOwner;
+  static inline AllocOwner currentOwner() { return pthread_self(); }
+#endif
+
+// Los de verdad (los resuelve el enlazador por --wrap)
+extern "C" void* __real_malloc(size_t size);
+extern "C" void* __real_calloc(size_t count, size_t size);
+extern "C" void* __real_realloc(void* ptr, size_t size);
+extern "C" void __real_free(void* ptr);
+
+static AllocCounters counters = {};
+static AllocOwner owner;
+static volatile bool ownerSet = false;
+static bool steady = false;  // Solo lo cambia (y solo cuenta) la tarea vigilada
+
+// Asignación de la tarea vigilada (solo ella escribe estos campos)
+static inline void countTracked(size_t size, void* caller) {
+  counters.tracked_allocs++;
+  counters.tracked_bytes += size;
+  if (steady) {
+    counters.steady_allocs++;
+    counters.steady_last_size = (uint32_t)size;
+    counters.steady_last_caller = stallCodeAddress(caller); // Para addr2line, como los de los bloqueos
+  }
+}
+
+static inline void countAlloc(void* ptr, size_t size, void* caller) {
+  if (ptr == nullptr) return;
+  // Atómico: se llama desde varias tareas (y en el ESP32, desde los dos núcleos)
+  __atomic_fetch_add(&counters.allocs, 1, __ATOMIC_RELAXED);
+  if (ownerSet && currentOwner() == owner) countTracked(size, caller);
+}
+
+extern "C" void* __wrap_malloc(size_t size) {
+  void* ptr = __real_malloc(size);
+  countAlloc(ptr, size, __builtin_return_address(0));
+  return ptr;
+}
+
+extern "C" void* __wrap_calloc(size_t count, size_t size) {
+  void* ptr = __real_calloc(count, size);
+  countAlloc(ptr, count * size, __builtin_return_address(0));
+  return ptr;
+}
+
+extern "C" void* __wrap_realloc(void* ptr, size_t size) {
+  void* moved = __real_realloc(ptr, size);
+  if (ptr == nullptr) {
+    countAlloc(moved, size, __builtin_return_address(0));
+  } else if (size == 0) {
+    __atomic_fetch_add(&counters.frees, 1, __ATOMIC_RELAXED);
+  } else if (moved != nullptr && ownerSet && currentOwner() == owner) {
+    // Crecer un bloque también es tocar el asignador (String::concat, por ejemplo)
+    countTracked(size, __builtin_return_address(0));
+  }
+  return moved;
+}
+
+extern "C" void __wrap_free(void* ptr) {
+  if (ptr != nullptr) __atomic_fetch_add(&counters.frees, 1, __ATOMIC_RELAXED);
+  __real_free(ptr);
+}
+
+#ifndef ESP_PLATFORM
+// En el host libstdc++ es una biblioteca compartida y su operator new no pasa por --wrap: se
+// reemplaza por uno que llama a malloc (en el ESP32 se enlaza estática y ya queda envuelta)
+void* operator new(size_t size) {
+  void* ptr = malloc(size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+#endif
+
+void allocCounterTrackCurrentTask() {
+  owner = currentOwner();
+  ownerSet = true;
+}
+
+void allocCounterRead(AllocCounters& out) {
+  out.allocs = __atomic_load_n(&counters.allocs, __ATOMIC_RELAXED);
+  out.frees = __atomic_load_n(&counters.frees, __ATOMIC_RELAXED);
+  out.tracked_allocs = counters.tracked_allocs;
+  out.tracked_bytes = counters.tracked_bytes;
+  out.steady_allocs = counters.steady_allocs;
+  out.steady_last_size = counters.steady_last_size;
+  out.steady_last_caller = counters.steady_last_caller;
+}
+
+uint32_t allocCounterTracked() {
+  return counters.tracked_allocs;
+}
+
+bool allocCounterSetSteady(bool value) {
+  bool previous = steady;
+  steady = value;
+  return previous;
+}
@@ -0,0 +1,47 @@
+#include "backoff.h"
+
+static uint32_t backoffRandom(Backoff& b) {
+  uint32_t x = b.rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  b.rng = x;
+  return x;
+}
+
+void backoffInit(Backoff& b, const BackoffConfig& cfg, uint32_t seed) {
+  b.cfg = cfg;
+  b.failures = 0;
+  b.next_ms = 0;
+  b.last_delay_ms = 0;
+  b.rng = seed != 0 ? seed : 0x9E3779B9u; // xorshift no admite estado 0
+}
+
+bool backoffReady(const Backoff& b, uint32_t now_ms) {
+  // Comparación con signo: sigue funcionando cuando millis() da la vuelta
+  return b.failures == 0 || (int32_t)(now_ms - b.next_ms) >= 0;
+}
+
+uint32_t backoffFailure(Backoff& b, uint32_t now_ms) {
+  // Tope exponencial sin desbordar: se deja de duplicar al alcanzar cap_ms
+  uint32_t ceiling = b.cfg.base_ms;
+  for (uint32_t i = 0; i < b.failures && ceiling < b.cfg.cap_ms; i++) {
+    ceiling *= 2;
+  }
+  if (ceiling > b.cfg.cap_ms) ceiling = b.cfg.cap_ms;
+
+  uint32_t delay_ms = ceiling;
+  if (b.cfg.jitter == BACKOFF_JITTER_FULL) {
+    delay_ms = backoffRandom(b) % (ceiling + 1);
+  }
+
+  if (b.failures < UINT32_MAX) b.failures++;
+  b.last_delay_ms = delay_ms;
+  b.next_ms = now_ms + delay_ms;
+  return delay_ms;
+}
+
+void backoffSuccess(Backoff& b) {
+  b.failures = 0;
+  b.last_delay_ms = 0;
+}
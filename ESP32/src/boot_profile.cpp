@@ -0,0 +1,25 @@
+#include "boot_profile.h"
+
+#include <string.h>
+
+void bootProfileInit(BootProfile& profile) {
+  memset(&profile, 0, sizeof(profile));
+}
+
+void bootPhaseEnd(BootProfile& profile, uint32_t now_us) {
+  if (!profile.open) return;
+  BootPhase& phase = profile.phases[profile.count - 1];
+  phase.duration_us = now_us - phase.start_us;
+  profile.open = false;
+}
+
+void bootPhaseBegin(BootProfile& profile, const char* name, uint32_t now_us) {
+  bootPhaseEnd(profile, now_us);
+  if (profile.count >= BOOT_PHASES_MAX) return;
+
+  BootPhase& phase = profile.phases[profile.count++];
+  phase.name = name;
+  phase.start_us = now_us;
+  phase.duration_us = 0;
+  profile.open = true;
+}
@@ -0,0 +1,128 @@
+#include "broker_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool brokerListParse(BrokerList& list, const char* text, uint16_t default_port) {
+  BrokerList parsed;
+  memset(&parsed, 0, sizeof(parsed));
+  parsed.active = -1;
+
+  const char* p = text;
+  while (p != nullptr && *p != '\0' && parsed.count < BROKER_LIST_MAX) {
+    const char* end = strchr(p, ',');
+    size_t len = end != nullptr ? (size_t)(end - p) : strlen(p);
+
+    // Recortar espacios
+    while (len > 0 && *p == ' ') { p++; len--; }
+    while (len > 0 && p[len - 1] == ' ') len--;
+
+    const char* colon = (const char*)memchr(p, ':', len);
+    size_t hostLen = colon != nullptr ? (size_t)(colon - p) : len;
+    long port = default_port;
+    if (colon != nullptr) {
+      char portText[8] = {};
+      size_t portLen = len - hostLen - 1;
+      if (portLen > 0 && portLen < sizeof(portText)) memcpy(portText, colon + 1, portLen);
+      port = strtol(portText, nullptr, 10);
+    }
+
+    if (hostLen > 0 && hostLen < BROKER_HOST_MAX && port > 0 && port <= 65535) {
+      BrokerEndpoint& ep = parsed.endpoints[parsed.count++];
+      memcpy(ep.host, p, hostLen);
+      ep.host[hostLen] = '\0';
+      ep.port = (uint16_t)port;
+      ep.rtt_ms = -1;
+      ep.failures = 0;
+    }
+    p = end != nullptr ? end + 1 : nullptr;
+  }
+
+  if (parsed.count == 0) return false;
+  list = parsed;
+  return true;
+}
+
+size_t brokerListFormat(const BrokerList& list, char* out, size_t size) {
+  if (size == 0) return 0;
+  size_t used = 0;
+  out[0] = '\0';
+  for (int i = 0; i < list.count; i++) {
+    int n = snprintf(out + used, size - used, "%s%s:%u", i > 0 ? "," : "",
+                     list.endpoints[i].host, (unsigned)list.endpoints[i].port);
+    if (n < 0 || (size_t)n >= size - used) break;
+    used += (size_t)n;
+  }
+  return used;
+}
+
+int brokerListSelect(BrokerList& list) {
+  if (list.count == 0) return -1;
+
+  // Si todos agotaron sus intentos se vuelve a empezar (puede ser una caída general de la red)
+  bool anyCandidate = false;
+  for (int i = 0; i < list.count; i++) {
+    if (list.endpoints[i].failures < BROKER_FAILOVER_FAILURES) anyCandidate = true;
+  }
+  if (!anyCandidate) {
+    for (int i = 0; i < list.count; i++) list.endpoints[i].failures = 0;
+  }
+
+  // Mejor latencia entre los candidatos que respondieron al sondeo
+  int32_t bestRtt = -1;
+  for (int i = 0; i < list.count; i++) {
+    const BrokerEndpoint& ep = list.endpoints[i];
+    if (ep.failures >= BROKER_FAILOVER_FAILURES || ep.rtt_ms < 0) continue;
+    if (bestRtt < 0 || ep.rtt_ms < bestRtt) bestRtt = ep.rtt_ms;
+  }
+
+  // El de mayor prioridad (menor índice) dentro del margen; sin sondeo, el de mayor prioridad
+  int chosen = -1;
+  for (int i = 0; i < list.count && chosen < 0; i++) {
+    const BrokerEndpoint& ep = list.endpoints[i];
+    if (ep.failures >= BROKER_FAILOVER_FAILURES) continue;
+    if (bestRtt < 0 || (ep.rtt_ms >= 0 && ep.rtt_ms <= bestRtt + BROKER_RTT_TIE_MS)) chosen = i;
+  }
+  if (chosen < 0) chosen = 0;
+
+  list.active = (int8_t)chosen;
+  return chosen;
+}
+
+const BrokerEndpoint* brokerListActive(const BrokerList& list) {
+  if (list.active < 0 || list.active >= list.count) return nullptr;
+  return &list.endpoints[list.active];
+}
+
+void brokerListReportFailure(BrokerList& list) {
+  if (list.active < 0 || list.active >= list.count) return;
+  BrokerEndpoint& ep = list.endpoints[list.active];
+  if (ep.failures < UINT8_MAX) ep.failures++;
+}
+
+void brokerListReportConnected(BrokerList& list) {
+  if (list.active < 0 || list.active >= list.count) return;
+  list.endpoints[list.active].failures = 0;
+}
+
+void brokerListSetRtt(BrokerList& list, int index, int32_t rtt_ms) {
+  if (index < 0 || index >= list.count) return;
+  list.endpoints[index].rtt_ms = rtt_ms;
+}
+
+bool brokerListShouldFailover(const BrokerList& list) {
+  const BrokerEndpoint* active = brokerListActive(list);
+  if (active == nullptr || list.count < 2 || active->failures == 0) return false;
+  if (active->failures >= BROKER_FAILOVER_FAILURES) return true;
+
+  // El activo no acepta ni TCP: no tiene sentido agotar sus intentos si otro responde
+  if (active->rtt_ms >= 0) return false;
+  for (int i = 0; i < list.count; i++) {
+    if (i != list.active && list.endpoints[i].rtt_ms >= 0 &&
+        list.endpoints[i].failures < BROKER_FAILOVER_FAILURES) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,57 @@
+#include "broker_probe.h"
+
+#include <string.h>
+#include <WiFi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Copia de los destinos y resultados: la tarea nunca toca la lista del loop
+static BrokerEndpoint probeTargets[BROKER_LIST_MAX];
+static int32_t probeRtt[BROKER_LIST_MAX];
+static uint8_t probeCount = 0;
+static volatile bool probeRunning = false;
+static volatile bool probeFinished = false;
+
+static void probeTask(void* arg) {
+  for (int i = 0; i < probeCount; i++) {
+    WiFiClient client;
+    unsigned long start = millis();
+    bool ok = client.connect(probeTargets[i].host, probeTargets[i].port, BROKER_PROBE_TIMEOUT_MS);
+    probeRtt[i] = ok ? (int32_t)(millis() - start) : -1;
+    client.stop();
+  }
+  probeFinished = true;
+  vTaskDelete(nullptr);
+}
+
+bool brokerProbeStart(const BrokerList& list) {
+  if (probeRunning) return false;
+
+  probeCount = list.count;
+  for (int i = 0; i < probeCount; i++) {
+    probeTargets[i] = list.endpoints[i];
+    probeRtt[i] = -1;
+  }
+  probeFinished = false;
+  probeRunning = true;
+
+  if (xTaskCreate(probeTask, "broker_probe", BROKER_PROBE_STACK, nullptr, 1, nullptr) != pdPASS) {
+    probeRunning = false;
+    return false;
+  }
+  return true;
+}
+
+bool brokerProbeDone(BrokerList& list) {
+  if (!probeRunning || !probeFinished) return false;
+  probeRunning = false;
+
+  // Solo si la lista no cambió mientras se sondeaba (se compara por host y puerto)
+  for (int i = 0; i < probeCount && i < list.count; i++) {
+    if (strcmp(list.endpoints[i].host, probeTargets[i].host) == 0 &&
+        list.endpoints[i].port == probeTargets[i].port) {
+      brokerListSetRtt(list, i, probeRtt[i]);
+    }
+  }
+  return true;
+}
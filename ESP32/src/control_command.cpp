@@ -0,0 +1,65 @@
+#include "control_command.h"
+
+#include <string.h>
+#include <ArduinoJson.h>
+
+#include "mqtt_transport.h"
+#include "time_service.h"
+
+// Un objeto con un solo campo y su texto (las demás claves las descarta el filtro)
+#define CONTROL_DOC_CAPACITY (JSON_OBJECT_SIZE(1) + CONTROL_COMMAND_MAX)
+#define CONTROL_FILTER_CAPACITY JSON_OBJECT_SIZE(1)
+
+static_assert(CONTROL_DOC_CAPACITY <= 128, "El documento del comando se reserva en la pila del loop");
+static_assert(MQTT_INBOUND_MAX <= UINT16_MAX, "El largo del payload se guarda en 16 bits");
+
+const char* controlCommandParse(const uint8_t* payload, size_t length, ControlAction& action) {
+  StaticJsonDocument<CONTROL_FILTER_CAPACITY> filter;
+  filter["command"] = true;
+
+  StaticJsonDocument<CONTROL_DOC_CAPACITY> doc;
+  DeserializationError error = deserializeJson(doc, payload, length, DeserializationOption::Filter(filter));
+  if (error == DeserializationError::NoMemory) return "UNKNOWN_COMMAND"; // Un "command" más largo que cualquiera válido
+  if (error) return "INVALID_JSON";
+
+  const char* command = doc["command"];
+  if (command == nullptr) return "MISSING_COMMAND";
+
+  if (strcmp(command, "START") == 0) {
+    action = CONTROL_START;
+  } else if (strcmp(command, "STOP") == 0) {
+    action = CONTROL_STOP;
+  } else {
+    return "UNKNOWN_COMMAND";
+  }
+  return nullptr;
+}
+
+const char* controlCommandHandle(const DeviceIdentity& identity, const char* topic, const uint8_t* payload,
+                                 size_t length, ControlPumpFn apply, int& pump_id) {
+  pump_id = CONTROL_PUMP_NONE;
+  ControlAction action;
+  const char* rejected = controlCommandParse(payload, length, action);
+  if (rejected != nullptr) return rejected;
+
+  // El número que está entre "{sitio}/{controlador}/pumps/" y "/control"
+  int parsed = 0;
+  if (!deviceParsePumpTopic(identity, topic, "control", parsed)) return "INVALID_TOPIC";
+  pump_id = parsed;
+  return apply(pump_id, action);
+}
+
+size_t controlCommandWriteReply(int pump_id, const char* result, const char* stamp, char* out, size_t size) {
+  // pump_id, result (literal, no se copia) y ts_ms (se copia)
+  static_assert(JSON_OBJECT_SIZE(3) + TIME_STAMP_WIDTH + 1 <= CONTROL_REPLY_MAX, "Respuesta a comando: documento chico");
+  StaticJsonDocument<CONTROL_REPLY_MAX> doc;
+  if (pump_id != CONTROL_PUMP_NONE) doc["pump_id"] = pump_id;
+  doc["result"] = result;
+  char field[TIME_STAMP_WIDTH + 1];
+  memcpy(field, stamp, TIME_STAMP_WIDTH);
+  field[TIME_STAMP_WIDTH] = '\0';
+  doc[TIME_STAMP_FIELD] = serialized((char*)field); // char* no constante: ArduinoJson lo copia
+
+  size_t n = serializeJson(doc, out, size);
+  return n < size ? n : 0;
+}
@@ -0,0 +1,320 @@
+#include "cpu_profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_idf_version.h>
+#include <esp_ipc.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+  #include <driver/gptimer.h>
+  #define PROFILER_GPTIMER 1
+#elif ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
+  #include <driver/timer.h>
+  #define PROFILER_LEGACY_TIMER 1
+#endif
+
+#define PROFILER_CORES portNUM_PROCESSORS
+#define PROFILER_PROBES 8             // Intentos de sondeo lineal antes de dar la muestra por perdida
+#define PROFILER_FLAG_ISR 0x01
+
+struct ProfileEntry {
+  uint32_t pc;       // 0 = libre
+  uint32_t count;    // A PROFILER_MAX_HZ tarda más de 9 días en desbordar
+  uint8_t task;
+  uint8_t flags;
+};
+
+struct CoreProfile {
+  ProfileEntry* entries;
+  TaskHandle_t tasks[PROFILER_MAX_TASKS];
+  char names[PROFILER_MAX_TASKS][configMAX_TASK_NAME_LEN]; // Copiados al verla: puede no existir al volcar
+  uint8_t task_count;
+  uint32_t samples;
+  uint32_t lost;
+  uint16_t used;
+#if PROFILER_GPTIMER
+  gptimer_handle_t timer;
+#elif PROFILER_LEGACY_TIMER
+  timer_isr_handle_t isr;
+#endif
+};
+
+static CoreProfile cores[PROFILER_CORES];
+static volatile bool running = false;
+static bool hasData = false;
+static uint32_t rateHz = 0;
+static int64_t startUs = 0;
+static int64_t stopUs = 0;
+
+// Índice de la tarea en la tabla del núcleo (PROFILER_MAX_TASKS = no entró)
+static inline uint8_t IRAM_ATTR taskIndex(CoreProfile& core, TaskHandle_t task) {
+  for (uint8_t i = 0; i < core.task_count; i++) {
+    if (core.tasks[i] == task) return i;
+  }
+  if (core.task_count >= PROFILER_MAX_TASKS) return PROFILER_MAX_TASKS;
+  core.tasks[core.task_count] = task;
+  strncpy(core.names[core.task_count], pcTaskGetName(task), configMAX_TASK_NAME_LEN - 1);
+  return core.task_count++;
+}
+
+// En la interrupción de nivel 3: EPC3 es el PC interrumpido y EPS3 el estado del procesador en ese momento
+static void IRAM_ATTR recordSample(CoreProfile& core) {
+  uint32_t pc = 0;
+  uint32_t ps = 0;
+#if defined(__XTENSA__)
+  asm volatile("rsr %0, epc3" : "=r"(pc));
+  asm volatile("rsr %0, eps3" : "=r"(ps));
+#endif
+  core.samples++;
+  if (pc == 0) return;
+
+  uint8_t task = taskIndex(core, xTaskGetCurrentTaskHandle());
+  uint8_t flags = (ps & 0x0F) != 0 ? PROFILER_FLAG_ISR : 0; // PS.INTLEVEL > 0: dentro de otra interrupción
+
+  uint32_t slot = (pc >> 2) * 2654435761u % PROFILER_TABLE_SIZE;
+  for (int probe = 0; probe < PROFILER_PROBES; probe++) {
+    ProfileEntry& entry = core.entries[(slot + probe) % PROFILER_TABLE_SIZE];
+    if (entry.pc == pc && entry.task == task && entry.flags == flags) {
+      entry.count++;
+      return;
+    }
+    if (entry.pc == 0) {
+      entry.pc = pc;
+      entry.task = task;
+      entry.flags = flags;
+      entry.count = 1;
+      core.used++;
+      return;
+    }
+  }
+  core.lost++;
+}
+
+#if PROFILER_GPTIMER
+
+static bool IRAM_ATTR onAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t* event, void* arg) {
+  recordSample(*(CoreProfile*)arg);
+  return false;
+}
+
+// Corre en el núcleo a perfilar (esp_ipc): la interrupción queda asignada a ese núcleo
+static void startOnCore(void* arg) {
+  CoreProfile& core = *(CoreProfile*)arg;
+  gptimer_config_t config = {};
+  config.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+  config.direction = GPTIMER_COUNT_UP;
+  config.resolution_hz = 1000000;
+  config.intr_priority = 3;
+  if (gptimer_new_timer(&config, &core.timer) != ESP_OK) {
+    core.timer = nullptr;
+    return;
+  }
+  gptimer_event_callbacks_t callbacks = {};
+  callbacks.on_alarm = onAlarm;
+  gptimer_register_event_callbacks(core.timer, &callbacks, &core);
+  gptimer_alarm_config_t alarm = {};
+  alarm.alarm_count = 1000000 / rateHz;
+  alarm.reload_count = 0;
+  alarm.flags.auto_reload_on_alarm = true;
+  gptimer_set_alarm_action(core.timer, &alarm);
+  gptimer_enable(core.timer);
+  gptimer_start(core.timer);
+}
+
+static void stopOnCore(void* arg) {
+  CoreProfile& core = *(CoreProfile*)arg;
+  if (core.timer == nullptr) return;
+  gptimer_stop(core.timer);
+  gptimer_disable(core.timer);
+  gptimer_del_timer(core.timer);
+  core.timer = nullptr;
+}
+
+static bool coreStarted(const CoreProfile& core) {
+  return core.timer != nullptr;
+}
+
+#elif PROFILER_LEGACY_TIMER
+
+// Grupo 1: el grupo 0 lo usan el perro guardián y las librerías de Arduino
+static void IRAM_ATTR onTimer(void* arg) {
+  CoreProfile& core = *(CoreProfile*)arg;
+  timer_idx_t idx = (timer_idx_t)(&core - cores);
+  timer_group_clr_intr_status_in_isr(TIMER_GROUP_1, idx);
+  timer_group_enable_alarm_in_isr(TIMER_GROUP_1, idx);
+  recordSample(core);
+}
+
+static void startOnCore(void* arg) {
+  CoreProfile& core = *(CoreProfile*)arg;
+  timer_idx_t idx = (timer_idx_t)(&core - cores);
+  timer_config_t config = {};
+  config.divider = 80; // 1 MHz con APB de 80 MHz
+  config.counter_dir = TIMER_COUNT_UP;
+  config.counter_en = TIMER_PAUSE;
+  config.alarm_en = TIMER_ALARM_EN;
+  config.auto_reload = TIMER_AUTORELOAD_EN;
+  config.intr_type = TIMER_INTR_LEVEL;
+  if (timer_init(TIMER_GROUP_1, idx, &config) != ESP_OK) return;
+  timer_set_counter_value(TIMER_GROUP_1, idx, 0);
+  timer_set_alarm_value(TIMER_GROUP_1, idx, 1000000 / rateHz);
+  timer_enable_intr(TIMER_GROUP_1, idx);
+  if (timer_isr_register(TIMER_GROUP_1, idx, onTimer, &core, ESP_INTR_FLAG_LEVEL3, &core.isr) != ESP_OK) {
+    core.isr = nullptr;
+    timer_deinit(TIMER_GROUP_1, idx);
+    return;
+  }
+  timer_start(TIMER_GROUP_1, idx);
+}
+
+static void stopOnCore(void* arg) {
+  CoreProfile& core = *(CoreProfile*)arg;
+  if (core.isr == nullptr) return;
+  timer_idx_t idx = (timer_idx_t)(&core - cores);
+  timer_pause(TIMER_GROUP_1, idx);
+  timer_disable_intr(TIMER_GROUP_1, idx);
+  esp_intr_free(core.isr);
+  timer_deinit(TIMER_GROUP_1, idx);
+  core.isr = nullptr;
+}
+
+static bool coreStarted(const CoreProfile& core) {
+  return core.isr != nullptr;
+}
+
+#else
+
+// ESP-IDF 5.0: gptimer todavía no permite elegir la prioridad de la interrupción
+static void startOnCore(void* arg) {}
+static void stopOnCore(void* arg) {}
+static bool coreStarted(const CoreProfile& core) { return false; }
+
+#endif
+
+void profilerRelease() {
+  if (running) return;
+  for (int c = 0; c < PROFILER_CORES; c++) {
+    if (cores[c].entries != nullptr) heap_caps_free(cores[c].entries);
+  }
+  memset(cores, 0, sizeof(cores));
+  hasData = false;
+}
+
+bool profilerStart(uint32_t rate_hz) {
+  if (running) return false;
+  if (rate_hz == 0 || rate_hz > PROFILER_MAX_HZ) rate_hz = PROFILER_DEFAULT_HZ;
+  profilerRelease();
+
+  for (int c = 0; c < PROFILER_CORES; c++) {
+    cores[c].entries = (ProfileEntry*)heap_caps_calloc(PROFILER_TABLE_SIZE, sizeof(ProfileEntry), MALLOC_CAP_INTERNAL);
+    if (cores[c].entries == nullptr) {
+      profilerRelease();
+      return false;
+    }
+  }
+
+  rateHz = rate_hz;
+  startUs = esp_timer_get_time();
+  running = true;
+  bool started = false;
+  for (int c = 0; c < PROFILER_CORES; c++) {
+    esp_ipc_call_blocking(c, startOnCore, &cores[c]);
+    started = started || coreStarted(cores[c]);
+  }
+  if (!started) {
+    running = false;
+    profilerRelease();
+    return false;
+  }
+  hasData = true;
+  return true;
+}
+
+void profilerStop() {
+  if (!running) return;
+  for (int c = 0; c < PROFILER_CORES; c++) esp_ipc_call_blocking(c, stopOnCore, &cores[c]);
+  stopUs = esp_timer_get_time();
+  running = false;
+}
+
+bool profilerRunning() {
+  return running;
+}
+
+bool profilerHasData() {
+  return hasData && !running;
+}
+
+void profilerSummary(ProfilerSummary& out) {
+  memset(&out, 0, sizeof(out));
+  out.rate_hz = rateHz;
+  out.duration_ms = (uint32_t)(((running ? esp_timer_get_time() : stopUs) - startUs) / 1000);
+  for (int c = 0; c < PROFILER_CORES; c++) {
+    out.samples += cores[c].samples;
+    out.lost += cores[c].lost;
+    out.entries += cores[c].used;
+  }
+}
+
+enum CursorPhase : uint8_t { CURSOR_HEADER = 0, CURSOR_TASKS, CURSOR_SAMPLES, CURSOR_END, CURSOR_DONE };
+
+void profilerCursorInit(ProfilerCursor& cursor) {
+  memset(&cursor, 0, sizeof(cursor));
+}
+
+bool profilerNextLine(ProfilerCursor& cursor, char* line, size_t size) {
+  if (!profilerHasData()) return false;
+  for (;;) {
+    switch (cursor.phase) {
+      case CURSOR_HEADER: {
+        ProfilerSummary summary;
+        profilerSummary(summary);
+        snprintf(line, size, "P %lu %lu %lu %lu", (unsigned long)summary.rate_hz, (unsigned long)summary.duration_ms,
+                 (unsigned long)summary.samples, (unsigned long)summary.lost);
+        cursor.phase = CURSOR_TASKS;
+        return true;
+      }
+      case CURSOR_TASKS:
+      case CURSOR_SAMPLES: {
+        if (cursor.core >= PROFILER_CORES) {
+          cursor.core = 0;
+          cursor.index = 0;
+          cursor.phase++;
+          continue;
+        }
+        const CoreProfile& core = cores[cursor.core];
+        if (cursor.phase == CURSOR_TASKS) {
+          if (cursor.index >= core.task_count) {
+            cursor.core++;
+            cursor.index = 0;
+            continue;
+          }
+          snprintf(line, size, "T %u %u %s", (unsigned)cursor.core, (unsigned)cursor.index, core.names[cursor.index]);
+          cursor.index++;
+          return true;
+        }
+        while (cursor.index < PROFILER_TABLE_SIZE && core.entries[cursor.index].pc == 0) cursor.index++;
+        if (cursor.index >= PROFILER_TABLE_SIZE) {
+          cursor.core++;
+          cursor.index = 0;
+          continue;
+        }
+        const ProfileEntry& entry = core.entries[cursor.index++];
+        snprintf(line, size, "S %u %u 0x%08lx %lu %u", (unsigned)cursor.core, (unsigned)entry.task,
+                 (unsigned long)entry.pc, (unsigned long)entry.count, (unsigned)(entry.flags & PROFILER_FLAG_ISR));
+        return true;
+      }
+      case CURSOR_END:
+        snprintf(line, size, "E");
+        cursor.phase = CURSOR_DONE;
+        return true;
+      default:
+        return false;
+    }
+  }
+}
@@ -0,0 +1,69 @@
+#include "device_identity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool deviceIdentityValidSegment(const char* segment, size_t max_size) {
+  if (segment == nullptr || segment[0] == '\0') return false;
+  size_t len = 0;
+  for (const char* p = segment; *p != '\0'; p++, len++) {
+    char c = *p;
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+    if (!ok || len + 1 >= max_size) return false;
+  }
+  return true;
+}
+
+void deviceIdentityFromMac(DeviceIdentity& id, const uint8_t mac[6], const char* site) {
+  snprintf(id.site, sizeof(id.site), "%s", site);
+  snprintf(id.controller, sizeof(id.controller), "ctl-%02x%02x%02x%02x%02x%02x",
+           mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  id.provisioned = false;
+}
+
+bool deviceIdentitySet(DeviceIdentity& id, const char* site, const char* controller) {
+  if (!deviceIdentityValidSegment(site, DEVICE_SITE_MAX) ||
+      !deviceIdentityValidSegment(controller, DEVICE_CONTROLLER_MAX)) {
+    return false;
+  }
+  snprintf(id.site, sizeof(id.site), "%s", site);
+  snprintf(id.controller, sizeof(id.controller), "%s", controller);
+  id.provisioned = true;
+  return true;
+}
+
+size_t deviceTopic(const DeviceIdentity& id, const char* suffix, char* out, size_t size) {
+  int n = snprintf(out, size, "%s/%s/%s", id.site, id.controller, suffix);
+  return (n > 0 && (size_t)n < size) ? (size_t)n : 0;
+}
+
+size_t deviceSiteTopic(const DeviceIdentity& id, const char* suffix, char* out, size_t size) {
+  int n = snprintf(out, size, "%s/%s", id.site, suffix);
+  return (n > 0 && (size_t)n < size) ? (size_t)n : 0;
+}
+
+size_t devicePumpTopic(const DeviceIdentity& id, int pump_id, const char* leaf, char* out, size_t size) {
+  int n = pump_id < 0
+      ? snprintf(out, size, "%s/%s/pumps/+/%s", id.site, id.controller, leaf)
+      : snprintf(out, size, "%s/%s/pumps/%d/%s", id.site, id.controller, pump_id, leaf);
+  return (n > 0 && (size_t)n < size) ? (size_t)n : 0;
+}
+
+bool deviceParsePumpTopic(const DeviceIdentity& id, const char* topic, const char* leaf, int& pump_id) {
+  // Prefijo "{sitio}/{controlador}/pumps/"
+  size_t siteLen = strlen(id.site);
+  size_t ctlLen = strlen(id.controller);
+  if (strncmp(topic, id.site, siteLen) != 0 || topic[siteLen] != '/') return false;
+  topic += siteLen + 1;
+  if (strncmp(topic, id.controller, ctlLen) != 0 || topic[ctlLen] != '/') return false;
+  topic += ctlLen + 1;
+  if (strncmp(topic, "pumps/", 6) != 0) return false;
+  topic += 6;
+
+  char* end = nullptr;
+  long value = strtol(topic, &end, 10);
+  if (end == topic || *end != '/' || value < 0 || strcmp(end + 1, leaf) != 0) return false;
+  pump_id = (int)value;
+  return true;
+}
@@ -0,0 +1,23 @@
+#include "dsp.h"
+
+#include <math.h>
+
+float dspAcRms(const uint16_t* samples, size_t count, float units_per_count) {
+  if (samples == nullptr || count == 0) return 0.0f;
+
+  // 1. Offset DC (promedio del bloque)
+  uint32_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += samples[i];
+  }
+  float mean = (float)sum / (float)count;
+
+  // 2. Suma de cuadrados de la componente alterna
+  float sumSquares = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    float centered = (float)samples[i] - mean;
+    sumSquares += centered * centered;
+  }
+
+  return sqrtf(sumSquares / (float)count) * units_per_count;
+}
@@ -0,0 +1,60 @@
+#include "energy_meter.h"
+
+void energyMeterInit(EnergyMeter& meter, const EnergyMeterConfig& cfg, double stored_kwh, double stored_m3) {
+  meter.cfg = cfg;
+  meter.total_kwh = stored_kwh;
+  meter.total_m3 = stored_m3;
+  meter.interval_kwh = 0.0;
+  meter.interval_m3 = 0.0;
+  meter.unsaved_kwh = 0.0;
+  meter.last_power_w = 0.0f;
+  meter.last_sample_ms = 0;
+  meter.has_sample = false;
+}
+
+void energyMeterSample(EnergyMeter& meter, float amps_rms, bool running, uint32_t now_ms) {
+  float power_w = running ? amps_rms * meter.cfg.voltage_v * meter.cfg.power_factor : 0.0f;
+  if (power_w < 0.0f) power_w = 0.0f;
+
+  if (meter.has_sample) {
+    uint32_t dt_ms = now_ms - meter.last_sample_ms; // Aritmética sin signo: tolera el desborde de millis()
+
+    if (dt_ms > 0 && dt_ms <= ENERGY_MAX_GAP_MS) {
+      double hours = (double)dt_ms / 3600000.0;
+
+      // Regla del trapecio entre la muestra anterior y la actual (Wh -> kWh)
+      double kwh = ((double)meter.last_power_w + (double)power_w) * 0.5 * hours / 1000.0;
+      meter.total_kwh += kwh;
+      meter.interval_kwh += kwh;
+      meter.unsaved_kwh += kwh;
+
+      // Volumen bombeado: solo cuenta mientras la bomba está en marcha
+      if (running) {
+        double m3 = (double)meter.cfg.nominal_flow_lpm * ((double)dt_ms / 60000.0) / 1000.0;
+        meter.total_m3 += m3;
+        meter.interval_m3 += m3;
+      }
+    }
+  }
+
+  meter.last_power_w = power_w;
+  meter.last_sample_ms = now_ms;
+  meter.has_sample = true;
+}
+
+double energyMeterCloseInterval(EnergyMeter& meter, double* interval_m3) {
+  double kwh = meter.interval_kwh;
+  if (interval_m3 != nullptr) *interval_m3 = meter.interval_m3;
+  meter.interval_kwh = 0.0;
+  meter.interval_m3 = 0.0;
+  return kwh;
+}
+
+float energyMeterKwhPerM3(const EnergyMeter& meter) {
+  if (meter.total_m3 <= 0.0) return 0.0f;
+  return (float)(meter.total_kwh / meter.total_m3);
+}
+
+void energyMeterMarkPersisted(EnergyMeter& meter) {
+  meter.unsaved_kwh = 0.0;
+}
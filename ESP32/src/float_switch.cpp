@@ -0,0 +1,39 @@
+#include "float_switch.h"
+
+void floatDebouncerInit(FloatDebouncer& debouncer) {
+  debouncer.stable_wet = false;
+  debouncer.initialized = false;
+  debouncer.changed_us = 0;
+}
+
+bool floatDebouncerUpdate(FloatDebouncer& debouncer, FloatSwitchId id, bool raw_wet,
+                          uint32_t last_edge_us, uint32_t now_us, FloatLevelEvent& event) {
+  // Primera lectura: se toma como estado inicial sin generar evento
+  if (!debouncer.initialized) {
+    debouncer.stable_wet = raw_wet;
+    debouncer.initialized = true;
+    debouncer.changed_us = now_us;
+    return false;
+  }
+
+  if (raw_wet == debouncer.stable_wet) return false;
+
+  // Todavía rebotando: esperar a que el pin se quede quieto
+  if (now_us - last_edge_us < FLOAT_DEBOUNCE_US) return false;
+
+  debouncer.stable_wet = raw_wet;
+  debouncer.changed_us = last_edge_us;
+
+  event.id = id;
+  event.wet = raw_wet;
+  event.edge_us = last_edge_us;
+  event.detected_us = now_us;
+  return true;
+}
+
+const char* floatLevelEventName(const FloatLevelEvent& event) {
+  if (event.id == FLOAT_SWITCH_HIGH) {
+    return event.wet ? "TANK_FULL" : "BELOW_FULL";
+  }
+  return event.wet ? "ABOVE_EMPTY" : "TANK_EMPTY";
+}
@@ -0,0 +1,75 @@
+#include "heap_monitor.h"
+
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Tareas que se vigilan (las del framework según su nombre en FreeRTOS)
+static const char* const MONITORED_TASKS[HEAP_MONITOR_TASKS] = {
+  "loopTask",        // setup() y loop()
+  "stall_mon",       // Detector de bloqueos (stall_monitor.h)
+  "log_drain",       // Salida del log (log_ring.h)
+  "mqtt_task",       // Cliente esp-mqtt
+  "tiT",             // Pila TCP/IP (lwIP)
+  "wifi",            // Controlador Wi-Fi
+  "sys_evt",         // Eventos del sistema (ESP-IDF 4)
+  "arduino_events",  // Eventos de WiFi.h
+  "esp_timer",
+};
+
+static volatile uint32_t failedAllocs = 0;
+static volatile uint32_t lastFailedSize = 0;
+
+// La llama el asignador cuando un pedido no se puede cumplir (puede ser cualquier tarea)
+static void onAllocFailed(size_t size, uint32_t caps, const char* function_name) {
+  failedAllocs = failedAllocs + 1;
+  lastFailedSize = size;
+}
+
+void heapMonitorBegin() {
+  heap_caps_register_failed_alloc_callback(onAllocFailed);
+}
+
+void heapMonitorSample(HeapSnapshot& out) {
+  out.free_bytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  out.min_free_bytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  out.largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  out.fragmentation_pct = out.free_bytes == 0
+    ? 100
+    : (uint8_t)(100 - (uint64_t)out.largest_block * 100 / out.free_bytes);
+  out.failed_allocs = failedAllocs;
+  out.last_failed_size = lastFailedSize;
+
+  out.stack_count = 0;
+  for (int i = 0; i < HEAP_MONITOR_TASKS; i++) {
+    TaskHandle_t task = xTaskGetHandle(MONITORED_TASKS[i]);
+    if (task == nullptr) continue;
+    TaskStackInfo& info = out.stacks[out.stack_count++];
+    info.name = MONITORED_TASKS[i];
+    info.free_bytes = uxTaskGetStackHighWaterMark(task); // En ESP-IDF viene en bytes
+  }
+}
+
+uint8_t heapMonitorWarnings(const HeapSnapshot& snapshot, uint32_t failed_seen) {
+  uint8_t warnings = 0;
+  if (snapshot.free_bytes < HEAP_WARN_FREE_BYTES) warnings |= HEAP_WARN_LOW_FREE;
+  if (snapshot.largest_block < HEAP_WARN_LARGEST_BLOCK_BYTES) warnings |= HEAP_WARN_SMALL_BLOCK;
+  if (snapshot.fragmentation_pct > HEAP_WARN_FRAGMENTATION_PCT) warnings |= HEAP_WARN_FRAGMENTED;
+  if (snapshot.failed_allocs != failed_seen) warnings |= HEAP_WARN_ALLOC_FAILED;
+  for (uint8_t i = 0; i < snapshot.stack_count; i++) {
+    if (snapshot.stacks[i].free_bytes < HEAP_WARN_STACK_BYTES) warnings |= HEAP_WARN_STACK;
+  }
+  return warnings;
+}
+
+const char* heapWarningName(HeapWarning warning) {
+  switch (warning) {
+    case HEAP_WARN_LOW_FREE: return "low_free";
+    case HEAP_WARN_SMALL_BLOCK: return "small_block";
+    case HEAP_WARN_FRAGMENTED: return "fragmented";
+    case HEAP_WARN_STACK: return "stack";
+    case HEAP_WARN_ALLOC_FAILED: return "alloc_failed";
+    case HEAP_WARN_STEADY_ALLOC: return "steady_alloc";
+  }
+  return "unknown";
+}
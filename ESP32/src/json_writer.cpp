@@ -0,0 +1,171 @@
+#include "json_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void jsonWriterInit(JsonWriter& w, char* buf, size_t capacity, JsonGrowFn grow, void* grow_ctx) {
+  w.buf = buf;
+  w.capacity = capacity;
+  w.length = 0;
+  w.failed = false;
+  w.need_comma = false;
+  w.grow = grow;
+  w.grow_ctx = grow_ctx;
+}
+
+// Asegura lugar para `n` bytes más
+static bool reserve(JsonWriter& w, size_t n) {
+  if (w.failed) return false;
+  if (w.length + n <= w.capacity) return true;
+  if (w.grow != nullptr && w.grow(w.grow_ctx, w.buf, w.capacity, w.length) && w.length + n <= w.capacity) {
+    return true;
+  }
+  w.failed = true;
+  return false;
+}
+
+static void put(JsonWriter& w, const char* data, size_t n) {
+  if (!reserve(w, n)) return;
+  memcpy(w.buf + w.length, data, n);
+  w.length += n;
+}
+
+static void putChar(JsonWriter& w, char c) {
+  if (!reserve(w, 1)) return;
+  w.buf[w.length++] = c;
+}
+
+// Coma si hace falta y la clave (las claves son identificadores: no se escapan)
+static void beginValue(JsonWriter& w, const char* key) {
+  if (w.need_comma) putChar(w, ',');
+  if (key != nullptr) {
+    putChar(w, '"');
+    put(w, key, strlen(key));
+    put(w, "\":", 2);
+  }
+  w.need_comma = true;
+}
+
+void jsonBeginObject(JsonWriter& w, const char* key) {
+  beginValue(w, key);
+  putChar(w, '{');
+  w.need_comma = false;
+}
+
+void jsonEndObject(JsonWriter& w) {
+  putChar(w, '}');
+  w.need_comma = true;
+}
+
+void jsonBeginArray(JsonWriter& w, const char* key) {
+  beginValue(w, key);
+  putChar(w, '[');
+  w.need_comma = false;
+}
+
+void jsonEndArray(JsonWriter& w) {
+  putChar(w, ']');
+  w.need_comma = true;
+}
+
+// Dígitos de `value` al final de `end` (hacia atrás); devuelve el comienzo
+static char* formatUnsigned(uint64_t value, char* end) {
+  do {
+    *--end = (char)('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  return end;
+}
+
+void jsonInt(JsonWriter& w, const char* key, int64_t value) {
+  char text[JSON_INT_MAX_CHARS];
+  char* end = text + sizeof(text);
+  uint64_t magnitude = value < 0 ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+  char* start = formatUnsigned(magnitude, end);
+  if (value < 0) *--start = '-';
+  beginValue(w, key);
+  put(w, start, end - start);
+}
+
+static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+#define JSON_FLOAT_DECIMALS_MAX 9
+#define JSON_FLOAT_FIXED_LIMIT 1e10  // Desde aquí se usa notación exponencial
+
+void jsonFloat(JsonWriter& w, const char* key, double value, uint8_t decimals) {
+  if (isnan(value) || isinf(value)) {
+    jsonNull(w, key);
+    return;
+  }
+  if (decimals > JSON_FLOAT_DECIMALS_MAX) decimals = JSON_FLOAT_DECIMALS_MAX;
+
+  char text[JSON_FLOAT_MAX_CHARS(JSON_FLOAT_DECIMALS_MAX)];
+  size_t n = 0;
+  double magnitude = fabs(value);
+  if (magnitude >= JSON_FLOAT_FIXED_LIMIT) {
+    n = (size_t)snprintf(text, sizeof(text), "%.6g", value); // Fuera de rango físico: no es el caso común
+  } else {
+    // Entero y fracción redondeados juntos (9.9999 con 2 decimales da 10)
+    uint64_t scaled = (uint64_t)(magnitude * POW10[decimals] + 0.5);
+    uint64_t whole = scaled / (uint64_t)POW10[decimals];
+    uint64_t fraction = scaled % (uint64_t)POW10[decimals];
+
+    char* end = text + sizeof(text);
+    char* start = end;
+    uint8_t digits = decimals;
+    while (digits > 0 && fraction % 10 == 0) { // Sin ceros finales
+      fraction /= 10;
+      digits--;
+    }
+    if (digits > 0) {
+      for (uint8_t i = 0; i < digits; i++) {
+        *--start = (char)('0' + fraction % 10);
+        fraction /= 10;
+      }
+      *--start = '.';
+    }
+    start = formatUnsigned(whole, start);
+    if (value < 0 && scaled != 0) *--start = '-';
+    n = end - start;
+    memmove(text, start, n);
+  }
+  beginValue(w, key);
+  put(w, text, n);
+}
+
+void jsonBool(JsonWriter& w, const char* key, bool value) {
+  beginValue(w, key);
+  if (value) put(w, "true", 4);
+  else put(w, "false", 5);
+}
+
+void jsonNull(JsonWriter& w, const char* key) {
+  beginValue(w, key);
+  put(w, "null", 4);
+}
+
+void jsonString(JsonWriter& w, const char* key, const char* value) {
+  beginValue(w, key);
+  putChar(w, '"');
+  for (const char* c = value; *c != '\0'; c++) {
+    unsigned char ch = (unsigned char)*c;
+    if (ch == '"' || ch == '\\') {
+      char escaped[2] = {'\\', (char)ch};
+      put(w, escaped, 2);
+    } else if (ch < 0x20) {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+      put(w, escaped, 6);
+    } else {
+      putChar(w, (char)ch);
+    }
+  }
+  putChar(w, '"');
+}
+
+size_t jsonRaw(JsonWriter& w, const char* key, const char* value, size_t length) {
+  beginValue(w, key);
+  size_t offset = w.length;
+  put(w, value, length);
+  return w.failed ? 0 : offset;
+}
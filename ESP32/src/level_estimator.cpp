@@ -0,0 +1,142 @@
+#include "level_estimator.h"
+
+#include <math.h>
+
+// Umbral de rechazo: innovación mayor a 3 sigma
+#define LEVEL_GATE_SIGMAS2 9.0f
+// Tras este número de rechazos seguidos se asume que la estimación es la que está mal
+#define LEVEL_MAX_REJECTED 5
+// Intervalo máximo de predicción (evita saltos tras un bloqueo largo del loop)
+#define LEVEL_MAX_PREDICT_MS 60000
+
+void levelEstimatorInit(LevelEstimator& est, const TankVolumeTable* table, const LevelEstimatorConfig& cfg) {
+  est.cfg = cfg;
+  est.table = table;
+  est.height_cm = (float)table->height_cm * 0.5f;
+  est.variance_cm2 = (float)(table->height_cm * table->height_cm); // Sin información
+  est.initialized = false;
+  est.last_ms = 0;
+  est.last_high_wet = -1;
+  est.last_low_wet = -1;
+  est.rejected_streak = 0;
+}
+
+static void clampToTank(LevelEstimator& est) {
+  if (est.height_cm < 0.0f) est.height_cm = 0.0f;
+  if (est.height_cm > (float)est.table->height_cm) est.height_cm = (float)est.table->height_cm;
+}
+
+// Corrección escalar estándar de Kalman
+static void correct(LevelEstimator& est, float measured_cm, float r_cm2) {
+  float gain = est.variance_cm2 / (est.variance_cm2 + r_cm2);
+  est.height_cm += gain * (measured_cm - est.height_cm);
+  est.variance_cm2 *= (1.0f - gain);
+  clampToTank(est);
+}
+
+void levelEstimatorPredict(LevelEstimator& est, float net_inflow_lpm, uint32_t now_ms) {
+  if (est.last_ms == 0) {
+    est.last_ms = now_ms;
+    return;
+  }
+
+  uint32_t dt_ms = now_ms - est.last_ms;
+  est.last_ms = now_ms;
+  if (dt_ms == 0) return;
+  if (dt_ms > LEVEL_MAX_PREDICT_MS) dt_ms = LEVEL_MAX_PREDICT_MS;
+
+  float minutes = (float)dt_ms / 60000.0f;
+  float litersPerCm = tankLitersPerCm(*est.table, est.height_cm);
+  if (litersPerCm > 0.0f) {
+    est.height_cm += net_inflow_lpm * minutes / litersPerCm;
+    clampToTank(est);
+  }
+
+  est.variance_cm2 += est.cfg.process_sigma_cm * est.cfg.process_sigma_cm * minutes;
+}
+
+bool levelEstimatorUpdateUltrasonic(LevelEstimator& est, float height_cm) {
+  if (isnan(height_cm)) return false;
+
+  float r = est.cfg.ultrasonic_sigma_cm * est.cfg.ultrasonic_sigma_cm;
+
+  // Primera medición válida: inicializar directamente
+  if (!est.initialized) {
+    est.height_cm = height_cm;
+    est.variance_cm2 = r;
+    est.initialized = true;
+    clampToTank(est);
+    return true;
+  }
+
+  float innovation = height_cm - est.height_cm;
+  float s = est.variance_cm2 + r;
+  if (innovation * innovation > LEVEL_GATE_SIGMAS2 * s && est.rejected_streak < LEVEL_MAX_REJECTED) {
+    est.rejected_streak++;
+    return false;
+  }
+
+  // Varios rechazos seguidos: la medición es consistente y la estimación se quedó atrás
+  if (est.rejected_streak >= LEVEL_MAX_REJECTED) {
+    est.variance_cm2 += innovation * innovation;
+  }
+  est.rejected_streak = 0;
+  correct(est, height_cm, r);
+  return true;
+}
+
+void levelEstimatorUpdateFloats(LevelEstimator& est, bool high_wet, bool low_wet) {
+  // Estado imposible (superior sumergido con inferior seco): flotador trabado, se ignora
+  if (high_wet && !low_wet) return;
+
+  float r = est.cfg.float_sigma_cm * est.cfg.float_sigma_cm;
+  bool highChanged = est.last_high_wet >= 0 && (bool)est.last_high_wet != high_wet;
+  bool lowChanged = est.last_low_wet >= 0 && (bool)est.last_low_wet != low_wet;
+  est.last_high_wet = high_wet;
+  est.last_low_wet = low_wet;
+
+  // 1. Cruce de flotador: ancla precisa a la altura de montaje
+  if (highChanged) {
+    correct(est, est.cfg.high_float_cm, r);
+    est.initialized = true;
+  } else if (lowChanged) {
+    correct(est, est.cfg.low_float_cm, r);
+    est.initialized = true;
+  }
+
+  // 2. Restricción de intervalo según el estado actual de los flotadores
+  float minCm = 0.0f;
+  float maxCm = (float)est.table->height_cm;
+  if (high_wet) {
+    minCm = est.cfg.high_float_cm;
+  } else if (low_wet) {
+    minCm = est.cfg.low_float_cm;
+    maxCm = est.cfg.high_float_cm;
+  } else {
+    maxCm = est.cfg.low_float_cm;
+  }
+
+  if (!est.initialized) {
+    // Sin ultrasonido todavía: centro del intervalo con varianza uniforme
+    float width = maxCm - minCm;
+    est.height_cm = 0.5f * (minCm + maxCm);
+    est.variance_cm2 = width * width / 12.0f;
+    return;
+  }
+
+  if (est.height_cm < minCm) {
+    est.height_cm = minCm;
+    if (est.variance_cm2 > r) est.variance_cm2 = r;
+  } else if (est.height_cm > maxCm) {
+    est.height_cm = maxCm;
+    if (est.variance_cm2 > r) est.variance_cm2 = r;
+  }
+}
+
+float levelEstimatorPercent(const LevelEstimator& est) {
+  return est.height_cm / (float)est.table->height_cm * 100.0f;
+}
+
+float levelEstimatorSigmaPercent(const LevelEstimator& est) {
+  return sqrtf(est.variance_cm2) / (float)est.table->height_cm * 100.0f;
+}
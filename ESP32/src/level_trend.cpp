@@ -0,0 +1,57 @@
+#include "level_trend.h"
+
+#include <string.h>
+
+void levelTrendInit(LevelTrend& trend) {
+  memset(&trend, 0, sizeof(trend));
+}
+
+void levelTrendAdd(LevelTrend& trend, float liters, uint32_t now_ms) {
+  trend.t_ms[trend.head] = now_ms;
+  trend.liters[trend.head] = liters;
+  trend.head = (trend.head + 1) % LEVEL_TREND_SAMPLES;
+  if (trend.count < LEVEL_TREND_SAMPLES) trend.count++;
+}
+
+bool levelTrendEstimate(const LevelTrend& trend, float capacity_liters, LevelTrendEstimate& out) {
+  if (trend.count < 4) return false;
+
+  // Índice de la muestra más antigua; los tiempos se toman relativos a ella
+  // para no perder precisión en float con millis() grandes.
+  int oldest = (trend.head + LEVEL_TREND_SAMPLES - trend.count) % LEVEL_TREND_SAMPLES;
+  uint32_t t0 = trend.t_ms[oldest];
+
+  float sumX = 0.0f, sumY = 0.0f, sumXY = 0.0f, sumXX = 0.0f;
+  for (int k = 0; k < trend.count; k++) {
+    int i = (oldest + k) % LEVEL_TREND_SAMPLES;
+    float x = (float)(trend.t_ms[i] - t0) / 60000.0f; // minutos
+    float y = trend.liters[i];
+    sumX += x;
+    sumY += y;
+    sumXY += x * y;
+    sumXX += x * x;
+  }
+
+  float n = (float)trend.count;
+  float denom = n * sumXX - sumX * sumX;
+  if (denom <= 0.0f) return false;
+
+  float slope = (n * sumXY - sumX * sumY) / denom;
+  float intercept = (sumY - slope * sumX) / n;
+
+  // Volumen actual según la recta (menos ruidoso que la última muestra)
+  int newest = (trend.head + LEVEL_TREND_SAMPLES - 1) % LEVEL_TREND_SAMPLES;
+  float now_liters = intercept + slope * ((float)(trend.t_ms[newest] - t0) / 60000.0f);
+  if (now_liters < 0.0f) now_liters = 0.0f;
+  if (now_liters > capacity_liters) now_liters = capacity_liters;
+
+  out.slope_lpm = slope;
+  out.minutes_to_empty = -1.0f;
+  out.minutes_to_full = -1.0f;
+  if (slope <= -LEVEL_TREND_MIN_SLOPE_LPM) {
+    out.minutes_to_empty = now_liters / -slope;
+  } else if (slope >= LEVEL_TREND_MIN_SLOPE_LPM) {
+    out.minutes_to_full = (capacity_liters - now_liters) / slope;
+  }
+  return true;
+}
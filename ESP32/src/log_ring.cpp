@@ -0,0 +1,184 @@
+#include "log_ring.h"
+
+#include <stdio.h>
+
+LogRing logRing = {};
+uint32_t (*logClock)() = nullptr;
+
+void logRingInit(LogRing& ring, LogSlot* slots, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) slots[i].seq.store(i, std::memory_order_relaxed);
+  ring.mask = count - 1;
+  ring.head.store(0, std::memory_order_relaxed);
+  ring.tail.store(0, std::memory_order_relaxed);
+  ring.written.store(0, std::memory_order_relaxed);
+  ring.dropped.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  ring.slots = slots;
+}
+
+// Cada lugar lleva un número de secuencia: igual a la posición = libre para esa vuelta,
+// posición + 1 = escrito, posición + tamaño = leído (libre para la vuelta siguiente)
+LogRecord* logRingReserve(LogRing& ring) {
+  if (ring.slots == nullptr) return nullptr;
+  uint32_t pos = ring.head.load(std::memory_order_relaxed);
+  for (;;) {
+    LogSlot& slot = ring.slots[pos & ring.mask];
+    int32_t diff = (int32_t)(slot.seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (ring.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return &slot.record;
+    } else if (diff < 0) {
+      ring.dropped.fetch_add(1, std::memory_order_relaxed); // Lleno: el consumidor no alcanzó
+      return nullptr;
+    } else {
+      pos = ring.head.load(std::memory_order_relaxed);    // Otro productor tomó este lugar
+    }
+  }
+}
+
+void logRingCommit(LogRing& ring, LogRecord* record) {
+  LogSlot* slot = (LogSlot*)((uint8_t*)record - offsetof(LogSlot, record));
+  uint32_t pos = slot->seq.load(std::memory_order_relaxed);
+  slot->seq.store(pos + 1, std::memory_order_release);
+  ring.written.fetch_add(1, std::memory_order_relaxed);
+}
+
+const LogRecord* logRingPeek(LogRing& ring) {
+  if (ring.slots == nullptr) return nullptr;
+  uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+  LogSlot& slot = ring.slots[tail & ring.mask];
+  if (slot.seq.load(std::memory_order_acquire) != tail + 1) return nullptr;
+  return &slot.record;
+}
+
+void logRingRelease(LogRing& ring) {
+  uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+  LogSlot& slot = ring.slots[tail & ring.mask];
+  slot.seq.store(tail + ring.mask + 1, std::memory_order_release);
+  ring.tail.store(tail + 1, std::memory_order_relaxed);
+}
+
+uint32_t logRingPending(const LogRing& ring) {
+  return ring.head.load(std::memory_order_relaxed) - ring.tail.load(std::memory_order_relaxed);
+}
+
+bool logRingForward(LogRing& ring, const LogRecord& record) {
+  LogRecord* copy = logRingReserve(ring);
+  if (copy == nullptr) return false;
+  *copy = record;
+  logRingCommit(ring, copy);
+  return true;
+}
+
+const char* logLevelName(uint8_t level) {
+  switch (level) {
+    case LOG_LEVEL_ERROR: return "error";
+    case LOG_LEVEL_WARN: return "warn";
+    case LOG_LEVEL_INFO: return "info";
+    case LOG_LEVEL_DEBUG: return "debug";
+    default: return "none";
+  }
+}
+
+// Agrega `text` a la salida; devuelve la nueva longitud (se corta sin pasarse de `size` - 1)
+static size_t append(char* out, size_t size, size_t n, const char* text, size_t length) {
+  if (n + 1 >= size) return n;
+  if (length > size - 1 - n) length = size - 1 - n;
+  memcpy(out + n, text, length);
+  return n + length;
+}
+
+static const char* argText(const LogRecord& record, const LogArg& arg) {
+  return arg.u < record.text_used ? record.text + arg.u : "";
+}
+
+// Recorre el formato y resuelve cada conversión con su argumento guardado. Los modificadores de
+// longitud originales se reemplazan: los enteros se guardaron con 64 bits y los reales como double.
+size_t logFormat(const LogRecord& record, char* out, size_t size) {
+  if (size == 0) return 0;
+  size_t n = 0;
+  uint8_t next = 0;
+  const char* f = record.format;
+
+  while (*f != '\0' && n + 1 < size) {
+    const char* percent = strchr(f, '%');
+    if (percent == nullptr) {
+      n = append(out, size, n, f, strlen(f));
+      break;
+    }
+    n = append(out, size, n, f, percent - f);
+    f = percent + 1;
+    if (*f == '%') {
+      n = append(out, size, n, "%", 1);
+      f++;
+      continue;
+    }
+
+    // Banderas, ancho y precisión se copian tal cual ('*' toma su valor de los argumentos)
+    char spec[24] = "%";
+    size_t s = 1;
+    while (*f != '\0' && strchr("-+ #0123456789.*", *f) != nullptr && s < sizeof(spec) - 8) {
+      if (*f == '*') {
+        long star = next < record.argc ? (long)record.args[next++].i : 0;
+        s += snprintf(spec + s, sizeof(spec) - s, "%ld", star);
+      } else {
+        spec[s++] = *f;
+      }
+      f++;
+    }
+    while (*f != '\0' && strchr("hlLqjzt", *f) != nullptr) f++;
+    char conversion = *f;
+    if (conversion == '\0') break;
+    f++;
+
+    if (next >= record.argc) {
+      n = append(out, size, n, "?", 1); // Argumento que no entró en el registro
+      continue;
+    }
+    const LogArg& arg = record.args[next++];
+    char value[48];
+    int length;
+    switch (conversion) {
+      case 'd': case 'i':
+        memcpy(spec + s, "lld", 4);
+        length = snprintf(value, sizeof(value), spec, (long long)arg.i);
+        break;
+      case 'u': case 'x': case 'X': case 'o':
+        spec[s++] = 'l';
+        spec[s++] = 'l';
+        spec[s++] = conversion;
+        spec[s] = '\0';
+        length = snprintf(value, sizeof(value), spec, (unsigned long long)arg.u);
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec[s++] = conversion;
+        spec[s] = '\0';
+        length = snprintf(value, sizeof(value), spec, arg.f);
+        break;
+      case 'c':
+        memcpy(spec + s, "c", 2);
+        length = snprintf(value, sizeof(value), spec, (int)arg.i);
+        break;
+      case 's':
+        if (s == 1) {
+          // Sin ancho ni precisión se copia entera: `value` es chico para una cadena de LOG_TEXT_MAX
+          const char* text = argText(record, arg);
+          n = append(out, size, n, text, strlen(text));
+          continue;
+        }
+        memcpy(spec + s, "s", 2);
+        length = snprintf(value, sizeof(value), spec, argText(record, arg));
+        break;
+      case 'p':
+        memcpy(spec + s, "p", 2);
+        length = snprintf(value, sizeof(value), spec, arg.p);
+        break;
+      default:
+        length = 0;
+        break;
+    }
+    if (length > 0) n = append(out, size, n, value, (size_t)length < sizeof(value) ? (size_t)length : sizeof(value) - 1);
+  }
+
+  out[n] = '\0';
+  return n;
+}
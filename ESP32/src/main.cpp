@@ -1,7 +1,47 @@
 #include <WiFi.h>
-#include <PubSubClient.h>
 #include <ArduinoJson.h>
 #include <cstdlib>
+#include <sys/time.h>
+#include <esp_timer.h>
+#include <esp_sntp.h>
+#include <esp_system.h>
+#include <esp_rom_sys.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "dsp.h"
+#include "energy_meter.h"
+#include "nvs_store.h"
+#include "tank_balance.h"
+#include "tank_geometry.h"
+#include "level_trend.h"
+#include "level_estimator.h"
+#include "float_switch.h"
+#include "mqtt_esp.h"
+#include "mqtt_publisher.h"
+#include "publish_profiles.h"
+#include "backoff.h"
+#include "broker_list.h"
+#include "broker_probe.h"
+#include "device_identity.h"
+#include "wifi_cache.h"
+#include "boot_profile.h"
+#include "time_service.h"
+#include "stage_metrics.h"
+#include "stall_monitor.h"
+#include "alloc_counter.h"
+#include "heap_monitor.h"
+#include "telemetry_payload.h"
+#include "control_command.h"
+#include "json_writer.h"
+#include "log_ring.h"
+#include "cpu_profiler.h"
+#include "trace_recorder.h"
+#include "tank_controller.h"
+#include "plant_config.h"
+#include "sensor_capture.h"
+#include "sim_plant.h"
+#include "scenario.h"
 
 // -------------------------------------------------------------------------
 // 0. MODOS DE OPERACIÓN
@@ -15,6 +55,7 @@
 */
 #define PUMP_MODE 1  // El modo 0 es prueba offline, el 1 es prueba online o produccion
 #define SENSOR_SIMULATION true // Indica si la data va a ser simulada o no
+#define FIRMWARE_VERSION "1.5.0" // Se reporta en la ficha y en el perfil de arranque
 #define STRIZE_REAL(x) #x
 #define STRIZE(x) STRIZE_REAL(x)
 
@@ -24,34 +65,93 @@
 
 const char* ssid = SSID_VAR;
 const char* password = PASSWD_VAR;
-const char* mqtt_server = IP_VAR; // IP de tu Broker
+const char* mqtt_server = IP_VAR; // Broker por defecto si la NVS no tiene lista (ver broker_list.h)
 const int mqtt_port = 1883;
 const int baudrate = 115200;
 
-const char* clientID = "ESP32_Pump_Controller";
+// Identidad del controlador: sitio + ID único (MAC o provisionado en NVS). El ID es también el client ID
+// MQTT, así dos controladores en el mismo broker no se expulsan entre sí (ver device_identity.h)
+DeviceIdentity identity;
 
 // Constantes de control
 #define RELAY_PIN_PUMP_1 27 // Pin de Relé para Bomba 1 (Pin de ejemplo)
 #define RELAY_PIN_PUMP_2 26 // Pin de Relé para Bomba 2 (Pin de ejemplo)
 
-// Estructura para gestionar el estado de cada bomba
+// Estructura para gestionar cada bomba (su estado y su medidor de energía están en tankController,
+// mismo índice; los datos del motor en plant_config.h)
 struct Pump {
   int id;
   int relayPin;
-  bool is_on; // Estado actual de la bomba (para simulación)
 };
 
 // Array para las dos bombas
 Pump pumps[] = {
-  {1, RELAY_PIN_PUMP_1, false},
-  {2, RELAY_PIN_PUMP_2, false}
+  {1, RELAY_PIN_PUMP_1},
+  {2, RELAY_PIN_PUMP_2}
 };
 const int NUM_PUMPS = 2; // Cantidad total de bombas
+static_assert(NUM_PUMPS == TANK_PUMPS, "Las bombas del firmware y las del controlador deben coincidir");
 
-// El topic de monitoreo se maneja directamente en publishTelemetry ya que se hace para cada bomba
+// Los totales se guardan en NVS cada cierto tiempo o al acumular suficiente energía (cuidar el desgaste de la flash)
+#define ENERGY_PERSIST_INTERVAL_MS 600000 // 10 minutos
+#define ENERGY_PERSIST_MIN_KWH 0.05
+unsigned long lastEnergyPersist = 0;
 
-// Control
-const char* CONTROL_TOPIC_SUBSCRIPTION = "caracas/pumps/+/control";
+// Tópicos bajo "{sitio}/{controlador}/", armados en setup() a partir de la identidad.
+// El topic de monitoreo se arma en publishTelemetry ya que se hace para cada bomba.
+
+// Control ({sitio}/{controlador}/pumps/+/control)
+char controlTopicSubscription[MQTT_TOPIC_MAX];
+
+// Alertas del tanque (fugas detectadas por balance de masa)
+char tankAlertTopic[MQTT_TOPIC_MAX];
+
+// Eventos de cruce de nivel de los flotadores (se publican en el momento, fuera del ciclo de telemetría)
+char levelEventTopic[MQTT_TOPIC_MAX];
+
+// Configuración del controlador (brokers, identidad). El ACL del broker debe limitar quién publica aquí.
+char controllerConfigTopic[MQTT_TOPIC_MAX];
+
+// Ficha del controlador (retenida): permite al backend descubrir los controladores de cada sitio
+char controllerInfoTopic[MQTT_TOPIC_MAX];
+
+// "Muestrear ahora" para todo el sitio ({sitio}/sample): instantáneas consistentes de la flota
+char sampleTriggerTopic[MQTT_TOPIC_MAX];
+
+// Histogramas de latencia por etapa ({sitio}/{controlador}/metrics, ver stage_metrics.h)
+char metricsTopic[MQTT_TOPIC_MAX];
+
+// Bloqueos del loop registrados por stall_monitor (se suben al conectar)
+char stallsTopic[MQTT_TOPIC_MAX];
+uint32_t stallUploadSeq = 0; // Registro subiéndose, esperando el PUBACK (0 = ninguno)
+
+// Tópico de diagnóstico: {sitio}/{controlador}/diagnostics (heap, pilas y asignaciones)
+char diagnosticsTopic[MQTT_TOPIC_MAX];
+
+// Perfilador de CPU: órdenes en {sitio}/{controlador}/profile/set, volcado en .../profile (ver cpu_profiler.h)
+char profileControlTopic[MQTT_TOPIC_MAX];
+char profileTopic[MQTT_TOPIC_MAX];
+
+// Traza de eventos: órdenes en {sitio}/{controlador}/trace/set, volcado en .../trace (ver trace_recorder.h)
+char traceControlTopic[MQTT_TOPIC_MAX];
+char traceTopic[MQTT_TOPIC_MAX];
+
+// Captura de sensores: órdenes en {sitio}/{controlador}/capture/set, lecturas en .../capture (ver sensor_capture.h)
+char captureControlTopic[MQTT_TOPIC_MAX];
+char captureTopic[MQTT_TOPIC_MAX];
+
+// Escenarios del modo simulación: guion de texto en {sitio}/{controlador}/scenario/set (ver scenario.h)
+char scenarioControlTopic[MQTT_TOPIC_MAX];
+
+// Advertencias y errores del log ({sitio}/{controlador}/log, ver serviceLogSink())
+char logTopic[MQTT_TOPIC_MAX];
+
+// Métricas del arranque (se publican una vez, tras la primera telemetría)
+char bootMetricsTopic[MQTT_TOPIC_MAX];
+
+// Reinicio programado tras cambiar la identidad (da tiempo a que salga la respuesta)
+#define IDENTITY_RESTART_DELAY_MS 3000
+unsigned long restartAt = 0;
 
 // -------------------------------------------------------------------------
 // 2. CONFIGURACIÓN DE SENSORES Y VARIABLES
@@ -65,155 +165,1555 @@ const char* CONTROL_TOPIC_SUBSCRIPTION = "caracas/pumps/+/control";
   // Pines para el sensor ultrasónico
   #define ULTRASONIC_TRIG 5  // Pin Trig
   #define ULTRASONIC_ECHO 18 // Pin Echo
-
-  // Parámetros físicos del tanque (necesarios para el cálculo en el caso ultrasónico)
-  const float TANK_HEIGHT_CM = 200.0; // Altura total del tanque en cm (ej: 2 metros)
-  const float EMPTY_DISTANCE_CM = 180.0; // Distancia desde el sensor hasta el nivel "0%" (fondo del tanque)
 #endif
 
-float current_amps = 0.0;
-float water_level_percent = 70.0;
-bool is_flow_detected = true;
-float current_inflow_rate = 155.5;
+// Tanque, geometría y montaje de los sensores: ver plant_config.h.
+// Nivel fusionado, balance, tendencia, energía por bomba, flotadores y reglas de control (ver
+// tank_controller.h); aquí solo se leen los sensores y se accionan los relés.
+TankController tankController;
+
+// --- Flotadores por interrupción ---
+// La ISR solo marca el instante del último flanco; el antirrebote se evalúa en cada vuelta del loop
+volatile uint32_t floatEdgeUs[FLOAT_SWITCH_COUNT] = {0, 0};
+
+// Captura de lecturas crudas (ver sensor_capture.h): el buffer se reserva al empezar
+#define CAPTURE_BUFFER_BYTES 8192
+SensorCapture sensorCapture;
+char* captureBuffer = nullptr;
+// Flotadores: en la captura van solo los cambios; al empezar, el estado de partida
+bool captureFloatsPending = false;
+bool capturedFloatRaw[FLOAT_SWITCH_COUNT];
+uint32_t capturedFloatEdgeUs[FLOAT_SWITCH_COUNT];
+
+#if SENSOR_SIMULATION
+  // Modo simulación: planta simulada y escenario que la mueve (ver la sección de escenarios)
+  SimPlant simPlant;
+  Scenario scenario;
+  bool scenarioBrokerDown = false; // "broker down": la cola de salida no se despacha (la conexión real sigue)
+  bool scenarioReported = false;
+#else
+  const bool scenarioBrokerDown = false;
+#endif
 
 long lastMsg = 0;
 #define PUBLISH_INTERVAL 5000 // Publicar cada 5 segundos (5000 ms)
+
+// Muestreo alineado: con hora NTP, la telemetría se toma en los múltiplos de PUBLISH_INTERVAL de la
+// hora real (…:00, …:05, …) en vez de en la fase libre de millis(). Así todos los controladores leen
+// en el mismo instante y el backend puede sumar la flota por límite ("slot_ms" en el JSON).
+// Sin NTP se sigue con el intervalo de millis().
+#define TELEMETRY_CLOCK_ALIGNED true
+#define SAMPLE_TRIGGER_MAX_AHEAD_MS 10000 // Un "sample now" para más adelante que esto se toma en el acto
+
+// Próximas muestras programadas (instante monótono en us, 0 = ninguna) y su límite en hora real (ms)
+int64_t alignedSampleMono = 0;
+int64_t alignedSlotMs = 0;
+int64_t triggerSampleMono = 0;
+int64_t triggerSlotMs = 0;
 #define WIFI_TIMEOUT_MS 60000 // Esperar 1 minuto (60000 ms) para la conexión Wi-Fi
 
-WiFiClient espClient;
-PubSubClient client(espClient);
+// Arranque rápido: asociación directa al último AP (BSSID + canal, sin escaneo) y con la última IP
+// (sin DHCP). Si no conecta en WIFI_FAST_TIMEOUT_MS se descarta la caché y se hace la conexión completa.
+#define WIFI_FAST_TIMEOUT_MS 3000
+#define WIFI_FAST_STATIC_IP true // Conviene una reserva DHCP para la MAC del equipo (evita conflictos de IP)
+
+// Tiempos del arranque, en ms desde el encendido (0 = todavía no ocurrió)
+struct BootMetrics {
+  const char* wifi_path;           // "fast_rtc", "fast_nvs", "full", "fallback" (directa falló) o "none"
+  unsigned long wifi_ms;           // Wi-Fi con IP
+  unsigned long mqtt_ms;           // Primera conexión MQTT
+  unsigned long first_publish_ms;  // Primera telemetría que la cola pasó al transporte conectado
+  unsigned long ntp_ms;            // Primera sincronización NTP
+  bool reported;
+};
+BootMetrics bootMetrics = {"none", 0, 0, 0, 0, false};
+BootProfile bootProfile; // Fases de setup() (ver boot_profile.h)
+
+// El perfil de arranque espera la hora NTP como máximo esto después de la primera telemetría
+#define BOOT_PROFILE_NTP_WAIT_MS 30000
+bool telemetryNow = false; // Publicar la telemetría sin esperar el intervalo (primera conexión)
+
+// Hora de las muestras: reloj monótono + correspondencia con NTP (ver time_service.h)
+TimeService timeService;
+
+// Latencia de cada etapa del ciclo; se publica y reinicia cada METRICS_INTERVAL_MS
+StageMetrics stageMetrics;
+#define METRICS_INTERVAL_MS 60000
+
+// Memoria: se revisa cada HEAP_CHECK_INTERVAL_MS; el diagnóstico sale cada DIAGNOSTICS_INTERVAL_MS
+// o en el acto si aparece un aviso nuevo (umbrales en heap_monitor.h)
+#define HEAP_CHECK_INTERVAL_MS 10000
+#define DIAGNOSTICS_INTERVAL_MS 300000
+unsigned long lastHeapCheck = 0;
+unsigned long lastDiagnostics = 0;
+uint8_t heapWarnings = 0;       // Avisos activos (HeapWarning)
+uint32_t failedAllocsSeen = 0;  // Pedidos fallidos ya avisados
+
+// Asignaciones del loop por etapa desde el arranque (incluye las de las etapas anidadas)
+uint32_t stageAllocs[STAGE_COUNT];
+#define STAGE_ALLOC_DEPTH 8
+uint32_t stageAllocMarks[STAGE_ALLOC_DEPTH];
+bool stageSteadyPrevious[STAGE_ALLOC_DEPTH];
+uint8_t stageAllocDepth = 0;
+
+// Las etapas más cortas que esto no van a la traza: las de cada vuelta del loop llenarían el anillo
+// en milisegundos y taparían lo que interesa (0 = todas)
+#define TRACE_STAGE_MIN_US 200
+
+// Régimen estable sin memoria dinámica: pasados los primeros ciclos de telemetría (inicializaciones
+// perezosas de drivers y de la libc), el ciclo muestra -> JSON -> cola y los manejadores de comandos
+// no deben asignar nada. Una asignación ahí se avisa en el diagnóstico ("steady_alloc") con la
+// dirección que llamó a malloc. La escritura en NVS queda fuera: su asignador interno reserva al
+// rotar páginas.
+#define STEADY_STATE_ALLOC_CHECK true
+#define STEADY_STATE_WARMUP_CYCLES 3
+bool steadyStateArmed = false;
+uint32_t telemetryCycles = 0;
+uint32_t steadyAllocsSeen = 0;
+
+bool isSteadyStage(MetricStage stage) {
+  switch (stage) {
+    case STAGE_TELEMETRY:
+    case STAGE_SENSORS:
+    case STAGE_SERIALIZE:
+    case STAGE_ULTRASONIC:
+    case STAGE_TEMPERATURE:
+    case STAGE_HANDLER_CONTROL:
+    case STAGE_HANDLER_SAMPLE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Reintentos de Wi-Fi y MQTT: cada uno con su propio backoff exponencial con jitter completo,
+// para que la flota no reconecte en bloque cuando el broker o el punto de acceso se reinician
+// (simulación de flota en tools/reconnect_sim.cpp)
+const BackoffConfig WIFI_BACKOFF = {2000, 60000, BACKOFF_JITTER_FULL};
+const BackoffConfig MQTT_BACKOFF = {1000, 30000, BACKOFF_JITTER_FULL};
+#define WIFI_ATTEMPT_WINDOW_MS 10000  // Tiempo que se deja a una asociación Wi-Fi antes de contarla como fallida
+#define MQTT_ATTEMPT_TIMEOUT_MS 30000 // Si el cliente no informa el resultado de un intento, se da por fallido
+Backoff wifiBackoff;
+Backoff mqttBackoff;
+bool wifiWasConnected = false;
+bool mqttAttemptPending = false;
+unsigned long mqttAttemptStart = 0;
+
+// Brokers candidatos (NVS) y estado de la conmutación por falla
+BrokerList brokers;
+bool brokersProbed = false;       // Sondeo inicial hecho (se elige el de menor latencia antes de conectar)
+bool brokerProbePending = false;
+bool mqttWasConnected = false;
+unsigned long mqttLostAt = 0;     // Para medir cuánto tarda en volver (con o sin cambio de broker)
+
+// Cliente MQTT asíncrono (esp-mqtt) y cola de salida con prioridades: publicar nunca bloquea el loop
+EspMqttTransport mqttTransport;
+MqttPublisher mqttPublisher;
+bool mqttStarted = false;
+#define MQTT_QOS_DEFAULT 1
+#define MQTT_QOS_TELEMETRY 0 // Periódica: la cola propia ya la retiene sin conexión
 
 // -------------------------------------------------------------------------
 // 3. FUNCIONES DE CONEXIÓN
 // -------------------------------------------------------------------------
 
+// Log asíncrono (ver log_ring.h): los LOG_x de cualquier tarea quedan en el anillo y esta tarea, de
+// baja prioridad, los formatea y escribe en el puerto serie (el único que escribe en él). Lo que
+// llega a LOG_MQTT_LEVEL se copia además a un anillo chico que el loop publica (serviceLogSink()).
+#define LOG_LINE_MAX 192          // Una línea más larga se corta
+#define LOG_RING_SLOTS 32         // Potencia de 2
+#define LOG_SINK_SLOTS 8
+#define LOG_DRAIN_STACK 3072
+#define LOG_DRAIN_IDLE_MS 10      // Espera con el anillo vacío
+#define LOG_MQTT_SINK true        // Publicar advertencias y errores en {sitio}/{controlador}/log
+#define LOG_MQTT_LEVEL LOG_LEVEL_WARN
+#define LOG_SINK_PER_LOOP 2
+
+static LogSlot logSlots[LOG_RING_SLOTS];
+static LogSlot logSinkSlots[LOG_SINK_SLOTS];
+LogRing logSinkRing = {};
+TaskHandle_t logDrainHandle = nullptr;
+
+uint32_t logMillis() {
+  return millis();
+}
+
+void logDrainTask(void* arg) {
+  static char line[LOG_LINE_MAX];
+  uint32_t droppedReported = 0;
+  for (;;) {
+    const LogRecord* record = logRingPeek(logRing);
+    if (record == nullptr) {
+      uint32_t dropped = logRing.dropped.load(std::memory_order_relaxed);
+      if (dropped != droppedReported) {
+        int n = snprintf(line, sizeof(line), "⚠️ %lu líneas de log descartadas (anillo lleno)\n",
+                         (unsigned long)(dropped - droppedReported));
+        Serial.write((const uint8_t*)line, n < (int)sizeof(line) ? (size_t)n : sizeof(line) - 1);
+        droppedReported = dropped;
+      }
+      vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_IDLE_MS));
+      continue;
+    }
+
+    size_t n = logFormat(*record, line, sizeof(line));
+    #if LOG_MQTT_SINK
+      if (record->level != LOG_LEVEL_NONE && record->level <= LOG_MQTT_LEVEL) logRingForward(logSinkRing, *record);
+    #endif
+    logRingRelease(logRing);
+    traceBegin("uart_write", (int32_t)n);
+    Serial.write((const uint8_t*)line, n); // Si el UART está lleno espera esta tarea, no el loop
+    traceEnd("uart_write");
+  }
+}
+
+// esp_restart() (ESP.restart(): cambio de identidad, corte del escenario): lo que quedó en el anillo
+// sale antes de reiniciar, directo al UART por la ROM. La tarea del log se suspende primero (es el
+// único consumidor y podría tener tomado el Serial). Un pánico o el watchdog no pasan por aquí: esas
+// líneas (hasta LOG_RING_SLOTS) se pierden; dónde estaba el loop queda en el anillo RTC de stall_monitor.
+void logFlushOnRestart() {
+  if (logDrainHandle != nullptr) vTaskSuspend(logDrainHandle);
+  static char line[LOG_LINE_MAX];
+  const LogRecord* record;
+  while ((record = logRingPeek(logRing)) != nullptr) {
+    logFormat(*record, line, sizeof(line));
+    logRingRelease(logRing);
+    esp_rom_printf("%s", line);
+  }
+}
+
+// Desde aquí todo el log pasa por el anillo
+void logBegin() {
+  logClock = logMillis;
+  logRingInit(logSinkRing, logSinkSlots, LOG_SINK_SLOTS);
+  logRingInit(logRing, logSlots, LOG_RING_SLOTS);
+  xTaskCreatePinnedToCore(logDrainTask, "log_drain", LOG_DRAIN_STACK, nullptr, tskIDLE_PRIORITY + 1,
+                          &logDrainHandle, 0);
+  esp_register_shutdown_handler(logFlushOnRestart);
+}
+
+// Espera la conexión Wi-Fi hasta `timeoutMs`
+bool waitForWifi(unsigned long timeoutMs) {
+  unsigned long startTime = millis();
+  unsigned long lastDot = startTime;
+  while (WiFi.status() != WL_CONNECTED && (millis() - startTime < timeoutMs)) {
+    delay(20);
+    if (millis() - lastDot >= 500) {
+      lastDot = millis();
+      LOG_I(".");
+    }
+  }
+  return WiFi.status() == WL_CONNECTED;
+}
+
+// Guarda BSSID, canal e IP de la conexión actual para el próximo arranque
+void saveWifiCache() {
+  WifiCache cache;
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = (uint8_t)WiFi.channel();
+  cache.ip = (uint32_t)WiFi.localIP();
+  cache.gateway = (uint32_t)WiFi.gatewayIP();
+  cache.subnet = (uint32_t)WiFi.subnetMask();
+  cache.dns = (uint32_t)WiFi.dnsIP();
+  wifiCacheSave(cache, ssid);
+}
+
 void setup_wifi() {
   // Ignorar Wi-Fi si estamos en el modo OFFLINE
   #if !PUMP_MODE
-    Serial.println("MODO OFFLINE_TEST: Saltando conexión Wi-Fi.");
+    LOG_I("MODO OFFLINE_TEST: Saltando conexión Wi-Fi.\n");
     return;
   #else
     delay(10);
-    Serial.print("Conectando a ");
-    Serial.println(ssid);
-    Serial.print("MAC Address: "); // F8:B3:B7:20:61:58 es la del ESP32 que estoy usando
-    Serial.println(WiFi.macAddress());
-
-    WiFi.begin(ssid, password);
-    
-    long startTime = millis();
+    LOG_I("Conectando a %s\n", ssid);
+    LOG_I("MAC Address: %s\n", WiFi.macAddress().c_str()); // F8:B3:B7:20:61:58 es la del ESP32 que estoy usando
+
+    // La caché propia reemplaza a la del SDK (que escribe la flash en cada conexión);
+    // los reintentos los programa maintainWifi() con backoff, no el driver
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
+
+    // 1. Asociación directa con la caché (RTC tras un reinicio, NVS tras un corte de energía)
+    WifiCache cache;
+    bool fromRtc = false;
+    bool triedFast = wifiCacheLoad(cache, ssid, fromRtc);
+    if (triedFast) {
+      LOG_I("Arranque rápido: canal %u, caché en %s\n", (unsigned)cache.channel, fromRtc ? "RTC" : "NVS");
+      #if WIFI_FAST_STATIC_IP
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+      #endif
+      WiFi.begin(ssid, password, cache.channel, cache.bssid);
+
+      if (waitForWifi(WIFI_FAST_TIMEOUT_MS)) {
+        bootMetrics.wifi_path = fromRtc ? "fast_rtc" : "fast_nvs";
+      } else {
+        LOG_W("\n⚠️ Asociación directa fallida, conexión completa (escaneo + DHCP)\n");
+        wifiCacheClear();
+        WiFi.disconnect();
+        #if WIFI_FAST_STATIC_IP
+          WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0)); // Volver a DHCP
+        #endif
+      }
+    }
 
-    while (WiFi.status() != WL_CONNECTED && (millis() - startTime < WIFI_TIMEOUT_MS)) {
-      delay(500);
-      Serial.print(".");
+    // 2. Conexión completa
+    if (WiFi.status() != WL_CONNECTED) {
+      WiFi.begin(ssid, password);
+      if (waitForWifi(WIFI_TIMEOUT_MS)) bootMetrics.wifi_path = triedFast ? "fallback" : "full";
     }
 
     if (WiFi.status() == WL_CONNECTED) {
-      Serial.println("\n✅ WiFi conectado!");
-      Serial.print("Dirección IP: ");
-      Serial.println(WiFi.localIP());
+      bootMetrics.wifi_ms = millis();
+      LOG_I("\n✅ WiFi conectado en %lu ms (%s)\n", bootMetrics.wifi_ms, bootMetrics.wifi_path);
+      wifiWasConnected = true;
+      LOG_I("Dirección IP: %s\n", WiFi.localIP().toString().c_str());
+      saveWifiCache();
     } else {
-      Serial.println("\n❌ Falla al conectar Wi-Fi después de 1 minuto. Procediendo sin conexión...");
+      LOG_E("\n❌ Falla al conectar Wi-Fi después de 1 minuto. Procediendo sin conexión...\n");
       // Forzar modo OFFLINE si falla la conexión después del timeout
       // Esto es un diagnóstico, pero mantenemos el loop activo para reintentos o simulación.
     }
   #endif
 }
 
-void reconnect() {
-  // Ignorar MQTT si no hay Wi-Fi o estamos en modo OFFLINE
-  #if !PUMP_MODE
-    return;
-  #else
-    while (!client.connected() && WiFi.status() == WL_CONNECTED) {
-      Serial.print("Intentando conexión MQTT...");
-      if (client.connect(clientID, "esp32", "SecurePass123")) {
-        Serial.println("conectado");
-        
-        // SUSCRIPCIÓN GENÉRICA PARA EL CONTROL DE CUALQUIER BOMBA
-        client.subscribe(CONTROL_TOPIC_SUBSCRIPTION); 
-        Serial.print("Suscrito al control genérico: ");
-        Serial.println(CONTROL_TOPIC_SUBSCRIPTION);
-        
-      } else {
-        Serial.print("falló, rc=");
-        Serial.print(client.state());
-        Serial.println(" Intentando de nuevo en 5 segundos...");
-        delay(5000);
+// --- Eventos del transporte MQTT (se ejecutan dentro de mqttTransport.poll(), en el loop) ---
+
+void publishControllerInfo();
+
+void onMqttConnected(bool sessionPresent) {
+  const BrokerEndpoint* broker = brokerListActive(brokers);
+  LOG_I("✅ MQTT conectado a %s:%u\n", broker->host, (unsigned)broker->port);
+  if (bootMetrics.mqtt_ms == 0) {
+    bootMetrics.mqtt_ms = millis();
+    telemetryNow = true; // La primera telemetría sale ya, no al cumplirse el intervalo
+  }
+  if (mqttLostAt != 0) {
+    LOG_I("Servicio MQTT recuperado en %lu ms\n", millis() - mqttLostAt);
+    mqttLostAt = 0;
+  }
+  mqttAttemptPending = false;
+  mqttWasConnected = true;
+  backoffSuccess(mqttBackoff);
+  brokerListReportConnected(brokers);
+
+  // Sesión nueva (otro broker o sesión vencida): las suscripciones se rehacen en cada conexión
+  // y la cola de salida se vacía sola al volver la conexión
+
+  // SUSCRIPCIÓN GENÉRICA PARA EL CONTROL DE CUALQUIER BOMBA
+  mqttTransport.subscribe(controlTopicSubscription, 1);
+  LOG_I("Suscrito al control genérico: %s\n", controlTopicSubscription);
+  mqttTransport.subscribe(controllerConfigTopic, 1);
+  mqttTransport.subscribe(sampleTriggerTopic, 0);
+  mqttTransport.subscribe(profileControlTopic, 1);
+  mqttTransport.subscribe(traceControlTopic, 1);
+  mqttTransport.subscribe(captureControlTopic, 1);
+  mqttTransport.subscribe(scenarioControlTopic, 1);
+
+  publishControllerInfo();
+}
+
+void onMqttDisconnected() {
+  // Se recibe tanto al perder la conexión como al fallar un intento
+  mqttAttemptPending = false;
+  if (mqttWasConnected) {
+    mqttWasConnected = false;
+    mqttLostAt = millis();
+  }
+  brokerListReportFailure(brokers);
+
+  // Con más de un broker se mide la latencia de todos para decidir si conviene cambiar
+  if (brokers.count > 1 && !brokerProbePending) {
+    brokerProbePending = brokerProbeStart(brokers);
+  }
+
+  uint32_t delayMs = backoffFailure(mqttBackoff, millis());
+  LOG_W("❌ MQTT desconectado (fallo %u), siguiente intento en %u ms\n",
+                (unsigned)mqttBackoff.failures, (unsigned)delayMs);
+  mqttPublisherOnDisconnected(mqttPublisher);
+}
+
+void onMqttPublished(int msgId) {
+  mqttPublisherOnPublished(mqttPublisher, msgId, millis());
+}
+
+void onMqttDeleted(int msgId) {
+  LOG_W("⚠️ MQTT: el mensaje %d venció sin PUBACK\n", msgId);
+  mqttPublisherOnDeleted(mqttPublisher, msgId);
+}
+
+void callback(const char* topic, const uint8_t* payload, size_t length, const MqttMessageProperties& props);
+
+// Arranca el cliente MQTT la primera vez que hay Wi-Fi; los reintentos los pide maintainMqtt()
+void startMqtt() {
+  #if PUMP_MODE
+    if (mqttStarted || WiFi.status() != WL_CONNECTED) return;
+
+    brokerListSelect(brokers);
+    const BrokerEndpoint* broker = brokerListActive(brokers);
+    MqttConnectConfig config = {broker->host, broker->port, identity.controller, "esp32", "SecurePass123"};
+    MqttTransportHandler handler = {onMqttConnected, onMqttDisconnected, onMqttPublished, callback, onMqttDeleted};
+    mqttStarted = mqttTransport.begin(config, handler);
+    mqttAttemptPending = mqttStarted;
+    mqttAttemptStart = millis();
+
+    LOG_I("Iniciando cliente MQTT hacia %s:%u (%d ms)\n", broker->host, (unsigned)broker->port,
+                  (int)broker->rtt_ms);
+  #endif
+}
+
+// Wi-Fi: si se cae, reintenta según su backoff. Cada intento tiene una ventana para asociarse;
+// la espera con jitter empieza a contar al cerrarse esa ventana.
+void maintainWifi() {
+  #if PUMP_MODE
+    unsigned long now = millis();
+    if (WiFi.status() == WL_CONNECTED) {
+      if (!wifiWasConnected) {
+        LOG_I("✅ WiFi reconectado tras %u intentos\n", (unsigned)wifiBackoff.failures);
+        wifiWasConnected = true;
+        backoffSuccess(wifiBackoff);
+      }
+      return;
+    }
+
+    if (wifiWasConnected) {
+      LOG_W("❌ WiFi perdido\n");
+      wifiWasConnected = false;
+    }
+    if (!backoffReady(wifiBackoff, now)) return;
+
+    WiFi.reconnect();
+    uint32_t delayMs = backoffFailure(wifiBackoff, now + WIFI_ATTEMPT_WINDOW_MS);
+    LOG_I("Reintentando WiFi (intento %u), próximo en %u ms\n",
+                  (unsigned)wifiBackoff.failures, (unsigned)(WIFI_ATTEMPT_WINDOW_MS + delayMs));
+  #endif
+}
+
+// Carga la lista de brokers de la NVS; sin lista guardada se usa el broker de compilación
+void loadBrokerList() {
+  char text[BROKER_LIST_TEXT_MAX];
+  if (!nvsLoadBrokers(text, sizeof(text)) || !brokerListParse(brokers, text, mqtt_port)) {
+    brokerListParse(brokers, mqtt_server, mqtt_port);
+  }
+  brokerListFormat(brokers, text, sizeof(text));
+  LOG_I("Brokers MQTT: %s\n", text);
+}
+
+// Pasa al broker elegido por brokerListSelect(). El primer intento sale con un jitter corto
+// (espera base) para que la flota entera no caiga sobre el broker de respaldo a la vez.
+void switchBroker(int previous) {
+  const BrokerEndpoint* broker = brokerListActive(brokers);
+  if (brokers.active == previous || !mqttTransport.setBroker(broker->host, broker->port)) return;
+
+  LOG_I("🔀 Conmutando al broker %s:%u (%d ms)\n", broker->host, (unsigned)broker->port,
+                (int)broker->rtt_ms);
+  backoffSuccess(mqttBackoff);
+  backoffFailure(mqttBackoff, millis());
+}
+
+// MQTT: arranca el cliente la primera vez y después pide cada reintento cuando vence su backoff.
+// Solo se intenta con Wi-Fi arriba, así un corte de Wi-Fi no infla la espera del broker.
+void maintainMqtt() {
+  #if PUMP_MODE
+    if (WiFi.status() != WL_CONNECTED) return;
+
+    if (brokerProbePending && brokerProbeDone(brokers)) {
+      brokerProbePending = false;
+      brokersProbed = true;
+    }
+
+    if (!mqttStarted) {
+      // Antes de la primera conexión se espera el sondeo para elegir el broker más cercano
+      if (brokers.count > 1 && !brokersProbed) {
+        if (!brokerProbePending) brokerProbePending = brokerProbeStart(brokers);
+        return;
       }
+      startMqtt();
+      return;
+    }
+    if (mqttTransport.connected()) return;
+
+    if (!mqttAttemptPending && brokerListShouldFailover(brokers)) {
+      int previous = brokers.active;
+      brokerListSelect(brokers);
+      switchBroker(previous);
+    }
+
+    unsigned long now = millis();
+    if (mqttAttemptPending) {
+      if (now - mqttAttemptStart < MQTT_ATTEMPT_TIMEOUT_MS) return;
+      mqttAttemptPending = false; // El cliente no informó el resultado: se permite otro intento
+    }
+    if (!backoffReady(mqttBackoff, now)) return;
+
+    if (mqttTransport.reconnect()) {
+      mqttAttemptPending = true;
+      mqttAttemptStart = now;
     }
   #endif
 }
 
-void callback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("📩 Mensaje recibido en topic: ");
-  Serial.println(topic);
+// Encola un mensaje para publicación asíncrona. No bloquea aunque no haya conexión:
+// el mensaje espera en la cola (acotada) y sale al reconectar.
+bool mqttPublish(const char* topic, const char* payload, size_t length, MqttPriority priority,
+                 uint8_t qos = MQTT_QOS_DEFAULT, const MqttPublishProperties* props = nullptr,
+                 const MqttSampleStamp* stamp = nullptr, uint32_t tag = 0) {
+  #if PUMP_MODE
+    MqttPublishProperties eventProps = {&EVENT_PROFILE, nullptr, 0};
+    return mqttPublisherEnqueue(mqttPublisher, topic, (const uint8_t*)payload, length, priority, qos, millis(),
+                                props != nullptr ? props : &eventProps, stamp, tag);
+  #else
+    return false;
+  #endif
+}
+
+// Reloj monótono en microsegundos (esp_timer: 64 bits, no da la vuelta ni salta con NTP)
+int64_t monoMicros() {
+  return esp_timer_get_time();
+}
+
+// Registra la duración de una etapa que empezó en `start_us` (monoMicros())
+void recordStage(MetricStage stage, int64_t start_us) {
+  uint32_t durationUs = (uint32_t)(monoMicros() - start_us);
+  stageMetricsRecord(stageMetrics, stage, durationUs);
+  if (durationUs >= TRACE_STAGE_MIN_US) traceComplete(stageName(stage), (uint32_t)start_us, durationUs);
+}
+
+// Abre una etapa: queda en la pila del detector de bloqueos junto con la dirección desde donde se
+// llamó (por eso no se expande en línea) y devuelve el instante de inicio para stageEnd()
+__attribute__((noinline)) int64_t stageBegin(MetricStage stage) {
+  stallPush(stage, (uint32_t)stallCodeAddress(__builtin_return_address(0)));
+  if (stageAllocDepth < STAGE_ALLOC_DEPTH) {
+    stageAllocMarks[stageAllocDepth] = allocCounterTracked();
+    stageSteadyPrevious[stageAllocDepth] = allocCounterSetSteady(steadyStateArmed && isSteadyStage(stage));
+  }
+  stageAllocDepth++;
+  return monoMicros();
+}
+
+void stageEnd(MetricStage stage, int64_t start_us) {
+  stallPop();
+  recordStage(stage, start_us);
+  if (stageAllocDepth > 0 && --stageAllocDepth < STAGE_ALLOC_DEPTH) {
+    stageAllocs[stage] += allocCounterTracked() - stageAllocMarks[stageAllocDepth];
+    allocCounterSetSteady(stageSteadyPrevious[stageAllocDepth]);
+  }
+}
 
-  // 1. DESERIALIZAR EL JSON (¡ESTA LÍNEA FALTABA!)
+// Marca de tiempo de una muestra tomada en `mono_us` (campo "ts_ms" de ancho fijo)
+void addSampleStamp(JsonDocument& doc, int64_t mono_us) {
+  char field[TIME_STAMP_WIDTH + 1];
+  timeServiceFormatStamp(timeService, mono_us, field);
+  field[TIME_STAMP_WIDTH] = '\0';
+  doc[TIME_STAMP_FIELD] = serialized((char*)field); // char* no constante: ArduinoJson lo copia
+}
+
+static_assert(TIME_STAMP_WIDTH == MQTT_STAMP_WIDTH, "La marca del publicador y la del servicio de hora deben coincidir");
+
+// Para el publicador: vuelve a marcar un mensaje encolado justo antes de enviarlo
+bool restampSample(int64_t mono_us, char* field) {
+  return timeServiceFormatStamp(timeService, mono_us, field);
+}
+
+// Publica un JSON armado con addSampleStamp(): si se encoló sin hora NTP, sale con la hora real de la muestra
+bool mqttPublishSample(const char* topic, const char* payload, size_t length, int64_t mono_us,
+                       MqttPriority priority, uint8_t qos = MQTT_QOS_DEFAULT,
+                       const MqttPublishProperties* props = nullptr) {
+  const char* field = strstr(payload, "\"" TIME_STAMP_FIELD "\":");
+  if (field == nullptr) return mqttPublish(topic, payload, length, priority, qos, props);
+
+  MqttSampleStamp stamp = {mono_us, (uint16_t)(field - payload + strlen("\"" TIME_STAMP_FIELD "\":"))};
+  return mqttPublish(topic, payload, length, priority, qos, props, &stamp);
+}
+
+// Atiende las sincronizaciones de SNTP (la primera y las periódicas) desde el loop
+void serviceTimeSync() {
+  if (sntp_get_sync_status() != SNTP_SYNC_STATUS_COMPLETED) return; // La lectura reinicia el estado
+
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  int64_t mono = monoMicros();
+  bool first = !timeService.synced;
+  timeServiceSync(timeService, mono, (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec);
+  alignedSampleMono = 0; // El próximo límite se recalcula con la nueva corrección
+
+  if (first) {
+    bootMetrics.ntp_ms = millis();
+    LOG_I("🕒 Hora NTP sincronizada a los %lu ms del arranque\n", bootMetrics.ntp_ms);
+  } else {
+    LOG_I("🕒 Resincronización NTP #%lu: corrección de %lld us\n",
+                  (unsigned long)timeService.syncs, (long long)timeService.last_step_us);
+  }
+}
+
+void setPumpRelay(int pumpIndex, bool on); // Ver la sección 4 (hardware o planta simulada)
+
+// Apaga el relé de una bomba y guarda su acumulado de energía
+void stopPump(int pumpIndex) {
+  Pump& pump = pumps[pumpIndex];
+  LOG_I(">>> 🛑 APAGANDO RELÉ BOMBA %d (Pin %d)\n", pump.id, pump.relayPin);
+  setPumpRelay(pumpIndex, false);
+  tankControllerSetPump(tankController, pumpIndex, false);
+
+  // Guardar el acumulado de energía al terminar un ciclo de bombeo
+  EnergyMeter& meter = tankController.meters[pumpIndex];
+  int64_t nvsStart = stageBegin(STAGE_NVS);
+  nvsSaveEnergy(pump.id, meter.total_kwh, meter.total_m3);
+  stageEnd(STAGE_NVS, nvsStart);
+  energyMeterMarkPersisted(meter);
+}
+
+// Comando ya validado sobre una bomba (MQTT o escenario): lo decide el controlador (ver tank_controller.h)
+const char* applyPumpAction(int pumpIndex, ControlAction action) {
+  Pump& pump = pumps[pumpIndex];
+  captureCommand(sensorCapture, micros(), millis(), pumpIndex, action == CONTROL_START);
+
+  if (action == CONTROL_START) {
+    const char* refused = tankControllerCommand(tankController, pumpIndex, action);
+    if (refused != nullptr) {
+      LOG_W("⚠️ Tanque vacío: se rechaza START de la Bomba %d (marcha en seco)\n", pump.id);
+      return refused;
+    }
+    LOG_I(">>> ✅ ACTIVANDO RELÉ BOMBA %d (Pin %d)\n", pump.id, pump.relayPin);
+    setPumpRelay(pumpIndex, true);
+    tankControllerSetPump(tankController, pumpIndex, true);
+  } else {
+    stopPump(pumpIndex);
+  }
+
+  return "APPLIED";
+}
+
+// Identidad: la provisionada en NVS o, si no hay, la derivada de la MAC de fábrica
+void loadDeviceIdentity() {
+  uint64_t efuseMac = ESP.getEfuseMac();
+  uint8_t mac[6];
+  for (int i = 0; i < 6; i++) mac[i] = (uint8_t)(efuseMac >> (8 * i));
+  deviceIdentityFromMac(identity, mac, DEVICE_DEFAULT_SITE);
+
+  char site[DEVICE_SITE_MAX];
+  char controller[DEVICE_CONTROLLER_MAX];
+  if (nvsLoadIdentity(site, sizeof(site), controller, sizeof(controller)) &&
+      !deviceIdentitySet(identity, site, controller)) {
+    LOG_W("⚠️ Identidad guardada inválida, se usa la de la MAC\n");
+  }
+
+  devicePumpTopic(identity, -1, "control", controlTopicSubscription, sizeof(controlTopicSubscription));
+  deviceTopic(identity, "tank/alerts", tankAlertTopic, sizeof(tankAlertTopic));
+  deviceTopic(identity, "tank/level_events", levelEventTopic, sizeof(levelEventTopic));
+  deviceTopic(identity, "config", controllerConfigTopic, sizeof(controllerConfigTopic));
+  deviceTopic(identity, "info", controllerInfoTopic, sizeof(controllerInfoTopic));
+  deviceTopic(identity, "boot", bootMetricsTopic, sizeof(bootMetricsTopic));
+  deviceSiteTopic(identity, "sample", sampleTriggerTopic, sizeof(sampleTriggerTopic));
+  deviceTopic(identity, "metrics", metricsTopic, sizeof(metricsTopic));
+  deviceTopic(identity, "stalls", stallsTopic, sizeof(stallsTopic));
+  deviceTopic(identity, "diagnostics", diagnosticsTopic, sizeof(diagnosticsTopic));
+  deviceTopic(identity, "log", logTopic, sizeof(logTopic));
+  deviceTopic(identity, "profile/set", profileControlTopic, sizeof(profileControlTopic));
+  deviceTopic(identity, "profile", profileTopic, sizeof(profileTopic));
+  deviceTopic(identity, "trace/set", traceControlTopic, sizeof(traceControlTopic));
+  deviceTopic(identity, "trace", traceTopic, sizeof(traceTopic));
+  deviceTopic(identity, "capture/set", captureControlTopic, sizeof(captureControlTopic));
+  deviceTopic(identity, "capture", captureTopic, sizeof(captureTopic));
+  deviceTopic(identity, "scenario/set", scenarioControlTopic, sizeof(scenarioControlTopic));
+
+  LOG_I("Controlador %s/%s (%s)\n", identity.site, identity.controller,
+                identity.provisioned ? "provisionado" : "MAC");
+}
+
+// Ficha retenida del controlador: sitio, ID, MAC y bombas que maneja
+void publishControllerInfo() {
   StaticJsonDocument<256> doc;
-  DeserializationError error = deserializeJson(doc, payload, length);
+  doc["site"] = identity.site;
+  doc["controller"] = identity.controller;
+  doc["provisioned"] = identity.provisioned;
+  doc["firmware"] = FIRMWARE_VERSION;
+  doc["mac"] = WiFi.macAddress();
+  JsonArray pumpIds = doc.createNestedArray("pumps");
+  for (int i = 0; i < NUM_PUMPS; i++) pumpIds.add(pumps[i].id);
+
+  char output[256];
+  size_t n = serializeJson(doc, output);
+  MqttPublishProperties infoProps = {&INFO_PROFILE, nullptr, 0};
+  mqttPublish(controllerInfoTopic, output, n, MQTT_PRIO_EVENT, MQTT_QOS_DEFAULT, &infoProps);
+}
+
+// Histogramas de la ventana en forma compacta y se empieza una ventana nueva. Por etapa (solo las
+// que tuvieron muestras): [n, promedio, p50, p95, máximo, [cubetas...]] en us; las cubetas van sin
+// los ceros finales (límites en stage_metrics.h). Si no caben en un mensaje se reparten en varios
+// con la misma ventana ("part").
+static void beginStageMetricsMessage(JsonDocument& doc, int64_t mono, uint32_t windowMs, uint8_t part) {
+  doc.clear();
+  addSampleStamp(doc, mono);
+  doc["firmware"] = FIRMWARE_VERSION;
+  doc["window_ms"] = windowMs;
+  doc["bucket_base_us"] = STAGE_BUCKET_BASE_US;
+  doc["part"] = part;
+  doc.createNestedObject("stages");
+}
+
+static void sendStageMetricsMessage(const JsonDocument& doc, int64_t mono) {
+  char output[MQTT_PAYLOAD_MAX];
+  size_t n = serializeJson(doc, output);
+  mqttPublishSample(metricsTopic, output, n, mono, MQTT_PRIO_BULK);
+}
+
+void publishStageMetrics() {
+  StaticJsonDocument<2048> doc;
+  int64_t mono = monoMicros();
+  uint32_t windowMs = millis() - stageMetrics.window_start_ms;
+  uint8_t part = 0;
+  bool pending = false;
+  beginStageMetricsMessage(doc, mono, windowMs, part);
+
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    const StageHistogram& hist = stageMetrics.stages[s];
+    if (hist.count == 0) continue;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+      JsonArray entry = doc["stages"].createNestedArray(stageName((MetricStage)s));
+      entry.add(hist.count);
+      entry.add((uint32_t)(hist.sum_us / hist.count));
+      entry.add(stageHistogramPercentile(hist, 50));
+      entry.add(stageHistogramPercentile(hist, 95));
+      entry.add(hist.max_us);
+
+      uint8_t used = STAGE_BUCKETS;
+      while (used > 0 && hist.buckets[used - 1] == 0) used--;
+      JsonArray buckets = entry.createNestedArray();
+      for (uint8_t b = 0; b < used; b++) buckets.add(hist.buckets[b]);
+
+      if (measureJson(doc) < MQTT_PAYLOAD_MAX) {
+        pending = true;
+        break;
+      }
+      // No cabe: sale lo acumulado sin esta etapa y se reintenta en un mensaje nuevo
+      doc["stages"].remove(stageName((MetricStage)s));
+      if (pending) sendStageMetricsMessage(doc, mono);
+      pending = false;
+      beginStageMetricsMessage(doc, mono, windowMs, ++part);
+    }
+  }
+  if (pending) sendStageMetricsMessage(doc, mono);
+  stageMetricsReset(stageMetrics, millis());
+}
+
+const char* resetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON: return "POWER_ON";
+    case ESP_RST_BROWNOUT: return "BROWNOUT";
+    case ESP_RST_SW: return "SOFTWARE";
+    case ESP_RST_PANIC: return "PANIC";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT: return "WATCHDOG";
+    case ESP_RST_DEEPSLEEP: return "DEEP_SLEEP";
+    case ESP_RST_EXT: return "EXTERNAL";
+    default: return "UNKNOWN";
+  }
+}
+
+// Perfil de arranque (una vez por encendido): versión, causa del reinicio, camino del Wi-Fi,
+// hitos en ms desde el encendido (null si no ocurrieron) y duración de cada fase de setup() en us.
+// El backend lo agrega por versión de firmware para detectar regresiones del arranque.
+void publishBootMetrics() {
+  StaticJsonDocument<1024> doc;
+  doc["firmware"] = FIRMWARE_VERSION;
+  doc["reset_reason"] = resetReasonName(esp_reset_reason());
+  doc["wifi_path"] = bootMetrics.wifi_path;
+  doc["wifi_ms"] = bootMetrics.wifi_ms;
+  doc["mqtt_ms"] = bootMetrics.mqtt_ms;
+  doc["first_publish_ms"] = bootMetrics.first_publish_ms;
+  if (bootMetrics.ntp_ms != 0) doc["ntp_ms"] = bootMetrics.ntp_ms;
+  else doc["ntp_ms"] = nullptr;
+
+  JsonArray phases = doc.createNestedArray("phases");
+  for (uint8_t i = 0; i < bootProfile.count; i++) {
+    JsonObject phase = phases.createNestedObject();
+    phase["name"] = bootProfile.phases[i].name;
+    phase["start_us"] = bootProfile.phases[i].start_us;
+    phase["us"] = bootProfile.phases[i].duration_us;
+  }
+
+  char output[MQTT_PAYLOAD_MAX];
+  size_t n = serializeJson(doc, output);
+  mqttPublish(bootMetricsTopic, output, n, MQTT_PRIO_EVENT);
+  bootMetrics.reported = true;
+  LOG_I("Arranque: WiFi %lu ms (%s), MQTT %lu ms, primera publicación %lu ms, NTP %lu ms\n",
+                bootMetrics.wifi_ms, bootMetrics.wifi_path, bootMetrics.mqtt_ms, bootMetrics.first_publish_ms,
+                bootMetrics.ntp_ms);
+  for (uint8_t i = 0; i < bootProfile.count; i++) {
+    LOG_I("  %-12s %8lu us\n", bootProfile.phases[i].name, (unsigned long)bootProfile.phases[i].duration_us);
+  }
+}
+
+// Sube un bloqueo registrado (uno por vuelta, el más antiguo primero). Las direcciones se traducen con
+// addr2line sobre el .elf de la versión indicada.
+void uploadStallRecord() {
+  StallRecord rec;
+  if (stallUploadSeq != 0 || !stallNextPending(rec)) return;
+
+  StaticJsonDocument<512> doc;
+  doc["seq"] = rec.seq;
+  doc["boot"] = rec.boot;
+  doc["current_boot"] = stallBootCount();
+  doc["firmware"] = FIRMWARE_VERSION;
+  doc["task"] = rec.task;
+  doc["uptime_ms"] = rec.uptime_ms;
+  doc["duration_ms"] = rec.duration_ms;
+  doc["fatal"] = rec.state == STALL_FATAL;
+  if (rec.state == STALL_FATAL && rec.boot + 1 == stallBootCount()) {
+    doc["reset_reason"] = resetReasonName(esp_reset_reason()); // El reinicio que cortó el bloqueo
+  }
+  JsonArray stages = doc.createNestedArray("stages"); // De la más externa a la más interna
+  JsonArray pcs = doc.createNestedArray("pcs");
+  for (uint8_t i = 0; i < rec.depth; i++) {
+    char pc[11];
+    snprintf(pc, sizeof(pc), "0x%08lx", (unsigned long)rec.pcs[i]);
+    stages.add(stageName((MetricStage)rec.stages[i]));
+    pcs.add(pc);
+  }
+
+  char output[512];
+  size_t n = serializeJson(doc, output);
+  // El tag es el seq: onPublisherDone lo marca subido recién con el PUBACK, o lo libera para reintentar
+  stallUploadSeq = rec.seq;
+  if (!mqttPublish(stallsTopic, output, n, MQTT_PRIO_BULK, 1, nullptr, nullptr, rec.seq)) stallUploadSeq = 0;
+}
+
+// Un mensaje con tag salió de la cola de salida (hoy solo los registros de bloqueo)
+void onPublisherDone(uint32_t tag, bool delivered) {
+  if (tag != stallUploadSeq) return;
+  if (delivered) stallMarkUploaded(tag);
+  stallUploadSeq = 0;
+}
+
+// Diagnóstico de memoria: heap (libre, mínimo, bloque más grande, fragmentación), margen de pila de
+// cada tarea, asignaciones (totales y del loop por etapa, solo las que tuvieron) y avisos activos.
+// Los contadores son acumulados desde el arranque: el backend saca la tasa entre mensajes.
+void publishDiagnostics(const HeapSnapshot& heap, MqttPriority priority) {
+  AllocCounters allocs;
+  allocCounterRead(allocs);
+
+  StaticJsonDocument<1024> doc;
+  int64_t mono = monoMicros();
+  addSampleStamp(doc, mono);
+  doc["firmware"] = FIRMWARE_VERSION;
+  doc["uptime_s"] = (uint32_t)(mono / 1000000);
+
+  JsonObject heapInfo = doc.createNestedObject("heap");
+  heapInfo["free"] = heap.free_bytes;
+  heapInfo["min_free"] = heap.min_free_bytes;
+  heapInfo["largest"] = heap.largest_block;
+  heapInfo["frag_pct"] = heap.fragmentation_pct;
+  heapInfo["failed"] = heap.failed_allocs;
+  if (heap.failed_allocs != 0) heapInfo["last_failed_size"] = heap.last_failed_size;
+
+  JsonObject allocInfo = doc.createNestedObject("allocs");
+  allocInfo["total"] = allocs.allocs;
+  // Solo malloc/calloc/realloc/free (ver alloc_counter.h): vale la tendencia, no el valor
+  allocInfo["live_malloc"] = (int32_t)(allocs.allocs - allocs.frees);
+  allocInfo["loop"] = allocs.tracked_allocs;
+  allocInfo["loop_bytes"] = allocs.tracked_bytes;
+  allocInfo["steady"] = allocs.steady_allocs; // En régimen estable: debería ser siempre 0
+  if (allocs.steady_allocs != 0) {
+    char pc[11];
+    snprintf(pc, sizeof(pc), "0x%08lx", (unsigned long)allocs.steady_last_caller);
+    allocInfo["steady_last_size"] = allocs.steady_last_size;
+    allocInfo["steady_last_pc"] = pc;
+  }
+  JsonObject perStage = allocInfo.createNestedObject("stages");
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    if (stageAllocs[s] != 0) perStage[stageName((MetricStage)s)] = stageAllocs[s];
+  }
+
+  JsonObject logInfo = doc.createNestedObject("log");
+  logInfo["written"] = logRing.written.load(std::memory_order_relaxed);
+  logInfo["dropped"] = logRing.dropped.load(std::memory_order_relaxed); // Anillo lleno: el UART no alcanzó
+
+  JsonObject stacks = doc.createNestedObject("stacks");
+  for (uint8_t i = 0; i < heap.stack_count; i++) stacks[heap.stacks[i].name] = heap.stacks[i].free_bytes;
+
+  JsonArray warnings = doc.createNestedArray("warnings");
+  for (uint8_t w = 0; w < HEAP_WARNING_COUNT; w++) {
+    if (heapWarnings & (1 << w)) warnings.add(heapWarningName((HeapWarning)(1 << w)));
+  }
+
+  char output[MQTT_PAYLOAD_MAX];
+  size_t n = serializeJson(doc, output);
+  mqttPublishSample(diagnosticsTopic, output, n, mono, priority);
+  lastDiagnostics = millis();
+}
+
+// --- Volcados de texto (perfil de CPU, traza, captura de sensores) ---
+// Salen de a poco por donde llegó la orden: por el log sin llenar su anillo, o por MQTT un mensaje
+// por vuelta escrito directamente en la cola y solo con lugar de sobra. Uno a la vez. Con `pending`
+// el volcado sigue abierto mientras el productor tenga algo más por entregar (captura en curso).
+// Cada mensaje MQTT empieza con "# <volcado> <trozo>" para que el host note trozos perdidos o
+// repetidos (QoS 1 puede entregar dos veces); las herramientas ignoran esa línea si no la usan.
+#define DUMP_SERIAL_LINES_PER_LOOP 8
+#define DUMP_LINE_MAX 64
+static_assert(PROFILER_LINE_MAX <= DUMP_LINE_MAX && TRACE_LINE_MAX <= DUMP_LINE_MAX &&
+              CAPTURE_LINE_MAX <= DUMP_LINE_MAX, "Línea de volcado muy corta");
+
+enum DumpSink : uint8_t { DUMP_SINK_SERIAL, DUMP_SINK_MQTT };
+
+struct DumpJob {
+  bool (*next_line)(char* line, size_t size); // nullptr = sin volcado en curso
+  void (*done)();
+  const char* topic;
+  DumpSink sink;
+  bool (*pending)(); // nullptr = termina con la primera línea que falte
+  uint16_t id;
+  uint16_t chunk;    // Próximo trozo por MQTT
+};
+DumpJob dumpJob = {};
+uint16_t dumpSeq = 0;
+
+bool dumpBusy() {
+  return dumpJob.next_line != nullptr;
+}
+
+void startDump(bool (*nextLine)(char*, size_t), void (*done)(), const char* topic, DumpSink sink,
+               bool (*pending)() = nullptr) {
+  dumpJob = {nextLine, done, topic, sink, pending, ++dumpSeq, 0};
+}
+
+void serviceDump() {
+  if (!dumpBusy()) return;
+
+  bool more = true;
+  if (dumpJob.sink == DUMP_SINK_SERIAL) {
+    char line[DUMP_LINE_MAX];
+    for (int i = 0; i < DUMP_SERIAL_LINES_PER_LOOP && more; i++) {
+      if (logRingPending(logRing) >= logRingCapacity(logRing) / 2) return;
+      more = dumpJob.next_line(line, sizeof(line));
+      if (more) LOG_OUT("%s\n", line);
+    }
+  } else {
+    if (!mqttTransport.connected() || mqttPublisher.stats.queue_depth >= MQTT_OUTBOUND_SLOTS / 2) return;
+    MqttPublishProperties props = {&TEXT_PROFILE, nullptr, 0};
+    MqttOutboundMessage* msg = mqttPublisherReserve(mqttPublisher, dumpJob.topic, MQTT_PRIO_BULK, 1, millis(), &props);
+    if (msg == nullptr) return;
+    char* chunk = (char*)mqttPublisherPayload(mqttPublisher, *msg);
+    size_t capacity = mqttPublisherCapacity(*msg);
+    size_t header = snprintf(chunk, capacity, "# %u %u\n", (unsigned)dumpJob.id, (unsigned)dumpJob.chunk);
+    size_t length = header;
+    while (length + DUMP_LINE_MAX <= capacity) { // Siempre entra una línea completa
+      more = dumpJob.next_line(chunk + length, DUMP_LINE_MAX);
+      if (!more) break;
+      length += strlen(chunk + length);
+      chunk[length++] = '\n';
+    }
+    if (length > header) {
+      mqttPublisherCommit(mqttPublisher, *msg, length);
+      dumpJob.chunk++;
+    } else {
+      mqttPublisherAbort(mqttPublisher, *msg);
+    }
+  }
+
+  if (!more && (dumpJob.pending == nullptr || !dumpJob.pending())) {
+    void (*done)() = dumpJob.done;
+    dumpJob = {};
+    if (done != nullptr) done();
+  }
+}
+
+// --- Perfilador de CPU (ver cpu_profiler.h) ---
+// Se arranca por MQTT ({"command":"start","rate_hz":997,"duration_s":30} en profileControlTopic) o por
+// el puerto serie ("profile start [hz] [s]"); al terminar el plazo o con "stop" el volcado sale por
+// donde llegó la orden. tools/profile_fold.cpp lo convierte en pilas para un flame graph.
+#define PROFILE_DEFAULT_DURATION_S 30
+#define PROFILE_MAX_DURATION_S 600
+
+DumpSink profileSink = DUMP_SINK_SERIAL;
+unsigned long profileStopAt = 0;
+ProfilerCursor profileCursor;
+
+void startProfile(uint32_t rateHz, uint32_t durationS, DumpSink sink) {
+  if (profilerRunning() || profilerHasData()) {
+    LOG_W("⚠️ El perfilador ya está en uso\n");
+    return;
+  }
+  if (durationS == 0) durationS = PROFILE_DEFAULT_DURATION_S;
+  if (durationS > PROFILE_MAX_DURATION_S) durationS = PROFILE_MAX_DURATION_S;
+  if (!profilerStart(rateHz)) {
+    LOG_W("⚠️ No se pudo arrancar el perfilador (memoria o temporizador)\n");
+    return;
+  }
+  ProfilerSummary summary;
+  profilerSummary(summary);
+  profileSink = sink;
+  profileStopAt = millis() + durationS * 1000;
+  LOG_I("🔬 Perfilando a %lu Hz durante %lu s\n", (unsigned long)summary.rate_hz, (unsigned long)durationS);
+}
+
+// Se detiene en la próxima vuelta de serviceProfiler() (o cuando termine otro volcado en curso)
+void stopProfile() {
+  if (profilerRunning()) profileStopAt = millis();
+}
+
+bool profileNextLine(char* line, size_t size) {
+  return profilerNextLine(profileCursor, line, size);
+}
+
+void profileDumpDone() {
+  profilerRelease();
+  LOG_I("🔬 Volcado del perfil terminado\n");
+}
+
+const char* handleProfileCommand(const uint8_t* payload, size_t length, DumpSink sink) {
+  StaticJsonDocument<128> doc;
+  if (deserializeJson(doc, payload, length)) return "INVALID_JSON";
+  const char* command = doc["command"] | "";
+  if (strcmp(command, "start") == 0) {
+    startProfile(doc["rate_hz"] | 0u, doc["duration_s"] | 0u, sink);
+  } else if (strcmp(command, "stop") == 0) {
+    stopProfile();
+  } else {
+    return "UNKNOWN_COMMAND";
+  }
+  return "APPLIED";
+}
+
+void serviceProfiler() {
+  if (!profilerRunning() || (long)(millis() - profileStopAt) < 0 || dumpBusy()) return;
+  profilerStop();
+  profilerCursorInit(profileCursor);
+  ProfilerSummary summary;
+  profilerSummary(summary);
+  LOG_I("🔬 Perfil: %lu muestras en %lu ms, %lu perdidas, %u puntos distintos\n", (unsigned long)summary.samples,
+        (unsigned long)summary.duration_ms, (unsigned long)summary.lost, (unsigned)summary.entries);
+  startDump(profileNextLine, profileDumpDone, profileTopic, profileSink);
+}
+
+// --- Traza de eventos (ver trace_recorder.h) ---
+// Registra siempre (etapas largas, mensajes, eventos de esp-mqtt, escrituras del log en el UART). Con
+// "trace dump" por el puerto serie o {"command":"dump"} en traceControlTopic sale lo último que pasó
+// (el registro se pausa mientras tanto); "stop"/"start" (o "trace off"/"trace on") lo apagan y
+// encienden. tools/trace_to_chrome.cpp lo convierte para chrome://tracing o Perfetto.
+TraceCursor traceCursor;
+
+uint32_t traceMicros() {
+  return (uint32_t)esp_timer_get_time();
+}
+
+uintptr_t traceCurrentTask(const char** name) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  *name = pcTaskGetName(task);
+  return (uintptr_t)task;
+}
+
+void traceRecorderBegin() {
+  traceInit(traceMicros, traceCurrentTask);
+}
+
+bool traceDumpNextLine(char* line, size_t size) {
+  return traceNextLine(traceCursor, line, size);
+}
+
+void traceDumpDone() {
+  LOG_I("🧵 Volcado de la traza terminado\n");
+}
+
+void dumpTrace(DumpSink sink) {
+  if (dumpBusy()) {
+    LOG_W("⚠️ Hay otro volcado en curso\n");
+    return;
+  }
+  traceCursorInit(traceCursor);
+  startDump(traceDumpNextLine, traceDumpDone, traceTopic, sink);
+}
 
-  if (error) {
-    Serial.print("❌ Error al leer JSON: ");
-    Serial.println(error.c_str());
-    return; // Salir si el JSON está mal formado
+const char* handleTraceCommand(const uint8_t* payload, size_t length, DumpSink sink) {
+  StaticJsonDocument<64> doc;
+  if (deserializeJson(doc, payload, length)) return "INVALID_JSON";
+  const char* command = doc["command"] | "";
+  if (strcmp(command, "dump") == 0) {
+    dumpTrace(sink);
+  } else if (strcmp(command, "start") == 0) {
+    traceSetEnabled(true);
+  } else if (strcmp(command, "stop") == 0) {
+    traceSetEnabled(false);
+  } else {
+    return "UNKNOWN_COMMAND";
   }
+  return "APPLIED";
+}
+
+// --- Captura de lecturas crudas (ver sensor_capture.h) ---
+// "capture start" por el puerto serie o {"command":"start"} en captureControlTopic guarda lo que entregan
+// los sensores y las órdenes a las bombas, y lo va sacando mientras dura por donde llegó la orden;
+// "stop" la cierra. tools/sensor_replay.cpp la reproduce en el host contra el mismo controlador.
+bool captureDumpNextLine(char* line, size_t size) {
+  return captureNextLine(sensorCapture, line, size);
+}
+
+bool captureDumpPending() {
+  return capturePending(sensorCapture);
+}
 
-  // 2. EXTRAER EL ID DE LA BOMBA
-  int pumpId = 0;
-  // Extraemos el número que está entre "pumps/" y "/control"
-  sscanf(topic, "caracas/pumps/%d/control", &pumpId);
+void captureDumpDone() {
+  if (sensorCapture.dropped > 0) {
+    LOG_W("⚠️ Captura: %lu lecturas descartadas (buffer lleno)\n", (unsigned long)sensorCapture.dropped);
+  }
+  LOG_I("🎙️ Captura terminada: %lu líneas\n", (unsigned long)sensorCapture.lines);
+  captureInit(sensorCapture, nullptr, 0);
+  free(captureBuffer);
+  captureBuffer = nullptr;
+}
 
-  if (pumpId == 0) {
-    Serial.println("⚠️ ID de bomba no detectado en el topic.");
+void startCapture(DumpSink sink) {
+  if (dumpBusy() || captureBuffer != nullptr) {
+    LOG_W("⚠️ Hay otro volcado en curso\n");
+    return;
+  }
+  captureBuffer = (char*)malloc(CAPTURE_BUFFER_BYTES);
+  if (captureBuffer == nullptr) {
+    LOG_W("⚠️ Sin memoria para la captura\n");
     return;
   }
+  captureInit(sensorCapture, captureBuffer, CAPTURE_BUFFER_BYTES);
+  captureStart(sensorCapture, NUM_PUMPS, millis());
+  captureFloatsPending = true;
+  startDump(captureDumpNextLine, captureDumpDone, captureTopic, sink, captureDumpPending);
+  LOG_I("🎙️ Capturando lecturas de los sensores\n");
+}
+
+// El volcado termina solo cuando sale lo que quedaba en el buffer
+void stopCapture() {
+  if (captureActive(sensorCapture)) captureStop(sensorCapture);
+}
 
-  // 3. BUSCAR LA BOMBA EN NUESTRO ARRAY
-  Pump* targetPump = nullptr;
+const char* handleCaptureCommand(const uint8_t* payload, size_t length, DumpSink sink) {
+  StaticJsonDocument<64> doc;
+  if (deserializeJson(doc, payload, length)) return "INVALID_JSON";
+  const char* command = doc["command"] | "";
+  if (strcmp(command, "start") == 0) {
+    startCapture(sink);
+  } else if (strcmp(command, "stop") == 0) {
+    stopCapture();
+  } else {
+    return "UNKNOWN_COMMAND";
+  }
+  return "APPLIED";
+}
+
+// --- Escenarios de simulación (ver scenario.h y sim_plant.h) ---
+// En modo simulación un escenario mueve la planta simulada: entradas, fallas de sensores y bombas,
+// comandos, cortes del broker y de energía. Arranca con SIM_DEFAULT_SCENARIO (lo de siempre: la calle
+// da agua 30 s sí y 30 s no); otro guion llega como texto en scenarioControlTopic y reemplaza al que
+// corre. Las expectativas se informan por el log al terminar ("scenario status" en cualquier momento);
+// el detalle de cada una lo da tools/scenario_runner.cpp corriendo el mismo guion en el host. El corte
+// de energía reinicia el equipo de verdad y con el reinicio vuelve el guion por defecto.
+#if SENSOR_SIMULATION
+const char SIM_DEFAULT_SCENARIO[] =
+  "name demo\n"
+  "level 70\n"
+  "loop\n"
+  "duration 60s\n"
+  "at 0s inflow 155\n"
+  "at 30s inflow 0\n";
+
+// Evento del equipo para las expectativas del escenario
+void scenarioNote(const char* event) {
+  scenarioEvent(scenario, millis(), event);
+}
+
+// Cada escenario arranca con las bombas apagadas y la planta en su nivel inicial
+void startScenario() {
   for (int i = 0; i < NUM_PUMPS; i++) {
-    if (pumps[i].id == pumpId) {
-      targetPump = &pumps[i];
-      break;
+    if (tankController.pump_on[i]) stopPump(i);
+  }
+  simPlantInit(simPlant, PLANT_CONTROLLER_CONFIG, scenario.level_percent, scenario.seed, millis(), micros());
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) floatEdgeUs[i] = simPlant.float_edge_us[i];
+  scenarioStart(scenario, millis());
+  scenarioBrokerDown = false;
+  scenarioReported = false;
+  LOG_I("🧪 Escenario %s: %u pasos, %u expectativas\n", scenario.name, (unsigned)scenario.step_count,
+        (unsigned)scenario.expect_count);
+}
+
+// Un guion con errores no corta el que está corriendo
+bool loadScenario(const char* text) {
+  static Scenario candidate;
+  int line = 0;
+  const char* error = scenarioParse(candidate, text, &line);
+  if (error != nullptr) {
+    LOG_W("⚠️ Guion de escenario, línea %d: %s\n", line, error);
+    return false;
+  }
+  scenario = candidate;
+  startScenario();
+  return true;
+}
+
+void reportScenario() {
+  uint8_t decided = 0;
+  for (int i = 0; i < scenario.expect_count; i++) {
+    const ScenarioExpect& expect = scenario.expects[i];
+    if (expect.state == SCENARIO_EXPECT_PENDING) continue;
+    decided++;
+    if (expect.state == SCENARIO_EXPECT_FAILED) {
+      LOG_W("❌ Escenario %s: falló la línea %u (se vio %.2f)\n", scenario.name, (unsigned)expect.line,
+            expect.observed);
     }
   }
+  uint8_t failures = scenarioFailures(scenario);
+  if (failures > 0) {
+    LOG_W("❌ Escenario %s: %u de %u expectativas fallaron\n", scenario.name, (unsigned)failures,
+          (unsigned)scenario.expect_count);
+  } else {
+    LOG_I("✅ Escenario %s: %u de %u expectativas cumplidas\n", scenario.name, (unsigned)decided,
+          (unsigned)scenario.expect_count);
+  }
+}
 
-  if (targetPump == nullptr) {
-    Serial.printf("⚠️ La Bomba %d no está configurada en este ESP32.\n", pumpId);
-    return;
+void serviceScenario() {
+  uint32_t now = millis();
+  ScenarioStep step;
+  while (scenarioNextStep(scenario, now, step)) {
+    if (scenarioApplyToPlant(step, simPlant, micros())) continue;
+
+    if (step.type == SCENARIO_STEP_COMMAND) {
+      const char* result = applyPumpAction(step.target, step.value != 0.0f ? CONTROL_START : CONTROL_STOP);
+      scenarioNote(result);
+    } else if (step.type == SCENARIO_STEP_BROKER) {
+      scenarioBrokerDown = step.value == 0.0f;
+      LOG_W("🧪 Escenario: broker %s\n", scenarioBrokerDown ? "caído" : "de vuelta");
+    } else if (step.type == SCENARIO_STEP_POWER_LOSS) {
+      LOG_W("🧪 Escenario: corte de energía\n");
+      ESP.restart(); // Sin guardar la energía: como un corte de verdad (logFlushOnRestart() saca el log)
+    }
   }
 
-  // 4. EXTRAER EL COMANDO (CON PROTECCIÓN ANTI-CRASH)
-  // Verificamos si la llave "command" existe antes de leerla
-  if (!doc.containsKey("command")) {
-    Serial.println("⚠️ El JSON recibido no tiene el campo 'command'.");
+  simPlantAdvance(simPlant, now, micros());
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) floatEdgeUs[i] = simPlant.float_edge_us[i]; // Como la ISR
+
+  ScenarioObservation obs;
+  for (int i = 0; i < NUM_PUMPS; i++) {
+    obs.pump_on[i] = tankController.pump_on[i];
+    obs.pump_amps[i] = tankController.last.pump_amps[i];
+    obs.energy_kwh[i] = tankController.meters[i].total_kwh;
+  }
+  obs.level_percent = tankController.level_percent;
+  obs.queue_depth = mqttPublisher.stats.queue_depth;
+  obs.sent = mqttPublisher.stats.sent;
+  obs.dropped = mqttPublisher.stats.dropped;
+  scenarioObserve(scenario, now, obs);
+
+  if (!scenarioReported && scenarioFinished(scenario, now)) {
+    scenarioFinish(scenario, now);
+    reportScenario();
+    scenarioReported = true;
+  }
+}
+#else
+inline void scenarioNote(const char*) {}
+#endif
+
+// Guion nuevo (texto plano) por MQTT: solo en modo simulación
+const char* handleScenarioCommand(const uint8_t* payload, size_t length) {
+  #if SENSOR_SIMULATION
+    char* text = (char*)malloc(length + 1);
+    if (text == nullptr) return "NO_MEMORY";
+    memcpy(text, payload, length);
+    text[length] = '\0';
+    bool loaded = loadScenario(text);
+    free(text);
+    return loaded ? "APPLIED" : "INVALID_SCENARIO";
+  #else
+    return "NOT_SIMULATION";
+  #endif
+}
+
+// Órdenes por el puerto serie, una por línea (sin bloquear: se lee lo que haya llegado)
+#define SERIAL_COMMAND_MAX 64
+
+void handleSerialCommand(char* line) {
+  char* verb = strtok(line, " ");
+  char* action = strtok(nullptr, " ");
+  if (verb != nullptr && strcmp(verb, "profile") == 0 && action != nullptr) {
+    if (strcmp(action, "start") == 0) {
+      char* rate = strtok(nullptr, " ");
+      char* duration = strtok(nullptr, " ");
+      startProfile(rate != nullptr ? strtoul(rate, nullptr, 10) : 0,
+                   duration != nullptr ? strtoul(duration, nullptr, 10) : 0, DUMP_SINK_SERIAL);
+      return;
+    }
+    if (strcmp(action, "stop") == 0) {
+      stopProfile();
+      return;
+    }
+  }
+  if (verb != nullptr && strcmp(verb, "trace") == 0 && action != nullptr) {
+    if (strcmp(action, "dump") == 0) {
+      dumpTrace(DUMP_SINK_SERIAL);
+      return;
+    }
+    if (strcmp(action, "on") == 0) {
+      traceSetEnabled(true);
+      return;
+    }
+    if (strcmp(action, "off") == 0) {
+      traceSetEnabled(false);
+      return;
+    }
+  }
+  if (verb != nullptr && strcmp(verb, "capture") == 0 && action != nullptr) {
+    if (strcmp(action, "start") == 0) {
+      startCapture(DUMP_SINK_SERIAL);
+      return;
+    }
+    if (strcmp(action, "stop") == 0) {
+      stopCapture();
+      return;
+    }
+  }
+  #if SENSOR_SIMULATION
+    if (verb != nullptr && strcmp(verb, "scenario") == 0 && action != nullptr) {
+      if (strcmp(action, "restart") == 0) {
+        startScenario();
+        return;
+      }
+      if (strcmp(action, "status") == 0) {
+        LOG_I("🧪 Escenario %s: %lu s\n", scenario.name, (unsigned long)(scenarioElapsedMs(scenario, millis()) / 1000));
+        reportScenario();
+        return;
+      }
+    }
+  #endif
+  LOG_W("⚠️ Orden desconocida. Uso: profile start [hz] [s] | profile stop | trace dump | trace on | trace off"
+        " | capture start | capture stop | scenario restart | scenario status\n");
+}
+
+void serviceSerialCommands() {
+  static char line[SERIAL_COMMAND_MAX];
+  static size_t length = 0;
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    if (c == '\r') continue;
+    if (c == '\n') {
+      line[length] = '\0';
+      if (length > 0) handleSerialCommand(line);
+      length = 0;
+    } else if (length < sizeof(line) - 1) {
+      line[length++] = (char)c;
+    }
+  }
+}
+
+// Publica lo que la tarea de log separó para MQTT, pocos por vuelta y solo con la cola holgada: el
+// log nunca desplaza telemetría ni diagnóstico (lo que no sale se pierde, queda en el puerto serie)
+void serviceLogSink() {
+  for (int i = 0; i < LOG_SINK_PER_LOOP; i++) {
+    if (!mqttTransport.connected() || mqttPublisher.stats.queue_depth >= MQTT_OUTBOUND_SLOTS / 2) return;
+    const LogRecord* record = logRingPeek(logSinkRing);
+    if (record == nullptr) return;
+
+    MqttPublishProperties props = {&EVENT_PROFILE, nullptr, 0};
+    MqttOutboundMessage* msg = mqttPublisherReserve(mqttPublisher, logTopic, MQTT_PRIO_BULK, 0, millis(), &props);
+    if (msg != nullptr) {
+      char text[LOG_LINE_MAX];
+      logFormat(*record, text, sizeof(text));
+      char* message = text + strspn(text, "\n");
+      size_t length = strlen(message);
+      while (length > 0 && message[length - 1] == '\n') message[--length] = '\0';
+
+      JsonWriter w;
+      jsonWriterInit(w, (char*)mqttPublisherPayload(mqttPublisher, *msg), mqttPublisherCapacity(*msg));
+      jsonBeginObject(w);
+      jsonInt(w, "uptime_ms", record->time_ms);
+      jsonString(w, "level", logLevelName(record->level));
+      jsonString(w, "message", message);
+      jsonEndObject(w);
+      if (jsonWriterOk(w)) mqttPublisherCommit(mqttPublisher, *msg, w.length);
+      else mqttPublisherAbort(mqttPublisher, *msg);
+    }
+    logRingRelease(logSinkRing);
+  }
+}
+
+// Revisa la memoria a baja frecuencia; un aviso nuevo sale en el acto (y por el puerto serie)
+void serviceHeapMonitor() {
+  if (millis() - lastHeapCheck < HEAP_CHECK_INTERVAL_MS) return;
+  lastHeapCheck = millis();
+
+  HeapSnapshot heap;
+  heapMonitorSample(heap);
+  AllocCounters allocs;
+  allocCounterRead(allocs);
+  uint8_t warnings = heapMonitorWarnings(heap, failedAllocsSeen);
+  if (allocs.steady_allocs != steadyAllocsSeen) {
+    warnings |= HEAP_WARN_STEADY_ALLOC;
+    LOG_W("⚠️ %lu asignaciones en régimen estable (la última: %lu B desde 0x%08lx)\n",
+              (unsigned long)(allocs.steady_allocs - steadyAllocsSeen), (unsigned long)allocs.steady_last_size,
+              (unsigned long)allocs.steady_last_caller);
+  }
+  uint8_t raised = warnings & ~heapWarnings;
+  heapWarnings = warnings;
+  failedAllocsSeen = heap.failed_allocs;
+  steadyAllocsSeen = allocs.steady_allocs;
+
+  if (raised != 0) {
+    LOG_W("⚠️ Memoria: libre %lu B (mínimo %lu B), bloque más grande %lu B, fragmentación %u%%, %lu pedidos fallidos\n",
+                  (unsigned long)heap.free_bytes, (unsigned long)heap.min_free_bytes,
+                  (unsigned long)heap.largest_block, heap.fragmentation_pct, (unsigned long)heap.failed_allocs);
+    publishDiagnostics(heap, MQTT_PRIO_EVENT);
+  } else if (millis() - lastDiagnostics >= DIAGNOSTICS_INTERVAL_MS) {
+    publishDiagnostics(heap, MQTT_PRIO_BULK);
+  }
+}
+
+// Nueva identidad {"site": "...", "controller": "..."}: se guarda en NVS y el equipo se reinicia
+// (cambian el client ID y todas las suscripciones)
+const char* applyIdentityConfig(const char* site, const char* controller) {
+  DeviceIdentity updated = identity;
+  if (site == nullptr) site = identity.site;
+  if (controller == nullptr) controller = identity.controller;
+  if (!deviceIdentitySet(updated, site, controller)) return "INVALID_IDENTITY";
+
+  nvsSaveIdentity(updated.site, updated.controller);
+  LOG_I("Identidad nueva %s/%s, reiniciando...\n", updated.site, updated.controller);
+  restartAt = millis() + IDENTITY_RESTART_DELAY_MS;
+  if (restartAt == 0) restartAt = 1;
+  return "APPLIED_RESTARTING";
+}
+
+// Configuración del controlador. Acepta:
+//  - {"brokers": "host:puerto,host:puerto"}: lista de brokers en orden de prioridad. Se guarda en NVS;
+//    si el broker actual ya no está en la lista se conmuta al mejor de la nueva.
+//  - {"site": "...", "controller": "..."}: identidad provisionada (ver applyIdentityConfig)
+const char* applyControllerConfig(const uint8_t* payload, size_t length) {
+  StaticJsonDocument<384> doc;
+  if (deserializeJson(doc, payload, length)) return "INVALID_JSON";
+
+  if (doc.containsKey("site") || doc.containsKey("controller")) {
+    return applyIdentityConfig(doc["site"], doc["controller"]);
+  }
+
+  const char* text = doc["brokers"];
+  BrokerList updated;
+  if (text == nullptr || !brokerListParse(updated, text, mqtt_port)) return "INVALID_BROKERS";
+
+  // Se conserva el broker en uso si sigue en la lista, para no cortar la conexión
+  const BrokerEndpoint* current = brokerListActive(brokers);
+  int previous = -1;
+  for (int i = 0; current != nullptr && i < updated.count; i++) {
+    if (strcmp(updated.endpoints[i].host, current->host) == 0 && updated.endpoints[i].port == current->port) {
+      updated.endpoints[i].rtt_ms = current->rtt_ms;
+      previous = i;
+    }
+  }
+  brokers = updated;
+  brokers.active = (int8_t)previous;
+
+  char stored[BROKER_LIST_TEXT_MAX];
+  brokerListFormat(brokers, stored, sizeof(stored));
+  nvsSaveBrokers(stored);
+  LOG_I("Brokers MQTT actualizados: %s\n", stored);
+
+  if (previous < 0 && mqttStarted) {
+    brokerListSelect(brokers);
+    switchBroker(-1);
+  }
+  return "APPLIED";
+}
+
+// Comando ya interpretado (ver controlCommandHandle): busca la bomba en nuestro array y ejecuta la acción
+const char* applyPumpCommand(int pumpId, ControlAction action) {
+  for (int i = 0; i < NUM_PUMPS; i++) {
+    if (pumps[i].id != pumpId) continue;
+    LOG_I("⚙️ Procesando comando: %s para Bomba %d\n", action == CONTROL_START ? "START" : "STOP", pumpId);
+    return applyPumpAction(i, action);
+  }
+  LOG_W("⚠️ La Bomba %d no está configurada en este ESP32.\n", pumpId);
+  return "UNKNOWN_PUMP";
+}
+
+// Aplica un comando de control. Devuelve el resultado que se informa en la respuesta MQTT 5.
+const char* applyControlCommand(const char* topic, const uint8_t* payload, size_t length, int& pumpId) {
+  const char* result = controlCommandHandle(identity, topic, payload, length, applyPumpCommand, pumpId);
+  if (pumpId == CONTROL_PUMP_NONE) LOG_W("⚠️ Comando rechazado: %s\n", result);
+  return result;
+}
+
+// "Muestrear ahora" {"slot_ms": <hora real en ms>} (slot opcional). Si el slot es futuro (hasta
+// SAMPLE_TRIGGER_MAX_AHEAD_MS) se espera a ese instante: todos los controladores del sitio leen a la
+// vez aunque el mensaje les llegue con distinta demora.
+void handleSampleTrigger(const uint8_t* payload, size_t length) {
+  int64_t slotMs = 0;
+  StaticJsonDocument<96> doc;
+  if (length > 0 && !deserializeJson(doc, payload, length)) {
+    slotMs = doc["slot_ms"] | (int64_t)0;
+  }
+
+  int64_t now = monoMicros();
+  int64_t slotMono = 0;
+  triggerSampleMono = now;
+  triggerSlotMs = 0; // Muestra en el acto: no corresponde a ningún límite
+  if (slotMs > 0 && timeServiceToMono(timeService, slotMs * 1000, slotMono) && slotMono > now &&
+      slotMono - now <= (int64_t)SAMPLE_TRIGGER_MAX_AHEAD_MS * 1000) {
+    triggerSampleMono = slotMono;
+    triggerSlotMs = slotMs;
+  }
+}
+
+void callback(const char* topic, const uint8_t* payload, size_t length, const MqttMessageProperties& props) {
+  LOG_D("📩 Mensaje recibido en topic: %s\n", topic); // Uno por mensaje: solo en compilaciones de depuración
+  traceInstant("mqtt_rx", (int32_t)length);
+
+  if (strcmp(topic, profileControlTopic) == 0) {
+    const char* result = handleProfileCommand(payload, length, DUMP_SINK_MQTT);
+    if (strcmp(result, "APPLIED") != 0) LOG_W("⚠️ Orden de perfil rechazada: %s\n", result);
     return;
   }
 
-  const char* command = doc["command"];
+  if (strcmp(topic, traceControlTopic) == 0) {
+    const char* result = handleTraceCommand(payload, length, DUMP_SINK_MQTT);
+    if (strcmp(result, "APPLIED") != 0) LOG_W("⚠️ Orden de traza rechazada: %s\n", result);
+    return;
+  }
 
-  // Protección extra: Si command es nulo por alguna razón, salir
-  if (command == nullptr) {
-    Serial.println("⚠️ El comando es nulo.");
+  if (strcmp(topic, captureControlTopic) == 0) {
+    const char* result = handleCaptureCommand(payload, length, DUMP_SINK_MQTT);
+    if (strcmp(result, "APPLIED") != 0) LOG_W("⚠️ Orden de captura rechazada: %s\n", result);
     return;
   }
 
-  Serial.printf("⚙️ Procesando comando: %s para Bomba %d\n", command, pumpId);
+  if (strcmp(topic, scenarioControlTopic) == 0) {
+    const char* result = handleScenarioCommand(payload, length);
+    if (strcmp(result, "APPLIED") != 0) LOG_W("⚠️ Escenario rechazado: %s\n", result);
+    return;
+  }
 
-  // 5. EJECUTAR LA ACCIÓN
-  if (strcmp(command, "START") == 0) {
-    Serial.printf(">>> ✅ ACTIVANDO RELÉ BOMBA %d (Pin %d)\n", targetPump->id, targetPump->relayPin);
-    digitalWrite(targetPump->relayPin, HIGH); 
-    targetPump->is_on = true;
-  } 
-  else if (strcmp(command, "STOP") == 0) {
-    Serial.printf(">>> 🛑 APAGANDO RELÉ BOMBA %d (Pin %d)\n", targetPump->id, targetPump->relayPin);
-    digitalWrite(targetPump->relayPin, LOW); 
-    targetPump->is_on = false;
-  } 
-  else {
-    Serial.printf("❓ Comando desconocido: %s\n", command);
+  if (strcmp(topic, sampleTriggerTopic) == 0) {
+    int64_t handlerStart = stageBegin(STAGE_HANDLER_SAMPLE);
+    handleSampleTrigger(payload, length);
+    stageEnd(STAGE_HANDLER_SAMPLE, handlerStart);
+    return;
   }
+
+  int pumpId = CONTROL_PUMP_NONE;
+  MetricStage handler = strcmp(topic, controllerConfigTopic) == 0 ? STAGE_HANDLER_CONFIG : STAGE_HANDLER_CONTROL;
+  int64_t handlerStart = stageBegin(handler);
+  const char* result = handler == STAGE_HANDLER_CONFIG
+      ? applyControllerConfig(payload, length)
+      : applyControlCommand(topic, payload, length, pumpId);
+  stageEnd(handler, handlerStart);
+
+  // MQTT 5: si el backend pidió respuesta, se contesta en su Response Topic con la misma Correlation Data
+  if (props.response_topic == nullptr) return;
+
+  int64_t mono = monoMicros();
+  char stamp[TIME_STAMP_WIDTH];
+  timeServiceFormatStamp(timeService, mono, stamp);
+  char output[CONTROL_REPLY_MAX];
+  size_t n = controlCommandWriteReply(pumpId, result, stamp, output, sizeof(output));
+  if (n == 0) return;
+
+  MqttPublishProperties replyProps = {&EVENT_PROFILE, props.correlation_data, props.correlation_length};
+  mqttPublishSample(props.response_topic, output, n, mono, MQTT_PRIO_EVENT, MQTT_QOS_DEFAULT, &replyProps);
 }
 
 // -------------------------------------------------------------------------
@@ -246,17 +1746,25 @@ void callback(char* topic, byte* payload, unsigned int length) {
       flow_pulses++;
     }
 
-    // Función que lee el sensor de Corriente (ej. CT no invasivo como SCT-013)
-    float readRealAmps() {
+    // --- Lecturas crudas (lo mismo que entrega la planta simulada, ver más abajo) ---
+
+    // Lectura suelta del sensor de Corriente (ej. CT no invasivo como SCT-013)
+    uint16_t readLineAdcRaw() {
         // En un proyecto real, se usa EmonLib o una librería similar 
         // para medir el RMS del pin analógico. Aquí solo leemos el valor crudo.
-        int sensorValue = analogRead(CURRENT_SENSOR_PIN);
-        // Conversión muy simple: (Valor leído / 4095) * MaxAmps
-        return (float)sensorValue * (25.0 / 4095.0); // Asumiendo un rango máximo de 25A
+        return analogRead(CURRENT_SENSOR_PIN);
     }
 
-    // Función auxiliar para leer la distancia ultrasónica
-    float getDistanceCM() {
+    // Bloque de ciclos completos del CT para el RMS de una bomba
+    void readPumpAdcBlockRaw(int pumpIndex, uint16_t* samples, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+          samples[i] = analogRead(CURRENT_SENSOR_PIN);
+          delayMicroseconds(CURRENT_RMS_SAMPLE_US);
+        }
+    }
+
+    // Duración del eco ultrasónico en µs (0 = sin eco)
+    uint32_t readEchoUsRaw() {
         // Generar pulso
         digitalWrite(ULTRASONIC_TRIG, LOW);
         delayMicroseconds(2);
@@ -264,178 +1772,387 @@ void callback(char* topic, byte* payload, unsigned int length) {
         delayMicroseconds(10);
         digitalWrite(ULTRASONIC_TRIG, LOW);
 
-        // Medir duración del eco
-        long duration = pulseIn(ULTRASONIC_ECHO, HIGH);
+        // Medir duración del eco (timeout de 30 ms: ~5 m ida y vuelta, en vez del segundo por defecto)
+        int64_t echoStart = stageBegin(STAGE_ULTRASONIC);
+        uint32_t duration = pulseIn(ULTRASONIC_ECHO, HIGH, 30000);
+        stageEnd(STAGE_ULTRASONIC, echoStart);
+        return duration;
+    }
+
+    // Pulsos del caudalímetro desde la lectura anterior
+    uint32_t readFlowPulsesRaw(uint32_t* elapsedMs) {
+        static unsigned long lastFlowRead = 0;
+        unsigned long now = millis();
 
-        // Calcular distancia (Velocidad del sonido: 343 m/s)
-        float distance = duration * 0.034 / 2;
-        
-        // Devolver la distancia medida, asegurando un rango razonable
-        if (distance == 0 || distance > 400) return EMPTY_DISTANCE_CM; // Retorna vacío si es error
-        
-        return distance; // Distancia del sensor a la superficie del agua
+        // Tomar los pulsos acumulados sin perder los que lleguen durante la lectura
+        noInterrupts();
+        long pulses = flow_pulses;
+        flow_pulses = 0; // Resetear contador de pulsos
+        interrupts();
+
+        *elapsedMs = now - lastFlowRead;
+        lastFlowRead = now;
+        return pulses;
     }
 
-    // Lee el nicel de agua mediante sensor ultrasonico
-    float readUltrasonicWaterLevel() {
-        float distanceToWater = getDistanceCM();
+    // Temperatura del DS18B20 de una bomba (-127 si no responde)
+    float readTemperatureRaw(int pumpIndex) {
+        DallasTemperature& sensors = (pumpIndex == 0) ? sensors1 : sensors2;
+        int64_t temperatureStart = stageBegin(STAGE_TEMPERATURE);
+        sensors.requestTemperatures();
+        float celsius = sensors.getTempCByIndex(0);
+        stageEnd(STAGE_TEMPERATURE, temperatureStart);
+        return celsius;
+    }
 
-        // Distancia de referencia: La altura máxima de agua que podemos medir.
-        // Max Level = EMPTY_DISTANCE_CM - (TANK_HEIGHT_CM - Max_Water_Level)
-        float maxWaterLevel = EMPTY_DISTANCE_CM; 
+    // Interrupciones de los flotadores: solo registran el instante del flanco
+    void IRAM_ATTR highFloatIsr() {
+      floatEdgeUs[FLOAT_SWITCH_HIGH] = micros();
+    }
 
-        // 1. Calcular la altura de agua real
-        float waterHeight = maxWaterLevel - distanceToWater;
+    void IRAM_ATTR lowFloatIsr() {
+      floatEdgeUs[FLOAT_SWITCH_LOW] = micros();
+    }
 
-        // 2. Escalar a porcentaje (Normalizar respecto a la altura total)
-        float percentage = (waterHeight / TANK_HEIGHT_CM) * 100.0;
+    // Lee el estado crudo de un flotador (true = flotador sumergido)
+    bool readFloatSwitchRaw(FloatSwitchId id) {
+        // Asumimos lógica: LOW cuando hay agua (flotador hundido); HIGH cuando está vacío/bajo (pull-up).
+        int pin = (id == FLOAT_SWITCH_HIGH) ? HIGH_LEVEL_PIN : LOW_LEVEL_PIN;
+        return digitalRead(pin) == LOW;
+    }
 
-        // Asegurar que el porcentaje está entre 0 y 100
-        if (percentage > 100.0) return 100.0;
-        if (percentage < 0.0) return 0.0;
+    void setPumpRelay(int pumpIndex, bool on) {
+        digitalWrite(pumps[pumpIndex].relayPin, on ? HIGH : LOW);
+    }
+#else
+    // --- Planta simulada (ver sim_plant.h) movida por un escenario (ver scenario.h) ---
+    // Los sensores simulados entregan lecturas crudas como las del hardware: de ahí en adelante
+    // (captura, conversiones, controlador) todo es igual. Los relés se accionan igual.
+    uint16_t readLineAdcRaw() {
+        return simPlantLineAdc(simPlant, micros());
+    }
 
-        return percentage;
+    void readPumpAdcBlockRaw(int pumpIndex, uint16_t* samples, size_t count) {
+        simPlantAdcBlock(simPlant, pumpIndex, micros(), CURRENT_RMS_SAMPLE_US, samples, count);
     }
 
-    // Función que lee el nivel de agua (ej. flotador o presión en pin analógico)
-    float readFloaterWaterLevel() {
-        int highStatus = digitalRead(HIGH_LEVEL_PIN); // Leer flotador superior
-        int lowStatus = digitalRead(LOW_LEVEL_PIN);   // Leer flotador inferior
+    uint32_t readEchoUsRaw() {
+        return simPlantEchoUs(simPlant);
+    }
 
-        // Caso 1: Tanque Lleno (Ambos flotadores levantados - HIGH en pull-up)
-        // Asumimos lógica: LOW cuando hay agua (flotador hundido); HIGH cuando está vacío/bajo.
-        if (highStatus == LOW) { // Si el flotador superior detecta agua
-            return 100.0;
-        }
-        
-        // Caso 2: Nivel por Debajo del Flotador Alto pero por Encima del Flotador Bajo
-        if (highStatus == HIGH && lowStatus == LOW) {
-            // En este estado intermedio, el nivel está entre ~20% y ~80%. 
-            // Se puede devolver un valor medio o simplemente un estado de bombeo.
-            return 50.0;
-        }
+    uint32_t readFlowPulsesRaw(uint32_t* elapsedMs) {
+        return simPlantFlowPulses(simPlant, millis(), elapsedMs);
+    }
 
-        // Caso 3: Tanque Vacío (Ambos flotadores caídos - HIGH en pull-up)
-        if (lowStatus == HIGH) { // Si el flotador inferior NO detecta agua
-            return 0.0;
-        }
+    float readTemperatureRaw(int pumpIndex) {
+        return simPlantTemperature(simPlant, pumpIndex);
+    }
 
-        // Default de seguridad
-        return 50.0;
+    bool readFloatSwitchRaw(FloatSwitchId id) {
+        return simPlantFloatRaw(simPlant, id, nullptr);
     }
 
-    // Función que lee el sensor de Flujo (Calcula L/min)
-    float readRealInflowRate() {
-        // La lógica debe calcular los pulsos/segundo (flow_pulses) y convertirlos a L/min
-        float flow_rate = (float)flow_pulses * 0.00225; // Ejemplo: 0.00225 L/pulso Ese es un valor K que depende del sensor
-        flow_pulses = 0; // Resetear contador de pulsos
-        return flow_rate;
+    void setPumpRelay(int pumpIndex, bool on) {
+        digitalWrite(pumps[pumpIndex].relayPin, on ? HIGH : LOW);
+        simPlantSetRelay(simPlant, pumpIndex, on);
     }
 #endif
 
+// --- Lecturas en unidades: cada lectura cruda pasa por la captura y por las conversiones del controlador ---
+
+// Corriente de línea (lectura suelta del CT)
+float readLineAmps() {
+  uint16_t counts = readLineAdcRaw();
+  captureLineAdc(sensorCapture, micros(), counts);
+  return tankLineAmps(tankController.cfg, counts);
+}
+
+// Corriente RMS real del CT: muestrea un bloque de ciclos completos y elimina el offset DC
+float readPumpAmpsRms(int pumpIndex) {
+  static uint16_t samples[CURRENT_RMS_SAMPLES];
+  uint32_t blockStart = micros();
+  readPumpAdcBlockRaw(pumpIndex, samples, CURRENT_RMS_SAMPLES);
+  captureAdcBlock(sensorCapture, blockStart, pumpIndex, samples, CURRENT_RMS_SAMPLES);
+  return tankPumpAmps(tankController.cfg, samples, CURRENT_RMS_SAMPLES);
+}
+
+// Altura de agua (cm desde el fondo) mediante sensor ultrasonico. NAN si la lectura falló.
+float readUltrasonicWaterHeightCm() {
+  uint32_t echoUs = readEchoUsRaw();
+  captureEcho(sensorCapture, micros(), echoUs);
+  return tankEchoHeightCm(tankController.cfg, echoUs);
+}
+
+// Entrada de la calle (L/min) con los pulsos del caudalímetro
+float readInflowRate() {
+  uint32_t elapsedMs = 0;
+  uint32_t pulses = readFlowPulsesRaw(&elapsedMs);
+  captureFlow(sensorCapture, micros(), pulses, elapsedMs);
+  return tankInflowLpm(tankController.cfg, pulses, elapsedMs);
+}
+
+float readPumpTemperature(int pumpIndex) {
+  float celsius = readTemperatureRaw(pumpIndex);
+  captureTemperature(sensorCapture, micros(), pumpIndex, celsius);
+  return celsius;
+}
+
 // -------------------------------------------------------------------------
 // 5. LÓGICA DE LECTURA Y PUBLICACIÓN
 // -------------------------------------------------------------------------
 
-void read_or_mock_sensors() {
-  
-  #if SENSOR_SIMULATION
-  // CASO A: SIMULACIÓN DE DATOS (PARA PRUEBA DE JSON/BACKEND)
-    is_flow_detected = (millis() / 30000) % 2 == 0; 
-    
-    if (is_flow_detected) {
-      current_amps = 10.0 + (float)random(0, 50) / 10.0;
-      current_inflow_rate = 140.0 + (float)random(0, 300) / 10.0;
-      water_level_percent = min(100.0, water_level_percent + 0.1);
-    } else {
-      current_amps = 0.0;
-      current_inflow_rate = 0.0;
-      water_level_percent = max(0.0, water_level_percent - 0.05);
+// Lecturas de un ciclo de telemetría (las de cada bomba incluidas), en unidades para el controlador
+void readSensors(TankReadings& readings) {
+  readings.line_amps = readLineAmps();
+  readings.inflow_lpm = readInflowRate();
+  readings.ultrasonic_height_cm = readUltrasonicWaterHeightCm();
+
+  for (int i = 0; i < NUM_PUMPS; i++) {
+    // Si está ON, leemos amperaje (o simulamos basado en estado si no hay sensor CT individual)
+    readings.pump_amps[i] = tankController.pump_on[i] ? readPumpAmpsRms(i) : 0.0;
+    readings.temperature_c[i] = readPumpTemperature(i);
+  }
+  readings.now_ms = millis();
+}
+
+// Guarda los totales de energía en NVS si pasó el intervalo o se acumuló suficiente energía
+void persistEnergyIfNeeded() {
+  unsigned long now = millis();
+  bool intervalElapsed = now - lastEnergyPersist >= ENERGY_PERSIST_INTERVAL_MS;
+
+  for (int i = 0; i < NUM_PUMPS; i++) {
+    EnergyMeter& meter = tankController.meters[i];
+    if (meter.unsaved_kwh <= 0.0) continue;
+
+    if (intervalElapsed || meter.unsaved_kwh >= ENERGY_PERSIST_MIN_KWH) {
+      nvsSaveEnergy(pumps[i].id, meter.total_kwh, meter.total_m3);
+      energyMeterMarkPersisted(meter);
     }
-  #else
-    // CASO B: LECTURA DE HARDWARE REAL
-    // La lectura de sensores reales (analógicos y digitales)
-    current_amps = readRealAmps();
-    water_level_percent = readFloaterWaterLevel();
-    current_inflow_rate = readRealInflowRate();
-    
-    // El flujo se detecta si la tasa de entrada es > 0
-    is_flow_detected = current_inflow_rate > 0.5; // Umbral de 0.5 L/min
-    
-    Serial.println("!!! LEYENDO HARDWARE REAL !!!");
-  #endif
+  }
+
+  if (intervalElapsed) lastEnergyPersist = now;
+}
+
+// Atiende un cruce de nivel confirmado (el controlador ya actualizó el estimador): relés y publicación inmediata
+void handleFloatEvent(const FloatLevelEvent& event, uint8_t stopMask) {
+  const char* name = floatLevelEventName(event);
+  LOG_I("🔔 Flotador %s: %s\n", event.id == FLOAT_SWITCH_HIGH ? "superior" : "inferior", name);
+  scenarioNote(name);
+
+  // 1. CONTROL: tanque vacío -> el controlador marcó qué bombas apagar para que no trabajen en seco
+  for (int i = 0; i < NUM_PUMPS; i++) {
+    if (stopMask & (1u << i)) {
+      stopPump(i);
+      scenarioNote("PUMP_STOP");
+    }
+  }
+
+  // 2. PUBLICACIÓN INMEDIATA
+  StaticJsonDocument<192> doc;
+  doc["event"] = name;
+  doc["switch"] = event.id == FLOAT_SWITCH_HIGH ? "HIGH" : "LOW";
+  doc["wet"] = event.wet;
+  doc["detection_latency_ms"] = (event.detected_us - event.edge_us) / 1000;
+  doc["water_level_percent"] = tankController.level_percent;
+  // La hora del evento es la del flanco, no la de la confirmación del antirrebote
+  int64_t edgeMono = monoMicros() - (int64_t)(uint32_t)(micros() - event.edge_us);
+  addSampleStamp(doc, edgeMono);
+
+  char output[192];
+  size_t n = serializeJson(doc, output);
+
+  // El vaciado del tanque es una alarma (apaga bombas); los demás cruces son eventos
+  bool isAlarm = event.id == FLOAT_SWITCH_LOW && !event.wet;
+  mqttPublishSample(levelEventTopic, output, n, edgeMono, isAlarm ? MQTT_PRIO_ALARM : MQTT_PRIO_EVENT);
+}
+
+// Evalúa el antirrebote de los flotadores; se llama en cada vuelta del loop
+void pollFloatSwitches() {
+  uint32_t now = micros();
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) {
+    FloatSwitchId id = (FloatSwitchId)i;
+    bool raw = readFloatSwitchRaw(id);
+    uint32_t edgeUs = floatEdgeUs[i];
+
+    // En la captura, solo los cambios (nivel crudo o flanco nuevo); al empezar, el estado de partida
+    if (captureActive(sensorCapture) &&
+        (captureFloatsPending || raw != capturedFloatRaw[i] || edgeUs != capturedFloatEdgeUs[i])) {
+      captureFloat(sensorCapture, now, millis(), i, raw, edgeUs);
+      capturedFloatRaw[i] = raw;
+      capturedFloatEdgeUs[i] = edgeUs;
+    }
+
+    FloatLevelEvent event;
+    uint8_t stopMask;
+    if (tankControllerFloat(tankController, id, raw, edgeUs, now, millis(), event, stopMask)) {
+      handleFloatEvent(event, stopMask);
+    }
+  }
+  captureFloatsPending = false;
+}
+
+// Publica la alerta de fuga (o su cierre) en el tópico del tanque
+void publishLeakEvent(TankLeakEvent event) {
+  const char* type = (event == LEAK_EVENT_RAISED) ? "LEAK_SUSPECTED" : "LEAK_CLEARED";
+  scenarioNote(type);
+
+  StaticJsonDocument<192> doc;
+  doc["type"] = type;
+  doc["leak_rate_lpm"] = tankController.balance.leak_rate_lpm;
+  doc["window_minutes"] = LEAK_WINDOW_MS / 60000UL;
+  doc["water_level_percent"] = tankController.level_percent;
+  int64_t mono = monoMicros();
+  addSampleStamp(doc, mono);
+
+  char output[192];
+  size_t n = serializeJson(doc, output);
+
+  mqttPublishSample(tankAlertTopic, output, n, mono, MQTT_PRIO_ALARM);
+
+  if (event == LEAK_EVENT_RAISED) {
+    LOG_W("🚨 POSIBLE FUGA: pérdida estimada de %.1f L/min con bombas en reposo\n", tankController.balance.leak_rate_lpm);
+  } else {
+    LOG_I("✅ Balance del tanque normal, alerta de fuga cerrada\n");
+  }
 }
 
-void publishTelemetry() {
-  // 1. LEER SENSORES GLOBALES (Entrada de calle y Nivel Tanque)
-  read_or_mock_sensors(); 
+// `slotMs`: límite de la hora real al que pertenece la muestra (0 = muestreo libre)
+void publishTelemetry(int64_t slotMs) {
+  // 1. LEER SENSORES (Entrada de calle, Nivel Tanque y cada bomba) Y PASARLOS AL CONTROLADOR
+  int64_t sampleMono = stageBegin(STAGE_TELEMETRY); // Instante de la muestra (común a todas las bombas)
+  int64_t sensorsStart = stageBegin(STAGE_SENSORS);
+  TankReadings readings;
+  readSensors(readings);
+  stageEnd(STAGE_SENSORS, sensorsStart);
+  captureCycle(sensorCapture, micros(), readings.now_ms);
+
+  TankLeakEvent leakEvent = tankControllerSample(tankController, readings);
+  if (leakEvent != LEAK_EVENT_NONE) {
+    publishLeakEvent(leakEvent);
+  }
+
+  // DS18B20 que dejó de responder (-127 °C): su temperatura sale null hasta que vuelva
+  for (int i = 0; i < NUM_PUMPS; i++) {
+    if (!(tankController.temperature_changed & (1u << i))) continue;
+    if (tankController.temperature_fault[i]) {
+      LOG_W("🌡️ Sensor de temperatura de la Bomba %d sin respuesta\n", pumps[i].id);
+      scenarioNote("TEMP_FAULT");
+    } else {
+      LOG_I("🌡️ Sensor de temperatura de la Bomba %d de vuelta\n", pumps[i].id);
+      scenarioNote("TEMP_OK");
+    }
+  }
+
+  // Balance del tanque en ventanas cortas y largas (común a todas las bombas)
+  const TankBalance& balance = tankController.balance;
+  TankBalanceWindow balance5;
+  TankBalanceWindow balance15;
+  bool hasBalance5 = tankBalanceWindow(balance, 5UL * 60000UL, balance5);
+  bool hasBalance15 = tankBalanceWindow(balance, 15UL * 60000UL, balance15);
+
+  LevelTrendEstimate trend;
+  bool hasTrend = levelTrendEstimate(tankController.trend, TANK_CAPACITY_LITERS, trend);
   
   // -----------------------------------------------------
   // BUCLE PARA PUBLICAR LOS DATOS DE CADA BOMBA
   // -----------------------------------------------------
   for (int i = 0; i < NUM_PUMPS; i++) {
     Pump currentPump = pumps[i];
-    
-    // 2. LECTURA ESPECÍFICA (Amperaje y Temperatura)
-    float pump_amps = 0.0;
-    float pump_temperature_celsius = 25.0;
-
-    #if SENSOR_SIMULATION
-      // Si la bomba está ON, generamos amperaje simulado. Si está OFF, es 0.
-      pump_amps = currentPump.is_on ? (10.0 + (float)random(0, 50) / 10.0) : 0.0;
-      pump_temperature_celsius = currentPump.is_on ? (65.0 + (float)random(-100, 150) / 10.0) : 25.0;
-    #else
-      // HARDWARE REAL
-      // Si está ON, leemos amperaje (o simulamos basado en estado si no hay sensor CT individual)
-      pump_amps = currentPump.is_on ? (readRealAmps() * 0.8) : 0.0; 
-
-      if (currentPump.id == 1) {
-        sensors1.requestTemperatures();
-        pump_temperature_celsius = sensors1.getTempCByIndex(0);
-      } else if (currentPump.id == 2) {
-        sensors2.requestTemperatures();
-        pump_temperature_celsius = sensors2.getTempCByIndex(0);
-      }
-    #endif
-    
-    // 3. CREAR EL JSON
-    StaticJsonDocument<256> doc;
+    float pump_amps = readings.pump_amps[i];
 
-    doc["pump_id"] = currentPump.id;
-    doc["current_amps"] = pump_amps;
-    doc["pump_temperature_celsius"] = pump_temperature_celsius;
-    
-    // Dato GLOBAL: El flujo de entrada se muestra siempre (aunque la bomba esté apagada)
-    doc["current_inflow_rate"] = current_inflow_rate; 
+    // 2. ENERGÍA: el controlador ya la integró con la corriente de este ciclo
+    EnergyMeter& meter = tankController.meters[i];
+    double interval_m3 = 0.0;
+    double interval_kwh = energyMeterCloseInterval(meter, &interval_m3);
     
-    doc["timestamp"] = (long)time(NULL); 
-    doc["water_level_percent"] = water_level_percent; 
-    
-    // El estado "FLOWING" (que pone la bomba verde en el frontend) 
-    // SOLO debe activarse si LA BOMBA TIENE AMPERAJE (está encendida).
-    // El current inflow rate debería ser para esto, pero se uso como corriente de agua en el front y se mantuvo, el street flow era el flujo de la calle
-    // debo corregir esto
-    doc["street_flow_status"] = (pump_amps > 0) ? "FLOWING" : "STOPPED";
-    
-    char output[256];
-    size_t n = serializeJson(doc, output);
-    
-    // Tópico dinámico
-    char topicBuffer[40];
-    sprintf(topicBuffer, "caracas/pumps/%d/telemetry", currentPump.id);
+    // 3. CREAR EL JSON (ver telemetry_payload.h)
+    TelemetrySample sample;
+    sample.pump_id = currentPump.id;
+    sample.amps = pump_amps;
+    sample.temperature_c = tankController.temperature_fault[i] ? NAN : readings.temperature_c[i];
+    sample.inflow_rate = readings.inflow_lpm;
+    sample.slot_ms = slotMs;
+    sample.level_percent = tankController.level_percent;
+    sample.level_sigma_percent = tankController.level_sigma_percent;
+    sample.queue_depth = mqttPublisher.stats.queue_depth;
+    sample.ack_latency_ms = mqttPublisher.stats.ack_latency_avg_ms;
+    sample.power_w = meter.last_power_w;
+    sample.energy_kwh_total = meter.total_kwh;
+    sample.energy_kwh_interval = interval_kwh;
+    sample.pumped_m3_interval = interval_m3;
+    sample.energy_kwh_per_m3 = energyMeterKwhPerM3(meter);
+    sample.tank_volume_l = tankController.tank_volume_l;
+    sample.inflow_total_l = balance.inflow_total_l;
+    sample.trend = hasTrend ? &trend : nullptr;
+    sample.balance5 = hasBalance5 ? &balance5 : nullptr;
+    sample.balance15 = hasBalance15 ? &balance15 : nullptr;
+    sample.leak_suspected = balance.leak_active;
+    sample.leak_rate_lpm = balance.leak_rate_lpm;
+
+    char stamp[TIME_STAMP_WIDTH]; // "ts_ms": hora real en ms o null si todavía no hay NTP
+    timeServiceFormatStamp(timeService, sampleMono, stamp);
 
-    // Publicar
-    #if PUMP_MODE
-      if (client.connected()) {
-          client.publish(topicBuffer, output, n);
-      }
-    #endif
+    // Tópico dinámico
+    char topicBuffer[MQTT_TOPIC_MAX];
+    devicePumpTopic(identity, currentPump.id, "telemetry", topicBuffer, sizeof(topicBuffer));
+
+    // Publicar (asíncrono: si no hay conexión queda en la cola). El JSON se escribe directamente
+    // en el lugar de la cola de salida, sin buffer intermedio.
+    MqttPublishProperties telemetryProps = {&TELEMETRY_PROFILE, nullptr, 0};
+    int64_t serializeStart = stageBegin(STAGE_SERIALIZE);
+    bool queued = telemetryPayloadPublish(mqttPublisher, topicBuffer, MQTT_QOS_TELEMETRY, &telemetryProps, sample,
+                                          stamp, sampleMono, millis());
+    stageEnd(STAGE_SERIALIZE, serializeStart);
+    if (!queued) {
+      LOG_W("⚠️ La telemetría de la Bomba %d no se encoló (cola llena)\n", currentPump.id);
+      continue;
+    }
     
     // Debug
-    Serial.printf("Bomba %d | Amps: %.1f | Status: %s | Entrada Calle: %.1f\n", 
-      currentPump.id, pump_amps, (pump_amps > 0) ? "FLOWING" : "STOPPED", current_inflow_rate);
+    LOG_D("Bomba %d | Amps: %.1f | Status: %s | Entrada Calle: %.1f\n", 
+      currentPump.id, pump_amps, (pump_amps > 0) ? "FLOWING" : "STOPPED", readings.inflow_lpm);
 
   } // Fin del bucle
+
+  int64_t nvsStart = stageBegin(STAGE_NVS);
+  persistEnergyIfNeeded();
+  stageEnd(STAGE_NVS, nvsStart);
+  stageEnd(STAGE_TELEMETRY, sampleMono);
+  if (!steadyStateArmed && ++telemetryCycles >= STEADY_STATE_WARMUP_CYCLES) steadyStateArmed = STEADY_STATE_ALLOC_CHECK;
+}
+
+// Decide cuándo tomar y publicar la telemetría (aplica a todos los modos)
+void serviceTelemetrySchedule() {
+  long now = millis();
+  int64_t mono = monoMicros();
+
+  // 1. "Muestrear ahora" pedido por el backend
+  if (triggerSampleMono != 0 && mono >= triggerSampleMono) {
+    triggerSampleMono = 0;
+    lastMsg = now;
+    publishTelemetry(triggerSlotMs);
+    return;
+  }
+
+  // 2. Límite de la hora real (se programa el siguiente en cuanto hay NTP)
+  bool aligned = TELEMETRY_CLOCK_ALIGNED && timeService.synced;
+  if (aligned && alignedSampleMono == 0) {
+    timeServiceNextBoundary(timeService, mono, PUBLISH_INTERVAL, alignedSampleMono, alignedSlotMs);
+  }
+  if (aligned && mono >= alignedSampleMono) {
+    alignedSampleMono = 0;
+    telemetryNow = false;
+    lastMsg = now;
+    publishTelemetry(alignedSlotMs);
+    return;
+  }
+
+  // 3. Sin NTP: intervalo libre de millis(); la primera conexión publica en el acto
+  if (telemetryNow || (!aligned && now - lastMsg > PUBLISH_INTERVAL)) {
+    telemetryNow = false;
+    lastMsg = now;
+    publishTelemetry(0);
+  }
 }
 
 // -------------------------------------------------------------------------
@@ -443,26 +2160,66 @@ void publishTelemetry() {
 // -------------------------------------------------------------------------
 
 void setup() {
+  // Las asignaciones de esta tarea (setup() y loop()) se cuentan aparte: ver publishDiagnostics()
+  allocCounterTrackCurrentTask();
+
+  // Lo que pasó antes de setup() (cargador de arranque, inicio del core) queda como fase "pre_setup"
+  bootProfileInit(bootProfile);
+  bootPhaseBegin(bootProfile, "pre_setup", 0);
+  bootPhaseBegin(bootProfile, "serial", micros());
   Serial.begin(baudrate);
+  logBegin();
+  traceRecorderBegin();
+
+  bootPhaseBegin(bootProfile, "stall_monitor", micros());
+  stallMonitorBegin(nvsNextBootCount());
+  heapMonitorBegin();
+
+  bootPhaseBegin(bootProfile, "identity", micros());
+  loadDeviceIdentity();
   
+  bootPhaseBegin(bootProfile, "wifi", micros());
   setup_wifi();
+
+  bootPhaseBegin(bootProfile, "mqtt_config", micros());
+  // Semillas distintas por equipo para que el jitter no coincida entre controladores
+  backoffInit(wifiBackoff, WIFI_BACKOFF, esp_random());
+  backoffInit(mqttBackoff, MQTT_BACKOFF, esp_random());
+  loadBrokerList();
   
-  // Si tenemos Wi-Fi, configuramos el MQTT
-  if (WiFi.status() == WL_CONNECTED) {
-    client.setServer(mqtt_server, mqtt_port);
-    client.setCallback(callback);
-  }
+  // Si tenemos Wi-Fi, arrancamos el MQTT (si no, se intenta desde el loop cuando conecte)
+  timeServiceInit(timeService);
+  stageMetricsInit(stageMetrics, millis());
+  mqttPublisherInit(mqttPublisher, &mqttTransport, restampSample);
+  mqttPublisher.done_fn = onPublisherDone;
+  startMqtt();
 
   // --- CONFIGURACIÓN DE PINES DE CONTROL (RELÉS) ---
+  bootPhaseBegin(bootProfile, "relays", micros());
   pinMode(RELAY_PIN_PUMP_1, OUTPUT);
   digitalWrite(RELAY_PIN_PUMP_1, LOW); // Iniciar apagada
   
   pinMode(RELAY_PIN_PUMP_2, OUTPUT);
   digitalWrite(RELAY_PIN_PUMP_2, LOW); // Iniciar apagada
+
+  // --- MEDIDORES DE ENERGÍA (recuperar acumulados de la NVS) ---
+  bootPhaseBegin(bootProfile, "energy_nvs", micros());
+  double stored_kwh[NUM_PUMPS] = {};
+  double stored_m3[NUM_PUMPS] = {};
+  for (int i = 0; i < NUM_PUMPS; i++) {
+    nvsLoadEnergy(pumps[i].id, stored_kwh[i], stored_m3[i]);
+    LOG_I("Bomba %d | Energía acumulada: %.3f kWh | Volumen: %.2f m3\n", pumps[i].id, stored_kwh[i], stored_m3[i]);
+  }
+
+  // --- CONTROLADOR DEL TANQUE (estimadores, balance, flotadores y energía) ---
+  bootPhaseBegin(bootProfile, "estimators", micros());
+  tankControllerInit(tankController, PLANT_CONTROLLER_CONFIG, stored_kwh, stored_m3);
+  captureInit(sensorCapture, nullptr, 0);
   
   #if !SENSOR_SIMULATION
     // INICIALIZACIÓN DEL HARDWARE REAL (Solo sensores)
-    Serial.println("--- Iniciando Sensores Reales ---");
+    bootPhaseBegin(bootProfile, "sensors", micros());
+    LOG_I("--- Iniciando Sensores Reales ---\n");
 
     // DS18B20
     sensors1.begin(); 
@@ -472,35 +2229,93 @@ void setup() {
     pinMode(FLOW_SENSOR_PIN, INPUT_PULLUP);
     attachInterrupt(digitalPinToInterrupt(FLOW_SENSOR_PIN), flowPulseCounter, RISING);
     
-    // Sensores de nivel
+    // Sensores de nivel (flanco en ambos sentidos para detectar llenado y vaciado)
     pinMode(HIGH_LEVEL_PIN, INPUT_PULLUP);
     pinMode(LOW_LEVEL_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(HIGH_LEVEL_PIN), highFloatIsr, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(LOW_LEVEL_PIN), lowFloatIsr, CHANGE);
    
     // Ultrasonico
     pinMode(ULTRASONIC_TRIG, OUTPUT);
     pinMode(ULTRASONIC_ECHO, INPUT);
     
   #else
-    Serial.println("--- Modo Simulación Activo (Sensores Simulados / Relés Reales) ---");
+    LOG_I("--- Modo Simulación Activo (Planta Simulada / Relés Reales) ---\n");
+    loadScenario(SIM_DEFAULT_SCENARIO); // Otro guion: scenario/set o tools/scenario_runner.cpp en el host
+    scenarioNote("BOOT");
   #endif
   
+  bootPhaseBegin(bootProfile, "time", micros());
   configTime(0, 0, "pool.ntp.org");
   setenv("TZ", "VET-4", 1);
+  bootPhaseEnd(bootProfile, micros());
+
+  // Recién ahora: las esperas de arriba (Wi-Fi, primer sondeo de brokers) pasan del plazo del watchdog
+  stallWatchdogBegin();
 }
 
 void loop() {
+  stallLoopBegin();
+  int64_t loopStart = monoMicros();
+  uint32_t loopAllocStart = allocCounterTracked();
+
   #if PUMP_MODE
-    // Modos que requieren conexión: intentar reconectar y mantener el loop MQTT
-    if (!client.connected()) {
-      reconnect();
+    // Modos que requieren conexión: los reintentos se programan con backoff y el cliente
+    // conecta en su propia tarea; aquí solo se atienden sus eventos y se despacha la cola
+    // de salida (nada bloquea)
+    int64_t stageStart = stageBegin(STAGE_WIFI);
+    maintainWifi();
+    stageEnd(STAGE_WIFI, stageStart);
+    stageStart = stageBegin(STAGE_MQTT_RECONNECT);
+    maintainMqtt();
+    stageEnd(STAGE_MQTT_RECONNECT, stageStart);
+    stageStart = stageBegin(STAGE_MQTT_POLL);
+    mqttTransport.poll();
+    stageEnd(STAGE_MQTT_POLL, stageStart);
+    stageStart = stageBegin(STAGE_MQTT_DISPATCH);
+    if (!scenarioBrokerDown) mqttPublisherService(mqttPublisher, millis()); // Broker caído por el escenario
+    stageEnd(STAGE_MQTT_DISPATCH, stageStart);
+    // Al enviarse, no al encolarse: encolada con conexión puede quedar atrás de otras o perderse en un corte
+    if (bootMetrics.first_publish_ms == 0 && mqttPublisher.stats.sent_by_priority[MQTT_PRIO_TELEMETRY] > 0) {
+      bootMetrics.first_publish_ms = millis();
     }
-    client.loop();
   #endif
 
-  long now = millis();
-  // Publicar si ha pasado el intervalo de tiempo (aplica a todos los modos)
-  if (now - lastMsg > PUBLISH_INTERVAL) {
-    lastMsg = now;
-    publishTelemetry();
+  #if SENSOR_SIMULATION
+    serviceScenario();
+  #endif
+
+  // Flotadores: los cruces de nivel se atienden y publican sin esperar al ciclo de telemetría
+  pollFloatSwitches();
+
+  // Reinicio pedido por un cambio de identidad: antes se guardan los acumulados de energía
+  if (restartAt != 0 && (long)(millis() - restartAt) >= 0) {
+    for (int i = 0; i < NUM_PUMPS; i++) {
+      nvsSaveEnergy(pumps[i].id, tankController.meters[i].total_kwh, tankController.meters[i].total_m3);
+    }
+    ESP.restart();
   }
+
+  serviceTimeSync();
+  serviceTelemetrySchedule();
+  serviceSerialCommands();
+  serviceProfiler();
+  serviceDump();
+
+  #if PUMP_MODE
+    // Perfil de arranque: tras la primera telemetría, esperando (un tiempo acotado) la hora NTP
+    if (!bootMetrics.reported && bootMetrics.first_publish_ms != 0 &&
+        (bootMetrics.ntp_ms != 0 || millis() - bootMetrics.first_publish_ms > BOOT_PROFILE_NTP_WAIT_MS)) {
+      publishBootMetrics();
+    }
+
+    if (millis() - stageMetrics.window_start_ms >= METRICS_INTERVAL_MS) publishStageMetrics();
+    if (mqttTransport.connected()) uploadStallRecord();
+    serviceHeapMonitor();
+    serviceLogSink();
+  #endif
+
+  recordStage(STAGE_LOOP, loopStart);
+  stageAllocs[STAGE_LOOP] += allocCounterTracked() - loopAllocStart;
+  stallLoopEnd();
 }
\ No newline at end of file
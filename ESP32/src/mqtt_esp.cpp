@@ -0,0 +1,281 @@
+#include "mqtt_esp.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <esp_idf_version.h>
+
+#include "mqtt_publisher.h"
+#include "trace_recorder.h"
+
+// Copia de un evento de esp-mqtt que viaja de la tarea de red al loop
+struct EspMqttQueuedEvent {
+  uint8_t type;
+  bool session_present;
+  int msg_id;
+  char topic[MQTT_TOPIC_MAX];
+  char response_topic[MQTT_TOPIC_MAX];
+  char content_type[MQTT_CONTENT_TYPE_MAX];
+  uint8_t correlation[MQTT_CORRELATION_MAX];
+  uint16_t correlation_length;
+  uint8_t payload[MQTT_INBOUND_MAX];
+  uint16_t length;
+};
+
+enum {
+  QUEUED_CONNECTED = 0,
+  QUEUED_DISCONNECTED,
+  QUEUED_PUBLISHED,
+  QUEUED_DELETED,
+  QUEUED_DATA
+};
+
+#define ESP_MQTT_IN_BUFFER (MQTT_INBOUND_MAX + MQTT_TOPIC_MAX)  // Comandos entrantes sin fragmentar
+#define ESP_MQTT_OUT_BUFFER (MQTT_JUMBO_PAYLOAD_MAX + MQTT_TOPIC_MAX + ESP_MQTT_PUBLISH_OVERHEAD)
+// 64: encabezados, formato, vencimiento y la propiedad de usuario "schema_version"
+static_assert(MQTT_CONTENT_TYPE_MAX + MQTT_CORRELATION_MAX + 64 <= ESP_MQTT_PUBLISH_OVERHEAD,
+              "Las propiedades MQTT 5 no entran en ESP_MQTT_PUBLISH_OVERHEAD");
+
+// Configuración completa del cliente (esp_mqtt_set_config también sobrescribe los campos que no se dan)
+static void fillClientConfig(const MqttConnectConfig& config, esp_mqtt_client_config_t& cfg) {
+  cfg = {};
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+  cfg.broker.address.hostname = config.host;
+  cfg.broker.address.port = config.port;
+  cfg.broker.address.transport = MQTT_TRANSPORT_OVER_TCP;
+  cfg.credentials.client_id = config.client_id;
+  cfg.credentials.username = config.username;
+  cfg.credentials.authentication.password = config.password;
+  cfg.session.message_retransmit_timeout = ESP_MQTT_RETRANSMIT_MS;
+  cfg.network.reconnect_timeout_ms = ESP_MQTT_FALLBACK_RECONNECT_MS;
+  cfg.buffer.size = ESP_MQTT_IN_BUFFER;
+  cfg.buffer.out_size = ESP_MQTT_OUT_BUFFER;
+#if ESP_MQTT_USE_V5
+  // Sesión persistente: los comandos QoS1 emitidos durante un corte llegan al reconectar,
+  // salvo que hayan vencido (Message Expiry Interval puesto por el backend)
+  cfg.session.protocol_ver = MQTT_PROTOCOL_V_5;
+  cfg.session.disable_clean_session = true;
+#endif
+#else
+  cfg.host = config.host;
+  cfg.port = config.port;
+  cfg.transport = MQTT_TRANSPORT_OVER_TCP;
+  cfg.client_id = config.client_id;
+  cfg.username = config.username;
+  cfg.password = config.password;
+  cfg.message_retransmit_timeout = ESP_MQTT_RETRANSMIT_MS;
+  cfg.reconnect_timeout_ms = ESP_MQTT_FALLBACK_RECONNECT_MS;
+  cfg.buffer_size = ESP_MQTT_IN_BUFFER;
+  cfg.out_buffer_size = ESP_MQTT_OUT_BUFFER;
+#endif
+}
+
+bool EspMqttTransport::copyHost(const char* host) {
+  // Si no cabe se rechaza antes de tocar la copia: el broker actual sigue valiendo
+  if (host == nullptr || strlen(host) >= sizeof(host_)) return false;
+  snprintf(host_, sizeof(host_), "%s", host);
+  config_.host = host_;
+  return true;
+}
+
+bool EspMqttTransport::begin(const MqttConnectConfig& config, const MqttTransportHandler& handler) {
+  handler_ = handler;
+  config_ = config;
+  if (!copyHost(config.host)) return false;
+  if (events_ == nullptr) {
+    events_ = xQueueCreate(ESP_MQTT_EVENT_QUEUE_LEN, sizeof(EspMqttQueuedEvent));
+    if (events_ == nullptr) return false;
+  }
+
+  esp_mqtt_client_config_t cfg;
+  fillClientConfig(config_, cfg);
+  client_ = esp_mqtt_client_init(&cfg);
+  if (client_ == nullptr) return false;
+
+#if ESP_MQTT_USE_V5
+  esp_mqtt5_connection_property_config_t connectProps = {};
+  connectProps.session_expiry_interval = ESP_MQTT_SESSION_EXPIRY_S;
+  esp_mqtt5_client_set_connect_property(client_, &connectProps);
+#endif
+
+  esp_mqtt_client_register_event(client_, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, onEvent, this);
+  return esp_mqtt_client_start(client_) == ESP_OK;
+}
+
+bool EspMqttTransport::connected() const {
+  return connected_;
+}
+
+bool EspMqttTransport::setBroker(const char* host, uint16_t port) {
+  if (client_ == nullptr || !copyHost(host)) return false;
+  config_.port = port;
+
+  esp_mqtt_client_config_t cfg;
+  fillClientConfig(config_, cfg);
+  if (esp_mqtt_set_config(client_, &cfg) != ESP_OK) return false;
+
+  // Si seguía conectado al anterior se corta; el evento DISCONNECTED reprograma el intento
+  if (connected_) esp_mqtt_client_disconnect(client_);
+  return true;
+}
+
+bool EspMqttTransport::reconnect() {
+  if (client_ == nullptr || connected_) return false;
+  // Solo surte efecto mientras el cliente espera para reconectar: adelanta el intento
+  return esp_mqtt_client_reconnect(client_) == ESP_OK;
+}
+
+#if ESP_MQTT_USE_V5
+mqtt5_user_property_handle_t EspMqttTransport::userProperties(const MqttPublishProfile* profile) {
+  if (profile == nullptr || profile->schema_version == nullptr) return nullptr;
+
+  // La lista se arma una sola vez por perfil; esp-mqtt la copia en cada publicación
+  for (int i = 0; i < ESP_MQTT_PROFILES; i++) {
+    if (profileKeys_[i] == profile) return profileProps_[i];
+    if (profileKeys_[i] == nullptr) {
+      esp_mqtt5_user_property_item_t items[] = {{"schema_version", profile->schema_version}};
+      esp_mqtt5_client_set_user_property(&profileProps_[i], items, 1);
+      profileKeys_[i] = profile;
+      return profileProps_[i];
+    }
+  }
+  return nullptr;
+}
+#endif
+
+int EspMqttTransport::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos,
+                              const MqttPublishProperties* props) {
+  if (client_ == nullptr) return -1;
+  int retain = (props != nullptr && props->profile != nullptr && props->profile->retain) ? 1 : 0;
+
+#if ESP_MQTT_USE_V5
+  if (props != nullptr && (props->profile != nullptr || props->correlation_length > 0)) {
+    const MqttPublishProfile* profile = props->profile;
+    esp_mqtt5_publish_property_config_t pubProps = {};
+
+    if (profile != nullptr) {
+      pubProps.payload_format_indicator = true; // JSON en UTF-8
+      pubProps.content_type = profile->content_type;
+      pubProps.message_expiry_interval = profile->expiry_s;
+      pubProps.user_property = userProperties(profile);
+    }
+
+    if (props->correlation_length > 0) {
+      pubProps.correlation_data = (const char*)props->correlation_data;
+      pubProps.correlation_data_len = props->correlation_length;
+    }
+    esp_mqtt5_client_set_publish_property(client_, &pubProps);
+  }
+#else
+  (void)props;
+#endif
+  // enqueue no bloquea: el mensaje queda en el outbox del cliente y lo envía su tarea
+  return esp_mqtt_client_enqueue(client_, topic, (const char*)payload, (int)length, qos, retain, true);
+}
+
+bool EspMqttTransport::subscribe(const char* filter, uint8_t qos) {
+  if (client_ == nullptr) return false;
+  return esp_mqtt_client_subscribe(client_, filter, qos) >= 0;
+}
+
+// Corre en la tarea de esp-mqtt: solo copia el evento, nunca llama a la lógica de la aplicación
+void EspMqttTransport::onEvent(void* arg, esp_event_base_t base, int32_t event_id, void* event_data) {
+  EspMqttTransport* self = (EspMqttTransport*)arg;
+  esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+
+  static EspMqttQueuedEvent queued; // Solo la tarea de esp-mqtt entra aquí: no hace falta reservar en la pila
+  memset(&queued, 0, offsetof(EspMqttQueuedEvent, payload));
+
+  switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+      self->connected_ = true;
+      queued.type = QUEUED_CONNECTED;
+      queued.session_present = event->session_present;
+      break;
+
+    case MQTT_EVENT_DISCONNECTED:
+      self->connected_ = false;
+      queued.type = QUEUED_DISCONNECTED;
+      break;
+
+    case MQTT_EVENT_PUBLISHED:
+      queued.type = QUEUED_PUBLISHED;
+      queued.msg_id = event->msg_id;
+      break;
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 4, 0)
+    case MQTT_EVENT_DELETED:
+      // Venció en el outbox (CONFIG_MQTT_OUTBOX_EXPIRED_TIMEOUT_MS) sin PUBACK
+      queued.type = QUEUED_DELETED;
+      queued.msg_id = event->msg_id;
+      break;
+#endif
+
+    case MQTT_EVENT_DATA:
+      // Los mensajes fragmentados (más grandes que el buffer) no son comandos válidos
+      if (event->topic_len <= 0 || event->topic_len >= MQTT_TOPIC_MAX ||
+          event->data_len != event->total_data_len || event->data_len > MQTT_INBOUND_MAX) {
+        return;
+      }
+      queued.type = QUEUED_DATA;
+      memcpy(queued.topic, event->topic, event->topic_len);
+      queued.topic[event->topic_len] = '\0';
+      memcpy(queued.payload, event->data, event->data_len);
+      queued.length = (uint16_t)event->data_len;
+
+#if ESP_MQTT_USE_V5
+      if (event->property != nullptr) {
+        const esp_mqtt5_event_property_t* p = event->property;
+        if (p->response_topic != nullptr && p->response_topic_len > 0 && p->response_topic_len < MQTT_TOPIC_MAX) {
+          memcpy(queued.response_topic, p->response_topic, p->response_topic_len);
+        }
+        if (p->content_type != nullptr && p->content_type_len > 0 && p->content_type_len < MQTT_CONTENT_TYPE_MAX) {
+          memcpy(queued.content_type, p->content_type, p->content_type_len);
+        }
+        if (p->correlation_data != nullptr && p->correlation_data_len <= MQTT_CORRELATION_MAX) {
+          memcpy(queued.correlation, p->correlation_data, p->correlation_data_len);
+          queued.correlation_length = p->correlation_data_len;
+        }
+      }
+#endif
+      break;
+
+    default:
+      return;
+  }
+
+  // Si el loop está atrasado y la cola está llena, el evento se pierde (no se bloquea la red)
+  traceInstant("mqtt_event", event_id);
+  if (xQueueSend(self->events_, &queued, 0) != pdTRUE) traceInstant("mqtt_event_lost", event_id);
+}
+
+void EspMqttTransport::poll() {
+  if (events_ == nullptr) return;
+
+  static EspMqttQueuedEvent event;
+  while (xQueueReceive(events_, &event, 0) == pdTRUE) {
+    switch (event.type) {
+      case QUEUED_CONNECTED:
+        if (handler_.on_connected) handler_.on_connected(event.session_present);
+        break;
+      case QUEUED_DISCONNECTED:
+        if (handler_.on_disconnected) handler_.on_disconnected();
+        break;
+      case QUEUED_PUBLISHED:
+        if (handler_.on_published) handler_.on_published(event.msg_id);
+        break;
+      case QUEUED_DELETED:
+        if (handler_.on_deleted) handler_.on_deleted(event.msg_id);
+        break;
+      case QUEUED_DATA: {
+        MqttMessageProperties props = {
+          event.content_type[0] != '\0' ? event.content_type : nullptr,
+          event.response_topic[0] != '\0' ? event.response_topic : nullptr,
+          event.correlation_length > 0 ? event.correlation : nullptr,
+          event.correlation_length
+        };
+        if (handler_.on_message) handler_.on_message(event.topic, event.payload, event.length, props);
+        break;
+      }
+    }
+  }
+}
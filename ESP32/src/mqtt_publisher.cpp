@@ -0,0 +1,262 @@
+#include "mqtt_publisher.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "trace_recorder.h"
+
+void mqttPublisherInit(MqttPublisher& pub, MqttTransport* transport, MqttStampFn stamp_fn) {
+  memset(&pub, 0, sizeof(pub));
+  pub.transport = transport;
+  pub.stamp_fn = stamp_fn;
+}
+
+static void releaseJumbo(MqttPublisher& pub, MqttOutboundMessage& msg) {
+  if (msg.jumbo && pub.jumbo_owner == &msg) pub.jumbo_owner = nullptr;
+  msg.jumbo = false;
+}
+
+static void notifyDone(MqttPublisher& pub, MqttOutboundMessage& msg, bool delivered) {
+  uint32_t tag = msg.tag;
+  msg.tag = 0;
+  if (tag != 0 && pub.done_fn != nullptr) pub.done_fn(tag, delivered);
+}
+
+static void releaseSlot(MqttPublisher& pub, MqttOutboundMessage& msg, bool delivered = false) {
+  if (msg.state == MQTT_SLOT_QUEUED && pub.stats.queue_depth > 0) pub.stats.queue_depth--;
+  if (msg.state == MQTT_SLOT_INFLIGHT && pub.stats.inflight > 0) pub.stats.inflight--;
+  releaseJumbo(pub, msg);
+  msg.state = MQTT_SLOT_FREE;
+  notifyDone(pub, msg, delivered);
+}
+
+// Busca un espacio libre; si no hay, expulsa el mensaje encolado más antiguo de menor prioridad
+static MqttOutboundMessage* acquireSlot(MqttPublisher& pub, uint8_t priority) {
+  MqttOutboundMessage* victim = nullptr;
+  for (int i = 0; i < MQTT_OUTBOUND_SLOTS; i++) {
+    MqttOutboundMessage& msg = pub.slots[i];
+    if (msg.state == MQTT_SLOT_FREE) return &msg;
+    if (msg.state != MQTT_SLOT_QUEUED) continue; // Lo que está en vuelo o en escritura no se toca
+    if (victim == nullptr || msg.priority > victim->priority ||
+        (msg.priority == victim->priority && msg.seq < victim->seq)) {
+      victim = &msg;
+    }
+  }
+
+  // Nunca se expulsa algo más importante que el mensaje nuevo
+  if (victim == nullptr || victim->priority < priority) return nullptr;
+
+  traceInstant("mqtt_evict", victim->priority);
+  releaseSlot(pub, *victim);
+  pub.stats.dropped++;
+  return victim;
+}
+
+MqttOutboundMessage* mqttPublisherReserve(MqttPublisher& pub, const char* topic, MqttPriority priority,
+                                          uint8_t qos, uint32_t now_ms, const MqttPublishProperties* props) {
+  if (strlen(topic) >= MQTT_TOPIC_MAX ||
+      (props != nullptr && props->correlation_length > MQTT_CORRELATION_MAX)) {
+    pub.stats.dropped++;
+    return nullptr;
+  }
+
+  MqttOutboundMessage* msg = acquireSlot(pub, priority);
+  if (msg == nullptr) {
+    pub.stats.dropped++;
+    return nullptr;
+  }
+
+  snprintf(msg->topic, sizeof msg->topic, "%s", topic); // Ya se comprobó que entra
+  msg->length = 0;
+  msg->jumbo = false;
+  msg->profile = props != nullptr ? props->profile : nullptr;
+  msg->correlation_length = 0;
+  if (props != nullptr && props->correlation_data != nullptr) {
+    memcpy(msg->correlation, props->correlation_data, props->correlation_length);
+    msg->correlation_length = (uint8_t)props->correlation_length;
+  }
+  msg->stamp_mono_us = 0;
+  msg->stamp_offset = 0;
+  msg->qos = qos > 1 ? 1 : qos;
+  msg->priority = priority;
+  msg->state = MQTT_SLOT_WRITING;
+  msg->msg_id = -1;
+  msg->enqueued_ms = now_ms;
+  msg->sent_ms = 0;
+  msg->tag = 0;
+  return msg;
+}
+
+uint8_t* mqttPublisherPayload(MqttPublisher& pub, MqttOutboundMessage& msg) {
+  return msg.jumbo ? pub.jumbo : msg.payload;
+}
+
+bool mqttPublisherGrow(MqttPublisher& pub, MqttOutboundMessage& msg, size_t used) {
+  if (msg.state != MQTT_SLOT_WRITING) return false;
+  if (msg.jumbo) return false; // Ya no hay nada más grande
+  if (pub.jumbo_owner != nullptr || used > MQTT_PAYLOAD_MAX) {
+    pub.stats.jumbo_busy++;
+    return false;
+  }
+  memcpy(pub.jumbo, msg.payload, used);
+  pub.jumbo_owner = &msg;
+  msg.jumbo = true;
+  pub.stats.jumbo_used++;
+  return true;
+}
+
+bool mqttPublisherCommit(MqttPublisher& pub, MqttOutboundMessage& msg, size_t length,
+                         const MqttSampleStamp* stamp) {
+  if (msg.state != MQTT_SLOT_WRITING) return false;
+  if (length > mqttPublisherCapacity(msg) ||
+      (stamp != nullptr && (stamp->offset == 0 || (size_t)stamp->offset + MQTT_STAMP_WIDTH > length))) {
+    releaseSlot(pub, msg);
+    pub.stats.dropped++;
+    return false;
+  }
+
+  msg.length = (uint16_t)length;
+  msg.stamp_mono_us = stamp != nullptr ? stamp->mono_us : 0;
+  msg.stamp_offset = stamp != nullptr ? stamp->offset : 0;
+  msg.state = MQTT_SLOT_QUEUED;
+  msg.seq = pub.next_seq++;
+
+  pub.stats.enqueued++;
+  traceInstant("mqtt_enqueue", msg.priority);
+  pub.stats.queue_depth++;
+  if (pub.stats.queue_depth > pub.stats.queue_high_water) pub.stats.queue_high_water = pub.stats.queue_depth;
+  return true;
+}
+
+void mqttPublisherAbort(MqttPublisher& pub, MqttOutboundMessage& msg) {
+  if (msg.state == MQTT_SLOT_WRITING) releaseSlot(pub, msg);
+}
+
+bool mqttPublisherEnqueue(MqttPublisher& pub, const char* topic, const uint8_t* payload, size_t length,
+                          MqttPriority priority, uint8_t qos, uint32_t now_ms,
+                          const MqttPublishProperties* props, const MqttSampleStamp* stamp, uint32_t tag) {
+  if (length > MQTT_JUMBO_PAYLOAD_MAX ||
+      (stamp != nullptr && (stamp->offset == 0 || (size_t)stamp->offset + MQTT_STAMP_WIDTH > length))) {
+    pub.stats.dropped++;
+    return false;
+  }
+
+  MqttOutboundMessage* msg = mqttPublisherReserve(pub, topic, priority, qos, now_ms, props);
+  if (msg == nullptr) return false;
+  if (length > MQTT_PAYLOAD_MAX && !mqttPublisherGrow(pub, *msg, 0)) {
+    mqttPublisherAbort(pub, *msg);
+    pub.stats.dropped++;
+    return false;
+  }
+  memcpy(mqttPublisherPayload(pub, *msg), payload, length);
+  msg->tag = tag;
+  return mqttPublisherCommit(pub, *msg, length, stamp);
+}
+
+// Siguiente mensaje a enviar: menor prioridad numérica y, a igualdad, el más antiguo
+static MqttOutboundMessage* nextQueued(MqttPublisher& pub) {
+  MqttOutboundMessage* best = nullptr;
+  for (int i = 0; i < MQTT_OUTBOUND_SLOTS; i++) {
+    MqttOutboundMessage& msg = pub.slots[i];
+    if (msg.state != MQTT_SLOT_QUEUED) continue;
+    if (best == nullptr || msg.priority < best->priority ||
+        (msg.priority == best->priority && msg.seq < best->seq)) {
+      best = &msg;
+    }
+  }
+  return best;
+}
+
+// Sin PUBACK ni aviso del transporte: se libera el lugar, sin volver a publicar
+static void checkAckTimeouts(MqttPublisher& pub, uint32_t now_ms) {
+  for (int i = 0; i < MQTT_OUTBOUND_SLOTS; i++) {
+    MqttOutboundMessage& msg = pub.slots[i];
+    if (msg.state != MQTT_SLOT_INFLIGHT) continue;
+    if (now_ms - msg.sent_ms < MQTT_ACK_TIMEOUT_MS) continue;
+    traceInstant("mqtt_unconfirmed", msg.msg_id);
+    releaseSlot(pub, msg);
+    pub.stats.unconfirmed++;
+  }
+}
+
+void mqttPublisherService(MqttPublisher& pub, uint32_t now_ms) {
+  if (pub.transport == nullptr || !pub.transport->connected()) {
+    pub.offline = true;
+    return;
+  }
+
+  // El transporte reenvía lo que estaba en vuelo al reconectar: el plazo corre desde ahora
+  if (pub.offline) {
+    pub.offline = false;
+    for (int i = 0; i < MQTT_OUTBOUND_SLOTS; i++) {
+      if (pub.slots[i].state == MQTT_SLOT_INFLIGHT) pub.slots[i].sent_ms = now_ms;
+    }
+  }
+  checkAckTimeouts(pub, now_ms);
+
+  while (pub.stats.inflight < MQTT_INFLIGHT_WINDOW) {
+    MqttOutboundMessage* msg = nextQueued(pub);
+    if (msg == nullptr) return;
+
+    uint8_t* payload = mqttPublisherPayload(pub, *msg);
+    if (msg->stamp_offset != 0 && pub.stamp_fn != nullptr) {
+      pub.stamp_fn(msg->stamp_mono_us, (char*)payload + msg->stamp_offset);
+    }
+
+    MqttPublishProperties props = {msg->profile, msg->correlation, msg->correlation_length};
+    int msg_id = pub.transport->publish(msg->topic, payload, msg->length, msg->qos, &props);
+    if (msg_id < 0) return; // El cliente no aceptó más: se reintenta en la próxima vuelta
+
+    traceInstant("mqtt_send", msg_id);
+    msg->sent_ms = now_ms;
+    pub.stats.sent++;
+    pub.stats.sent_by_priority[msg->priority]++;
+    pub.stats.queue_depth--;
+
+    if (msg->qos == 0) {
+      releaseJumbo(pub, *msg);
+      msg->state = MQTT_SLOT_FREE;
+      notifyDone(pub, *msg, true);
+      continue;
+    }
+
+    msg->msg_id = msg_id;
+    msg->state = MQTT_SLOT_INFLIGHT;
+    pub.stats.inflight++;
+  }
+}
+
+void mqttPublisherOnPublished(MqttPublisher& pub, int msg_id, uint32_t now_ms) {
+  for (int i = 0; i < MQTT_OUTBOUND_SLOTS; i++) {
+    MqttOutboundMessage& msg = pub.slots[i];
+    if (msg.state != MQTT_SLOT_INFLIGHT || msg.msg_id != msg_id) continue;
+
+    uint32_t latency = now_ms - msg.sent_ms;
+    pub.stats.ack_latency_last_ms = latency;
+    if (pub.stats.acked == 0) {
+      pub.stats.ack_latency_avg_ms = latency;
+    } else {
+      pub.stats.ack_latency_avg_ms = (pub.stats.ack_latency_avg_ms * 7 + latency) / 8;
+    }
+    if (latency > pub.stats.ack_latency_max_ms) pub.stats.ack_latency_max_ms = latency;
+    pub.stats.acked++;
+    traceInstant("mqtt_ack", (int32_t)latency);
+
+    releaseSlot(pub, msg, true);
+    return;
+  }
+}
+
+void mqttPublisherOnDeleted(MqttPublisher& pub, int msg_id) {
+  for (int i = 0; i < MQTT_OUTBOUND_SLOTS; i++) {
+    MqttOutboundMessage& msg = pub.slots[i];
+    if (msg.state != MQTT_SLOT_INFLIGHT || msg.msg_id != msg_id) continue;
+    releaseSlot(pub, msg);
+    pub.stats.dropped++;
+    return;
+  }
+}
+
+void mqttPublisherOnDisconnected(MqttPublisher& pub) {
+  pub.offline = true;
+}
@@ -0,0 +1,108 @@
+#include "nvs_store.h"
+
+#include <Preferences.h>
+
+static Preferences prefs;
+
+// El namespace de energía queda abierto desde la primera lectura (en setup()): abrir y cerrar la NVS
+// en cada guardado reserva memoria dinámica, y el guardado ocurre en el ciclo de telemetría
+static Preferences energyPrefs;
+static bool energyOpen = false;
+
+static bool openEnergy() {
+  if (!energyOpen) energyOpen = energyPrefs.begin("energy", false);
+  return energyOpen;
+}
+
+bool nvsLoadEnergy(int pump_id, double& total_kwh, double& total_m3) {
+  char kwhKey[16];
+  char m3Key[16];
+  snprintf(kwhKey, sizeof(kwhKey), "p%d_kwh", pump_id);
+  snprintf(m3Key, sizeof(m3Key), "p%d_m3", pump_id);
+
+  if (!openEnergy()) {
+    total_kwh = 0.0;
+    total_m3 = 0.0;
+    return false;
+  }
+  bool found = energyPrefs.isKey(kwhKey);
+  total_kwh = energyPrefs.getDouble(kwhKey, 0.0);
+  total_m3 = energyPrefs.getDouble(m3Key, 0.0);
+  return found;
+}
+
+void nvsSaveEnergy(int pump_id, double total_kwh, double total_m3) {
+  char kwhKey[16];
+  char m3Key[16];
+  snprintf(kwhKey, sizeof(kwhKey), "p%d_kwh", pump_id);
+  snprintf(m3Key, sizeof(m3Key), "p%d_m3", pump_id);
+
+  if (!openEnergy()) return;
+  energyPrefs.putDouble(kwhKey, total_kwh);
+  energyPrefs.putDouble(m3Key, total_m3);
+}
+
+bool nvsLoadBrokers(char* text, size_t size) {
+  if (size == 0) return false;
+  text[0] = '\0';
+  if (!prefs.begin("mqtt", true)) return false;
+  if (!prefs.isKey("brokers")) {
+    prefs.end();
+    return false;
+  }
+  size_t n = prefs.getString("brokers", text, size);
+  prefs.end();
+  return n > 0 && text[0] != '\0';
+}
+
+void nvsSaveBrokers(const char* text) {
+  if (!prefs.begin("mqtt", false)) return;
+  prefs.putString("brokers", text);
+  prefs.end();
+}
+
+bool nvsLoadIdentity(char* site, size_t site_size, char* controller, size_t controller_size) {
+  if (!prefs.begin("identity", true)) return false;
+  bool found = prefs.isKey("site") && prefs.isKey("controller");
+  if (found) {
+    prefs.getString("site", site, site_size);
+    prefs.getString("controller", controller, controller_size);
+  }
+  prefs.end();
+  return found;
+}
+
+void nvsSaveIdentity(const char* site, const char* controller) {
+  if (!prefs.begin("identity", false)) return;
+  prefs.putString("site", site);
+  prefs.putString("controller", controller);
+  prefs.end();
+}
+
+uint32_t nvsNextBootCount() {
+  if (!prefs.begin("boot", false)) return 0;
+  uint32_t count = prefs.getUInt("count", 0) + 1;
+  prefs.putUInt("count", count);
+  prefs.end();
+  return count;
+}
+
+bool nvsLoadWifiCache(void* data, size_t size) {
+  if (!prefs.begin("wifi", true)) return false;
+  bool found = prefs.isKey("cache") && prefs.getBytesLength("cache") == size;
+  if (found) prefs.getBytes("cache", data, size);
+  prefs.end();
+  return found;
+}
+
+void nvsSaveWifiCache(const void* data, size_t size) {
+  if (!prefs.begin("wifi", false)) return;
+  prefs.putBytes("cache", data, size);
+  prefs.end();
+}
+
+void nvsClearWifiCache() {
+  if (!prefs.begin("wifi", false)) return;
+  prefs.remove("cache");
+  prefs.end();
+}
@@ -0,0 +1,445 @@
+#include "scenario.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCENARIO_MAX_TOKENS 8
+
+static const char* const EVENT_NAMES[] = {
+  "TANK_FULL", "BELOW_FULL", "ABOVE_EMPTY", "TANK_EMPTY", "PUMP_STOP", "LEAK_SUSPECTED", "LEAK_CLEARED",
+  "TEMP_FAULT", "TEMP_OK", "APPLIED", "REJECTED_TANK_EMPTY", "BOOT",
+};
+
+static const char* const CHECK_NAMES[] = {
+  "pump", "level", "amps", "energy", "queue", "sent", "dropped", "event", "no",
+};
+
+// Separa la línea en palabras (en el lugar); devuelve cuántas
+static int tokenize(char* line, char** tokens) {
+  char* comment = strchr(line, '#');
+  if (comment != nullptr) *comment = '\0';
+  int count = 0;
+  char* p = line;
+  while (count < SCENARIO_MAX_TOKENS) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    if (*p == '\0') break;
+    tokens[count++] = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    if (*p == '\0') break;
+    *p++ = '\0';
+  }
+  return count;
+}
+
+static bool parseTime(const char* text, uint32_t& ms) {
+  char* end;
+  double value = strtod(text, &end);
+  if (end == text || value < 0.0) return false;
+  double scale;
+  if (strcmp(end, "ms") == 0) scale = 1.0;
+  else if (*end == '\0' || strcmp(end, "s") == 0) scale = 1000.0;
+  else if (strcmp(end, "m") == 0) scale = 60000.0;
+  else if (strcmp(end, "h") == 0) scale = 3600000.0;
+  else return false;
+  value *= scale;
+  if (value > 4e9) return false;  // Más de ~46 días no entra en 32 bits
+  ms = (uint32_t)(value + 0.5);
+  return true;
+}
+
+// "t" o "t1..t2"
+static bool parseWindow(char* text, uint32_t& from_ms, uint32_t& to_ms) {
+  char* dots = strstr(text, "..");
+  if (dots == nullptr) {
+    if (!parseTime(text, from_ms)) return false;
+    to_ms = from_ms;
+    return true;
+  }
+  *dots = '\0';
+  return parseTime(text, from_ms) && parseTime(dots + 2, to_ms) && to_ms >= from_ms;
+}
+
+static bool parseNumber(const char* text, float& value) {
+  char* end;
+  value = strtof(text, &end);
+  return end != text && *end == '\0' && !isnan(value);
+}
+
+static bool parsePump(const char* text, int8_t& index) {
+  char* end;
+  long id = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || id < 1 || id > TANK_PUMPS) return false;
+  index = (int8_t)(id - 1);
+  return true;
+}
+
+static bool parseFloatId(const char* text, int8_t& id) {
+  if (strcmp(text, "high") == 0) id = FLOAT_SWITCH_HIGH;
+  else if (strcmp(text, "low") == 0) id = FLOAT_SWITCH_LOW;
+  else return false;
+  return true;
+}
+
+static bool knownEvent(const char* name) {
+  for (const char* known : EVENT_NAMES) {
+    if (strcmp(name, known) == 0) return true;
+  }
+  return false;
+}
+
+// "fault ..." / "clear ..." (tokens desde la clase de falla)
+static const char* parseFault(bool set, char** tok, int n, ScenarioStep& step) {
+  if (n < 1) return "falta la clase de falla";
+  step.value = set ? 1.0f : 0.0f;
+  if (strcmp(tok[0], "temp") == 0) {
+    step.type = SCENARIO_STEP_TEMP_FAULT;
+    if (n != 2 || !parsePump(tok[1], step.target)) return "bomba inválida";
+  } else if (strcmp(tok[0], "pump") == 0) {
+    step.type = SCENARIO_STEP_PUMP_FAULT;
+    if (n != 2 || !parsePump(tok[1], step.target)) return "bomba inválida";
+  } else if (strcmp(tok[0], "echo") == 0) {
+    step.type = SCENARIO_STEP_ECHO_FAULT;
+    if (n != 1) return "sobran palabras";
+  } else if (strcmp(tok[0], "float") == 0) {
+    step.type = SCENARIO_STEP_FLOAT_FAULT;
+    if (n < 2 || !parseFloatId(tok[1], step.target)) return "flotador inválido (high|low)";
+    if (!set) {
+      if (n != 2) return "sobran palabras";
+      step.value = SIM_FLOAT_OK;
+    } else if (n == 2) {
+      step.value = -1.0f;
+    } else if (n == 3 && strcmp(tok[2], "wet") == 0) {
+      step.value = SIM_FLOAT_STUCK_WET;
+    } else if (n == 3 && strcmp(tok[2], "dry") == 0) {
+      step.value = SIM_FLOAT_STUCK_DRY;
+    } else {
+      return "posición inválida (wet|dry)";
+    }
+  } else {
+    return "falla desconocida";
+  }
+  return nullptr;
+}
+
+// "at <t> ..."
+static const char* parseStep(char** tok, int n, ScenarioStep& step) {
+  if (n < 3 || !parseTime(tok[1], step.at_ms)) return "tiempo inválido";
+  const char* verb = tok[2];
+  step.target = -1;
+  step.value = 0.0f;
+  if (strcmp(verb, "inflow") == 0 || strcmp(verb, "leak") == 0) {
+    step.type = verb[0] == 'i' ? SCENARIO_STEP_INFLOW : SCENARIO_STEP_LEAK;
+    if (n != 4 || !parseNumber(tok[3], step.value) || step.value < 0.0f) return "caudal inválido";
+  } else if (strcmp(verb, "temp") == 0) {
+    step.type = SCENARIO_STEP_TEMPERATURE;
+    if (n != 5 || !parsePump(tok[3], step.target)) return "bomba inválida";
+    if (strcmp(tok[4], "auto") == 0) step.value = NAN;
+    else if (!parseNumber(tok[4], step.value)) return "temperatura inválida";
+  } else if (strcmp(verb, "start") == 0 || strcmp(verb, "stop") == 0) {
+    step.type = SCENARIO_STEP_COMMAND;
+    step.value = verb[2] == 'a' ? 1.0f : 0.0f;
+    if (n != 4 || !parsePump(tok[3], step.target)) return "bomba inválida";
+  } else if (strcmp(verb, "fault") == 0 || strcmp(verb, "clear") == 0) {
+    return parseFault(verb[0] == 'f', tok + 3, n - 3, step);
+  } else if (strcmp(verb, "broker") == 0) {
+    step.type = SCENARIO_STEP_BROKER;
+    if (n != 4 || (strcmp(tok[3], "up") != 0 && strcmp(tok[3], "down") != 0)) return "broker up|down";
+    step.value = tok[3][0] == 'u' ? 1.0f : 0.0f;
+  } else if (strcmp(verb, "power") == 0) {
+    step.type = SCENARIO_STEP_POWER_LOSS;
+    if (n != 4 || strcmp(tok[3], "loss") != 0) return "power loss";
+  } else {
+    return "acción desconocida";
+  }
+  return nullptr;
+}
+
+// "expect <t|t1..t2> ..."
+static const char* parseExpect(char** tok, int n, ScenarioExpect& expect) {
+  if (n < 3 || !parseWindow(tok[1], expect.from_ms, expect.to_ms)) return "tiempo inválido";
+  const char* what = tok[2];
+  bool window = expect.to_ms != expect.from_ms;
+  expect.target = -1;
+  expect.min = -INFINITY;
+  expect.max = INFINITY;
+
+  if (strcmp(what, "event") == 0 || strcmp(what, "no") == 0) {
+    expect.type = what[0] == 'e' ? SCENARIO_CHECK_EVENT : SCENARIO_CHECK_NO_EVENT;
+    if (n != 4 || !knownEvent(tok[3])) return "evento desconocido";
+    strncpy(expect.event, tok[3], SCENARIO_EVENT_MAX - 1);
+    return nullptr;
+  }
+  if (window) return "las ventanas son solo para eventos";
+
+  if (strcmp(what, "pump") == 0) {
+    expect.type = SCENARIO_CHECK_PUMP;
+    if (n != 5 || !parsePump(tok[3], expect.target)) return "bomba inválida";
+    if (strcmp(tok[4], "on") != 0 && strcmp(tok[4], "off") != 0) return "estado inválido (on|off)";
+    expect.min = expect.max = tok[4][1] == 'n' ? 1.0f : 0.0f;
+  } else if (strcmp(what, "level") == 0) {
+    expect.type = SCENARIO_CHECK_LEVEL;
+    if (n != 5 || !parseNumber(tok[3], expect.min) || !parseNumber(tok[4], expect.max)) return "rango inválido";
+  } else if (strcmp(what, "amps") == 0 || strcmp(what, "energy") == 0) {
+    expect.type = what[0] == 'a' ? SCENARIO_CHECK_AMPS : SCENARIO_CHECK_ENERGY;
+    if (n != 6 || !parsePump(tok[3], expect.target)) return "bomba inválida";
+    if (!parseNumber(tok[4], expect.min) || !parseNumber(tok[5], expect.max)) return "rango inválido";
+  } else if (strcmp(what, "queue") == 0 || strcmp(what, "dropped") == 0) {
+    expect.type = what[0] == 'q' ? SCENARIO_CHECK_QUEUE : SCENARIO_CHECK_DROPPED;
+    if (n != 4 || !parseNumber(tok[3], expect.max)) return "máximo inválido";
+  } else if (strcmp(what, "sent") == 0) {
+    expect.type = SCENARIO_CHECK_SENT;
+    if (n != 4 || !parseNumber(tok[3], expect.min)) return "mínimo inválido";
+  } else {
+    return "expectativa desconocida";
+  }
+  if (expect.min > expect.max) return "rango invertido";
+  return nullptr;
+}
+
+static const char* parseLine(Scenario& scn, char* line, uint16_t line_no) {
+  char* tok[SCENARIO_MAX_TOKENS];
+  int n = tokenize(line, tok);
+  if (n == 0) return nullptr;
+
+  if (strcmp(tok[0], "name") == 0) {
+    if (n < 2) return "falta el nombre";
+    snprintf(scn.name, sizeof(scn.name), "%s", tok[1]);
+  } else if (strcmp(tok[0], "duration") == 0) {
+    if (n != 2 || !parseTime(tok[1], scn.duration_ms) || scn.duration_ms == 0) return "duración inválida";
+  } else if (strcmp(tok[0], "level") == 0) {
+    if (n != 2 || !parseNumber(tok[1], scn.level_percent) || scn.level_percent < 0.0f ||
+        scn.level_percent > 100.0f) {
+      return "nivel inválido (0..100)";
+    }
+  } else if (strcmp(tok[0], "seed") == 0) {
+    if (n != 2) return "semilla inválida";
+    scn.seed = (uint32_t)strtoul(tok[1], nullptr, 10);
+  } else if (strcmp(tok[0], "loop") == 0) {
+    scn.loop = true;
+  } else if (strcmp(tok[0], "at") == 0) {
+    if (scn.step_count >= SCENARIO_MAX_STEPS) return "demasiados pasos";
+    ScenarioStep& step = scn.steps[scn.step_count];
+    const char* error = parseStep(tok, n, step);
+    if (error != nullptr) return error;
+    step.line = line_no;
+    scn.step_count++;
+  } else if (strcmp(tok[0], "expect") == 0) {
+    if (scn.expect_count >= SCENARIO_MAX_EXPECTS) return "demasiadas expectativas";
+    ScenarioExpect& expect = scn.expects[scn.expect_count];
+    memset(&expect, 0, sizeof(expect));
+    const char* error = parseExpect(tok, n, expect);
+    if (error != nullptr) return error;
+    expect.line = line_no;
+    scn.expect_count++;
+  } else {
+    return "directiva desconocida";
+  }
+  return nullptr;
+}
+
+const char* scenarioParse(Scenario& scn, const char* text, int* error_line) {
+  memset(&scn, 0, sizeof(scn));
+  snprintf(scn.name, sizeof(scn.name), "sin_nombre");
+  scn.level_percent = 70.0f;
+  scn.seed = 1;
+
+  uint16_t line_no = 0;
+  const char* p = text;
+  while (*p != '\0') {
+    const char* end = strchr(p, '\n');
+    size_t length = end != nullptr ? (size_t)(end - p) : strlen(p);
+    line_no++;
+    if (error_line != nullptr) *error_line = line_no;
+    if (length >= SCENARIO_LINE_MAX) return "línea muy larga";
+
+    char line[SCENARIO_LINE_MAX];
+    memcpy(line, p, length);
+    line[length] = '\0';
+    const char* error = parseLine(scn, line, line_no);
+    if (error != nullptr) return error;
+    p += length;
+    if (*p == '\n') p++;
+  }
+  if (error_line != nullptr) *error_line = 0;
+
+  // Orden por instante (estable: a igual instante, el del guion)
+  for (int i = 1; i < scn.step_count; i++) {
+    ScenarioStep step = scn.steps[i];
+    int j = i - 1;
+    for (; j >= 0 && scn.steps[j].at_ms > step.at_ms; j--) scn.steps[j + 1] = scn.steps[j];
+    scn.steps[j + 1] = step;
+  }
+
+  // Sin duración: hasta un segundo después de lo último que el guion menciona
+  if (scn.duration_ms == 0) {
+    uint32_t last = 0;
+    for (int i = 0; i < scn.step_count; i++) last = scn.steps[i].at_ms > last ? scn.steps[i].at_ms : last;
+    for (int i = 0; i < scn.expect_count; i++) last = scn.expects[i].to_ms > last ? scn.expects[i].to_ms : last;
+    scn.duration_ms = last + 1000;
+  }
+  if (scn.loop && scn.expect_count > 0) return "un escenario con loop no lleva expectativas";
+  return nullptr;
+}
+
+void scenarioStart(Scenario& scn, uint32_t now_ms) {
+  scn.start_ms = now_ms;
+  scn.next_step = 0;
+  for (int i = 0; i < scn.expect_count; i++) {
+    ScenarioExpect& expect = scn.expects[i];
+    expect.state = SCENARIO_EXPECT_PENDING;
+    expect.observed = NAN;
+    expect.observed_ms = 0;
+  }
+}
+
+uint32_t scenarioElapsedMs(const Scenario& scn, uint32_t now_ms) {
+  return now_ms - scn.start_ms;
+}
+
+bool scenarioFinished(const Scenario& scn, uint32_t now_ms) {
+  return !scn.loop && scenarioElapsedMs(scn, now_ms) >= scn.duration_ms;
+}
+
+bool scenarioNextStep(Scenario& scn, uint32_t now_ms, ScenarioStep& step) {
+  if (scn.loop && scn.next_step >= scn.step_count && scenarioElapsedMs(scn, now_ms) >= scn.duration_ms) {
+    scn.start_ms += scn.duration_ms;
+    scn.next_step = 0;
+  }
+  if (scn.next_step >= scn.step_count) return false;
+  if (scn.steps[scn.next_step].at_ms > scenarioElapsedMs(scn, now_ms)) return false;
+  step = scn.steps[scn.next_step++];
+  return true;
+}
+
+bool scenarioApplyToPlant(const ScenarioStep& step, SimPlant& plant, uint32_t now_us) {
+  switch (step.type) {
+    case SCENARIO_STEP_INFLOW:
+      plant.inflow_lpm = step.value;
+      return true;
+    case SCENARIO_STEP_LEAK:
+      plant.leak_lpm = step.value;
+      return true;
+    case SCENARIO_STEP_TEMPERATURE:
+      plant.temperature_c[step.target] = step.value;
+      return true;
+    case SCENARIO_STEP_TEMP_FAULT:
+      plant.temperature_fault[step.target] = step.value != 0.0f;
+      return true;
+    case SCENARIO_STEP_PUMP_FAULT:
+      plant.seized[step.target] = step.value != 0.0f;
+      return true;
+    case SCENARIO_STEP_ECHO_FAULT:
+      plant.echo_lost = step.value != 0.0f;
+      return true;
+    case SCENARIO_STEP_FLOAT_FAULT: {
+      FloatSwitchId id = (FloatSwitchId)step.target;
+      SimFloatFault fault = (SimFloatFault)(int)step.value;
+      if (step.value < 0.0f) fault = plant.float_wet[id] ? SIM_FLOAT_STUCK_WET : SIM_FLOAT_STUCK_DRY;
+      simPlantSetFloatFault(plant, id, fault, now_us);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+static float observedValue(const ScenarioExpect& expect, const ScenarioObservation& obs) {
+  switch (expect.type) {
+    case SCENARIO_CHECK_PUMP: return obs.pump_on[expect.target] ? 1.0f : 0.0f;
+    case SCENARIO_CHECK_LEVEL: return obs.level_percent;
+    case SCENARIO_CHECK_AMPS: return obs.pump_amps[expect.target];
+    case SCENARIO_CHECK_ENERGY: return (float)obs.energy_kwh[expect.target];
+    case SCENARIO_CHECK_QUEUE: return obs.queue_depth;
+    case SCENARIO_CHECK_SENT: return (float)obs.sent;
+    case SCENARIO_CHECK_DROPPED: return (float)obs.dropped;
+    default: return NAN;
+  }
+}
+
+static void decide(ScenarioExpect& expect, bool passed, float observed, uint32_t elapsed_ms) {
+  expect.state = passed ? SCENARIO_EXPECT_PASSED : SCENARIO_EXPECT_FAILED;
+  expect.observed = observed;
+  expect.observed_ms = elapsed_ms;
+}
+
+void scenarioObserve(Scenario& scn, uint32_t now_ms, const ScenarioObservation& obs) {
+  uint32_t elapsed = scenarioElapsedMs(scn, now_ms);
+  for (int i = 0; i < scn.expect_count; i++) {
+    ScenarioExpect& expect = scn.expects[i];
+    if (expect.state != SCENARIO_EXPECT_PENDING) continue;
+
+    if (expect.type == SCENARIO_CHECK_EVENT || expect.type == SCENARIO_CHECK_NO_EVENT) {
+      // Pasó la ventana sin el evento
+      if (elapsed > expect.to_ms) decide(expect, expect.type == SCENARIO_CHECK_NO_EVENT, NAN, elapsed);
+      continue;
+    }
+    if (elapsed < expect.from_ms) continue;
+    float value = observedValue(expect, obs);
+    decide(expect, value >= expect.min && value <= expect.max, value, elapsed);
+  }
+}
+
+void scenarioEvent(Scenario& scn, uint32_t now_ms, const char* name) {
+  uint32_t elapsed = scenarioElapsedMs(scn, now_ms);
+  for (int i = 0; i < scn.expect_count; i++) {
+    ScenarioExpect& expect = scn.expects[i];
+    if (expect.state != SCENARIO_EXPECT_PENDING) continue;
+    if (expect.type != SCENARIO_CHECK_EVENT && expect.type != SCENARIO_CHECK_NO_EVENT) continue;
+    if (elapsed < expect.from_ms || elapsed > expect.to_ms || strcmp(name, expect.event) != 0) continue;
+    decide(expect, expect.type == SCENARIO_CHECK_EVENT, 1.0f, elapsed);
+  }
+}
+
+void scenarioFinish(Scenario& scn, uint32_t now_ms) {
+  uint32_t elapsed = scenarioElapsedMs(scn, now_ms);
+  for (int i = 0; i < scn.expect_count; i++) {
+    ScenarioExpect& expect = scn.expects[i];
+    if (expect.state != SCENARIO_EXPECT_PENDING) continue;
+    decide(expect, expect.type == SCENARIO_CHECK_NO_EVENT, NAN, elapsed);
+  }
+}
+
+uint8_t scenarioFailures(const Scenario& scn) {
+  uint8_t failures = 0;
+  for (int i = 0; i < scn.expect_count; i++) {
+    if (scn.expects[i].state == SCENARIO_EXPECT_FAILED) failures++;
+  }
+  return failures;
+}
+
+void scenarioDescribe(const ScenarioExpect& expect, char* out, size_t size) {
+  int n = snprintf(out, size, "línea %u: %s", (unsigned)expect.line, CHECK_NAMES[expect.type]);
+  if (expect.target >= 0 && n >= 0 && (size_t)n < size) n += snprintf(out + n, size - n, " %d", expect.target + 1);
+  if (n < 0 || (size_t)n >= size) return;
+
+  switch (expect.type) {
+    case SCENARIO_CHECK_EVENT:
+    case SCENARIO_CHECK_NO_EVENT:
+      snprintf(out + n, size - n, " %s entre %.1f y %.1f s: %s", expect.event, expect.from_ms / 1000.0,
+               expect.to_ms / 1000.0,
+               expect.state == SCENARIO_EXPECT_PENDING ? "pendiente"
+               : isnan(expect.observed)                ? "no ocurrió"
+                                                       : "ocurrió");
+      if (!isnan(expect.observed)) {
+        size_t used = strlen(out);
+        snprintf(out + used, size - used, " a los %.3f s", expect.observed_ms / 1000.0);
+      }
+      return;
+    case SCENARIO_CHECK_PUMP:
+      snprintf(out + n, size - n, " %s a los %.1f s, se vio %s", expect.min != 0.0f ? "on" : "off",
+               expect.from_ms / 1000.0,
+               isnan(expect.observed) ? "nada" : (expect.observed != 0.0f ? "on" : "off"));
+      return;
+    default:
+      break;
+  }
+
+  if (isinf(expect.min)) n += snprintf(out + n, size - n, " <= %g", expect.max);
+  else if (isinf(expect.max)) n += snprintf(out + n, size - n, " >= %g", expect.min);
+  else n += snprintf(out + n, size - n, " en [%g, %g]", expect.min, expect.max);
+  if (n < 0 || (size_t)n >= size) return;
+  if (isnan(expect.observed)) snprintf(out + n, size - n, " a los %.1f s: sin observar", expect.from_ms / 1000.0);
+  else snprintf(out + n, size - n, " a los %.1f s, se vio %.3f", expect.from_ms / 1000.0, expect.observed);
+}
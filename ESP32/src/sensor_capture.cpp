@@ -0,0 +1,128 @@
+#include "sensor_capture.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+void captureInit(SensorCapture& cap, char* buf, size_t size) {
+  memset(&cap, 0, sizeof(cap));
+  cap.buf = buf;
+  cap.size = size;
+  cap.ended = true;
+}
+
+// Encola una línea (con su '\0') si entra entera
+static bool pushLine(SensorCapture& cap, const char* line) {
+  size_t length = strlen(line) + 1;
+  if (cap.size - cap.used < length) return false;
+  for (size_t i = 0; i < length; i++) {
+    cap.buf[cap.head] = line[i];
+    cap.head = cap.head + 1 == cap.size ? 0 : cap.head + 1;
+  }
+  cap.used += length;
+  cap.lines++;
+  return true;
+}
+
+// Reserva lugar para una lectura de `lines` líneas; si no entra se descarta entera
+static bool beginRecord(SensorCapture& cap, size_t lines) {
+  if (!cap.active || cap.buf == nullptr) return false;
+  bool report = cap.dropped != cap.dropped_reported;
+  if (cap.size - cap.used < (lines + (report ? 1 : 0)) * CAPTURE_LINE_MAX) {
+    cap.dropped++;
+    return false;
+  }
+  if (report) {
+    char line[CAPTURE_LINE_MAX];
+    snprintf(line, sizeof(line), "D %lu", (unsigned long)(cap.dropped - cap.dropped_reported));
+    pushLine(cap, line);
+    cap.dropped_reported = cap.dropped;
+  }
+  return true;
+}
+
+static void record(SensorCapture& cap, const char* format, ...) {
+  if (!beginRecord(cap, 1)) return;
+  char line[CAPTURE_LINE_MAX];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  pushLine(cap, line);
+}
+
+void captureStart(SensorCapture& cap, uint8_t pumps, uint32_t now_ms) {
+  cap.head = cap.tail = cap.used = 0;
+  cap.lines = cap.dropped = cap.dropped_reported = 0;
+  cap.active = true;
+  cap.ended = false;
+  record(cap, "H %d %u %lu", CAPTURE_VERSION, (unsigned)pumps, (unsigned long)now_ms);
+}
+
+void captureStop(SensorCapture& cap) {
+  // La Z sale cuando se termina de leer lo que quedó en el buffer (ver captureNextLine)
+  cap.active = false;
+}
+
+void captureLineAdc(SensorCapture& cap, uint32_t t_us, uint16_t counts) {
+  record(cap, "L %lu %u", (unsigned long)t_us, (unsigned)counts);
+}
+
+void captureAdcBlock(SensorCapture& cap, uint32_t t_us, uint8_t pump, const uint16_t* samples, size_t count) {
+  if (!beginRecord(cap, (count + CAPTURE_ADC_PER_LINE - 1) / CAPTURE_ADC_PER_LINE)) return;
+  char line[CAPTURE_LINE_MAX];
+  for (size_t from = 0; from < count; from += CAPTURE_ADC_PER_LINE) {
+    int n = snprintf(line, sizeof(line), "A %lu %u %u %u", (unsigned long)t_us, (unsigned)pump, (unsigned)from,
+                     (unsigned)count);
+    for (size_t i = from; i < count && i < from + CAPTURE_ADC_PER_LINE; i++) {
+      n += snprintf(line + n, sizeof(line) - n, " %03x", (unsigned)(samples[i] & 0xfff));
+    }
+    pushLine(cap, line);
+  }
+}
+
+void captureFlow(SensorCapture& cap, uint32_t t_us, uint32_t pulses, uint32_t elapsed_ms) {
+  record(cap, "P %lu %lu %lu", (unsigned long)t_us, (unsigned long)pulses, (unsigned long)elapsed_ms);
+}
+
+void captureEcho(SensorCapture& cap, uint32_t t_us, uint32_t echo_us) {
+  record(cap, "U %lu %lu", (unsigned long)t_us, (unsigned long)echo_us);
+}
+
+void captureTemperature(SensorCapture& cap, uint32_t t_us, uint8_t pump, float celsius) {
+  record(cap, "T %lu %u %ld", (unsigned long)t_us, (unsigned)pump, lroundf(celsius * 100.0f));
+}
+
+void captureFloat(SensorCapture& cap, uint32_t t_us, uint32_t now_ms, uint8_t id, bool raw_wet, uint32_t edge_us) {
+  record(cap, "F %lu %lu %u %d %lu", (unsigned long)t_us, (unsigned long)now_ms, (unsigned)id, raw_wet ? 1 : 0,
+         (unsigned long)edge_us);
+}
+
+void captureCommand(SensorCapture& cap, uint32_t t_us, uint32_t now_ms, uint8_t pump, bool start) {
+  record(cap, "C %lu %lu %u %s", (unsigned long)t_us, (unsigned long)now_ms, (unsigned)pump, start ? "START" : "STOP");
+}
+
+void captureCycle(SensorCapture& cap, uint32_t t_us, uint32_t now_ms) {
+  record(cap, "K %lu %lu", (unsigned long)t_us, (unsigned long)now_ms);
+}
+
+bool captureNextLine(SensorCapture& cap, char* line, size_t size) {
+  if (cap.used == 0) {
+    // Detenida y vacía: falta cerrar con la Z
+    if (cap.active || cap.ended || cap.buf == nullptr) return false;
+    cap.ended = true;
+    snprintf(line, size, "Z");
+    return true;
+  }
+  size_t n = 0;
+  for (;;) {
+    char c = cap.buf[cap.tail];
+    cap.tail = cap.tail + 1 == cap.size ? 0 : cap.tail + 1;
+    cap.used--;
+    if (c == '\0') break;
+    if (n + 1 < size) line[n++] = c;
+  }
+  line[n] = '\0';
+  return true;
+}
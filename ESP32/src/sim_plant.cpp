@@ -0,0 +1,142 @@
+#include "sim_plant.h"
+
+#include <math.h>
+#include <string.h>
+
+#define SIM_SOUND_CM_PER_US 0.034f // La misma velocidad del sonido que tankEchoHeightCm()
+#define SIM_TEMPERATURE_NOISE_C 0.5f
+
+// Generador congruencial (Numerical Recipes): reproducible en el equipo y en el host
+static float randomUnit(SimPlant& plant) {
+  plant.seed = plant.seed * 1664525u + 1013904223u;
+  return (float)(plant.seed >> 8) / 16777216.0f;  // [0, 1)
+}
+
+static float randomSpread(SimPlant& plant, float spread) {
+  return (randomUnit(plant) * 2.0f - 1.0f) * spread;
+}
+
+static bool floatWetAtLevel(const SimPlant& plant, FloatSwitchId id) {
+  float mount_cm = id == FLOAT_SWITCH_HIGH ? plant.cfg.level.high_float_cm : plant.cfg.level.low_float_cm;
+  return plant.height_cm >= mount_cm;
+}
+
+static void updateFloats(SimPlant& plant, uint32_t now_us) {
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) {
+    FloatSwitchId id = (FloatSwitchId)i;
+    bool wet;
+    switch (plant.float_fault[i]) {
+      case SIM_FLOAT_STUCK_DRY: wet = false; break;
+      case SIM_FLOAT_STUCK_WET: wet = true; break;
+      default: wet = floatWetAtLevel(plant, id); break;
+    }
+    if (wet == plant.float_wet[i]) continue;
+    plant.float_wet[i] = wet;
+    plant.float_edge_us[i] = now_us;
+  }
+}
+
+void simPlantInit(SimPlant& plant, const TankControllerConfig& cfg, float level_percent, uint32_t seed,
+                  uint32_t now_ms, uint32_t now_us) {
+  memset(&plant, 0, sizeof(plant));
+  plant.cfg = cfg;
+  plant.height_cm = level_percent / 100.0 * cfg.table->height_cm;
+  if (plant.height_cm > cfg.overflow_cm) plant.height_cm = cfg.overflow_cm;
+  for (int i = 0; i < TANK_PUMPS; i++) plant.temperature_c[i] = NAN;
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) {
+    plant.float_wet[i] = floatWetAtLevel(plant, (FloatSwitchId)i);
+    plant.float_edge_us[i] = now_us;
+  }
+  plant.last_ms = now_ms;
+  plant.last_flow_ms = now_ms;
+  plant.seed = seed != 0 ? seed : 1;
+}
+
+void simPlantAdvance(SimPlant& plant, uint32_t now_ms, uint32_t now_us) {
+  uint32_t elapsed_ms = now_ms - plant.last_ms;
+  plant.last_ms = now_ms;
+
+  if (elapsed_ms > 0) {
+    double minutes = elapsed_ms / 60000.0;
+    float net_lpm = plant.inflow_lpm - plant.leak_lpm;
+    for (int i = 0; i < TANK_PUMPS; i++) {
+      if (plant.relay[i] && !plant.seized[i]) net_lpm -= plant.cfg.energy[i].nominal_flow_lpm;
+    }
+
+    float liters_per_cm = tankLitersPerCm(*plant.cfg.table, (float)plant.height_cm);
+    if (liters_per_cm > 0.0f) plant.height_cm += net_lpm * minutes / liters_per_cm;
+    if (plant.height_cm < 0.0) plant.height_cm = 0.0;
+    if (plant.height_cm > plant.cfg.overflow_cm) plant.height_cm = plant.cfg.overflow_cm; // Rebalsa
+
+    if (plant.inflow_lpm > 0.0f) plant.pending_pulses += plant.inflow_lpm * minutes / plant.cfg.liters_per_pulse;
+  }
+  updateFloats(plant, now_us);
+}
+
+void simPlantSetRelay(SimPlant& plant, int pump, bool on) {
+  if (pump >= 0 && pump < TANK_PUMPS) plant.relay[pump] = on;
+}
+
+void simPlantSetFloatFault(SimPlant& plant, FloatSwitchId id, SimFloatFault fault, uint32_t now_us) {
+  plant.float_fault[id] = fault;
+  updateFloats(plant, now_us);
+}
+
+float simPlantPumpAmps(const SimPlant& plant, int pump) {
+  if (pump < 0 || pump >= TANK_PUMPS || !plant.relay[pump]) return 0.0f;
+  return plant.seized[pump] ? SIM_PUMP_SEIZED_AMPS : SIM_PUMP_RUN_AMPS;
+}
+
+// Cuentas del ADC de un CT con `ct_rms` amperios eficaces en el instante `t_us` (recorta en los extremos)
+static uint16_t ctCounts(const SimPlant& plant, float ct_rms, uint32_t t_us) {
+  float phase = 2.0f * (float)M_PI * SIM_MAINS_HZ * (float)(t_us % 1000000u) / 1e6f;
+  float counts = SIM_ADC_MIDSCALE + ct_rms * sqrtf(2.0f) * sinf(phase) / plant.cfg.amps_per_count;
+  if (counts < 0.0f) return 0;
+  if (counts > SIM_ADC_MAX) return SIM_ADC_MAX;
+  return (uint16_t)lroundf(counts);
+}
+
+uint16_t simPlantLineAdc(SimPlant& plant, uint32_t now_us) {
+  float line_rms = 0.0f;
+  for (int i = 0; i < TANK_PUMPS; i++) line_rms += simPlantPumpAmps(plant, i);
+  return ctCounts(plant, line_rms, now_us);
+}
+
+// El controlador atribuye a cada bomba `pump_amps_share` de lo que mide el CT: se invierte aquí
+void simPlantAdcBlock(SimPlant& plant, int pump, uint32_t start_us, uint32_t sample_us, uint16_t* samples,
+                      size_t count) {
+  float ct_rms = plant.cfg.pump_amps_share > 0.0f ? simPlantPumpAmps(plant, pump) / plant.cfg.pump_amps_share : 0.0f;
+  for (size_t i = 0; i < count; i++) samples[i] = ctCounts(plant, ct_rms, start_us + (uint32_t)i * sample_us);
+}
+
+uint32_t simPlantFlowPulses(SimPlant& plant, uint32_t now_ms, uint32_t* elapsed_ms) {
+  uint32_t pulses = (uint32_t)plant.pending_pulses;
+  plant.pending_pulses -= pulses;
+  *elapsed_ms = now_ms - plant.last_flow_ms;
+  plant.last_flow_ms = now_ms;
+  return pulses;
+}
+
+uint32_t simPlantEchoUs(SimPlant& plant) {
+  if (plant.echo_lost) return 0;
+  float distance = plant.cfg.empty_distance_cm - (float)plant.height_cm + randomSpread(plant, SIM_ULTRASONIC_NOISE_CM);
+  if (distance < 1.0f) distance = 1.0f;
+  return (uint32_t)lroundf(distance * 2.0f / SIM_SOUND_CM_PER_US);
+}
+
+float simPlantTemperature(SimPlant& plant, int pump) {
+  if (pump < 0 || pump >= TANK_PUMPS) return NAN;
+  if (plant.temperature_fault[pump]) return SIM_DS18B20_DISCONNECTED_C;
+  float base = plant.temperature_c[pump];
+  if (isnan(base)) base = plant.relay[pump] ? SIM_TEMPERATURE_RUN_C : SIM_TEMPERATURE_IDLE_C;
+  return base + randomSpread(plant, SIM_TEMPERATURE_NOISE_C);
+}
+
+bool simPlantFloatRaw(const SimPlant& plant, FloatSwitchId id, uint32_t* edge_us) {
+  if (edge_us != nullptr) *edge_us = plant.float_edge_us[id];
+  return plant.float_wet[id];
+}
+
+float simPlantLevelPercent(const SimPlant& plant) {
+  return (float)(plant.height_cm / plant.cfg.table->height_cm * 100.0);
+}
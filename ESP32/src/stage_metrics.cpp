@@ -0,0 +1,57 @@
+#include "stage_metrics.h"
+
+#include <string.h>
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = {
+  "sensors", "telemetry", "serialize", "mqtt_dispatch", "mqtt_poll",
+  "handler_control", "handler_config", "handler_sample", "loop",
+  "wifi", "mqtt_reconnect", "ultrasonic", "temperature", "nvs"
+};
+
+void stageMetricsInit(StageMetrics& metrics, uint32_t now_ms) {
+  memset(&metrics, 0, sizeof(metrics));
+  metrics.window_start_ms = now_ms;
+}
+
+void stageMetricsReset(StageMetrics& metrics, uint32_t now_ms) {
+  stageMetricsInit(metrics, now_ms);
+}
+
+void stageMetricsRecord(StageMetrics& metrics, MetricStage stage, uint32_t duration_us) {
+  if (stage >= STAGE_COUNT) return;
+  StageHistogram& hist = metrics.stages[stage];
+
+  uint8_t bucket = 0;
+  uint32_t bound = STAGE_BUCKET_BASE_US;
+  while (bucket < STAGE_BUCKETS - 1 && duration_us >= bound) {
+    bucket++;
+    bound <<= 1;
+  }
+
+  hist.buckets[bucket]++;
+  hist.count++;
+  hist.sum_us += duration_us;
+  if (duration_us > hist.max_us) hist.max_us = duration_us;
+}
+
+const char* stageName(MetricStage stage) {
+  return stage < STAGE_COUNT ? STAGE_NAMES[stage] : "unknown";
+}
+
+uint32_t stageHistogramPercentile(const StageHistogram& hist, uint8_t p) {
+  if (hist.count == 0) return 0;
+
+  // Posición (1..count) de la muestra del percentil, redondeando hacia arriba
+  uint32_t rank = (uint32_t)(((uint64_t)hist.count * p + 99) / 100);
+  if (rank == 0) rank = 1;
+
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < STAGE_BUCKETS - 1; i++) {
+    seen += hist.buckets[i];
+    if (seen >= rank) {
+      uint32_t bound = (uint32_t)STAGE_BUCKET_BASE_US << i;
+      return bound < hist.max_us ? bound : hist.max_us;
+    }
+  }
+  return hist.max_us;
+}
@@ -0,0 +1,195 @@
+#include "stall_monitor.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_task_wdt.h>
+#include <esp_idf_version.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define STALL_RING_MAGIC 0x53544c01u // "STL" + versión 1
+
+struct StallRing {
+  uint32_t magic;
+  uint32_t boot;
+  uint32_t next_seq;
+  uint8_t head;                       // Próximo registro a sobrescribir
+  StallRecord records[STALL_RING_SIZE];
+  uint32_t crc;
+};
+
+// Sin inicializar a propósito: conserva los registros entre reinicios que no cortan la energía
+RTC_NOINIT_ATTR static StallRing ring;
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Estado de la vuelta actual del loop (lo escribe el loop, lo lee la tarea de vigilancia)
+static volatile int64_t iterationStartUs = 0;  // 0 = entre vueltas
+static volatile uint32_t iteration = 0;
+static volatile uint8_t stackDepth = 0;
+static volatile uint8_t stackStages[STALL_TRACE_DEPTH];
+static volatile uint32_t stackPcs[STALL_TRACE_DEPTH];
+
+static TaskHandle_t loopTask = nullptr;
+static uint32_t openIteration = 0;  // Vuelta con registro abierto
+static int8_t openRecord = -1;
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+  }
+  return ~crc;
+}
+
+static uint32_t ringCrc() {
+  return crc32((const uint8_t*)&ring, offsetof(StallRing, crc));
+}
+
+// Abre un registro con la pila de etapas actual (dentro de la sección crítica)
+static void openStall(uint32_t iter, int64_t start_us, int64_t now_us) {
+  StallRecord& rec = ring.records[ring.head];
+  memset(&rec, 0, sizeof(rec));
+  rec.seq = ring.next_seq++;
+  rec.boot = ring.boot;
+  rec.uptime_ms = (uint32_t)(start_us / 1000);
+  rec.duration_ms = (uint32_t)((now_us - start_us) / 1000);
+  rec.state = STALL_ONGOING;
+
+  uint8_t depth = stackDepth < STALL_TRACE_DEPTH ? stackDepth : STALL_TRACE_DEPTH;
+  for (uint8_t i = 0; i < depth; i++) {
+    rec.stages[i] = stackStages[i];
+    rec.pcs[i] = stackPcs[i];
+  }
+  rec.depth = depth;
+  strncpy(rec.task, pcTaskGetName(loopTask), STALL_TASK_NAME_MAX - 1);
+
+  openRecord = ring.head;
+  openIteration = iter;
+  ring.head = (ring.head + 1) % STALL_RING_SIZE;
+}
+
+static void monitorTask(void* arg) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(STALL_MONITOR_PERIOD_MS));
+
+    int64_t start = iterationStartUs;
+    if (start == 0 || esp_timer_get_time() - start < (int64_t)STALL_BUDGET_MS * 1000) continue;
+
+    portENTER_CRITICAL(&ringMux);
+    // Se vuelve a leer dentro de la sección crítica: la vuelta pudo terminar mientras tanto
+    start = iterationStartUs;
+    uint32_t iter = iteration;
+    int64_t now = esp_timer_get_time();
+    if (start != 0) {
+      if (openRecord < 0 || openIteration != iter) {
+        openStall(iter, start, now);
+      } else {
+        ring.records[openRecord].duration_ms = (uint32_t)((now - start) / 1000);
+      }
+      ring.crc = ringCrc();
+    }
+    portEXIT_CRITICAL(&ringMux);
+  }
+}
+
+static void configureTaskWatchdog() {
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+  // Se mantiene la vigilancia de la tarea idle del núcleo 0, como en la configuración de Arduino
+  esp_task_wdt_config_t config = {};
+  config.timeout_ms = STALL_WDT_TIMEOUT_S * 1000;
+  config.idle_core_mask = 1 << 0;
+  config.trigger_panic = true;
+  if (esp_task_wdt_reconfigure(&config) != ESP_OK) esp_task_wdt_init(&config);
+#else
+  esp_task_wdt_init(STALL_WDT_TIMEOUT_S, true); // Si ya estaba iniciado, solo cambia el plazo
+#endif
+  esp_task_wdt_add(nullptr);
+}
+
+void stallMonitorBegin(uint32_t boot) {
+  loopTask = xTaskGetCurrentTaskHandle();
+
+  if (ring.magic != STALL_RING_MAGIC || ring.crc != ringCrc() || ring.head >= STALL_RING_SIZE) {
+    memset(&ring, 0, sizeof(ring));
+    ring.magic = STALL_RING_MAGIC;
+    ring.next_seq = 1;
+  }
+
+  // Lo que quedó abierto en el arranque anterior terminó en reinicio
+  for (int i = 0; i < STALL_RING_SIZE; i++) {
+    if (ring.records[i].seq != 0 && ring.records[i].state == STALL_ONGOING) ring.records[i].state = STALL_FATAL;
+  }
+  ring.boot = boot != 0 ? boot : ring.boot + 1; // Sin NVS: al menos cuenta mientras dure la RTC
+  ring.crc = ringCrc();
+
+  xTaskCreatePinnedToCore(monitorTask, "stall_mon", STALL_MONITOR_STACK, nullptr, configMAX_PRIORITIES - 2, nullptr, 0);
+}
+
+void stallWatchdogBegin() {
+  configureTaskWatchdog();
+}
+
+void stallLoopBegin() {
+  esp_task_wdt_reset();
+  stackDepth = 0;
+  iteration = iteration + 1;
+  iterationStartUs = esp_timer_get_time();
+}
+
+void stallLoopEnd() {
+  portENTER_CRITICAL(&ringMux);
+  int64_t start = iterationStartUs;
+  iterationStartUs = 0;
+  if (openRecord >= 0 && openIteration == iteration) {
+    StallRecord& rec = ring.records[openRecord];
+    rec.duration_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+    rec.state = STALL_ENDED;
+    openRecord = -1;
+    ring.crc = ringCrc();
+  }
+  portEXIT_CRITICAL(&ringMux);
+}
+
+void stallPush(uint8_t stage, uint32_t pc) {
+  uint8_t depth = stackDepth;
+  if (depth < STALL_TRACE_DEPTH) {
+    stackStages[depth] = stage;
+    stackPcs[depth] = pc;
+  }
+  stackDepth = depth + 1;
+}
+
+void stallPop() {
+  if (stackDepth > 0) stackDepth = stackDepth - 1;
+}
+
+uint32_t stallBootCount() {
+  return ring.boot;
+}
+
+bool stallNextPending(StallRecord& out) {
+  bool found = false;
+  portENTER_CRITICAL(&ringMux);
+  for (int i = 0; i < STALL_RING_SIZE; i++) {
+    const StallRecord& rec = ring.records[i];
+    if (rec.seq == 0 || rec.uploaded || rec.state == STALL_ONGOING) continue;
+    if (!found || rec.seq < out.seq) {
+      out = rec;
+      found = true;
+    }
+  }
+  portEXIT_CRITICAL(&ringMux);
+  return found;
+}
+
+void stallMarkUploaded(uint32_t seq) {
+  portENTER_CRITICAL(&ringMux);
+  for (int i = 0; i < STALL_RING_SIZE; i++) {
+    if (ring.records[i].seq == seq) ring.records[i].uploaded = true;
+  }
+  ring.crc = ringCrc();
+  portEXIT_CRITICAL(&ringMux);
+}
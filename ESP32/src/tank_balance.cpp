@@ -0,0 +1,127 @@
+#include "tank_balance.h"
+
+#include <string.h>
+
+void tankBalanceInit(TankBalance& balance) {
+  memset(&balance, 0, sizeof(balance));
+}
+
+static const TankBalanceSample& sampleAt(const TankBalance& balance, uint8_t age) {
+  // age 0 = muestra más reciente
+  int index = (int)balance.head - 1 - (int)age;
+  if (index < 0) index += TANK_BALANCE_RING;
+  return balance.ring[index];
+}
+
+static void pushSample(TankBalance& balance, const TankBalanceSample& sample) {
+  balance.ring[balance.head] = sample;
+  balance.head = (balance.head + 1) % TANK_BALANCE_RING;
+  if (balance.count < TANK_BALANCE_RING) balance.count++;
+}
+
+bool tankBalanceWindow(const TankBalance& balance, uint32_t window_ms, TankBalanceWindow& out) {
+  if (balance.count < 2) return false;
+
+  const TankBalanceSample& newest = sampleAt(balance, 0);
+
+  // Buscar la muestra más reciente que cubra toda la ventana
+  bool idle = !newest.pumps_on;
+  bool saturated = newest.saturated;
+  int startAge = -1;
+  for (uint8_t age = 1; age < balance.count; age++) {
+    const TankBalanceSample& s = sampleAt(balance, age);
+    if (s.pumps_on) idle = false;
+    if (s.saturated) saturated = true;
+    if (newest.t_ms - s.t_ms >= window_ms) {
+      startAge = age;
+      break;
+    }
+  }
+  if (startAge < 0) return false;
+
+  const TankBalanceSample& oldest = sampleAt(balance, (uint8_t)startAge);
+  float minutes = (float)(newest.t_ms - oldest.t_ms) / 60000.0f;
+  if (minutes <= 0.0f) return false;
+
+  float inflow = (float)(newest.inflow_l - oldest.inflow_l);
+  float pumped = (float)(newest.pumped_l - oldest.pumped_l);
+  float outflow = inflow - (newest.volume_l - oldest.volume_l);
+
+  out.minutes = minutes;
+  out.inflow_lpm = inflow / minutes;
+  out.outflow_lpm = outflow / minutes;
+  out.pumped_lpm = pumped / minutes;
+  out.unaccounted_lpm = (outflow - pumped) / minutes;
+  out.idle = idle && pumped <= 0.0f;
+  out.saturated = saturated;
+  return true;
+}
+
+static TankLeakEvent evaluateLeak(TankBalance& balance) {
+  TankBalanceWindow window;
+  if (!tankBalanceWindow(balance, LEAK_WINDOW_MS, window)) return LEAK_EVENT_NONE;
+
+  // Con bombas funcionando el balance no distingue fuga de bombeo: se mantiene el estado
+  if (!window.idle) return LEAK_EVENT_NONE;
+  // Tanque lleno: la entrada que rebalsa parece salida no explicada; también se mantiene el estado
+  if (window.saturated) return LEAK_EVENT_NONE;
+
+  if (window.unaccounted_lpm >= LEAK_THRESHOLD_LPM) {
+    if (balance.leak_streak < LEAK_CONFIRM_EVALS) balance.leak_streak++;
+    if (balance.leak_active) {
+      balance.leak_rate_lpm = window.unaccounted_lpm;
+    } else if (balance.leak_streak >= LEAK_CONFIRM_EVALS) {
+      balance.leak_active = true;
+      balance.leak_rate_lpm = window.unaccounted_lpm;
+      return LEAK_EVENT_RAISED;
+    }
+    return LEAK_EVENT_NONE;
+  }
+
+  balance.leak_streak = 0;
+
+  // Histéresis: la alerta se limpia con la mitad del umbral
+  if (balance.leak_active && window.unaccounted_lpm < LEAK_THRESHOLD_LPM * 0.5f) {
+    balance.leak_active = false;
+    balance.leak_rate_lpm = 0.0f;
+    return LEAK_EVENT_CLEARED;
+  }
+  return LEAK_EVENT_NONE;
+}
+
+TankLeakEvent tankBalanceUpdate(TankBalance& balance, float inflow_lpm, float volume_l,
+                                double pumped_total_l, bool pumps_on, bool saturated, uint32_t now_ms) {
+  if (inflow_lpm < 0.0f) inflow_lpm = 0.0f;
+
+  // 1. TOTALIZADOR (regla del trapecio)
+  if (balance.has_sample) {
+    uint32_t dt_ms = now_ms - balance.last_ms;
+    if (dt_ms > 0 && dt_ms <= TANK_BALANCE_MAX_GAP_MS) {
+      balance.inflow_total_l += ((double)balance.last_inflow_lpm + (double)inflow_lpm) * 0.5 * ((double)dt_ms / 60000.0);
+    }
+  }
+  balance.last_inflow_lpm = inflow_lpm;
+  balance.last_ms = now_ms;
+  balance.has_sample = true;
+  if (pumps_on) balance.pumps_on_since_push = true;
+  if (saturated) balance.saturated_since_push = true;
+
+  // 2. HISTORIAL PARA LAS VENTANAS DESLIZANTES
+  if (balance.count > 0 && now_ms - sampleAt(balance, 0).t_ms < TANK_BALANCE_SAMPLE_MS) {
+    return LEAK_EVENT_NONE;
+  }
+
+  TankBalanceSample sample;
+  sample.t_ms = now_ms;
+  sample.inflow_l = balance.inflow_total_l;
+  sample.pumped_l = pumped_total_l;
+  sample.volume_l = volume_l;
+  sample.pumps_on = balance.pumps_on_since_push;
+  sample.saturated = balance.saturated_since_push;
+  pushSample(balance, sample);
+  balance.pumps_on_since_push = pumps_on;
+  balance.saturated_since_push = saturated;
+
+  // 3. DETECCIÓN DE FUGA
+  return evaluateLeak(balance);
+}
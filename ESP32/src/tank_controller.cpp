@@ -0,0 +1,148 @@
+#include "tank_controller.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "dsp.h"
+
+#define SOUND_CM_PER_US 0.034f  // 343 m/s
+#define ECHO_MAX_DISTANCE_CM 400.0f
+
+void tankControllerInit(TankController& ctl, const TankControllerConfig& cfg, const double* stored_kwh,
+                        const double* stored_m3) {
+  memset(&ctl, 0, sizeof(ctl));
+  ctl.cfg = cfg;
+  levelEstimatorInit(ctl.level, cfg.table, cfg.level);
+  levelTrendInit(ctl.trend);
+  tankBalanceInit(ctl.balance);
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) floatDebouncerInit(ctl.floats[i]);
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    energyMeterInit(ctl.meters[i], cfg.energy[i], stored_kwh != nullptr ? stored_kwh[i] : 0.0,
+                    stored_m3 != nullptr ? stored_m3[i] : 0.0);
+  }
+  ctl.level_percent = 70.0f;
+}
+
+float tankLineAmps(const TankControllerConfig& cfg, uint16_t adc) {
+  return (float)adc * cfg.amps_per_count;
+}
+
+float tankPumpAmps(const TankControllerConfig& cfg, const uint16_t* samples, size_t count) {
+  if (samples == nullptr || count == 0) return 0.0f;
+  return dspAcRms(samples, count, cfg.amps_per_count) * cfg.pump_amps_share;
+}
+
+// Litros en el intervalo divididos entre los minutos transcurridos
+float tankInflowLpm(const TankControllerConfig& cfg, uint32_t pulses, uint32_t elapsed_ms) {
+  if (elapsed_ms == 0) return 0.0f;
+  float liters = (float)pulses * cfg.liters_per_pulse;
+  return liters * 60000.0f / (float)elapsed_ms;
+}
+
+// La distancia empty_distance_cm corresponde al fondo del tanque
+float tankEchoHeightCm(const TankControllerConfig& cfg, uint32_t echo_us) {
+  float distance = (float)echo_us * SOUND_CM_PER_US / 2.0f;
+  if (distance == 0.0f || distance > ECHO_MAX_DISTANCE_CM) return NAN;
+  return cfg.empty_distance_cm - distance;
+}
+
+bool tankControllerFloatWet(const TankController& ctl, FloatSwitchId id) {
+  const FloatDebouncer& debouncer = ctl.floats[id];
+  return debouncer.initialized ? debouncer.stable_wet : ctl.float_raw[id];
+}
+
+bool tankControllerTankEmpty(const TankController& ctl) {
+  const FloatDebouncer& low = ctl.floats[FLOAT_SWITCH_LOW];
+  return low.initialized && !low.stable_wet;
+}
+
+float tankControllerNetInflowLpm(const TankController& ctl) {
+  float net_inflow_lpm = ctl.last.inflow_lpm;
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    if (ctl.pump_on[i]) net_inflow_lpm -= ctl.cfg.energy[i].nominal_flow_lpm;
+  }
+  return net_inflow_lpm;
+}
+
+bool tankControllerPumpsOn(const TankController& ctl) {
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    if (ctl.pump_on[i]) return true;
+  }
+  return false;
+}
+
+static void publishLevel(TankController& ctl) {
+  ctl.level_percent = levelEstimatorPercent(ctl.level);
+  ctl.level_sigma_percent = levelEstimatorSigmaPercent(ctl.level);
+}
+
+TankLeakEvent tankControllerSample(TankController& ctl, const TankReadings& readings) {
+  ctl.last = readings;
+  ctl.flow_detected = readings.inflow_lpm > ctl.cfg.flow_detect_lpm;
+
+  // 1. Nivel: ultrasonido y flotadores fusionados (filtro de Kalman)
+  levelEstimatorPredict(ctl.level, tankControllerNetInflowLpm(ctl), readings.now_ms);
+  levelEstimatorUpdateUltrasonic(ctl.level, readings.ultrasonic_height_cm);
+  levelEstimatorUpdateFloats(ctl.level, tankControllerFloatWet(ctl, FLOAT_SWITCH_HIGH),
+                             tankControllerFloatWet(ctl, FLOAT_SWITCH_LOW));
+  publishLevel(ctl);
+
+  // 2. Totalizador de entrada, tendencia y balance de masa (con lo bombeado hasta el ciclo anterior)
+  double pumped_total_l = 0.0;
+  for (int i = 0; i < TANK_PUMPS; i++) pumped_total_l += ctl.meters[i].total_m3 * 1000.0;
+  ctl.tank_volume_l = tankLitersAtPercent(*ctl.cfg.table, ctl.level_percent);
+  levelTrendAdd(ctl.trend, ctl.tank_volume_l, readings.now_ms);
+  // Tanque en el rebalse: lo que entra se va por el tubo y el balance lo vería como fuga
+  float overflow_percent = (ctl.cfg.overflow_cm - TANK_SATURATED_MARGIN_CM) / (float)ctl.cfg.table->height_cm * 100.0f;
+  bool saturated = ctl.level_percent >= overflow_percent;
+  TankLeakEvent leak = tankBalanceUpdate(ctl.balance, readings.inflow_lpm, ctl.tank_volume_l, pumped_total_l,
+                                         tankControllerPumpsOn(ctl), saturated, readings.now_ms);
+
+  // 3. Energía de cada bomba con la corriente de este ciclo
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    energyMeterSample(ctl.meters[i], readings.pump_amps[i], ctl.pump_on[i], readings.now_ms);
+  }
+
+  // 4. Sensores de temperatura que dejaron de responder (o volvieron)
+  ctl.temperature_changed = 0;
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    float celsius = readings.temperature_c[i];
+    bool fault = isnan(celsius) || celsius <= TANK_TEMPERATURE_DISCONNECTED_C + 0.5f;
+    if (fault != ctl.temperature_fault[i]) ctl.temperature_changed |= (uint8_t)(1u << i);
+    ctl.temperature_fault[i] = fault;
+  }
+  return leak;
+}
+
+bool tankControllerFloat(TankController& ctl, FloatSwitchId id, bool raw_wet, uint32_t last_edge_us,
+                         uint32_t now_us, uint32_t now_ms, FloatLevelEvent& event, uint8_t& stop_mask) {
+  stop_mask = 0;
+  ctl.float_raw[id] = raw_wet;
+  if (!floatDebouncerUpdate(ctl.floats[id], id, raw_wet, last_edge_us, now_us, event)) return false;
+
+  // Tanque vacío: apagar las bombas para que no trabajen en seco
+  if (event.id == FLOAT_SWITCH_LOW && !event.wet) {
+    for (int i = 0; i < TANK_PUMPS; i++) {
+      if (!ctl.pump_on[i]) continue;
+      ctl.pump_on[i] = false;
+      stop_mask |= (uint8_t)(1u << i);
+    }
+  }
+
+  // El cruce es un ancla precisa del nivel
+  levelEstimatorPredict(ctl.level, tankControllerNetInflowLpm(ctl), now_ms);
+  levelEstimatorUpdateFloats(ctl.level, tankControllerFloatWet(ctl, FLOAT_SWITCH_HIGH),
+                             tankControllerFloatWet(ctl, FLOAT_SWITCH_LOW));
+  publishLevel(ctl);
+  return true;
+}
+
+const char* tankControllerCommand(const TankController& ctl, int pump, ControlAction action) {
+  if (pump < 0 || pump >= TANK_PUMPS) return "UNKNOWN_PUMP";
+  if (action == CONTROL_START && tankControllerTankEmpty(ctl)) return "REJECTED_TANK_EMPTY";
+  return nullptr;
+}
+
+void tankControllerSetPump(TankController& ctl, int pump, bool on) {
+  if (pump >= 0 && pump < TANK_PUMPS) ctl.pump_on[pump] = on;
+}
@@ -0,0 +1,107 @@
+#include "telemetry_payload.h"
+
+// Campos en orden; `stamp_offset` recibe la posición del valor de "ts_ms"
+static void writeTelemetry(JsonWriter& w, const TelemetrySample& sample, const char* stamp, size_t& stamp_offset) {
+  jsonBeginObject(w);
+  jsonInt(w, "pump_id", sample.pump_id);
+  jsonFloat(w, "current_amps", sample.amps, TELEMETRY_DECIMALS);
+  jsonFloat(w, "pump_temperature_celsius", sample.temperature_c, TELEMETRY_DECIMALS);
+
+  // Dato GLOBAL: El flujo de entrada se muestra siempre (aunque la bomba esté apagada)
+  jsonFloat(w, "current_inflow_rate", sample.inflow_rate, TELEMETRY_DECIMALS);
+
+  // "ts_ms": hora real en ms o null si todavía no hay NTP
+  stamp_offset = jsonRaw(w, TIME_STAMP_FIELD, stamp, TIME_STAMP_WIDTH);
+  if (sample.slot_ms != 0) jsonInt(w, "slot_ms", sample.slot_ms);
+  jsonFloat(w, "water_level_percent", sample.level_percent, TELEMETRY_DECIMALS);
+  jsonFloat(w, "water_level_sigma_percent", sample.level_sigma_percent, TELEMETRY_DECIMALS); // Incertidumbre del nivel fusionado
+
+  // Estado de la cola de salida MQTT
+  jsonInt(w, "mqtt_queue_depth", sample.queue_depth);
+  jsonInt(w, "mqtt_ack_latency_ms", sample.ack_latency_ms);
+
+  // El estado "FLOWING" (que pone la bomba verde en el frontend)
+  // SOLO debe activarse si LA BOMBA TIENE AMPERAJE (está encendida).
+  // El current inflow rate debería ser para esto, pero se uso como corriente de agua en el front y se mantuvo, el street flow era el flujo de la calle
+  // debo corregir esto
+  jsonString(w, "street_flow_status", (sample.amps > 0) ? "FLOWING" : "STOPPED");
+
+  // Energía: potencia instantánea, acumulado histórico, energía del intervalo y eficiencia
+  jsonFloat(w, "power_watts", sample.power_w, TELEMETRY_POWER_DECIMALS);
+  jsonFloat(w, "energy_kwh_total", sample.energy_kwh_total, TELEMETRY_KWH_DECIMALS);
+  jsonFloat(w, "energy_kwh_interval", sample.energy_kwh_interval, TELEMETRY_INTERVAL_DECIMALS);
+  jsonFloat(w, "pumped_m3_interval", sample.pumped_m3_interval, TELEMETRY_INTERVAL_DECIMALS);
+  jsonFloat(w, "energy_kwh_per_m3", sample.energy_kwh_per_m3, TELEMETRY_KWH_DECIMALS);
+
+  // Tanque: volumen según la geometría y tiempo estimado hasta vacío / lleno
+  jsonFloat(w, "tank_volume_liters", sample.tank_volume_l, TELEMETRY_VOLUME_DECIMALS);
+  if (sample.trend != nullptr) {
+    jsonFloat(w, "tank_trend_lpm", sample.trend->slope_lpm, TELEMETRY_DECIMALS);
+    if (sample.trend->minutes_to_empty >= 0) {
+      jsonFloat(w, "minutes_to_empty", sample.trend->minutes_to_empty, TELEMETRY_VOLUME_DECIMALS);
+    }
+    if (sample.trend->minutes_to_full >= 0) {
+      jsonFloat(w, "minutes_to_full", sample.trend->minutes_to_full, TELEMETRY_VOLUME_DECIMALS);
+    }
+  }
+
+  // Tanque: totalizador de entrada, salida implícita y estado de fuga
+  jsonFloat(w, "inflow_total_liters", sample.inflow_total_l, TELEMETRY_VOLUME_DECIMALS);
+  if (sample.balance5 != nullptr) {
+    jsonFloat(w, "tank_outflow_lpm_5min", sample.balance5->outflow_lpm, TELEMETRY_DECIMALS);
+    jsonFloat(w, "tank_unaccounted_lpm_5min", sample.balance5->unaccounted_lpm, TELEMETRY_DECIMALS);
+  }
+  if (sample.balance15 != nullptr) {
+    jsonFloat(w, "tank_outflow_lpm_15min", sample.balance15->outflow_lpm, TELEMETRY_DECIMALS);
+    jsonFloat(w, "tank_unaccounted_lpm_15min", sample.balance15->unaccounted_lpm, TELEMETRY_DECIMALS);
+  }
+  jsonBool(w, "leak_suspected", sample.leak_suspected);
+  if (sample.leak_suspected) {
+    jsonFloat(w, "leak_rate_lpm", sample.leak_rate_lpm, TELEMETRY_DECIMALS);
+  }
+  jsonEndObject(w);
+}
+
+size_t telemetryPayloadWrite(const TelemetrySample& sample, const char* stamp, char* out, size_t size,
+                             size_t* stamp_offset) {
+  JsonWriter w;
+  jsonWriterInit(w, out, size);
+  size_t offset = 0;
+  writeTelemetry(w, sample, stamp, offset);
+  if (!jsonWriterOk(w)) return 0; // Un JSON incompleto no se publica
+  if (stamp_offset != nullptr) *stamp_offset = offset;
+  return w.length;
+}
+
+struct SlotWriter {
+  MqttPublisher* pub;
+  MqttOutboundMessage* msg;
+};
+
+// Si el lugar se llena, lo escrito pasa al buffer grande del publicador y se sigue ahí
+static bool growIntoJumbo(void* ctx, char*& buf, size_t& capacity, size_t used) {
+  SlotWriter* slot = (SlotWriter*)ctx;
+  if (!mqttPublisherGrow(*slot->pub, *slot->msg, used)) return false;
+  buf = (char*)mqttPublisherPayload(*slot->pub, *slot->msg);
+  capacity = mqttPublisherCapacity(*slot->msg);
+  return true;
+}
+
+bool telemetryPayloadPublish(MqttPublisher& pub, const char* topic, uint8_t qos, const MqttPublishProperties* props,
+                             const TelemetrySample& sample, const char* stamp, int64_t mono_us, uint32_t now_ms) {
+  MqttOutboundMessage* msg = mqttPublisherReserve(pub, topic, MQTT_PRIO_TELEMETRY, qos, now_ms, props);
+  if (msg == nullptr) return false;
+
+  SlotWriter slot = {&pub, msg};
+  JsonWriter w;
+  jsonWriterInit(w, (char*)mqttPublisherPayload(pub, *msg), mqttPublisherCapacity(*msg), growIntoJumbo, &slot);
+  size_t offset = 0;
+  writeTelemetry(w, sample, stamp, offset);
+  if (!jsonWriterOk(w)) {
+    mqttPublisherAbort(pub, *msg);
+    return false;
+  }
+
+  MqttSampleStamp sampleStamp = {mono_us, (uint16_t)offset};
+  return mqttPublisherCommit(pub, *msg, w.length, &sampleStamp);
+}
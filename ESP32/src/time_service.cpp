@@ -0,0 +1,52 @@
+#include "time_service.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void timeServiceInit(TimeService& ts) {
+  memset(&ts, 0, sizeof(ts));
+}
+
+void timeServiceSync(TimeService& ts, int64_t mono_us, int64_t wall_us) {
+  int64_t offset = wall_us - mono_us;
+  ts.last_step_us = ts.synced ? offset - ts.offset_us : 0;
+  ts.offset_us = offset;
+  ts.last_sync_mono_us = mono_us;
+  ts.synced = true;
+  ts.syncs++;
+}
+
+bool timeServiceToWall(const TimeService& ts, int64_t mono_us, int64_t& wall_us) {
+  if (!ts.synced) return false;
+  wall_us = mono_us + ts.offset_us;
+  return true;
+}
+
+bool timeServiceToMono(const TimeService& ts, int64_t wall_us, int64_t& mono_us) {
+  if (!ts.synced) return false;
+  mono_us = wall_us - ts.offset_us;
+  return true;
+}
+
+bool timeServiceNextBoundary(const TimeService& ts, int64_t mono_us, uint32_t period_ms,
+                             int64_t& boundary_mono_us, int64_t& boundary_wall_ms) {
+  int64_t wall_us = 0;
+  if (period_ms == 0 || !timeServiceToWall(ts, mono_us, wall_us)) return false;
+
+  boundary_wall_ms = (wall_us / 1000 / period_ms + 1) * period_ms;
+  boundary_mono_us = boundary_wall_ms * 1000 - ts.offset_us;
+  return true;
+}
+
+bool timeServiceFormatStamp(const TimeService& ts, int64_t mono_us, char* out) {
+  char text[TIME_STAMP_WIDTH + 8];
+  int64_t wall_us = 0;
+  bool known = timeServiceToWall(ts, mono_us, wall_us) && wall_us > 0;
+  if (known) {
+    snprintf(text, sizeof(text), "%-*lld", TIME_STAMP_WIDTH, (long long)(wall_us / 1000));
+  } else {
+    snprintf(text, sizeof(text), "%-*s", TIME_STAMP_WIDTH, "null");
+  }
+  memcpy(out, text, TIME_STAMP_WIDTH);
+  return known;
+}
@@ -0,0 +1,149 @@
+#include "trace_recorder.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+struct TraceEvent {
+  uint32_t ts_us;
+  const char* name;
+  int32_t arg;
+  uint8_t type;
+  uint8_t task;
+};
+
+struct TraceSlot {
+  std::atomic<uint32_t> seq;  // Índice + 1 una vez escrito (0 = escribiéndose o nunca usado)
+  TraceEvent event;
+};
+
+static TraceSlot slots[TRACE_RING_EVENTS];
+static std::atomic<uint32_t> head(0);
+static std::atomic<bool> enabled(false);
+static TraceClockFn clockFn = nullptr;
+static TraceTaskFn taskFn = nullptr;
+
+static std::atomic<uintptr_t> taskKeys[TRACE_MAX_TASKS];
+static char taskNames[TRACE_MAX_TASKS][TRACE_TASK_NAME_MAX];
+
+static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS debe ser potencia de 2");
+#if defined(__XTENSA__)
+static_assert(sizeof(TraceSlot) == 20, "Actualizar el tamaño del lugar en trace_recorder.h");
+#endif
+
+void traceInit(TraceClockFn clock, TraceTaskFn task) {
+  clockFn = clock;
+  taskFn = task;
+  enabled.store(clock != nullptr && task != nullptr, std::memory_order_release);
+}
+
+void traceSetEnabled(bool on) {
+  enabled.store(on && clockFn != nullptr, std::memory_order_release);
+}
+
+bool traceEnabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+uint32_t traceNow() {
+  return clockFn != nullptr ? clockFn() : 0;
+}
+
+// Índice de la tarea actual; la tabla se completa sin bloqueos (TRACE_MAX_TASKS = no entró)
+static uint8_t currentTask() {
+  const char* name = nullptr;
+  uintptr_t key = taskFn(&name);
+  for (uint8_t i = 0; i < TRACE_MAX_TASKS; i++) {
+    uintptr_t current = taskKeys[i].load(std::memory_order_acquire);
+    if (current == key) return i;
+    if (current == 0) {
+      uintptr_t expected = 0;
+      if (taskKeys[i].compare_exchange_strong(expected, key, std::memory_order_acq_rel)) {
+        strncpy(taskNames[i], name != nullptr ? name : "?", TRACE_TASK_NAME_MAX - 1);
+        return i;
+      }
+      if (expected == key) return i; // Otra llamada de la misma tarea (desde una interrupción) ganó
+    }
+  }
+  return TRACE_MAX_TASKS;
+}
+
+static void record(TraceType type, const char* name, uint32_t ts_us, int32_t arg) {
+  if (!enabled.load(std::memory_order_relaxed)) return;
+  uint32_t index = head.fetch_add(1, std::memory_order_relaxed);
+  TraceSlot& slot = slots[index & (TRACE_RING_EVENTS - 1)];
+  slot.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event.ts_us = ts_us;
+  slot.event.name = name;
+  slot.event.arg = arg;
+  slot.event.type = type;
+  slot.event.task = currentTask();
+  slot.seq.store(index + 1, std::memory_order_release);
+}
+
+void traceBegin(const char* name, int32_t arg) {
+  record(TRACE_BEGIN, name, traceNow(), arg);
+}
+
+void traceEnd(const char* name, int32_t arg) {
+  record(TRACE_END, name, traceNow(), arg);
+}
+
+void traceInstant(const char* name, int32_t arg) {
+  record(TRACE_INSTANT, name, traceNow(), arg);
+}
+
+void traceComplete(const char* name, uint32_t start_us, uint32_t duration_us) {
+  record(TRACE_COMPLETE, name, start_us, (int32_t)duration_us);
+}
+
+enum TracePhase : uint8_t { PHASE_HEADER = 0, PHASE_TASKS, PHASE_EVENTS, PHASE_END, PHASE_DONE };
+
+void traceCursorInit(TraceCursor& cursor) {
+  memset(&cursor, 0, sizeof(cursor));
+  cursor.was_enabled = enabled.exchange(false, std::memory_order_acq_rel);
+  cursor.end = head.load(std::memory_order_acquire);
+  cursor.next = cursor.end > TRACE_RING_EVENTS ? cursor.end - TRACE_RING_EVENTS : 0;
+}
+
+bool traceNextLine(TraceCursor& cursor, char* line, size_t size) {
+  switch (cursor.phase) {
+    case PHASE_HEADER:
+      snprintf(line, size, "R %lu %lu", (unsigned long)(cursor.end - cursor.next), (unsigned long)cursor.next);
+      cursor.phase = PHASE_TASKS;
+      return true;
+
+    case PHASE_TASKS:
+      while (cursor.task < TRACE_MAX_TASKS && taskKeys[cursor.task].load(std::memory_order_acquire) != 0) {
+        uint8_t task = cursor.task++;
+        snprintf(line, size, "T %u %s", (unsigned)task, taskNames[task]);
+        return true;
+      }
+      cursor.phase = PHASE_EVENTS;
+      // fallthrough
+    case PHASE_EVENTS:
+      while (cursor.next != cursor.end) {
+        uint32_t index = cursor.next++;
+        const TraceSlot& slot = slots[index & (TRACE_RING_EVENTS - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != index + 1) continue; // A medio escribir
+        TraceEvent event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire); // La copia no puede pasar a después de releer seq
+        if (slot.seq.load(std::memory_order_relaxed) != index + 1 || event.name == nullptr) continue;
+        snprintf(line, size, "%c %lu %u %s %ld", (char)event.type, (unsigned long)event.ts_us, (unsigned)event.task,
+                 event.name, (long)event.arg);
+        return true;
+      }
+      cursor.phase = PHASE_END;
+      // fallthrough
+    case PHASE_END:
+      snprintf(line, size, "Z");
+      cursor.phase = PHASE_DONE;
+      return true;
+
+    default:
+      if (cursor.was_enabled) traceSetEnabled(true);
+      cursor.was_enabled = false;
+      return false;
+  }
+}
@@ -0,0 +1,65 @@
+#include "wifi_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <esp_attr.h>
+
+#include "nvs_store.h"
+
+#define WIFI_CACHE_MAGIC 0x57464301u // "WFC" + versión 1
+
+// Sin inicializar a propósito: conserva su contenido entre reinicios que no cortan la energía
+RTC_NOINIT_ATTR static WifiCache rtcCache;
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+  }
+  return ~crc;
+}
+
+static uint32_t cacheCrc(const WifiCache& cache) {
+  return crc32((const uint8_t*)&cache, offsetof(WifiCache, crc));
+}
+
+static bool cacheValid(const WifiCache& cache, uint32_t ssid_hash) {
+  return cache.magic == WIFI_CACHE_MAGIC && cache.ssid_hash == ssid_hash &&
+         cache.channel >= 1 && cache.channel <= 14 && cache.crc == cacheCrc(cache);
+}
+
+bool wifiCacheLoad(WifiCache& cache, const char* ssid, bool& from_rtc) {
+  uint32_t ssidHash = crc32((const uint8_t*)ssid, strlen(ssid));
+
+  if (cacheValid(rtcCache, ssidHash)) {
+    cache = rtcCache;
+    from_rtc = true;
+    return true;
+  }
+
+  from_rtc = false;
+  if (nvsLoadWifiCache(&cache, sizeof(cache)) && cacheValid(cache, ssidHash)) {
+    rtcCache = cache;
+    return true;
+  }
+  return false;
+}
+
+void wifiCacheSave(WifiCache& cache, const char* ssid) {
+  cache.magic = WIFI_CACHE_MAGIC;
+  cache.ssid_hash = crc32((const uint8_t*)ssid, strlen(ssid));
+  cache.reserved = 0;
+  cache.crc = cacheCrc(cache);
+  rtcCache = cache;
+
+  // Solo se escribe la flash si cambió algo (lo normal es reconectar al mismo AP con la misma IP)
+  WifiCache stored;
+  if (nvsLoadWifiCache(&stored, sizeof(stored)) && memcmp(&stored, &cache, sizeof(cache)) == 0) return;
+  nvsSaveWifiCache(&cache, sizeof(cache));
+}
+
+void wifiCacheClear() {
+  memset(&rtcCache, 0, sizeof(rtcCache));
+  nvsClearWifiCache();
+}
@@ -0,0 +1,57 @@
+// -------------------------------------------------------------------------
+// MICROBENCHMARKS DE LOS NÚCLEOS DEL FIRMWARE (HOST, GOOGLE BENCHMARK)
+// -------------------------------------------------------------------------
+// Registra cada núcleo de bench_kernels.h como un benchmark. Sin opciones
+// de salida deja además los resultados en JSON (bench-host.json) con la
+// revisión en el contexto, para comparar contra otra revisión con
+// compare.py de Google Benchmark:
+//
+//   pio run -e bench_host -t exec
+//   compare.py benchmarks antes.json bench-host.json
+//
+// Acepta las opciones de Google Benchmark (--benchmark_filter=command,
+// --benchmark_repetitions=5, --benchmark_out=ARCHIVO...). Necesita la
+// biblioteca instalada (apt install libbenchmark-dev, brew install
+// google-benchmark). Los ns del host sirven para ver regresiones; la
+// relación con el ESP32 la da tools/bench_target.cpp.
+
+#include <string.h>
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "bench_kernels.h"
+
+#define BENCH_HOST_OUT "bench-host.json"
+
+static void runKernel(benchmark::State& state, const BenchKernel* kernel) {
+  if (kernel->setup != nullptr) kernel->setup();
+  uint32_t i = 0;
+  for (auto _ : state) kernel->run(i++);
+  state.SetItemsProcessed(state.iterations());
+}
+
+int main(int argc, char** argv) {
+  std::vector<char*> args(argv, argv + argc);
+  bool hasOut = false;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--benchmark_out=", strlen("--benchmark_out=")) == 0) hasOut = true;
+  }
+  static char outArg[] = "--benchmark_out=" BENCH_HOST_OUT;
+  static char formatArg[] = "--benchmark_out_format=json";
+  if (!hasOut) {
+    args.push_back(outArg);
+    args.push_back(formatArg);
+  }
+  int count = (int)args.size();
+
+  for (size_t k = 0; k < BENCH_KERNEL_COUNT; k++) {
+    benchmark::RegisterBenchmark(BENCH_KERNELS[k].name, runKernel, &BENCH_KERNELS[k]);
+  }
+  benchmark::AddCustomContext("revision", BENCH_REVISION);
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 2;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include "bench_kernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "control_command.h"
+#include "device_identity.h"
+#include "dsp.h"
+#include "level_estimator.h"
+#include "level_trend.h"
+#include "mqtt_publisher.h"
+#include "publish_profiles.h"
+#include "tank_geometry.h"
+#include "telemetry_payload.h"
+#include "time_service.h"
+
+#include "test_fixtures.h"
+
+#define BENCH_RMS_SAMPLES 320       // Los de un bloque de corriente en read_or_mock_sensors()
+#define BENCH_TREND_INTERVAL_MS 5000 // Una muestra de nivel por telemetría
+
+volatile uint32_t benchSink = 0;
+
+static FixtureTransport transport; // El despacho libera los lugares QoS0
+static MqttPublisher publisher;
+static DeviceIdentity identity;
+
+static void setupCommon() {
+  deviceIdentitySet(identity, "caracas", "ctl-bench");
+  fixtureTimeInit();
+  mqttPublisherInit(publisher, &transport, fixtureRestamp);
+}
+
+// --- Serialización de la telemetría ---
+
+static void runTelemetryWrite(uint32_t i) {
+  static char out[TELEMETRY_JSON_MAX];
+  char stamp[TIME_STAMP_WIDTH];
+  timeServiceFormatStamp(fixtureTime, (int64_t)i * 1000, stamp);
+  TelemetrySample sample = fixtureSample(i, 1 + (int)(i & 1));
+  benchSink += (uint32_t)telemetryPayloadWrite(sample, stamp, out, sizeof(out));
+}
+
+// Lo que hace publishTelemetry() por bomba: escribir en el lugar de la cola y despacharlo
+static void runTelemetryPublish(uint32_t i) {
+  char stamp[TIME_STAMP_WIDTH];
+  int64_t mono = (int64_t)i * 1000;
+  timeServiceFormatStamp(fixtureTime, mono, stamp);
+  TelemetrySample sample = fixtureSample(i, 1 + (int)(i & 1));
+  MqttPublishProperties props = {&TELEMETRY_PROFILE, nullptr, 0};
+  telemetryPayloadPublish(publisher, "caracas/ctl-bench/pumps/1/telemetry", 0, &props, sample, stamp, mono, i);
+  mqttPublisherService(publisher, i);
+}
+
+// --- Comandos entrantes ---
+
+static const char* const COMMANDS[] = {
+  "{\"command\":\"START\",\"source\":\"dashboard\",\"user\":\"operador-turno-noche\"}",
+  "{\"command\":\"STOP\"}",
+  "{\"command\":\"PURGE\"}",
+  "{\"command\":",
+};
+#define COMMAND_COUNT (sizeof(COMMANDS) / sizeof(COMMANDS[0]))
+static size_t commandLengths[COMMAND_COUNT];
+static char commandTopics[2][MQTT_TOPIC_MAX];
+static bool pumpOn[3];
+
+static void setupCommands() {
+  setupCommon();
+  for (size_t k = 0; k < COMMAND_COUNT; k++) commandLengths[k] = strlen(COMMANDS[k]);
+  devicePumpTopic(identity, 1, "control", commandTopics[0], sizeof(commandTopics[0]));
+  devicePumpTopic(identity, 2, "control", commandTopics[1], sizeof(commandTopics[1]));
+}
+
+static void runCommandParse(uint32_t i) {
+  ControlAction action = CONTROL_STOP;
+  size_t k = i % COMMAND_COUNT;
+  const char* rejected = controlCommandParse((const uint8_t*)COMMANDS[k], commandLengths[k], action);
+  benchSink += rejected == nullptr ? (uint32_t)action : 7;
+}
+
+// applyPumpCommand() de main.cpp sin relés: solo anota el estado
+static const char* applyPump(int pumpId, ControlAction action) {
+  if (pumpId < 1 || pumpId > 2) return "UNKNOWN_PUMP";
+  pumpOn[pumpId] = action == CONTROL_START;
+  return "APPLIED";
+}
+
+// Lo de applyControlCommand(): el mismo controlCommandHandle() (tópico -> bomba, payload -> acción, acción aplicada)
+static void runCommandDispatch(uint32_t i) {
+  int pumpId = 0;
+  size_t k = i % COMMAND_COUNT;
+  const char* result = controlCommandHandle(identity, commandTopics[i & 1], (const uint8_t*)COMMANDS[k],
+                                            commandLengths[k], applyPump, pumpId);
+  benchSink += (uint32_t)result[0] + (pumpId != CONTROL_PUMP_NONE && pumpOn[pumpId]);
+}
+
+// --- Tópicos ---
+
+static void runTopicFormat(uint32_t i) {
+  char topic[MQTT_TOPIC_MAX];
+  benchSink += (uint32_t)devicePumpTopic(identity, 1 + (int)(i & 1), "telemetry", topic, sizeof(topic));
+}
+
+static void runTopicParse(uint32_t i) {
+  int pumpId = 0;
+  benchSink += deviceParsePumpTopic(identity, commandTopics[i & 1], "control", pumpId) ? (uint32_t)pumpId : 0;
+}
+
+// --- Señal y filtros ---
+
+static uint16_t rmsSamples[BENCH_RMS_SAMPLES];
+
+static void setupRms() {
+  // Senoidal de 60 Hz muestreada a ~5 kHz sobre el offset del divisor, como la del CT
+  for (int n = 0; n < BENCH_RMS_SAMPLES; n++) {
+    rmsSamples[n] = (uint16_t)(2048.0 + 900.0 * sin(2.0 * M_PI * 60.0 * n / 5000.0));
+  }
+}
+
+static void runAcRms(uint32_t i) {
+  rmsSamples[i % BENCH_RMS_SAMPLES] ^= 1; // Que la entrada cambie entre vueltas
+  float rms = dspAcRms(rmsSamples, BENCH_RMS_SAMPLES, 25.0f / 4095.0f);
+  benchSink += (uint32_t)(rms * 1000.0f);
+}
+
+static constexpr TankVolumeTable TANK_TABLE = tankMakeRectangular(250.0, 200.0, 200.0);
+static LevelEstimator estimator;
+
+static void setupEstimator() {
+  LevelEstimatorConfig cfg = {160.0f, 40.0f, 3.0f, 1.0f, 2.0f}; // Los de main.cpp
+  levelEstimatorInit(estimator, &TANK_TABLE, cfg);
+}
+
+// Una vuelta del filtro de nivel: predicción con el caudal neto y corrección con el ultrasonido
+static void runLevelEstimator(uint32_t i) {
+  levelEstimatorPredict(estimator, 12.0f - (float)(i % 25), i * 500);
+  levelEstimatorUpdateUltrasonic(estimator, 120.0f + (float)(i % 9) * 0.5f);
+  benchSink += (uint32_t)(levelEstimatorPercent(estimator) * 100.0f);
+}
+
+static LevelTrend levelTrend;
+
+static void setupTrend() {
+  levelTrendInit(levelTrend);
+}
+
+static void runLevelTrend(uint32_t i) {
+  levelTrendAdd(levelTrend, 7000.0f - (float)(i % 1000) * 2.5f, i * BENCH_TREND_INTERVAL_MS);
+  LevelTrendEstimate estimate;
+  if (levelTrendEstimate(levelTrend, 10000.0f, estimate)) benchSink += (uint32_t)(estimate.slope_lpm * -100.0f);
+}
+
+const BenchKernel BENCH_KERNELS[] = {
+  {"telemetry_write", setupCommon, runTelemetryWrite},
+  {"telemetry_publish", setupCommon, runTelemetryPublish},
+  {"command_parse", setupCommands, runCommandParse},
+  {"command_dispatch", setupCommands, runCommandDispatch},
+  {"topic_format", setupCommon, runTopicFormat},
+  {"topic_parse", setupCommands, runTopicParse},
+  {"dsp_ac_rms_320", setupRms, runAcRms},
+  {"level_estimator", setupEstimator, runLevelEstimator},
+  {"level_trend", setupTrend, runLevelTrend},
+};
+const size_t BENCH_KERNEL_COUNT = sizeof(BENCH_KERNELS) / sizeof(BENCH_KERNELS[0]);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -------------------------------------------------------------------------
+// NÚCLEOS DEL FIRMWARE PARA MICROBENCHMARKS
+// -------------------------------------------------------------------------
+// Una sola lista de núcleos, medida por dos arneses: Google Benchmark en el
+// host (tools/bench_host.cpp) y el contador de ciclos del ESP32
+// (tools/bench_target.cpp). Cada núcleo es el código real del firmware
+// (los módulos puros de src/) con entradas fijas que varían con la vuelta
+// para que el compilador no pliegue nada.
+//
+// Los resultados llevan el nombre del núcleo y la revisión (BENCH_REVISION,
+// el commit al compilar) para compararlos entre versiones.
+
+#ifndef BENCH_REVISION
+  #define BENCH_REVISION "desconocida"
+#endif
+
+struct BenchKernel {
+  const char* name;
+  void (*setup)();          // Fuera de la medición (puede ser nullptr)
+  void (*run)(uint32_t i);  // Una operación
+};
+
+extern const BenchKernel BENCH_KERNELS[];
+extern const size_t BENCH_KERNEL_COUNT;
+
+// Los núcleos dejan aquí sus resultados para que no se eliminen
+extern volatile uint32_t benchSink;
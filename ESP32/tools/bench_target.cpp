@@ -0,0 +1,60 @@
+// -------------------------------------------------------------------------
+// MICROBENCHMARKS DE LOS NÚCLEOS DEL FIRMWARE (ESP32, CONTADOR DE CICLOS)
+// -------------------------------------------------------------------------
+// Firmware aparte (no el del controlador): mide cada núcleo de
+// bench_kernels.h con el contador de ciclos del CPU (CCOUNT) y escribe una
+// línea JSON por núcleo en el puerto serie, con el prefijo "BENCH " para
+// separarla del resto:
+//
+//   pio run -e bench_esp32 -t upload
+//   pio device monitor -e bench_esp32 | grep --line-buffered '^BENCH ' | cut -c7- > bench-esp32.jsonl
+//
+// Sin Wi-Fi ni otras tareas de la aplicación; igual pueden caer
+// interrupciones del sistema dentro de una tanda, por eso se informa el
+// mínimo por operación (el más representativo del código) junto con la
+// mediana de las tandas. Al terminar vuelve a empezar cada BENCH_PAUSE_MS.
+
+#include <Arduino.h>
+
+#include <algorithm>
+
+#include "bench_kernels.h"
+
+#define BENCH_WARMUP_OPS 50
+#define BENCH_BATCH_OPS 200   // Operaciones por tanda (el contador de 32 bits da la vuelta en ~17 s)
+#define BENCH_BATCHES 15
+#define BENCH_PAUSE_MS 10000
+
+static void benchKernel(const BenchKernel& kernel) {
+  if (kernel.setup != nullptr) kernel.setup();
+  uint32_t i = 0;
+  for (int n = 0; n < BENCH_WARMUP_OPS; n++) kernel.run(i++);
+
+  uint32_t cycles[BENCH_BATCHES];
+  for (int b = 0; b < BENCH_BATCHES; b++) {
+    uint32_t start = ESP.getCycleCount();
+    for (int n = 0; n < BENCH_BATCH_OPS; n++) kernel.run(i++);
+    cycles[b] = ESP.getCycleCount() - start;
+  }
+  std::sort(cycles, cycles + BENCH_BATCHES);
+
+  uint32_t mhz = ESP.getCpuFreqMHz();
+  float minCycles = (float)cycles[0] / BENCH_BATCH_OPS;
+  float medianCycles = (float)cycles[BENCH_BATCHES / 2] / BENCH_BATCH_OPS;
+  Serial.printf("BENCH {\"revision\":\"%s\",\"kernel\":\"%s\",\"ops\":%u,\"cycles_min\":%.1f,"
+                "\"cycles_median\":%.1f,\"ns_min\":%.1f,\"cpu_mhz\":%u}\n",
+                BENCH_REVISION, kernel.name, (unsigned)(BENCH_BATCH_OPS * BENCH_BATCHES), minCycles,
+                medianCycles, minCycles * 1000.0f / (float)mhz, (unsigned)mhz);
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+}
+
+void loop() {
+  Serial.printf("⏱️ Microbenchmarks (%u núcleos, revisión %s)\n", (unsigned)BENCH_KERNEL_COUNT, BENCH_REVISION);
+  for (size_t k = 0; k < BENCH_KERNEL_COUNT; k++) benchKernel(BENCH_KERNELS[k]);
+  Serial.printf("BENCH_END %u\n", (unsigned)benchSink);
+  delay(BENCH_PAUSE_MS);
+}
@@ -0,0 +1,245 @@
+// -------------------------------------------------------------------------
+// MEDICIÓN DE CONMUTACIÓN ENTRE BROKERS (HOST)
+// -------------------------------------------------------------------------
+// Cliente MQTT 3.1.1 mínimo (CONNECT / PINGREQ) sobre sockets POSIX que usa
+// la misma lógica que el firmware: BrokerList para elegir y conmutar, y
+// Backoff con los valores de MQTT_BACKOFF de main.cpp. Mide el tiempo desde
+// que se pierde el broker activo hasta el CONNACK del siguiente.
+//
+//   mosquitto -p 1883 &  mosquitto -p 1884 &
+//   g++ -std=gnu++17 -O2 -Iinclude tools/failover_bench.cpp src/broker_list.cpp src/backoff.cpp -o failover_bench
+//   ./failover_bench --brokers 127.0.0.1:1883,127.0.0.1:1884 --failovers 3
+//
+// Luego detener y volver a levantar los mosquitto alternadamente.
+//
+// Los tiempos anotados al incorporar la conmutación (0,26 a 1,0 s, acotados
+// por el jitter base de 1 s) NO se midieron contra Mosquitto: se tomaron con
+// dos brokers mínimos de reemplazo en loopback que solo responden CONNECT y
+// PINGREQ. Falta repetir la medición con dos instancias reales de Mosquitto.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "backoff.h"
+#include "broker_list.h"
+
+static const BackoffConfig BENCH_BACKOFF = {1000, 30000, BACKOFF_JITTER_FULL}; // MQTT_BACKOFF de main.cpp
+#define BENCH_PROBE_TIMEOUT_MS 1000  // BROKER_PROBE_TIMEOUT_MS del firmware
+#define BENCH_CONNACK_TIMEOUT_MS 2000
+
+static uint32_t nowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// Conexión TCP con timeout. Devuelve el descriptor o -1.
+static int tcpConnect(const BrokerEndpoint& ep, int timeout_ms) {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", (unsigned)ep.port);
+  struct addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* addr = nullptr;
+  if (getaddrinfo(ep.host, port, &hints, &addr) != 0) return -1;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  int rc = connect(fd, addr->ai_addr, addr->ai_addrlen);
+  freeaddrinfo(addr);
+
+  if (rc != 0 && errno == EINPROGRESS) {
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (poll(&pfd, 1, timeout_ms) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+      rc = 0;
+    }
+  }
+  if (rc != 0) {
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, 0);
+  return fd;
+}
+
+// Mismo criterio que broker_probe.cpp: tiempo de conexión TCP
+static void probeAll(BrokerList& list) {
+  for (int i = 0; i < list.count; i++) {
+    uint32_t start = nowMs();
+    int fd = tcpConnect(list.endpoints[i], BENCH_PROBE_TIMEOUT_MS);
+    brokerListSetRtt(list, i, fd >= 0 ? (int32_t)(nowMs() - start) : -1);
+    if (fd >= 0) close(fd);
+  }
+}
+
+static bool readExact(int fd, uint8_t* buf, size_t len, int timeout_ms) {
+  size_t got = 0;
+  while (got < len) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) != 1) return false;
+    ssize_t n = recv(fd, buf + got, len - got, 0);
+    if (n <= 0) return false;
+    got += (size_t)n;
+  }
+  return true;
+}
+
+// CONNECT (sesión limpia) y espera del CONNACK
+static bool mqttConnect(int fd, const char* client_id, uint16_t keepalive_s) {
+  uint8_t packet[128];
+  size_t idLen = strlen(client_id);
+  size_t remaining = 10 + 2 + idLen;
+  size_t n = 0;
+  packet[n++] = 0x10;
+  packet[n++] = (uint8_t)remaining;
+  const uint8_t header[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02};
+  memcpy(packet + n, header, sizeof(header));
+  n += sizeof(header);
+  packet[n++] = (uint8_t)(keepalive_s >> 8);
+  packet[n++] = (uint8_t)(keepalive_s & 0xFF);
+  packet[n++] = (uint8_t)(idLen >> 8);
+  packet[n++] = (uint8_t)(idLen & 0xFF);
+  memcpy(packet + n, client_id, idLen);
+  n += idLen;
+  if (send(fd, packet, n, MSG_NOSIGNAL) != (ssize_t)n) return false;
+
+  uint8_t connack[4];
+  return readExact(fd, connack, sizeof(connack), BENCH_CONNACK_TIMEOUT_MS) && connack[0] == 0x20 && connack[3] == 0;
+}
+
+// Igual que onMqttDisconnected() + maintainMqtt() del firmware: se cuenta el fallo, se sondea
+// y, si corresponde, se conmuta con un jitter corto para el primer intento
+static void onDisconnected(BrokerList& list, Backoff& backoff) {
+  brokerListReportFailure(list);
+  probeAll(list);
+  backoffFailure(backoff, nowMs());
+  if (!brokerListShouldFailover(list)) return;
+
+  int previous = list.active;
+  brokerListSelect(list);
+  if (list.active == previous) return;
+  printf("  conmutando a %s:%u (%d ms)\n", list.endpoints[list.active].host,
+         (unsigned)list.endpoints[list.active].port, (int)list.endpoints[list.active].rtt_ms);
+  backoffSuccess(backoff);
+  backoffFailure(backoff, nowMs());
+}
+
+int main(int argc, char** argv) {
+  const char* brokersText = "127.0.0.1:1883,127.0.0.1:1884";
+  int failoversWanted = 3;
+  uint16_t keepalive = 2;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--brokers") == 0 && i + 1 < argc) {
+      brokersText = argv[++i];
+    } else if (strcmp(argv[i], "--failovers") == 0 && i + 1 < argc) {
+      failoversWanted = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--keepalive") == 0 && i + 1 < argc) {
+      keepalive = (uint16_t)atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "uso: %s [--brokers h:p,h:p] [--failovers N] [--keepalive s]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  BrokerList list;
+  if (!brokerListParse(list, brokersText, 1883) || keepalive == 0) {
+    fprintf(stderr, "lista de brokers o keepalive inválidos\n");
+    return 1;
+  }
+
+  Backoff backoff;
+  backoffInit(backoff, BENCH_BACKOFF, (uint32_t)getpid() ^ nowMs());
+
+  probeAll(list);
+  brokerListSelect(list);
+
+  int fd = -1;
+  int failovers = 0;
+  int lostFrom = -1;
+  uint32_t lostAt = 0;
+  uint32_t lastPing = 0;
+  uint32_t pingSentAt = 0;
+  uint32_t worstMs = 0;
+  uint64_t totalMs = 0;
+
+  while (failovers < failoversWanted) {
+    uint32_t now = nowMs();
+
+    if (fd < 0) {
+      if (!backoffReady(backoff, now)) {
+        usleep(10000);
+        continue;
+      }
+
+      const BrokerEndpoint& ep = list.endpoints[list.active];
+      fd = tcpConnect(ep, BENCH_PROBE_TIMEOUT_MS);
+      if (fd >= 0 && mqttConnect(fd, "failover_bench", keepalive)) {
+        backoffSuccess(backoff);
+        brokerListReportConnected(list);
+        lastPing = nowMs();
+        pingSentAt = 0;
+        printf("conectado a %s:%u\n", ep.host, (unsigned)ep.port);
+
+        if (lostFrom >= 0) {
+          uint32_t elapsed = nowMs() - lostAt;
+          printf("  recuperado en %u ms (%s)\n", elapsed, list.active != lostFrom ? "otro broker" : "mismo broker");
+          if (elapsed > worstMs) worstMs = elapsed;
+          totalMs += elapsed;
+          failovers++;
+          lostFrom = -1;
+        }
+        continue;
+      }
+      if (fd >= 0) close(fd);
+      fd = -1;
+      onDisconnected(list, backoff);
+      continue;
+    }
+
+    // Conectado: keepalive con PINGREQ; se detecta la caída por cierre del socket o falta de PINGRESP
+    bool lost = false;
+    if (pingSentAt == 0 && now - lastPing >= keepalive * 500u) {
+      const uint8_t pingreq[] = {0xC0, 0x00};
+      lost = send(fd, pingreq, sizeof(pingreq), MSG_NOSIGNAL) != (ssize_t)sizeof(pingreq);
+      pingSentAt = now;
+    }
+    if (pingSentAt != 0 && now - pingSentAt > keepalive * 1000u) lost = true;
+
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (!lost && poll(&pfd, 1, 10) == 1) {
+      uint8_t buf[64];
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+        lost = true;
+      } else if (buf[0] == 0xD0) {
+        pingSentAt = 0;
+        lastPing = nowMs();
+      }
+    }
+
+    if (lost) {
+      close(fd);
+      fd = -1;
+      lostFrom = list.active;
+      lostAt = nowMs();
+      printf("perdido %s:%u\n", list.endpoints[list.active].host, (unsigned)list.endpoints[list.active].port);
+      onDisconnected(list, backoff);
+    }
+  }
+
+  printf("\n%d recuperaciones: promedio %llu ms, peor %u ms\n", failovers,
+         (unsigned long long)(totalMs / (failovers > 0 ? failovers : 1)), worstMs);
+  return 0;
+}
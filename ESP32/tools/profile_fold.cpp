@@ -0,0 +1,210 @@
+// -------------------------------------------------------------------------
+// SIMBOLIZADOR DEL PERFIL DE CPU (HOST)
+// -------------------------------------------------------------------------
+// Lee el volcado de cpu_profiler.h (captura del puerto serie o los mensajes
+// de {sitio}/{controlador}/profile; las demás líneas se ignoran), resuelve
+// cada PC contra el ELF del firmware con addr2line y escribe las pilas en
+// formato "folded" (una por línea: marco;marco;marco cantidad), la entrada
+// de flamegraph.pl, speedscope o inferno:
+//
+//   núcleo;tarea[;isr];función_externa;...;función_interna  cantidad
+//
+// Los marcos debajo de la tarea salen de las funciones expandidas en línea
+// (addr2line -i): el perfilador solo guarda el PC. Por stderr imprime el
+// resumen y las funciones con más muestras.
+//
+// Por MQTT cada mensaje empieza con "# <volcado> <trozo>": los trozos
+// repetidos (reentrega de QoS 1) se descartan y, si falta alguno o el
+// volcado no llega a la "E", se avisa que los conteos están incompletos.
+//
+//   pio run -e profile_fold
+//   mosquitto_sub -t caracas/ctl-01/profile > perfil.txt   (o la captura del monitor serie)
+//   .pio/build/profile_fold/program --elf .pio/build/esp32dev/firmware.elf perfil.txt > perfil.folded
+//   flamegraph.pl perfil.folded > perfil.svg
+//
+// Opciones: --addr2line RUTA (por defecto xtensa-esp32-elf-addr2line),
+// --no-inline (solo la función del PC), --no-core (sin el marco del núcleo).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#define FOLD_BATCH 200 // Direcciones por llamada a addr2line
+
+struct Sample {
+  unsigned core;
+  unsigned task;
+  unsigned long pc;
+  unsigned long count;
+  bool isr;
+};
+
+static std::map<std::pair<unsigned, unsigned>, std::string> taskNames;
+static std::vector<Sample> samples;
+static std::map<unsigned long, std::vector<std::string>> frames; // PC -> marcos, del externo al interno
+static std::map<unsigned, std::set<unsigned>> chunks;            // Volcado -> trozos MQTT recibidos
+static bool skipping = false;                                    // Dentro de un trozo repetido
+static unsigned long duplicates = 0;
+static bool ended = false;
+
+static void parseLine(const char* line) {
+  while (*line == ' ' || *line == '\t') line++;
+  char name[64];
+  Sample s = {};
+  unsigned isr = 0;
+  unsigned dump, chunk;
+  unsigned long rate, duration, total, lost;
+  if (sscanf(line, "# %u %u", &dump, &chunk) == 2) {
+    skipping = !chunks[dump].insert(chunk).second;
+    if (skipping) duplicates++;
+    return;
+  }
+  if (skipping) return;
+  if (line[0] == 'E' && strspn(line + 1, "\r\n") == strlen(line + 1)) {
+    ended = true;
+  } else if (sscanf(line, "P %lu %lu %lu %lu", &rate, &duration, &total, &lost) == 4) {
+    fprintf(stderr, "perfil: %lu Hz, %lu ms, %lu muestras, %lu perdidas\n", rate, duration, total, lost);
+  } else if (sscanf(line, "T %u %u %63s", &s.core, &s.task, name) == 3) {
+    taskNames[{s.core, s.task}] = name;
+  } else if (sscanf(line, "S %u %u %lx %lu %u", &s.core, &s.task, &s.pc, &s.count, &isr) == 5) {
+    s.isr = isr != 0;
+    samples.push_back(s);
+  }
+}
+
+// Resuelve un lote de direcciones: addr2line -a repite cada dirección y luego da pares función/ubicación,
+// del marco interno al externo cuando hay funciones expandidas en línea
+static bool symbolize(const std::string& tool, const std::string& elf, const std::vector<unsigned long>& pcs,
+                      size_t from, size_t to, bool inlines) {
+  std::string command = tool + " -a -f -C" + (inlines ? " -i" : "") + " -e '" + elf + "'";
+  char address[24];
+  for (size_t i = from; i < to; i++) {
+    snprintf(address, sizeof(address), " 0x%08lx", pcs[i]);
+    command += address;
+  }
+  FILE* out = popen(command.c_str(), "r");
+  if (out == nullptr) return false;
+
+  char line[1024];
+  std::vector<std::string>* current = nullptr;
+  bool expectFunction = true;
+  while (fgets(line, sizeof(line), out) != nullptr) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (strncmp(line, "0x", 2) == 0 && strchr(line, ' ') == nullptr) {
+      current = &frames[strtoul(line, nullptr, 16)];
+      current->clear();
+      expectFunction = true;
+      continue;
+    }
+    if (current == nullptr) continue;
+    if (expectFunction) {
+      // Los argumentos de plantillas y funciones no aportan al gráfico y pueden llevar ';'
+      std::string function = line;
+      size_t paren = function.find('(');
+      if (paren != std::string::npos && paren > 0) function.resize(paren);
+      std::replace(function.begin(), function.end(), ';', ',');
+      current->insert(current->begin(), function); // Interno primero en la salida: se invierte
+    }
+    expectFunction = !expectFunction;
+  }
+  return pclose(out) == 0;
+}
+
+int main(int argc, char** argv) {
+  std::string elf;
+  std::string tool = "xtensa-esp32-elf-addr2line";
+  bool inlines = true;
+  bool withCore = true;
+  const char* input = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--elf") == 0 && i + 1 < argc) elf = argv[++i];
+    else if (strcmp(argv[i], "--addr2line") == 0 && i + 1 < argc) tool = argv[++i];
+    else if (strcmp(argv[i], "--no-inline") == 0) inlines = false;
+    else if (strcmp(argv[i], "--no-core") == 0) withCore = false;
+    else if (argv[i][0] != '-') input = argv[i];
+    else {
+      fprintf(stderr, "uso: %s --elf firmware.elf [--addr2line RUTA] [--no-inline] [--no-core] [volcado]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (elf.empty()) {
+    fprintf(stderr, "falta --elf (ej. .pio/build/esp32dev/firmware.elf)\n");
+    return 2;
+  }
+
+  FILE* in = input != nullptr ? fopen(input, "r") : stdin;
+  if (in == nullptr) {
+    fprintf(stderr, "no se pudo abrir %s\n", input);
+    return 1;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), in) != nullptr) parseLine(line);
+  if (in != stdin) fclose(in);
+
+  bool complete = ended;
+  if (duplicates > 0) fprintf(stderr, "perfil: %lu trozos repetidos descartados\n", duplicates);
+  for (const auto& dump : chunks) {
+    unsigned last = *dump.second.rbegin();
+    for (unsigned chunk = 0; chunk <= last; chunk++) {
+      if (dump.second.count(chunk) != 0) continue;
+      fprintf(stderr, "perfil: falta el trozo %u del volcado %u\n", chunk, dump.first);
+      complete = false;
+    }
+  }
+  if (!ended) fprintf(stderr, "perfil: el volcado no llega a la línea E (¿se cortó la captura?)\n");
+  if (!complete) fprintf(stderr, "perfil: volcado incompleto, los conteos son parciales\n");
+  if (samples.empty()) {
+    fprintf(stderr, "el volcado no tiene muestras\n");
+    return 1;
+  }
+
+  std::vector<unsigned long> pcs;
+  for (const Sample& s : samples) pcs.push_back(s.pc);
+  std::sort(pcs.begin(), pcs.end());
+  pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+  for (size_t from = 0; from < pcs.size(); from += FOLD_BATCH) {
+    if (!symbolize(tool, elf, pcs, from, std::min(pcs.size(), from + FOLD_BATCH), inlines)) {
+      fprintf(stderr, "falló %s (¿está en el PATH? ver --addr2line)\n", tool.c_str());
+      return 1;
+    }
+  }
+
+  // Pilas plegadas y muestras propias por función
+  std::map<std::string, unsigned long> folded;
+  std::map<std::string, unsigned long> self;
+  unsigned long total = 0;
+  for (const Sample& s : samples) {
+    std::string stack;
+    if (withCore) stack = "core" + std::to_string(s.core) + ";";
+    auto task = taskNames.find({s.core, s.task});
+    stack += task != taskNames.end() ? task->second : "task" + std::to_string(s.task);
+    if (s.isr) stack += ";[isr]";
+
+    const std::vector<std::string>& stackFrames = frames[s.pc];
+    char address[16];
+    snprintf(address, sizeof(address), "0x%08lx", s.pc);
+    std::string leaf = stackFrames.empty() || stackFrames.back() == "??" ? address : stackFrames.back();
+    for (const std::string& frame : stackFrames) stack += ";" + (frame == "??" ? std::string(address) : frame);
+    if (stackFrames.empty()) stack += ";" + leaf;
+
+    folded[stack] += s.count;
+    self[leaf] += s.count;
+    total += s.count;
+  }
+  for (const auto& entry : folded) printf("%s %lu\n", entry.first.c_str(), entry.second);
+
+  std::vector<std::pair<unsigned long, std::string>> top;
+  for (const auto& entry : self) top.push_back({entry.second, entry.first});
+  std::sort(top.rbegin(), top.rend());
+  fprintf(stderr, "\n%-60s %8s %6s\n", "función", "muestras", "%");
+  for (size_t i = 0; i < top.size() && i < 20; i++) {
+    fprintf(stderr, "%-60.60s %8lu %5.1f%%\n", top[i].second.c_str(), top[i].first, 100.0 * top[i].first / total);
+  }
+  return 0;
+}
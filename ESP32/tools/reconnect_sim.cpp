@@ -0,0 +1,167 @@
+// -------------------------------------------------------------------------
+// SIMULACIÓN DE RECONEXIÓN DE UNA FLOTA DE CONTROLADORES (HOST)
+// -------------------------------------------------------------------------
+// Cientos de clientes virtuales, cada uno con el mismo Backoff que el
+// firmware, pierden el broker a la vez (reinicio del broker) y reconectan.
+// El broker acepta como máximo `capacity` conexiones por segundo; los
+// intentos por encima de eso se rechazan (sobrecarga).
+//
+// Compara la política anterior (5 s fijos), backoff exponencial sin jitter
+// y backoff exponencial con jitter completo (la del firmware), y reporta la
+// tasa pico de intentos y el tiempo de recuperación tras el reinicio.
+//
+//   pio run -e reconnect_sim -t exec
+//   g++ -std=gnu++17 -O2 -Iinclude tools/reconnect_sim.cpp src/backoff.cpp -o reconnect_sim
+//   ./reconnect_sim --clients 500 --capacity 50 --down 30 [--csv]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "backoff.h"
+
+#define SIM_STEP_MS 10
+#define SIM_BOUNCE_AT_MS 10000     // Instante en que se reinicia el broker
+#define SIM_MAX_MS (20 * 60000)    // Límite de la simulación
+
+struct SimPolicy {
+  const char* name;
+  BackoffConfig cfg;
+};
+
+// La última es MQTT_BACKOFF de main.cpp
+static const SimPolicy POLICIES[] = {
+  {"fijo_5s", {5000, 5000, BACKOFF_JITTER_NONE}},
+  {"exp_sin_jitter", {1000, 30000, BACKOFF_JITTER_NONE}},
+  {"exp_jitter_completo", {1000, 30000, BACKOFF_JITTER_FULL}},
+};
+
+struct SimClient {
+  Backoff backoff;
+  bool connected;
+};
+
+struct SimResult {
+  uint32_t attempts;          // Intentos desde el reinicio
+  uint32_t rejected;          // Intentos rechazados con el broker arriba (sobrecarga)
+  uint32_t peak_attempts_s;   // Máximo de intentos en un segundo con el broker arriba
+  int32_t recover_50_ms;      // Tiempo desde que el broker vuelve hasta el 50 % conectado (-1 = nunca)
+  int32_t recover_99_ms;
+  int32_t recover_100_ms;
+};
+
+static SimResult simulate(const SimPolicy& policy, int clients, uint32_t capacity, uint32_t down_ms, bool csv) {
+  std::vector<SimClient> fleet(clients);
+  for (int i = 0; i < clients; i++) {
+    // Semilla distinta por cliente, como esp_random() en cada equipo
+    backoffInit(fleet[i].backoff, policy.cfg, 2654435761u * (uint32_t)(i + 1));
+    fleet[i].connected = true;
+  }
+
+  SimResult result = {0, 0, 0, -1, -1, -1};
+  uint32_t up_at_ms = SIM_BOUNCE_AT_MS + down_ms;
+  uint32_t bucket_attempts = 0;
+  uint32_t bucket_accepted = 0;
+  int connected = clients;
+
+  for (uint32_t now = 0; now <= SIM_MAX_MS; now += SIM_STEP_MS) {
+    // Cubetas de un segundo para el límite del broker y las estadísticas
+    if (now % 1000 == 0 && now > 0) {
+      if (csv) printf("%s,%u,%u,%d\n", policy.name, now / 1000 - 1, bucket_attempts, connected);
+      if (now > up_at_ms && bucket_attempts > result.peak_attempts_s) result.peak_attempts_s = bucket_attempts;
+      bucket_attempts = 0;
+      bucket_accepted = 0;
+    }
+
+    if (now == SIM_BOUNCE_AT_MS) {
+      // Peor caso: todos detectan la caída en el mismo instante
+      for (SimClient& c : fleet) {
+        c.connected = false;
+        backoffFailure(c.backoff, now);
+      }
+      connected = 0;
+    }
+
+    bool broker_up = now < SIM_BOUNCE_AT_MS || now >= up_at_ms;
+    for (SimClient& c : fleet) {
+      if (c.connected || !backoffReady(c.backoff, now)) continue;
+
+      result.attempts++;
+      bucket_attempts++;
+      if (broker_up && bucket_accepted < capacity) {
+        bucket_accepted++;
+        c.connected = true;
+        backoffSuccess(c.backoff);
+        connected++;
+      } else {
+        if (broker_up) result.rejected++;
+        backoffFailure(c.backoff, now);
+      }
+    }
+
+    if (now >= up_at_ms) {
+      int32_t since_up = (int32_t)(now - up_at_ms);
+      if (result.recover_50_ms < 0 && connected * 2 >= clients) result.recover_50_ms = since_up;
+      if (result.recover_99_ms < 0 && connected * 100 >= clients * 99) result.recover_99_ms = since_up;
+      if (connected == clients) {
+        result.recover_100_ms = since_up;
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+static void printSeconds(int32_t ms) {
+  if (ms < 0) {
+    printf(" %10s", "nunca");
+  } else {
+    printf(" %9.1fs", ms / 1000.0);
+  }
+}
+
+int main(int argc, char** argv) {
+  int clients = 500;
+  uint32_t capacity = 50;   // Conexiones por segundo que acepta el broker
+  uint32_t down_ms = 30000; // Duración del reinicio del broker
+  bool csv = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+      clients = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--capacity") == 0 && i + 1 < argc) {
+      capacity = (uint32_t)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--down") == 0 && i + 1 < argc) {
+      down_ms = (uint32_t)atoi(argv[++i]) * 1000;
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "uso: %s [--clients N] [--capacity conexiones/s] [--down segundos] [--csv]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (clients <= 0 || capacity == 0) {
+    fprintf(stderr, "--clients y --capacity deben ser mayores que 0\n");
+    return 1;
+  }
+
+  if (csv) {
+    printf("politica,segundo,intentos,conectados\n");
+  } else {
+    printf("%d clientes, broker caído %u s, capacidad %u conexiones/s\n\n", clients, down_ms / 1000, capacity);
+    printf("%-20s %10s %10s %10s %11s %11s %11s\n",
+           "politica", "intentos", "rechazos", "pico/s", "50%", "99%", "100%");
+  }
+
+  for (const SimPolicy& policy : POLICIES) {
+    SimResult r = simulate(policy, clients, capacity, down_ms, csv);
+    if (csv) continue;
+    printf("%-20s %10u %10u %10u", policy.name, r.attempts, r.rejected, r.peak_attempts_s);
+    printSeconds(r.recover_50_ms);
+    printSeconds(r.recover_99_ms);
+    printSeconds(r.recover_100_ms);
+    printf("\n");
+  }
+  return 0;
+}
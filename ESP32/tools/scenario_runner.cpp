@@ -0,0 +1,337 @@
+// -------------------------------------------------------------------------
+// CORRIDA DE ESCENARIOS DE SIMULACIÓN (HOST)
+// -------------------------------------------------------------------------
+// Corre guiones de scenario.h contra la planta simulada (sim_plant.h) y el
+// mismo código del firmware, en tiempo virtual de a 1 ms (una vuelta del
+// loop): lecturas crudas -> conversiones -> controlador del tanque
+// (tank_controller.h con plant_config.h) -> flotadores, reglas de las
+// bombas, fugas y energía -> cola de salida MQTT (mqtt_publisher.h, con la
+// telemetría de telemetry_payload.h) hacia un broker de prueba.
+//
+// Lo que en el equipo solo se aproxima aquí está completo:
+//  - broker down/up: el transporte deja de estar conectado; lo encolado
+//    espera, lo que estaba en vuelo se reenvía al volver
+//  - power loss: se pierde todo lo que está en RAM (controlador, cola,
+//    relés); la energía vuelve desde lo último guardado (al apagar una
+//    bomba, cada 10 minutos o al juntar 0,05 kWh, como persistEnergyIfNeeded())
+//    y se registra BOOT. La planta y el guion siguen: son el mundo de afuera.
+//
+// Un guion con `loop` corre una sola vuelta. Sale PASS o FAIL por guion,
+// con el detalle de cada expectativa que falló.
+//
+//   pio run -e scenario_runner
+//   .pio/build/scenario_runner/program scenarios/*.scn
+//
+// Opciones: --verbose (pasos y eventos con su instante).
+// Código de salida: 0 si todo pasó, 1 si alguna expectativa falló, 2 si un guion no es válido.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mqtt_publisher.h"
+#include "plant_config.h"
+#include "publish_profiles.h"
+#include "scenario.h"
+#include "sim_plant.h"
+#include "tank_controller.h"
+#include "telemetry_payload.h"
+#include "time_service.h"
+
+#include "test_fixtures.h"
+
+#define RUNNER_TICK_MS 1
+#define RUNNER_PUBLISH_INTERVAL_MS 5000     // PUBLISH_INTERVAL de main.cpp
+#define RUNNER_PERSIST_INTERVAL_MS 600000   // ENERGY_PERSIST_INTERVAL_MS
+#define RUNNER_PERSIST_MIN_KWH 0.05         // ENERGY_PERSIST_MIN_KWH
+#define RUNNER_SCRIPT_MAX 8192
+
+static FixtureTransport transport; // El guion lo corta con `up`
+static MqttPublisher publisher;
+static TankController controller;
+static SimPlant plant;
+static Scenario scenario;
+static uint16_t adcBlock[CURRENT_RMS_SAMPLES];
+
+// Lo que sobrevive a un corte de energía (la NVS)
+static double storedKwh[TANK_PUMPS];
+static double storedM3[TANK_PUMPS];
+
+static uint32_t nowMs = 0;
+static uint32_t lastPublishMs = 0;
+static uint32_t lastPersistMs = 0;
+static bool verbose = false;
+
+static uint32_t nowUs() {
+  return (uint32_t)((uint64_t)nowMs * 1000u);
+}
+
+static void onPublished(int msgId) {
+  mqttPublisherOnPublished(publisher, msgId, nowMs);
+}
+
+static void note(const char* event) {
+  if (verbose) printf("  %10.3f s  %s\n", scenarioElapsedMs(scenario, nowMs) / 1000.0, event);
+  scenarioEvent(scenario, nowMs, event);
+}
+
+static void persistEnergy(int pump) {
+  storedKwh[pump] = controller.meters[pump].total_kwh;
+  storedM3[pump] = controller.meters[pump].total_m3;
+  energyMeterMarkPersisted(controller.meters[pump]);
+}
+
+// Alarmas y eventos: QoS1 como en el equipo, para que el broker caído se note en la cola
+static void publishEvent(const char* type, MqttPriority priority) {
+  char payload[96];
+  int n = snprintf(payload, sizeof(payload), "{\"event\":\"%s\",\"water_level_percent\":%.2f}", type,
+                   controller.level_percent);
+  MqttPublishProperties props = {&EVENT_PROFILE, nullptr, 0};
+  mqttPublisherEnqueue(publisher, "sim/ctl/events", (const uint8_t*)payload, (size_t)n, priority, 1, nowMs, &props);
+}
+
+// stopPump() de main.cpp
+static void stopPump(int pump) {
+  simPlantSetRelay(plant, pump, false);
+  tankControllerSetPump(controller, pump, false);
+  persistEnergy(pump);
+}
+
+// applyPumpAction() de main.cpp
+static const char* applyPumpAction(int pump, ControlAction action) {
+  if (action == CONTROL_STOP) {
+    stopPump(pump);
+    return "APPLIED";
+  }
+  const char* refused = tankControllerCommand(controller, pump, action);
+  if (refused != nullptr) return refused;
+  simPlantSetRelay(plant, pump, true);
+  tankControllerSetPump(controller, pump, true);
+  return "APPLIED";
+}
+
+// Arranque del equipo: lo que había en RAM se pierde
+static void boot() {
+  tankControllerInit(controller, PLANT_CONTROLLER_CONFIG, storedKwh, storedM3);
+  for (int i = 0; i < TANK_PUMPS; i++) simPlantSetRelay(plant, i, false);
+  mqttPublisherInit(publisher, &transport);
+  lastPublishMs = nowMs;
+  lastPersistMs = nowMs;
+  note("BOOT");
+}
+
+static void pollFloats() {
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) {
+    FloatSwitchId id = (FloatSwitchId)i;
+    uint32_t edgeUs;
+    bool raw = simPlantFloatRaw(plant, id, &edgeUs);
+    FloatLevelEvent event;
+    uint8_t stopMask;
+    if (!tankControllerFloat(controller, id, raw, edgeUs, nowUs(), nowMs, event, stopMask)) continue;
+    const char* name = floatLevelEventName(event);
+    note(name);
+    for (int p = 0; p < TANK_PUMPS; p++) {
+      if (stopMask & (1u << p)) {
+        stopPump(p);
+        note("PUMP_STOP");
+      }
+    }
+    bool isAlarm = event.id == FLOAT_SWITCH_LOW && !event.wet;
+    publishEvent(name, isAlarm ? MQTT_PRIO_ALARM : MQTT_PRIO_EVENT);
+  }
+}
+
+// readSensors() y publishTelemetry() de main.cpp
+static void telemetryCycle() {
+  TankReadings readings;
+  readings.line_amps = tankLineAmps(controller.cfg, simPlantLineAdc(plant, nowUs()));
+  uint32_t elapsedMs = 0;
+  uint32_t pulses = simPlantFlowPulses(plant, nowMs, &elapsedMs);
+  readings.inflow_lpm = tankInflowLpm(controller.cfg, pulses, elapsedMs);
+  readings.ultrasonic_height_cm = tankEchoHeightCm(controller.cfg, simPlantEchoUs(plant));
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    readings.pump_amps[i] = 0.0f;
+    if (controller.pump_on[i]) {
+      simPlantAdcBlock(plant, i, nowUs(), CURRENT_RMS_SAMPLE_US, adcBlock, CURRENT_RMS_SAMPLES);
+      readings.pump_amps[i] = tankPumpAmps(controller.cfg, adcBlock, CURRENT_RMS_SAMPLES);
+    }
+    readings.temperature_c[i] = simPlantTemperature(plant, i);
+  }
+  readings.now_ms = nowMs;
+
+  TankLeakEvent leak = tankControllerSample(controller, readings);
+  if (leak != LEAK_EVENT_NONE) {
+    const char* type = leak == LEAK_EVENT_RAISED ? "LEAK_SUSPECTED" : "LEAK_CLEARED";
+    note(type);
+    publishEvent(type, MQTT_PRIO_ALARM);
+  }
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    if (controller.temperature_changed & (1u << i)) note(controller.temperature_fault[i] ? "TEMP_FAULT" : "TEMP_OK");
+  }
+
+  int64_t mono = (int64_t)nowMs * 1000;
+  char stamp[TIME_STAMP_WIDTH];
+  timeServiceFormatStamp(fixtureTime, mono, stamp);
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    EnergyMeter& meter = controller.meters[i];
+    double intervalM3 = 0.0;
+    double intervalKwh = energyMeterCloseInterval(meter, &intervalM3);
+
+    TelemetrySample sample = {};
+    sample.pump_id = i + 1;
+    sample.amps = readings.pump_amps[i];
+    sample.temperature_c = controller.temperature_fault[i] ? NAN : readings.temperature_c[i];
+    sample.inflow_rate = readings.inflow_lpm;
+    sample.level_percent = controller.level_percent;
+    sample.level_sigma_percent = controller.level_sigma_percent;
+    sample.queue_depth = publisher.stats.queue_depth;
+    sample.ack_latency_ms = publisher.stats.ack_latency_avg_ms;
+    sample.power_w = meter.last_power_w;
+    sample.energy_kwh_total = meter.total_kwh;
+    sample.energy_kwh_interval = intervalKwh;
+    sample.pumped_m3_interval = intervalM3;
+    sample.energy_kwh_per_m3 = energyMeterKwhPerM3(meter);
+    sample.tank_volume_l = controller.tank_volume_l;
+    sample.inflow_total_l = controller.balance.inflow_total_l;
+    sample.leak_suspected = controller.balance.leak_active;
+    sample.leak_rate_lpm = controller.balance.leak_rate_lpm;
+
+    char topic[MQTT_TOPIC_MAX];
+    snprintf(topic, sizeof(topic), "sim/ctl/pumps/%d/telemetry", i + 1);
+    MqttPublishProperties props = {&TELEMETRY_PROFILE, nullptr, 0};
+    telemetryPayloadPublish(publisher, topic, 0, &props, sample, stamp, mono, nowMs);
+  }
+
+  // persistEnergyIfNeeded()
+  bool intervalElapsed = nowMs - lastPersistMs >= RUNNER_PERSIST_INTERVAL_MS;
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    if (intervalElapsed || controller.meters[i].unsaved_kwh >= RUNNER_PERSIST_MIN_KWH) persistEnergy(i);
+  }
+  if (intervalElapsed) lastPersistMs = nowMs;
+}
+
+static void applyStep(const ScenarioStep& step) {
+  if (verbose) printf("  %10.3f s  línea %u\n", scenarioElapsedMs(scenario, nowMs) / 1000.0, (unsigned)step.line);
+  if (scenarioApplyToPlant(step, plant, nowUs())) return;
+
+  switch (step.type) {
+    case SCENARIO_STEP_COMMAND:
+      note(applyPumpAction(step.target, step.value != 0.0f ? CONTROL_START : CONTROL_STOP));
+      break;
+    case SCENARIO_STEP_BROKER:
+      transport.up = step.value != 0.0f;
+      if (!transport.up) mqttPublisherOnDisconnected(publisher);
+      break;
+    case SCENARIO_STEP_POWER_LOSS:
+      boot();
+      break;
+    default:
+      break;
+  }
+}
+
+static void observe() {
+  ScenarioObservation obs;
+  for (int i = 0; i < TANK_PUMPS; i++) {
+    obs.pump_on[i] = controller.pump_on[i];
+    obs.pump_amps[i] = controller.last.pump_amps[i];
+    obs.energy_kwh[i] = controller.meters[i].total_kwh;
+  }
+  obs.level_percent = controller.level_percent;
+  obs.queue_depth = publisher.stats.queue_depth;
+  obs.sent = publisher.stats.sent;
+  obs.dropped = publisher.stats.dropped;
+  scenarioObserve(scenario, nowMs, obs);
+}
+
+// Un guion de principio a fin. Devuelve las expectativas que fallaron (-1 si no es válido).
+static int runScenario(const char* path) {
+  FILE* in = fopen(path, "r");
+  if (in == nullptr) {
+    fprintf(stderr, "No se pudo abrir %s\n", path);
+    return -1;
+  }
+  static char text[RUNNER_SCRIPT_MAX];
+  size_t length = fread(text, 1, sizeof(text) - 1, in);
+  fclose(in);
+  text[length] = '\0';
+
+  int errorLine = 0;
+  const char* error = scenarioParse(scenario, text, &errorLine);
+  if (error != nullptr) {
+    if (errorLine > 0) fprintf(stderr, "%s:%d: %s\n", path, errorLine, error);
+    else fprintf(stderr, "%s: %s\n", path, error);
+    return -1;
+  }
+  if (verbose) printf("%s (%s)\n", path, scenario.name);
+
+  nowMs = 0;
+  memset(storedKwh, 0, sizeof(storedKwh));
+  memset(storedM3, 0, sizeof(storedM3));
+  transport.up = true;
+  simPlantInit(plant, PLANT_CONTROLLER_CONFIG, scenario.level_percent, scenario.seed, nowMs, nowUs());
+  scenarioStart(scenario, nowMs);
+  boot();
+
+  while (scenarioElapsedMs(scenario, nowMs) < scenario.duration_ms) {
+    ScenarioStep step;
+    while (scenarioNextStep(scenario, nowMs, step)) applyStep(step);
+    simPlantAdvance(plant, nowMs, nowUs());
+
+    // Una vuelta del loop: despacho, flotadores, telemetría
+    transport.poll();
+    mqttPublisherService(publisher, nowMs);
+    pollFloats();
+    if (nowMs - lastPublishMs >= RUNNER_PUBLISH_INTERVAL_MS) {
+      lastPublishMs = nowMs;
+      telemetryCycle();
+    }
+    observe();
+    if (scenario.loop && scenarioElapsedMs(scenario, nowMs) + RUNNER_TICK_MS >= scenario.duration_ms) break;
+    nowMs += RUNNER_TICK_MS;
+  }
+  scenarioFinish(scenario, nowMs);
+
+  int failures = scenarioFailures(scenario);
+  printf("%s  %s (%s): %d/%u expectativas, nivel final %.1f %% (real %.1f %%)\n", failures == 0 ? "PASS" : "FAIL",
+         path, scenario.name, scenario.expect_count - failures, (unsigned)scenario.expect_count,
+         controller.level_percent, simPlantLevelPercent(plant));
+  for (int i = 0; i < scenario.expect_count; i++) {
+    const ScenarioExpect& expect = scenario.expects[i];
+    if (expect.state != SCENARIO_EXPECT_FAILED && !verbose) continue;
+    char line[160];
+    scenarioDescribe(expect, line, sizeof(line));
+    printf("      %s %s\n", expect.state == SCENARIO_EXPECT_FAILED ? "✗" : "✓", line);
+  }
+  return failures;
+}
+
+int main(int argc, char** argv) {
+  int paths = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+    else if (argv[i][0] != '-') paths++;
+    else paths = -1000;
+  }
+  if (paths <= 0) {
+    fprintf(stderr, "uso: %s [--verbose] GUION.scn...\n", argv[0]);
+    return 2;
+  }
+
+  fixtureTimeInit();
+  MqttTransportHandler handler = {nullptr, nullptr, onPublished, nullptr, nullptr};
+  transport.begin(MqttConnectConfig{}, handler);
+
+  int failed = 0;
+  int invalid = 0;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] == '-') continue;
+    int failures = runScenario(argv[i]);
+    if (failures < 0) invalid++;
+    else if (failures > 0) failed++;
+  }
+  printf("%d guiones: %d con fallas, %d inválidos\n", paths, failed, invalid);
+  if (invalid > 0) return 2;
+  return failed > 0 ? 1 : 0;
+}
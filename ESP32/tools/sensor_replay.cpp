@@ -0,0 +1,284 @@
+// -------------------------------------------------------------------------
+// REPRODUCCIÓN DE UNA CAPTURA DE SENSORES (HOST)
+// -------------------------------------------------------------------------
+// Lee una captura de sensor_capture.h (puerto serie con "capture start" o
+// mensajes de {sitio}/{controlador}/capture; las demás líneas se ignoran) y
+// le entrega las mismas lecturas crudas al mismo controlador del firmware
+// (tank_controller.h, con plant_config.h): nivel, balance, fugas, energía,
+// flotadores y reglas de las bombas dan lo mismo en cada corrida.
+//
+//  - las lecturas de un ciclo se juntan hasta su línea K y ahí se procesan
+//  - los flotadores se evalúan en cada línea F y, mientras haya un cambio
+//    sin confirmar, en pasos de 1 ms de tiempo virtual (como el loop)
+//  - los comandos (línea C) pasan por las mismas reglas que en el equipo
+//
+// Sale una línea JSON por ciclo y por evento, en orden y sin depender del
+// reloj del host: dos corridas se comparan con diff.
+//
+//   pio run -e sensor_replay
+//   mosquitto_sub -t caracas/ctl-01/capture > captura.txt   (o la captura del monitor serie)
+//   .pio/build/sensor_replay/program captura.txt > salida.jsonl
+//
+// Opciones: --speed N (1 = tiempo real, 10 = diez veces más rápido; por
+// defecto 0 = lo más rápido posible) y --quiet (solo eventos, sin ciclos).
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include "plant_config.h"
+#include "sensor_capture.h"
+#include "tank_controller.h"
+
+#define REPLAY_TICK_US 1000 // Paso de los flotadores entre líneas (una vuelta del loop)
+
+static TankController controller;
+static TankReadings readings;
+static uint16_t adcBlock[TANK_PUMPS][CURRENT_RMS_SAMPLES];
+
+// Flotadores tal como los vio el equipo
+static bool floatRaw[FLOAT_SWITCH_COUNT];
+static uint32_t floatEdgeUs[FLOAT_SWITCH_COUNT];
+static bool floatSeen[FLOAT_SWITCH_COUNT];
+
+// Reloj virtual: micros() desenrollado y la última referencia de millis()
+static bool haveClock = false;
+static uint32_t lastRaw = 0;
+static int64_t clockUs = 0;
+static int64_t msBaseUs = -1;
+static uint32_t msBase = 0;
+
+static double speed = 0.0;
+static bool quiet = false;
+static int64_t paceStartUs = 0;
+static std::chrono::steady_clock::time_point paceStart;
+
+static unsigned long cycles = 0;
+static unsigned long events = 0;
+static unsigned long dropped = 0;
+
+static uint32_t nowMs() {
+  if (msBaseUs < 0) return msBase;
+  return msBase + (uint32_t)((clockUs - msBaseUs) / 1000);
+}
+
+static void syncMs(uint32_t ms) {
+  msBase = ms;
+  msBaseUs = clockUs;
+}
+
+static void resetCycle() {
+  memset(&readings, 0, sizeof(readings));
+  readings.ultrasonic_height_cm = NAN;
+  for (int i = 0; i < TANK_PUMPS; i++) readings.temperature_c[i] = NAN;
+}
+
+// Con --speed, espera a que el reloj del host alcance al virtual
+static void pace() {
+  if (speed <= 0.0) return;
+  auto due = paceStart + std::chrono::microseconds((int64_t)((clockUs - paceStartUs) / speed));
+  std::this_thread::sleep_until(due);
+}
+
+static void printLevel() {
+  printf("\"level_percent\":%.2f,\"level_sigma_percent\":%.2f", controller.level_percent,
+         controller.level_sigma_percent);
+}
+
+static void pollFloats() {
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) {
+    if (!floatSeen[i]) continue;
+    FloatLevelEvent event;
+    uint8_t stopMask;
+    if (!tankControllerFloat(controller, (FloatSwitchId)i, floatRaw[i], floatEdgeUs[i], (uint32_t)clockUs, nowMs(),
+                             event, stopMask)) {
+      continue;
+    }
+    events++;
+    printf("{\"type\":\"float\",\"ms\":%lu,\"switch\":\"%s\",\"event\":\"%s\",\"detection_latency_ms\":%lu,",
+           (unsigned long)nowMs(), event.id == FLOAT_SWITCH_HIGH ? "HIGH" : "LOW", floatLevelEventName(event),
+           (unsigned long)((event.detected_us - event.edge_us) / 1000));
+    printLevel();
+    printf("}\n");
+    for (int p = 0; p < TANK_PUMPS; p++) {
+      if (stopMask & (1u << p)) printf("{\"type\":\"stop\",\"ms\":%lu,\"pump\":%d}\n", (unsigned long)nowMs(), p);
+    }
+  }
+}
+
+// Un flotador con el nivel crudo distinto del estable todavía puede confirmar un cruce
+static bool floatPending() {
+  for (int i = 0; i < FLOAT_SWITCH_COUNT; i++) {
+    const FloatDebouncer& debouncer = controller.floats[i];
+    if (floatSeen[i] && debouncer.initialized && debouncer.stable_wet != floatRaw[i]) return true;
+  }
+  return false;
+}
+
+// Lleva el reloj virtual hasta la marca de la línea; en el camino corre el loop de los flotadores
+static void advanceTo(uint32_t raw) {
+  if (!haveClock) {
+    haveClock = true;
+    lastRaw = raw;
+    clockUs = raw;
+    paceStartUs = clockUs;
+    paceStart = std::chrono::steady_clock::now();
+    if (msBaseUs < 0) msBaseUs = clockUs; // La H solo trae millis()
+    return;
+  }
+  int64_t target = clockUs + (int32_t)(raw - lastRaw);
+  lastRaw = raw;
+  while (floatPending() && clockUs + REPLAY_TICK_US < target) {
+    clockUs += REPLAY_TICK_US;
+    pollFloats();
+  }
+  if (target > clockUs) clockUs = target;
+  pace();
+}
+
+static void runCycle(uint32_t ms) {
+  readings.now_ms = ms;
+  TankLeakEvent leak = tankControllerSample(controller, readings);
+  cycles++;
+
+  if (!quiet) {
+    printf("{\"type\":\"cycle\",\"ms\":%lu,\"inflow_lpm\":%.2f,\"line_amps\":%.2f,\"ultrasonic_cm\":",
+           (unsigned long)ms, readings.inflow_lpm, readings.line_amps);
+    if (isnan(readings.ultrasonic_height_cm)) printf("null,");
+    else printf("%.1f,", readings.ultrasonic_height_cm);
+    printLevel();
+    printf(",\"tank_volume_l\":%.1f,\"inflow_total_l\":%.1f,\"leak_active\":%s,\"pumps\":[", controller.tank_volume_l,
+           controller.balance.inflow_total_l, controller.balance.leak_active ? "true" : "false");
+    for (int i = 0; i < TANK_PUMPS; i++) {
+      const EnergyMeter& meter = controller.meters[i];
+      printf("%s{\"on\":%s,\"amps\":%.2f,\"power_w\":%.1f,\"energy_kwh\":%.5f}", i > 0 ? "," : "",
+             controller.pump_on[i] ? "true" : "false", readings.pump_amps[i], meter.last_power_w, meter.total_kwh);
+    }
+    printf("]}\n");
+  }
+
+  if (leak != LEAK_EVENT_NONE) {
+    events++;
+    printf("{\"type\":\"leak\",\"ms\":%lu,\"event\":\"%s\",\"leak_rate_lpm\":%.2f,", (unsigned long)ms,
+           leak == LEAK_EVENT_RAISED ? "LEAK_SUSPECTED" : "LEAK_CLEARED", controller.balance.leak_rate_lpm);
+    printLevel();
+    printf("}\n");
+  }
+  resetCycle();
+}
+
+static void runCommand(uint32_t ms, int pump, bool start) {
+  ControlAction action = start ? CONTROL_START : CONTROL_STOP;
+  const char* result = tankControllerCommand(controller, pump, action);
+  if (result == nullptr) {
+    tankControllerSetPump(controller, pump, start);
+    result = "APPLIED";
+  }
+  events++;
+  printf("{\"type\":\"command\",\"ms\":%lu,\"pump\":%d,\"action\":\"%s\",\"result\":\"%s\"}\n", (unsigned long)ms,
+         pump, start ? "START" : "STOP", result);
+}
+
+static void parseAdc(const char* line) {
+  unsigned long t;
+  unsigned pump, from, total;
+  int used = 0;
+  if (sscanf(line, "A %lu %u %u %u%n", &t, &pump, &from, &total, &used) != 4) return;
+  if (pump >= TANK_PUMPS || total > CURRENT_RMS_SAMPLES) return;
+  advanceTo((uint32_t)t);
+  const char* p = line + used;
+  unsigned sample;
+  int n;
+  size_t i = from;
+  while (i < total && sscanf(p, " %x%n", &sample, &n) == 1) {
+    adcBlock[pump][i++] = (uint16_t)sample;
+    p += n;
+  }
+  // El bloque se procesa con su última línea (se descartan enteros, nunca a medias)
+  if (i == total) readings.pump_amps[pump] = tankPumpAmps(controller.cfg, adcBlock[pump], total);
+}
+
+static void parseLine(const char* line) {
+  while (*line == ' ' || *line == '\t') line++;
+  unsigned long t, a, b, c;
+  unsigned id, pump, version;
+  int raw;
+  long centi;
+  char action[8];
+
+  if (sscanf(line, "H %u %u %lu", &version, &pump, &a) == 3) {
+    if (version != CAPTURE_VERSION) fprintf(stderr, "captura: versión %u, se esperaba %d\n", version, CAPTURE_VERSION);
+    if (pump != TANK_PUMPS) fprintf(stderr, "captura: %u bombas, el controlador tiene %d\n", pump, TANK_PUMPS);
+    msBase = (uint32_t)a;
+    if (!quiet) printf("{\"type\":\"start\",\"ms\":%lu,\"pumps\":%u}\n", a, pump);
+  } else if (line[0] == 'A') {
+    parseAdc(line);
+  } else if (sscanf(line, "L %lu %lu", &t, &a) == 2) {
+    advanceTo((uint32_t)t);
+    readings.line_amps = tankLineAmps(controller.cfg, (uint16_t)a);
+  } else if (sscanf(line, "P %lu %lu %lu", &t, &a, &b) == 3) {
+    advanceTo((uint32_t)t);
+    readings.inflow_lpm = tankInflowLpm(controller.cfg, (uint32_t)a, (uint32_t)b);
+  } else if (sscanf(line, "U %lu %lu", &t, &a) == 2) {
+    advanceTo((uint32_t)t);
+    readings.ultrasonic_height_cm = tankEchoHeightCm(controller.cfg, (uint32_t)a);
+  } else if (sscanf(line, "T %lu %u %ld", &t, &pump, &centi) == 3) {
+    advanceTo((uint32_t)t);
+    if (pump < TANK_PUMPS) readings.temperature_c[pump] = (float)centi / 100.0f;
+  } else if (sscanf(line, "F %lu %lu %u %d %lu", &t, &a, &id, &raw, &c) == 5) {
+    advanceTo((uint32_t)t);
+    syncMs((uint32_t)a);
+    if (id >= FLOAT_SWITCH_COUNT) return;
+    floatRaw[id] = raw != 0;
+    floatEdgeUs[id] = (uint32_t)c;
+    floatSeen[id] = true;
+    pollFloats();
+  } else if (sscanf(line, "C %lu %lu %u %7s", &t, &a, &pump, action) == 4) {
+    advanceTo((uint32_t)t);
+    syncMs((uint32_t)a);
+    runCommand((uint32_t)a, (int)pump, strcmp(action, "START") == 0);
+  } else if (sscanf(line, "K %lu %lu", &t, &a) == 2) {
+    advanceTo((uint32_t)t);
+    syncMs((uint32_t)a);
+    runCycle((uint32_t)a);
+  } else if (sscanf(line, "D %lu", &a) == 1) {
+    dropped = a;
+    fprintf(stderr, "captura: %lu lecturas descartadas en el equipo (buffer lleno); la reproducción no es fiel\n", a);
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) speed = atof(argv[++i]);
+    else if (strcmp(argv[i], "--quiet") == 0) quiet = true;
+    else if (path == nullptr && argv[i][0] != '-') path = argv[i];
+    else {
+      fprintf(stderr, "uso: %s [--speed N] [--quiet] [CAPTURA]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  FILE* in = path != nullptr ? fopen(path, "r") : stdin;
+  if (in == nullptr) {
+    fprintf(stderr, "No se pudo abrir %s\n", path);
+    return 2;
+  }
+
+  tankControllerInit(controller, PLANT_CONTROLLER_CONFIG, nullptr, nullptr);
+  resetCycle();
+
+  char line[256];
+  while (fgets(line, sizeof(line), in) != nullptr) {
+    line[strcspn(line, "\r\n")] = '\0';
+    parseLine(line);
+  }
+  if (in != stdin) fclose(in);
+
+  fprintf(stderr, "reproducción: %lu ciclos, %lu eventos%s\n", cycles, events, dropped > 0 ? " (captura incompleta)" : "");
+  return 0;
+}
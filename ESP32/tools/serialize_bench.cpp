@@ -0,0 +1,161 @@
+// -------------------------------------------------------------------------
+// COSTO DE SERIALIZAR Y ENCOLAR LA TELEMETRÍA (HOST)
+// -------------------------------------------------------------------------
+// Compara, por mensaje, el camino anterior y el actual de publishTelemetry():
+//
+//  - documento:  StaticJsonDocument -> buffer en la pila -> copia a la cola
+//  - stream+copia: json_writer al buffer en la pila -> copia a la cola
+//  - en el lugar: json_writer directo en el lugar de la cola (sin copia)
+//
+// Cada vuelta incluye el despacho QoS0 hacia un transporte que no hace nada,
+// así que la diferencia entre filas es el costo de armar y copiar el JSON.
+// Los modos se alternan durante BENCH_ROUNDS vueltas y se informa la mejor
+// de cada uno, que es la menos afectada por el resto del sistema.
+// Al final encola un payload más grande que un lugar (buffer compartido) y
+// comprueba que salga completo.
+//
+//   pio run -e serialize_bench -t exec
+//
+// En el ESP32 la relación entre filas es la que importa, no los ns del host.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ArduinoJson.h>
+
+#include "mqtt_publisher.h"
+#include "telemetry_payload.h"
+#include "time_service.h"
+
+#include "test_fixtures.h"
+
+#define BENCH_ITERATIONS 200000
+#define BENCH_ROUNDS 7         // Se alternan los modos y queda la mejor vuelta de cada uno (menos ruido del host)
+#define BENCH_BIG_PAYLOAD 3000 // Más que MQTT_PAYLOAD_MAX, menos que MQTT_JUMBO_PAYLOAD_MAX
+
+static FixtureTransport transport;
+static MqttPublisher publisher;
+static const char* TOPIC = "caracas/ctl-bench/pumps/1/telemetry";
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// El serializador anterior (ArduinoJson), mismos campos
+static size_t writeDocument(const TelemetrySample& s, const char* stamp, char* out, size_t size) {
+  StaticJsonDocument<JSON_OBJECT_SIZE(27) + TIME_STAMP_WIDTH + 1> doc;
+  doc["pump_id"] = s.pump_id;
+  doc["current_amps"] = s.amps;
+  doc["pump_temperature_celsius"] = s.temperature_c;
+  doc["current_inflow_rate"] = s.inflow_rate;
+  char field[TIME_STAMP_WIDTH + 1];
+  memcpy(field, stamp, TIME_STAMP_WIDTH);
+  field[TIME_STAMP_WIDTH] = '\0';
+  doc[TIME_STAMP_FIELD] = serialized((char*)field);
+  doc["slot_ms"] = s.slot_ms;
+  doc["water_level_percent"] = s.level_percent;
+  doc["water_level_sigma_percent"] = s.level_sigma_percent;
+  doc["mqtt_queue_depth"] = s.queue_depth;
+  doc["mqtt_ack_latency_ms"] = s.ack_latency_ms;
+  doc["street_flow_status"] = (s.amps > 0) ? "FLOWING" : "STOPPED";
+  doc["power_watts"] = s.power_w;
+  doc["energy_kwh_total"] = s.energy_kwh_total;
+  doc["energy_kwh_interval"] = s.energy_kwh_interval;
+  doc["pumped_m3_interval"] = s.pumped_m3_interval;
+  doc["energy_kwh_per_m3"] = s.energy_kwh_per_m3;
+  doc["tank_volume_liters"] = s.tank_volume_l;
+  doc["tank_trend_lpm"] = s.trend->slope_lpm;
+  doc["minutes_to_empty"] = s.trend->minutes_to_empty;
+  doc["inflow_total_liters"] = s.inflow_total_l;
+  doc["tank_outflow_lpm_5min"] = s.balance5->outflow_lpm;
+  doc["tank_unaccounted_lpm_5min"] = s.balance5->unaccounted_lpm;
+  doc["tank_outflow_lpm_15min"] = s.balance15->outflow_lpm;
+  doc["tank_unaccounted_lpm_15min"] = s.balance15->unaccounted_lpm;
+  doc["leak_suspected"] = s.leak_suspected;
+  doc["leak_rate_lpm"] = s.leak_rate_lpm;
+  if (doc.overflowed() || measureJson(doc) >= size) return 0;
+  return serializeJson(doc, out, size);
+}
+
+enum BenchMode { BENCH_DOCUMENT, BENCH_STREAM_COPY, BENCH_IN_SLOT };
+
+static bool publishOnce(BenchMode mode, const TelemetrySample& sample, int64_t mono) {
+  char stamp[TIME_STAMP_WIDTH];
+  timeServiceFormatStamp(fixtureTime, mono, stamp);
+
+  if (mode == BENCH_IN_SLOT) {
+    return telemetryPayloadPublish(publisher, TOPIC, 0, nullptr, sample, stamp, mono, 0);
+  }
+
+  char output[TELEMETRY_JSON_MAX];
+  size_t offset = 0;
+  size_t n;
+  if (mode == BENCH_DOCUMENT) {
+    n = writeDocument(sample, stamp, output, sizeof(output));
+    const char* field = strstr(output, "\"" TIME_STAMP_FIELD "\":"); // Como mqttPublishSample()
+    offset = field != nullptr ? field - output + strlen("\"" TIME_STAMP_FIELD "\":") : 0;
+  } else {
+    n = telemetryPayloadWrite(sample, stamp, output, sizeof(output), &offset);
+  }
+  if (n == 0) return false;
+  MqttSampleStamp sampleStamp = {mono, (uint16_t)offset};
+  return mqttPublisherEnqueue(publisher, TOPIC, (const uint8_t*)output, n, MQTT_PRIO_TELEMETRY, 0, 0, nullptr,
+                              &sampleStamp);
+}
+
+// ns por mensaje de una vuelta de BENCH_ITERATIONS
+static double run(const char* name, BenchMode mode) {
+  TelemetrySample samples[16];
+  for (uint32_t i = 0; i < 16; i++) samples[i] = fixtureSample(i, 1);
+
+  uint64_t start = nowNs();
+  for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+    if (!publishOnce(mode, samples[i % 16], (int64_t)i * 5000000)) {
+      fprintf(stderr, "%s: no se encoló la vuelta %u\n", name, i);
+      exit(1);
+    }
+    mqttPublisherService(publisher, 0);
+  }
+  return (double)(nowNs() - start) / BENCH_ITERATIONS;
+}
+
+// Un payload más grande que un lugar pasa por el buffer compartido y sale completo
+static bool checkBigPayload() {
+  static uint8_t big[BENCH_BIG_PAYLOAD];
+  for (size_t i = 0; i < sizeof(big); i++) big[i] = (uint8_t)('a' + i % 26);
+  if (!mqttPublisherEnqueue(publisher, TOPIC, big, sizeof(big), MQTT_PRIO_BULK, 0, 0)) return false;
+  mqttPublisherService(publisher, 0);
+  return transport.lastLength == sizeof(big) && memcmp(transport.last, big, sizeof(big)) == 0 &&
+         publisher.jumbo_owner == nullptr;
+}
+
+int main() {
+  fixtureTimeInit();
+  MqttTransportHandler handler = {};
+  transport.begin(MqttConnectConfig{}, handler);
+  mqttPublisherInit(publisher, &transport, fixtureRestamp);
+
+  printf("telemetría: cota al compilar %u B, lugar de la cola %u B\n", (unsigned)TELEMETRY_JSON_MAX,
+         (unsigned)MQTT_PAYLOAD_MAX);
+  static const char* const NAMES[] = {"documento", "stream+copia", "en el lugar"};
+  double best[3] = {0, 0, 0};
+  uint64_t bytes[3] = {0, 0, 0};
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    for (int mode = BENCH_DOCUMENT; mode <= BENCH_IN_SLOT; mode++) {
+      uint64_t bytesBefore = transport.bytes;
+      double ns = run(NAMES[mode], (BenchMode)mode);
+      if (round == 0 || ns < best[mode]) best[mode] = ns;
+      bytes[mode] = (transport.bytes - bytesBefore) / BENCH_ITERATIONS;
+    }
+  }
+  for (int mode = BENCH_DOCUMENT; mode <= BENCH_IN_SLOT; mode++) {
+    printf("%-14s %8.1f ns/msg %6llu B/msg\n", NAMES[mode], best[mode], (unsigned long long)bytes[mode]);
+  }
+
+  bool big = checkBigPayload();
+  printf("payload de %u B (buffer compartido): %s\n", (unsigned)BENCH_BIG_PAYLOAD, big ? "OK" : "FALLA");
+  return big ? 0 : 1;
+}
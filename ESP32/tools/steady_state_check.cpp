@@ -0,0 +1,222 @@
+// -------------------------------------------------------------------------
+// VERIFICACIÓN DE RÉGIMEN ESTABLE SIN MEMORIA DINÁMICA (HOST)
+// -------------------------------------------------------------------------
+// Corre en el host el mismo código que el firmware usa en régimen estable
+// y falla si alguna vuelta asigna memoria dinámica:
+//
+//  - muestra -> JSON escrito en el lugar de la cola de salida
+//    (telemetry_payload, mqtt_publisher) -> despacho con remarcado de hora hacia un transporte de prueba
+//  - mensaje entrante -> tópico (device_identity) -> comando
+//    (control_command) -> acción -> respuesta encolada
+//
+// malloc/calloc/realloc/free pasan por alloc_counter (--wrap en el
+// enlazado, ver platformio.ini). Tras unas vueltas de calentamiento se
+// marca el régimen estable; cualquier asignación posterior se informa con
+// su tamaño y la dirección que llamó (addr2line -e sobre el ejecutable).
+//
+//   pio run -e steady_state_check -t exec
+//
+// Con --trace ARCHIVO deja además la traza de las últimas vueltas (el
+// mismo trace_recorder del firmware, con el reloj del host) para
+// tools/trace_to_chrome.cpp.
+//
+// Código de salida: 0 si no hubo asignaciones en régimen estable, 1 si sí
+// o si la rama de comandos no llegó a aplicar ni responder ninguno.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ArduinoJson.h>
+
+#include <chrono>
+
+#include "alloc_counter.h"
+#include "control_command.h"
+#include "device_identity.h"
+#include "mqtt_publisher.h"
+#include "publish_profiles.h"
+#include "telemetry_payload.h"
+#include "time_service.h"
+#include "trace_recorder.h"
+
+#include "test_fixtures.h"
+
+#define CHECK_WARMUP_CYCLES 3
+#define CHECK_CYCLES 2000
+#define CHECK_PUMPS 2
+
+static FixtureTransport transport;
+static MqttPublisher publisher;
+static DeviceIdentity identity;
+static bool pumpOn[CHECK_PUMPS + 1];
+static uint32_t nowMs = 0;
+static uint32_t applied = 0; // Comandos que llegaron a la bomba
+static uint32_t replies = 0; // Respuestas encoladas
+
+static void onPublished(int msgId) {
+  mqttPublisherOnPublished(publisher, msgId, nowMs);
+}
+
+// Publica con la marca "ts_ms" para que el publicador la rehaga al despachar (como mqttPublishSample)
+static bool enqueueSample(const char* topic, const char* payload, size_t length, int64_t mono, MqttPriority priority,
+                          uint8_t qos, const MqttPublishProperties* props) {
+  const char* field = strstr(payload, "\"" TIME_STAMP_FIELD "\":");
+  if (field == nullptr) return false;
+  MqttSampleStamp stamp = {mono, (uint16_t)(field - payload + strlen("\"" TIME_STAMP_FIELD "\":"))};
+  return mqttPublisherEnqueue(publisher, topic, (const uint8_t*)payload, length, priority, qos, nowMs, props, &stamp);
+}
+
+// Ciclo de telemetría de publishTelemetry()
+static void telemetryCycle(uint32_t cycle) {
+  int64_t mono = (int64_t)nowMs * 1000;
+  for (int pump = 1; pump <= CHECK_PUMPS; pump++) {
+    TelemetrySample sample = fixtureSample(cycle, pump);
+    if (!pumpOn[pump]) sample.amps = 0.0f;
+    sample.queue_depth = publisher.stats.queue_depth;
+    sample.ack_latency_ms = publisher.stats.ack_latency_avg_ms;
+
+    char stamp[TIME_STAMP_WIDTH];
+    timeServiceFormatStamp(fixtureTime, mono, stamp);
+    char topic[MQTT_TOPIC_MAX];
+    devicePumpTopic(identity, pump, "telemetry", topic, sizeof(topic));
+    MqttPublishProperties props = {&TELEMETRY_PROFILE, nullptr, 0};
+    if (!telemetryPayloadPublish(publisher, topic, 0, &props, sample, stamp, mono, nowMs)) {
+      fprintf(stderr, "La telemetría de la bomba %d no se encoló\n", pump);
+      exit(1);
+    }
+  }
+}
+
+// applyPumpAction() de main.cpp, sin relés ni controlador
+static const char* applyPump(int pumpId, ControlAction action) {
+  if (pumpId < 1 || pumpId > CHECK_PUMPS) return "UNKNOWN_PUMP";
+  pumpOn[pumpId] = action == CONTROL_START;
+  applied++;
+  return "APPLIED";
+}
+
+// La rama de comandos de callback(): el mismo controlCommandHandle() y la misma respuesta MQTT 5
+static void onMessage(const char* topic, const uint8_t* payload, size_t length, const MqttMessageProperties& props) {
+  int pumpId = 0;
+  const char* result = controlCommandHandle(identity, topic, payload, length, applyPump, pumpId);
+  if (props.response_topic == nullptr) return;
+
+  int64_t mono = (int64_t)nowMs * 1000;
+  char stamp[TIME_STAMP_WIDTH];
+  timeServiceFormatStamp(fixtureTime, mono, stamp);
+  char output[CONTROL_REPLY_MAX];
+  size_t n = controlCommandWriteReply(pumpId, result, stamp, output, sizeof(output));
+  if (n == 0) return;
+  MqttPublishProperties replyProps = {&EVENT_PROFILE, props.correlation_data, props.correlation_length};
+  if (enqueueSample(props.response_topic, output, n, mono, MQTT_PRIO_EVENT, 1, &replyProps)) replies++;
+}
+
+// Comando entrante con Response Topic: llega por el transporte en el próximo poll()
+static void commandCycle(uint32_t cycle) {
+  static const char* const PAYLOADS[] = {
+    "{\"command\":\"START\",\"source\":\"dashboard\",\"user\":\"operador-turno-noche\"}",
+    "{\"command\":\"STOP\"}",
+    "{\"command\":\"PURGE\"}",
+    "{\"cmd\":\"START\"}",
+    "{\"command\":",
+  };
+  static char topics[CHECK_PUMPS][MQTT_TOPIC_MAX];
+  static char replyTopics[CHECK_PUMPS][MQTT_TOPIC_MAX];
+  static const uint8_t correlation[] = "4b7f0c2e-9d1a-4c55-8e1b-0f6a2d9c3e71";
+
+  int pump = (int)(cycle % CHECK_PUMPS);
+  if (topics[pump][0] == '\0') {
+    devicePumpTopic(identity, pump + 1, "control", topics[pump], sizeof(topics[pump]));
+    snprintf(replyTopics[pump], sizeof(replyTopics[pump]), "%s/ack", topics[pump]);
+  }
+  MqttMessageProperties props = {"application/json", replyTopics[pump], correlation, sizeof(correlation) - 1};
+  transport.receive(topics[pump], PAYLOADS[cycle % (sizeof(PAYLOADS) / sizeof(PAYLOADS[0]))], props);
+}
+
+static void runCycle(uint32_t cycle) {
+  nowMs += 5000;
+  traceBegin("telemetry", (int32_t)cycle);
+  telemetryCycle(cycle);
+  traceEnd("telemetry");
+  traceBegin("command");
+  commandCycle(cycle);
+  transport.poll(); // Entrega el comando (y confirma lo que estaba en vuelo)
+  traceEnd("command");
+  // Despacho y confirmaciones (varias vueltas del loop por ciclo)
+  traceBegin("dispatch");
+  for (int i = 0; i < 4; i++) {
+    transport.poll();
+    mqttPublisherService(publisher, nowMs);
+  }
+  traceEnd("dispatch");
+}
+
+// Reloj y tarea de la traza en el host: un solo hilo
+static uint32_t traceHostMicros() {
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static uintptr_t traceHostTask(const char** name) {
+  *name = "main";
+  return 1;
+}
+
+static bool writeTrace(const char* path) {
+  FILE* out = fopen(path, "w");
+  if (out == nullptr) return false;
+  TraceCursor cursor;
+  traceCursorInit(cursor);
+  char line[TRACE_LINE_MAX];
+  while (traceNextLine(cursor, line, sizeof(line))) fprintf(out, "%s\n", line);
+  return fclose(out) == 0;
+}
+
+int main(int argc, char** argv) {
+  const char* tracePath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+    else {
+      fprintf(stderr, "uso: %s [--trace ARCHIVO]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (tracePath != nullptr) traceInit(traceHostMicros, traceHostTask);
+  allocCounterTrackCurrentTask();
+
+  deviceIdentitySet(identity, "caracas", "ctl-check");
+  fixtureTimeInit();
+  MqttTransportHandler handler = {nullptr, nullptr, onPublished, onMessage, nullptr};
+  transport.begin(MqttConnectConfig{}, handler);
+  mqttPublisherInit(publisher, &transport, fixtureRestamp);
+
+  for (uint32_t cycle = 0; cycle < CHECK_WARMUP_CYCLES; cycle++) runCycle(cycle);
+
+  applied = 0;
+  replies = 0;
+  AllocCounters before;
+  allocCounterRead(before);
+  allocCounterSetSteady(true);
+  for (uint32_t cycle = CHECK_WARMUP_CYCLES; cycle < CHECK_WARMUP_CYCLES + CHECK_CYCLES; cycle++) runCycle(cycle);
+  allocCounterSetSteady(false);
+  AllocCounters after;
+  allocCounterRead(after);
+
+  uint32_t steady = after.steady_allocs - before.steady_allocs;
+  if (tracePath != nullptr && !writeTrace(tracePath)) fprintf(stderr, "No se pudo escribir %s\n", tracePath);
+  printf("ciclos=%u publicados=%u bytes=%llu descartados=%u comandos=%u respuestas=%u asignaciones_regimen=%u\n",
+         CHECK_CYCLES, transport.published, (unsigned long long)transport.bytes, publisher.stats.dropped, applied,
+         replies, steady);
+  if (steady != 0) {
+    printf("FALLA: la última fue de %u B, llamada desde %p\n", after.steady_last_size,
+           (void*)after.steady_last_caller);
+    return 1;
+  }
+  // Sin comandos aplicados ni respuestas la rama de control no corrió: el cero no la cubre
+  if (applied == 0 || replies == 0) {
+    printf("FALLA: la rama de comandos no se ejercitó (¿ArduinoJson real en el enlazado?)\n");
+    return 1;
+  }
+  printf("OK: sin memoria dinámica en régimen estable\n");
+  return 0;
+}
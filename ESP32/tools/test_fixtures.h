@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mqtt_publisher.h"
+#include "mqtt_transport.h"
+#include "tank_balance.h"
+#include "telemetry_payload.h"
+#include "time_service.h"
+
+// -------------------------------------------------------------------------
+// PIEZAS COMUNES DE LAS HERRAMIENTAS DE PRUEBA Y MEDICIÓN
+// -------------------------------------------------------------------------
+// El broker de prueba, el reloj de pared con su remarcado y la muestra de
+// telemetría fija que usan scenario_runner, steady_state_check,
+// serialize_bench y bench_kernels. Nada propio del host: bench_kernels
+// también se compila para el ESP32 (env bench_esp32).
+
+#define FIXTURE_EPOCH_US 1760000000000000LL // Hora de pared a la que se sincroniza el reloj
+
+// Broker de prueba: conectado salvo que se baje `up`; confirma cada QoS1 en el siguiente poll() con
+// conexión y entrega ahí el mensaje que se le dio con receive(), como poll() de EspMqttTransport.
+// Como el outbox de esp-mqtt, lo que estaba en vuelo se confirma al volver.
+class FixtureTransport : public MqttTransport {
+ public:
+  bool begin(const MqttConnectConfig&, const MqttTransportHandler& handler) override {
+    handler_ = handler;
+    return true;
+  }
+  bool connected() const override { return up; }
+  bool reconnect() override { return up; }
+  bool setBroker(const char*, uint16_t) override { return true; }
+  int publish(const char*, const uint8_t* payload, size_t length, uint8_t qos,
+              const MqttPublishProperties*) override {
+    if (!up) return -1;
+    published++;
+    bytes += length;
+    last = payload;
+    lastLength = length;
+    if (qos == 0) return 0;
+    int id = ++nextId_;
+    if (pendingCount_ < MQTT_INFLIGHT_WINDOW) pending_[pendingCount_++] = id;
+    return id;
+  }
+  bool subscribe(const char*, uint8_t) override { return true; }
+  void poll() override {
+    if (!up) return;
+    for (int i = 0; i < pendingCount_; i++) {
+      if (handler_.on_published) handler_.on_published(pending_[i]);
+    }
+    pendingCount_ = 0;
+    const char* inbound = inbound_;
+    inbound_ = nullptr;
+    if (inbound != nullptr && handler_.on_message) {
+      handler_.on_message(inboundTopic_, (const uint8_t*)inbound, strlen(inbound), inboundProps_);
+    }
+  }
+
+  // Mensaje entrante para el próximo poll(); `topic` y `payload` deben seguir vivos hasta entonces
+  void receive(const char* topic, const char* payload, const MqttMessageProperties& props) {
+    inboundTopic_ = topic;
+    inbound_ = payload;
+    inboundProps_ = props;
+  }
+
+  bool up = true;
+  uint32_t published = 0;
+  uint64_t bytes = 0;
+  const uint8_t* last = nullptr; // Último payload despachado
+  size_t lastLength = 0;
+
+ private:
+  MqttTransportHandler handler_ = {};
+  int nextId_ = 0;
+  int pending_[MQTT_INFLIGHT_WINDOW];
+  int pendingCount_ = 0;
+  const char* inboundTopic_ = nullptr;
+  const char* inbound_ = nullptr;
+  MqttMessageProperties inboundProps_ = {};
+};
+
+// Reloj de pared de las herramientas (un solo hilo)
+inline TimeService fixtureTime;
+
+inline void fixtureTimeInit() {
+  timeServiceInit(fixtureTime);
+  timeServiceSync(fixtureTime, 0, FIXTURE_EPOCH_US);
+}
+
+// MqttRestampFn para mqttPublisherInit()
+inline bool fixtureRestamp(int64_t mono_us, char* field) {
+  return timeServiceFormatStamp(fixtureTime, mono_us, field);
+}
+
+inline const LevelTrendEstimate FIXTURE_TREND = {-2.5f, 380.0f, -1.0f};
+inline const TankBalanceWindow FIXTURE_BALANCE = {5.0f, 150.0f, 152.0f, 150.0f, 2.0f, false, false};
+
+// Muestra con todos los campos de publishTelemetry(); varía con la vuelta `i` para que nada se pliegue
+inline TelemetrySample fixtureSample(uint32_t i, int pump_id) {
+  TelemetrySample sample = {};
+  sample.pump_id = pump_id;
+  sample.amps = 12.5f + (float)(i % 7);
+  sample.temperature_c = 61.25f;
+  sample.inflow_rate = 155.5f;
+  sample.slot_ms = FIXTURE_EPOCH_US / 1000 + i * 5000LL;
+  sample.level_percent = 70.0f - (float)(i % 50) / 10.0f;
+  sample.level_sigma_percent = 1.5f;
+  sample.power_w = 2337.5f;
+  sample.energy_kwh_total = 1234.5678;
+  sample.energy_kwh_interval = 0.0032;
+  sample.pumped_m3_interval = 0.16;
+  sample.energy_kwh_per_m3 = 0.02f;
+  sample.tank_volume_l = 7000.0f;
+  sample.inflow_total_l = 1.5e6;
+  sample.trend = &FIXTURE_TREND;
+  sample.balance5 = &FIXTURE_BALANCE;
+  sample.balance15 = &FIXTURE_BALANCE;
+  sample.leak_suspected = i % 3 == 0;
+  sample.leak_rate_lpm = 4.0f;
+  return sample;
+}
@@ -0,0 +1,136 @@
+// -------------------------------------------------------------------------
+// CONVERTIDOR DE LA TRAZA A CHROME TRACE (HOST)
+// -------------------------------------------------------------------------
+// Lee el volcado de trace_recorder.h (captura del puerto serie, mensajes de
+// {sitio}/{controlador}/trace o el archivo de una herramienta de host; las
+// demás líneas se ignoran y si hay varios volcados queda el último) y lo
+// escribe en el formato JSON de Chrome Trace, que abren chrome://tracing y
+// ui.perfetto.dev: una fila por tarea, tramos anidados por etapa y los
+// eventos sueltos (mensajes, eventos de esp-mqtt) como instantes.
+//
+// Las marcas del equipo son de 32 bits en us: se desenrollan tomando la
+// diferencia con el evento anterior (sirve mientras el volcado abarque
+// menos de ~35 min) y se cuentan desde el primer evento.
+//
+//   pio run -e trace_to_chrome
+//   mosquitto_sub -t caracas/ctl-01/trace | sed '/^Z$/q' > traza.txt   (o la captura del monitor serie)
+//
+// Por MQTT el volcado llega en varios mensajes: se lee hasta la línea "Z".
+//   .pio/build/trace_to_chrome/program traza.txt > traza.json
+//
+// Opciones: --process NOMBRE (nombre de la fila del proceso, por defecto "ESP32").
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct Event {
+  char type;
+  int64_t ts_us;
+  unsigned task;
+  std::string name;
+  long arg;
+};
+
+static std::map<unsigned, std::string> taskNames;
+static std::vector<Event> events;
+static bool haveLast = false;
+static uint32_t lastRaw = 0;
+static int64_t lastUs = 0;
+
+static void parseLine(const char* line) {
+  while (*line == ' ' || *line == '\t') line++;
+  char name[64];
+  char type;
+  unsigned long count, overwritten, ts;
+  unsigned task;
+  long arg;
+  if (sscanf(line, "R %lu %lu", &count, &overwritten) == 2) {
+    // Volcado nuevo: se descarta lo anterior
+    taskNames.clear();
+    events.clear();
+    haveLast = false;
+    fprintf(stderr, "traza: %lu eventos (%lu anteriores pisados)\n", count, overwritten);
+  } else if (sscanf(line, "T %u %63s", &task, name) == 2) {
+    taskNames[task] = name;
+  } else if (sscanf(line, "%c %lu %u %63s %ld", &type, &ts, &task, name, &arg) == 5 &&
+             (type == 'B' || type == 'E' || type == 'i' || type == 'X')) {
+    uint32_t raw = (uint32_t)ts;
+    lastUs = haveLast ? lastUs + (int32_t)(raw - lastRaw) : 0;
+    lastRaw = raw;
+    haveLast = true;
+    events.push_back({type, lastUs, task, name, arg});
+  }
+}
+
+static void printString(const std::string& text) {
+  putchar('"');
+  for (char c : text) {
+    if (c == '"' || c == '\\') putchar('\\');
+    if ((unsigned char)c < 0x20) continue;
+    putchar(c);
+  }
+  putchar('"');
+}
+
+int main(int argc, char** argv) {
+  std::string process = "ESP32";
+  const char* input = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--process") == 0 && i + 1 < argc) process = argv[++i];
+    else if (argv[i][0] != '-') input = argv[i];
+    else {
+      fprintf(stderr, "uso: %s [--process NOMBRE] [volcado]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  FILE* in = input != nullptr ? fopen(input, "r") : stdin;
+  if (in == nullptr) {
+    fprintf(stderr, "no se pudo abrir %s\n", input);
+    return 1;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), in) != nullptr) parseLine(line);
+  if (in != stdin) fclose(in);
+  if (events.empty()) {
+    fprintf(stderr, "no hay eventos de traza en la entrada\n");
+    return 1;
+  }
+
+  // El primer evento del anillo no es necesariamente el más viejo (un tramo completo se registra al terminar)
+  int64_t origin = events[0].ts_us;
+  int64_t last = origin;
+  for (const Event& e : events) {
+    int64_t end = e.ts_us + (e.type == 'X' ? e.arg : 0);
+    if (e.ts_us < origin) origin = e.ts_us;
+    if (end > last) last = end;
+  }
+
+  printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":");
+  printString(process);
+  printf("}}");
+  for (const auto& task : taskNames) {
+    printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", task.first);
+    printString(task.second);
+    printf("}}");
+  }
+  for (const Event& e : events) {
+    printf(",\n{\"name\":");
+    printString(e.name);
+    printf(",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%u", e.type, (long long)(e.ts_us - origin), e.task);
+    if (e.type == 'X') printf(",\"dur\":%ld", e.arg);
+    else if (e.type == 'i') printf(",\"s\":\"t\",\"args\":{\"arg\":%ld}", e.arg);
+    else if (e.arg != 0) printf(",\"args\":{\"arg\":%ld}", e.arg);
+    printf("}");
+  }
+  printf("\n]}\n");
+  fprintf(stderr, "%zu eventos, %zu tareas, %.3f ms\n", events.size(), taskNames.size(),
+          (double)(last - origin) / 1000.0);
+  return 0;
+}
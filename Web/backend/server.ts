@@ -3,6 +3,7 @@ import cors from 'cors';
 import mqtt from 'mqtt';
 import { Pool } from 'pg';
 import dotenv from 'dotenv';
+import { randomUUID } from 'crypto';
 
 // Cargar variables de entorno
 dotenv.config();
@@ -19,30 +20,290 @@ const pool = new Pool({
 });
 
 // --- CONFIGURACIÓN MQTT ---
+// MQTT 5: propiedades (Content Type, versión de esquema, Correlation Data) y alias de tópico
+const COMMAND_EXPIRY_SECONDS = 30; // Un comando que no se entregó en 30 s ya no debe aplicarse
+const TELEMETRY_SCHEMA_VERSION = '3';
+const MAX_CLOCK_AHEAD_MS = 5 * 60 * 1000; // Una muestra "del futuro" indica un reloj mal sincronizado
+
 const mqttClient = mqtt.connect(process.env.MQTT_BROKER_URL || 'mqtt://localhost:1883', {
   username: process.env.MQTT_USERNAME || 'backend',
   password: process.env.MQTT_PASSWORD || 'BackendPass456',
+  protocolVersion: 5,
+  properties: {
+    topicAliasMaximum: 16, // Permite que el broker nos envíe alias de tópico
+  },
 });
 
+// Jerarquía de tópicos: {sitio}/{controlador}/pumps/{bomba}/{telemetry|control|control/ack}
+// {sitio}/{controlador}/info (ficha retenida de cada controlador), {sitio}/{controlador}/boot
+// (perfil de arranque, uno por encendido), {sitio}/{controlador}/metrics (latencia por etapa),
+// {sitio}/{controlador}/stalls (bloqueos del loop) y {sitio}/{controlador}/diagnostics (memoria).
+// Los equipos con firmware anterior publican en caracas/pumps/{bomba}/telemetry: se registran
+// con el controlador LEGACY_CONTROLLER.
+const LEGACY_CONTROLLER = 'legacy';
+const SEGMENT_PATTERN = /^[A-Za-z0-9_-]+$/;
+
+interface TopicRoute {
+  site: string;
+  controller: string;
+  pumpId?: number;
+  leaf: string;
+}
+
+function parseTopic(topic: string): TopicRoute | null {
+  const parts = topic.split('/');
+  if (parts.length === 4 && parts[1] === 'pumps') {
+    return { site: parts[0], controller: LEGACY_CONTROLLER, pumpId: Number(parts[2]), leaf: parts[3] };
+  }
+  if (parts.length >= 5 && parts[2] === 'pumps') {
+    return { site: parts[0], controller: parts[1], pumpId: Number(parts[3]), leaf: parts.slice(4).join('/') };
+  }
+  if (parts.length === 3) {
+    return { site: parts[0], controller: parts[1], leaf: parts[2] };
+  }
+  return null;
+}
+
+// Controladores conocidos (por su ficha o por su telemetría), clave "sitio/controlador"
+const controllers = new Map<string, { site: string; controller: string; pumps: number[]; mac?: string; lastSeen: number }>();
+
+function registerController(site: string, controller: string, pumps: number[], mac?: string) {
+  const key = `${site}/${controller}`;
+  const known = controllers.get(key);
+  const merged = Array.from(new Set([...(known?.pumps || []), ...pumps])).sort((a, b) => a - b);
+  if (!known) console.log(`🆕 Controlador detectado: ${key}`);
+  controllers.set(key, { site, controller, pumps: merged, mac: mac || known?.mac, lastSeen: Date.now() });
+}
+
+// --- Instantáneas de la flota ---
+// Con muestreo alineado, cada telemetría trae "slot_ms" (límite de la hora real en que se tomó).
+// Las lecturas de un mismo sitio y slot se juntan y, pasado SNAPSHOT_GRACE_MS desde la primera,
+// se agregan en una sola pasada (consumo total, entrada total, nivel medio).
+const SNAPSHOT_GRACE_MS = 3000;
+
+interface SnapshotReading {
+  controller: string;
+  pumpId: number;
+  payload: any;
+}
+
+const openSnapshots = new Map<string, { site: string; slotMs: number; readings: SnapshotReading[] }>();
+
+function addSnapshotReading(site: string, slotMs: number, reading: SnapshotReading) {
+  const key = `${site}/${slotMs}`;
+  let snapshot = openSnapshots.get(key);
+  if (!snapshot) {
+    snapshot = { site, slotMs, readings: [] };
+    openSnapshots.set(key, snapshot);
+    setTimeout(() => {
+      openSnapshots.delete(key);
+      closeSnapshot(snapshot!).catch((err) => console.error('❌ Error guardando instantánea:', err));
+    }, SNAPSHOT_GRACE_MS);
+  }
+  snapshot.readings.push(reading);
+}
+
+async function closeSnapshot(snapshot: { site: string; slotMs: number; readings: SnapshotReading[] }) {
+  let totalAmps = 0;
+  let totalPower = 0;
+  let levelSum = 0;
+  let totalInflow = 0;
+  let minTs = Infinity;
+  let maxTs = -Infinity;
+  const controllersSeen = new Set<string>();
+
+  for (const { controller, payload } of snapshot.readings) {
+    totalAmps += payload.current_amps || 0;
+    totalPower += payload.power_watts || 0;
+    if (typeof payload.ts_ms === 'number') {
+      minTs = Math.min(minTs, payload.ts_ms);
+      maxTs = Math.max(maxTs, payload.ts_ms);
+    }
+    // Entrada y nivel son del tanque del controlador: se cuentan una vez por controlador
+    if (!controllersSeen.has(controller)) {
+      controllersSeen.add(controller);
+      totalInflow += payload.current_inflow_rate || 0;
+      levelSum += payload.water_level_percent || 0;
+    }
+  }
+
+  // Dispersión entre la primera y la última muestra del slot (qué tan simultánea fue la lectura)
+  const spreadMs = maxTs >= minTs ? maxTs - minTs : null;
+  await pool.query(
+    `INSERT INTO site_snapshots (site_id, slot_at, controllers, pumps, total_amps, total_power_watts, total_inflow_rate, avg_water_level_percent, spread_ms)
+     VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9)`,
+    [snapshot.site, new Date(snapshot.slotMs), controllersSeen.size, snapshot.readings.length, totalAmps, totalPower,
+     totalInflow, levelSum / controllersSeen.size, spreadMs]
+  );
+}
+
+// Comandos enviados que esperan respuesta del ESP32 (clave: Correlation Data)
+const pendingCommands = new Map<string, { target: string; command: string; sentAt: number }>();
+
 mqttClient.on('connect', () => {
-  console.log('✅ Conectado al Broker MQTT');
-  // Suscribirse a telemetría de todas las bombas
-  mqttClient.subscribe('caracas/pumps/+/telemetry');
+  console.log('✅ Conectado al Broker MQTT (v5)');
+  // Suscribirse a telemetría de todas las bombas, a las respuestas de los comandos y a las fichas
+  mqttClient.subscribe('+/+/pumps/+/telemetry');
+  mqttClient.subscribe('+/+/pumps/+/control/ack');
+  mqttClient.subscribe('+/+/info');
+  mqttClient.subscribe('+/+/boot');
+  mqttClient.subscribe('+/+/metrics');
+  mqttClient.subscribe('+/+/stalls', { qos: 1 });
+  mqttClient.subscribe('+/+/diagnostics');
+  mqttClient.subscribe('caracas/pumps/+/telemetry'); // Firmware anterior
 });
 
-mqttClient.on('message', async (topic, message) => {
+// Respuesta del ESP32 a un comando: se empareja por Correlation Data
+function handleCommandAck(topic: string, message: Buffer, correlationData?: Buffer) {
+  const ack = JSON.parse(message.toString());
+  const correlationId = correlationData ? correlationData.toString() : '';
+  const pending = pendingCommands.get(correlationId);
+
+  if (!pending) {
+    console.warn(`⚠️ Respuesta sin comando pendiente en ${topic}:`, ack);
+    return;
+  }
+
+  pendingCommands.delete(correlationId);
+  console.log(`📬 ${pending.target}: ${pending.command} -> ${ack.result} (${Date.now() - pending.sentAt} ms)`);
+}
+
+// Perfil de arranque de un controlador: se guarda para agregarlo por versión de firmware
+async function handleBootProfile(route: TopicRoute, boot: any) {
+  console.log(`🔌 Arranque de ${route.site}/${route.controller} (v${boot.firmware}, ${boot.reset_reason}): ` +
+    `WiFi ${boot.wifi_ms} ms (${boot.wifi_path}), MQTT ${boot.mqtt_ms} ms, primera publicación ${boot.first_publish_ms} ms`);
+  await pool.query(
+    `INSERT INTO controller_boot (site_id, controller_id, firmware, reset_reason, wifi_path, wifi_ms, mqtt_ms, first_publish_ms, ntp_ms, phases)
+     VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10)`,
+    [route.site, route.controller, boot.firmware || 'unknown', boot.reset_reason, boot.wifi_path, boot.wifi_ms,
+     boot.mqtt_ms, boot.first_publish_ms, boot.ntp_ms, JSON.stringify(boot.phases || [])]
+  );
+}
+
+// Histogramas de latencia por etapa (una ventana por mensaje). Cada etapa viene como
+// [n, promedio, p50, p95, máximo, [cubetas...]] en us; se guarda una fila por etapa
+async function handleStageMetrics(route: TopicRoute, metrics: any) {
+  const windowEnd = typeof metrics.ts_ms === 'number' ? new Date(metrics.ts_ms) : new Date();
+  for (const [stage, entry] of Object.entries<any[]>(metrics.stages || {})) {
+    const [samples, avgUs, p50Us, p95Us, maxUs, buckets] = entry;
+    await pool.query(
+      `INSERT INTO stage_metrics (site_id, controller_id, firmware, window_end, window_ms, stage, samples, avg_us, p50_us, p95_us, max_us, buckets)
+       VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12)`,
+      [route.site, route.controller, metrics.firmware || 'unknown', windowEnd, metrics.window_ms, stage,
+       samples, avgUs, p50Us, p95Us, maxUs, buckets || []]
+    );
+  }
+}
+
+// Bloqueo del loop: etapas activas (de la más externa a la más interna) y la dirección desde donde
+// se entró a cada una. (controlador, arranque, seq) identifica el registro: una reentrega no duplica.
+// El arranque es un contador en la NVS del equipo (no vuelve a 0 con un corte de energía, como sí
+// pasa con seq); los equipos marcan el registro como subido recién con el PUBACK.
+async function handleStallRecord(route: TopicRoute, stall: any) {
+  const stages: string[] = stall.stages || [];
+  const pcs: string[] = stall.pcs || [];
+  console.warn(`🐢 Bloqueo de ${stall.duration_ms} ms en ${route.site}/${route.controller}: ` +
+    `${stages.join(' > ') || 'loop'}${stall.fatal ? ` (terminó en reinicio: ${stall.reset_reason || '?'})` : ''}`);
+  await pool.query(
+    `INSERT INTO loop_stalls (site_id, controller_id, firmware, boot, seq, task, uptime_ms, duration_ms, fatal, reset_reason, stage, pc, stages, pcs)
+     VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14)
+     ON CONFLICT (controller_id, boot, seq) DO NOTHING`,
+    [route.site, route.controller, stall.firmware || 'unknown', stall.boot, stall.seq, stall.task, stall.uptime_ms,
+     stall.duration_ms, !!stall.fatal, stall.reset_reason || null, stages[stages.length - 1] || 'loop',
+     pcs[pcs.length - 1] || null, stages, pcs]
+  );
+}
+
+// Diagnóstico de memoria: heap, pilas y asignaciones (contadores acumulados desde el arranque).
+// Si trae avisos (umbrales del firmware) se registran también en el log
+async function handleDiagnostics(route: TopicRoute, diag: any) {
+  const heap = diag.heap || {};
+  const allocs = diag.allocs || {};
+  const warnings: string[] = diag.warnings || [];
+  if (warnings.length > 0) {
+    console.warn(`🧠 Memoria de ${route.site}/${route.controller} (${warnings.join(', ')}): libre ${heap.free} B, ` +
+      `mínimo ${heap.min_free} B, bloque más grande ${heap.largest} B, fragmentación ${heap.frag_pct}%`);
+  }
+  const sampledAt = typeof diag.ts_ms === 'number' ? new Date(diag.ts_ms) : new Date();
+  await pool.query(
+    `INSERT INTO controller_diagnostics (site_id, controller_id, firmware, sampled_at, uptime_s, free_bytes, min_free_bytes,
+       largest_block, fragmentation_pct, failed_allocs, allocs, live_allocs, loop_allocs, stage_allocs, stacks, warnings)
+     VALUES ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16)`,
+    [route.site, route.controller, diag.firmware || 'unknown', sampledAt, diag.uptime_s, heap.free, heap.min_free,
+     heap.largest, heap.frag_pct, heap.failed || 0, allocs.total, allocs.live_malloc ?? allocs.live, allocs.loop,
+     JSON.stringify(allocs.stages || {}), JSON.stringify(diag.stacks || {}), warnings]
+  );
+}
+
+mqttClient.on('message', async (topic, message, packet) => {
   try {
+    const properties = packet.properties || {};
+    const route = parseTopic(topic);
+    if (!route) return;
+
+    if (route.leaf === 'control/ack') {
+      handleCommandAck(topic, message, properties.correlationData);
+      return;
+    }
+
+    if (route.leaf === 'info') {
+      if (message.length === 0) return; // Ficha retenida borrada
+      const info = JSON.parse(message.toString());
+      registerController(route.site, route.controller, info.pumps || [], info.mac);
+      return;
+    }
+
+    if (route.leaf === 'metrics') {
+      await handleStageMetrics(route, JSON.parse(message.toString()));
+      return;
+    }
+
+    if (route.leaf === 'stalls') {
+      await handleStallRecord(route, JSON.parse(message.toString()));
+      return;
+    }
+
+    if (route.leaf === 'diagnostics') {
+      await handleDiagnostics(route, JSON.parse(message.toString()));
+      return;
+    }
+
+    if (route.leaf === 'boot') {
+      await handleBootProfile(route, JSON.parse(message.toString()));
+      return;
+    }
+
+    // La bomba 0 es válida: solo se descarta si falta o no es un número
+    if (route.leaf !== 'telemetry' || route.pumpId === undefined || !Number.isInteger(route.pumpId)) return;
+
     const payload = JSON.parse(message.toString());
     console.log(`📡 Dato recibido en ${topic}:`, payload);
 
-    // Extraer ID de la bomba del tópico
-    const pumpId = topic.split('/')[2];
+    // Versión de esquema (propiedad de usuario MQTT 5); los equipos con MQTT 3.1.1 no la envían
+    const schemaVersion = properties.userProperties?.schema_version;
+    if (schemaVersion && schemaVersion !== TELEMETRY_SCHEMA_VERSION) {
+      console.warn(`⚠️ Telemetría con esquema v${schemaVersion} (esperado v${TELEMETRY_SCHEMA_VERSION}) en ${topic}`);
+    }
+
+    // Sitio, controlador e ID de la bomba salen del tópico
+    registerController(route.site, route.controller, [route.pumpId]);
+
+    // Hora de la muestra (ts_ms, ms desde 1970) según el ESP32; si todavía no tenía hora NTP
+    // viene null y se usa la hora de llegada
+    const receivedAt = Date.now();
+    const sampledAt = typeof payload.ts_ms === 'number' && payload.ts_ms <= receivedAt + MAX_CLOCK_AHEAD_MS
+      ? new Date(payload.ts_ms)
+      : new Date(receivedAt);
+    
+    if (typeof payload.slot_ms === 'number') {
+      addSnapshotReading(route.site, payload.slot_ms, { controller: route.controller, pumpId: route.pumpId, payload });
+    }
     
     // Guardar en Base de Datos
     await pool.query(
-      `INSERT INTO pump_telemetry (pump_id, water_level_percent, current_amps, current_inflow_rate, street_flow_status)
-       VALUES ($1, $2, $3, $4, $5)`,
-      [pumpId, payload.water_level_percent, payload.current_amps, payload.current_inflow_rate, payload.street_flow_status]
+      `INSERT INTO pump_telemetry (site_id, controller_id, pump_id, timestamp, water_level_percent, current_amps, current_inflow_rate, street_flow_status)
+       VALUES ($1, $2, $3, $4, $5, $6, $7, $8)`,
+      [route.site, route.controller, route.pumpId, sampledAt, payload.water_level_percent, payload.current_amps, payload.current_inflow_rate, payload.street_flow_status]
     );
   } catch (err) {
     console.error('❌ Error procesando mensaje MQTT:', err);
@@ -57,14 +318,18 @@ app.get('/', (req, res) => {
 });
 
 // 2. Enviar comando a una bomba (Desde el Frontend)
-// Endpoint para recibir comandos desde el Frontend y enviarlos al ESP32 vía MQTT
-app.post('/api/pumps/:id/control', (req, res) => {
-  const { id } = req.params;
-  const { command } = req.body;
-  const topic = `caracas/pumps/${id}/control`;
+// Publica el comando en {sitio}/{controlador}/pumps/{id}/control y responde al cliente HTTP
+function sendPumpCommand(res: express.Response, site: string, controller: string, id: string, command: string) {
+  if (!SEGMENT_PATTERN.test(site) || !SEGMENT_PATTERN.test(controller) || !/^[0-9]+$/.test(id)) {
+    return res.status(400).json({ success: false, error: 'Sitio, controlador o bomba inválidos' });
+  }
+  // Firmware anterior: escucha en {sitio}/pumps/{id}/control
+  const topic = controller === LEGACY_CONTROLLER
+    ? `${site}/pumps/${id}/control`
+    : `${site}/${controller}/pumps/${id}/control`;
   
   // 1. PRIMER LOG: Confirmar que la petición llegó al Backend
-  console.log(`🔔 INTENTO DE CONTROL: Recibida orden ${command} para Bomba ${id}`);
+  console.log(`🔔 INTENTO DE CONTROL: Recibida orden ${command} para Bomba ${id} (${site}/${controller})`);
 
   if (!mqttClient.connected) {
     console.error('❌ ERROR CRÍTICO: El cliente MQTT no está conectado. No se puede enviar la orden.');
@@ -72,10 +337,28 @@ app.post('/api/pumps/:id/control', (req, res) => {
   }
 
   const payload = JSON.stringify({ command });
+  const correlationId = randomUUID();
 
   // 2. PUBLICAR CON CALLBACK: Para saber si MQTT aceptó el mensaje
-  mqttClient.publish(topic, payload, { qos: 1 }, (error) => {
+  // El broker descarta el comando si no se entregó antes de COMMAND_EXPIRY_SECONDS, y el ESP32
+  // responde en el Response Topic con la misma Correlation Data
+  const options = {
+    qos: 1 as const,
+    properties: {
+      messageExpiryInterval: COMMAND_EXPIRY_SECONDS,
+      contentType: 'application/json',
+      responseTopic: `${topic}/ack`,
+      correlationData: Buffer.from(correlationId),
+      userProperties: { schema_version: '1' },
+    },
+  };
+
+  pendingCommands.set(correlationId, { target: `${site}/${controller}/bomba ${id}`, command, sentAt: Date.now() });
+  setTimeout(() => pendingCommands.delete(correlationId), COMMAND_EXPIRY_SECONDS * 1000 * 2);
+
+  mqttClient.publish(topic, payload, options, (error) => {
     if (error) {
+      pendingCommands.delete(correlationId);
       console.error(`❌ FALLÓ PUBLICACIÓN MQTT: ${error.message}`);
       return res.status(500).json({ success: false, error: error.message });
     } else {
@@ -84,18 +367,255 @@ app.post('/api/pumps/:id/control', (req, res) => {
       return res.json({ 
         success: true, 
         message: `Command ${command} sent to pump ${id}`,
-        mqtt_topic: topic 
+        mqtt_topic: topic,
+        correlation_id: correlationId
       });
     }
   });
+}
+
+app.post('/api/sites/:site/controllers/:controller/pumps/:id/control', (req, res) => {
+  const { site, controller, id } = req.params;
+  sendPumpCommand(res, site, controller, id, req.body.command);
+});
+
+// Ruta anterior (sin sitio ni controlador): se aceptan en el cuerpo; si no vienen, se busca el único
+// controlador conocido que tenga esa bomba
+app.post('/api/pumps/:id/control', (req, res) => {
+  const { id } = req.params;
+  const { command, site, controller } = req.body;
+  if (site && controller) {
+    return sendPumpCommand(res, site, controller, id, command);
+  }
+
+  const owners = Array.from(controllers.values()).filter(
+    (c) => c.pumps.includes(Number(id)) && (!site || c.site === site)
+  );
+  if (owners.length !== 1) {
+    return res.status(owners.length === 0 ? 404 : 409).json({
+      success: false,
+      error: owners.length === 0
+        ? `Ningún controlador conocido maneja la bomba ${id}`
+        : `La bomba ${id} existe en varios controladores; indique site y controller`,
+      controllers: owners.map((c) => `${c.site}/${c.controller}`),
+    });
+  }
+  sendPumpCommand(res, owners[0].site, owners[0].controller, id, command);
+});
+
+// --- "Muestrear ahora" para todo un sitio ---
+// Se difunde en {sitio}/sample con un slot en el próximo segundo entero (al menos 1 s adelante, para
+// que el mensaje llegue a todos antes): los controladores con NTP leen exactamente en ese instante.
+app.post('/api/sites/:site/sample', (req, res) => {
+  const { site } = req.params;
+  if (!SEGMENT_PATTERN.test(site)) {
+    return res.status(400).json({ success: false, error: 'Sitio inválido' });
+  }
+  if (!mqttClient.connected) {
+    return res.status(503).json({ success: false, error: "Backend desconectado de MQTT" });
+  }
+
+  const slotMs = Math.ceil((Date.now() + 1000) / 1000) * 1000;
+  mqttClient.publish(`${site}/sample`, JSON.stringify({ slot_ms: slotMs }), { qos: 0 }, (error) => {
+    if (error) return res.status(500).json({ success: false, error: error.message });
+    console.log(`📸 Muestreo pedido a ${site} para ${new Date(slotMs).toISOString()}`);
+    res.json({ success: true, slot_ms: slotMs });
+  });
+});
+
+// --- Instantáneas de la flota por sitio (las más recientes primero, ?limit= hasta 500) ---
+app.get('/api/sites/:site/snapshots', async (req, res) => {
+  try {
+    const limit = Math.min(Number(req.query.limit) > 0 ? Number(req.query.limit) : 50, 500);
+    const result = await pool.query(
+      `SELECT * FROM site_snapshots WHERE site_id = $1 ORDER BY slot_at DESC LIMIT $2`,
+      [req.params.site, limit]
+    );
+    res.json(result.rows);
+  } catch (err) {
+    console.error(err);
+    res.status(500).json({ error: 'Error al leer base de datos' });
+  }
+});
+
+// --- Controladores conocidos (sitio, ID, bombas) ---
+app.get('/api/controllers', (req, res) => {
+  res.json(Array.from(controllers.values()));
 });
 
 // --- Endpoint para obtener historial de telemetría ---
 app.get('/api/telemetry', async (req, res) => {
   try {
-    // Consultamos las últimas 20 lecturas de la base de datos local
+    // Consultamos las últimas 20 lecturas de la base de datos local (opcional: ?site=&controller=)
+    const site = typeof req.query.site === 'string' ? req.query.site : null;
+    const controller = typeof req.query.controller === 'string' ? req.query.controller : null;
+    const result = await pool.query(
+      `SELECT * FROM pump_telemetry
+       WHERE ($1::text IS NULL OR site_id = $1) AND ($2::text IS NULL OR controller_id = $2)
+       ORDER BY timestamp DESC LIMIT 20`,
+      [site, controller]
+    );
+    res.json(result.rows);
+  } catch (err) {
+    console.error(err);
+    res.status(500).json({ error: 'Error al leer base de datos' });
+  }
+});
+
+// --- Perfil de arranque agregado por versión de firmware (opcional: ?days=, por defecto 30) ---
+// Mediana y p95 de los hitos y promedio de cada fase de setup(), para ver regresiones entre versiones
+app.get('/api/boot-profiles', async (req, res) => {
+  try {
+    const days = Number(req.query.days) > 0 ? Number(req.query.days) : 30;
+    const totals = await pool.query(
+      `SELECT firmware, COUNT(*)::int AS boots,
+              percentile_cont(0.5) WITHIN GROUP (ORDER BY wifi_ms) AS wifi_ms_p50,
+              percentile_cont(0.5) WITHIN GROUP (ORDER BY mqtt_ms) AS mqtt_ms_p50,
+              percentile_cont(0.5) WITHIN GROUP (ORDER BY first_publish_ms) AS first_publish_ms_p50,
+              percentile_cont(0.95) WITHIN GROUP (ORDER BY first_publish_ms) AS first_publish_ms_p95,
+              percentile_cont(0.5) WITHIN GROUP (ORDER BY ntp_ms) AS ntp_ms_p50
+       FROM controller_boot
+       WHERE received_at > NOW() - make_interval(days => $1)
+       GROUP BY firmware ORDER BY MAX(received_at) DESC`,
+      [days]
+    );
+    const phases = await pool.query(
+      `SELECT firmware, phase->>'name' AS name, AVG((phase->>'us')::bigint)::bigint AS avg_us
+       FROM controller_boot, jsonb_array_elements(phases) AS phase
+       WHERE received_at > NOW() - make_interval(days => $1)
+       GROUP BY firmware, phase->>'name'`,
+      [days]
+    );
+    res.json(totals.rows.map((row) => ({
+      ...row,
+      phases: phases.rows.filter((p) => p.firmware === row.firmware).map((p) => ({ name: p.name, avg_us: Number(p.avg_us) })),
+    })));
+  } catch (err) {
+    console.error(err);
+    res.status(500).json({ error: 'Error al leer base de datos' });
+  }
+});
+
+// --- Latencia por etapa: periodo reciente contra la línea base (opcional: ?hours=1&baseline_days=7) ---
+// Las cubetas de todas las ventanas se suman y los percentiles salen del histograma combinado
+// (promediar percentiles de ventanas distintas no da un percentil)
+const STAGE_BUCKET_BASE_US = 16; // Igual que en stage_metrics.h del ESP32
+const STAGE_BUCKETS = 12;          // La última cubeta no tiene cota: se usa el máximo observado
+
+function histogramPercentile(buckets: number[], maxUs: number, p: number): number | null {
+  const total = buckets.reduce((a, b) => a + b, 0);
+  if (total === 0) return null;
+  const rank = Math.max(1, Math.ceil((total * p) / 100));
+  let seen = 0;
+  for (let i = 0; i < buckets.length; i++) {
+    seen += buckets[i];
+    if (seen >= rank) return i < STAGE_BUCKETS - 1 ? Math.min(STAGE_BUCKET_BASE_US * 2 ** i, maxUs) : maxUs;
+  }
+  return maxUs;
+}
+
+async function stageHistograms(from: string, to: string) {
+  const result = await pool.query(
+    `SELECT stage, bucket.i::int AS i, SUM(bucket.n)::bigint AS n, MAX(max_us) AS max_us
+     FROM stage_metrics, unnest(buckets) WITH ORDINALITY AS bucket(n, i)
+     WHERE window_end > NOW() - $1::interval AND window_end <= NOW() - $2::interval
+     GROUP BY stage, bucket.i`,
+    [from, to]
+  );
+  const stages = new Map<string, { buckets: number[]; maxUs: number }>();
+  for (const row of result.rows) {
+    const stage = stages.get(row.stage) || { buckets: [], maxUs: 0 };
+    stage.buckets[row.i - 1] = Number(row.n);
+    stage.maxUs = Math.max(stage.maxUs, row.max_us);
+    stages.set(row.stage, stage);
+  }
+  return stages;
+}
+
+app.get('/api/metrics/stages', async (req, res) => {
+  try {
+    const hours = Number(req.query.hours) > 0 ? Number(req.query.hours) : 1;
+    const baselineDays = Number(req.query.baseline_days) > 0 ? Number(req.query.baseline_days) : 7;
+    const recent = await stageHistograms(`${hours} hours`, '0 seconds');
+    const baseline = await stageHistograms(`${baselineDays} days`, `${hours} hours`);
+
+    const summarize = (h?: { buckets: number[]; maxUs: number }) => {
+      const buckets = Array.from(h?.buckets || [], (n) => n || 0);
+      return {
+        samples: buckets.reduce((a, b) => a + b, 0),
+        p50_us: histogramPercentile(buckets, h?.maxUs || 0, 50),
+        p95_us: histogramPercentile(buckets, h?.maxUs || 0, 95),
+        max_us: h?.maxUs ?? null,
+      };
+    };
+    const names = Array.from(new Set([...recent.keys(), ...baseline.keys()])).sort();
+    res.json(names.map((stage) => ({ stage, recent: summarize(recent.get(stage)), baseline: summarize(baseline.get(stage)) })));
+  } catch (err) {
+    console.error(err);
+    res.status(500).json({ error: 'Error al leer base de datos' });
+  }
+});
+
+// --- Ranking de fuentes de bloqueo en la flota (opcional: ?days=30) ---
+// Agrupa por versión, etapa más interna y dirección (un mismo punto del código en una misma versión)
+app.get('/api/stalls/ranking', async (req, res) => {
+  try {
+    const days = Number(req.query.days) > 0 ? Number(req.query.days) : 30;
+    const result = await pool.query(
+      `SELECT firmware, stage, pc, COUNT(*)::int AS stalls, COUNT(DISTINCT controller_id)::int AS controllers,
+              SUM(CASE WHEN fatal THEN 1 ELSE 0 END)::int AS fatal,
+              percentile_cont(0.95) WITHIN GROUP (ORDER BY duration_ms) AS duration_ms_p95,
+              MAX(duration_ms) AS duration_ms_max, MAX(received_at) AS last_seen
+       FROM loop_stalls
+       WHERE received_at > NOW() - make_interval(days => $1)
+       GROUP BY firmware, stage, pc
+       ORDER BY stalls DESC, duration_ms_max DESC
+       LIMIT 50`,
+      [days]
+    );
+    res.json(result.rows);
+  } catch (err) {
+    console.error(err);
+    res.status(500).json({ error: 'Error al leer base de datos' });
+  }
+});
+
+// --- Último diagnóstico de memoria de cada controlador (los que tienen avisos primero) ---
+app.get('/api/diagnostics/latest', async (req, res) => {
+  try {
+    const result = await pool.query(
+      `SELECT * FROM (
+         SELECT DISTINCT ON (site_id, controller_id) *
+         FROM controller_diagnostics
+         ORDER BY site_id, controller_id, sampled_at DESC
+       ) latest
+       ORDER BY cardinality(warnings) DESC, min_free_bytes ASC`
+    );
+    res.json(result.rows);
+  } catch (err) {
+    console.error(err);
+    res.status(500).json({ error: 'Error al leer base de datos' });
+  }
+});
+
+// --- Historial de memoria de un controlador (opcional: ?hours=, por defecto 24) ---
+// loop_allocs_per_min: tasa de asignaciones del loop entre mensajes (nula tras un reinicio)
+app.get('/api/sites/:site/controllers/:controller/diagnostics', async (req, res) => {
+  try {
+    const hours = Number(req.query.hours) > 0 ? Number(req.query.hours) : 24;
     const result = await pool.query(
-      'SELECT * FROM pump_telemetry ORDER BY timestamp DESC LIMIT 20'
+      `SELECT sampled_at, uptime_s, free_bytes, min_free_bytes, largest_block, fragmentation_pct, failed_allocs,
+              live_allocs, loop_allocs, stage_allocs, stacks, warnings,
+              CASE WHEN uptime_s > prev_uptime_s
+                   THEN (loop_allocs - prev_loop_allocs) * 60.0 / (uptime_s - prev_uptime_s) END AS loop_allocs_per_min
+       FROM (
+         SELECT *, LAG(uptime_s) OVER w AS prev_uptime_s, LAG(loop_allocs) OVER w AS prev_loop_allocs
+         FROM controller_diagnostics
+         WHERE site_id = $1 AND controller_id = $2 AND sampled_at > NOW() - make_interval(hours => $3)
+         WINDOW w AS (ORDER BY sampled_at)
+       ) history
+       ORDER BY sampled_at`,
+      [req.params.site, req.params.controller, hours]
     );
     res.json(result.rows);
   } catch (err) {
@@ -0,0 +1,95 @@
+import { useEffect, useState } from "react";
+import { Card, CardContent, CardHeader, CardTitle } from "@/components/ui/card";
+import { Table, TableBody, TableCell, TableHead, TableHeader, TableRow } from "@/components/ui/table";
+import { Timer } from "lucide-react";
+
+interface StageSummary {
+  samples: number;
+  p50_us: number | null;
+  p95_us: number | null;
+  max_us: number | null;
+}
+
+interface StageLatency {
+  stage: string;
+  recent: StageSummary;
+  baseline: StageSummary;
+}
+
+// p95 reciente por encima de esto respecto a la línea base se marca como regresión
+const REGRESSION_RATIO = 1.5;
+
+const formatUs = (us: number | null) => {
+  if (us === null) return "—";
+  return us >= 1000 ? `${(us / 1000).toFixed(1)} ms` : `${us} µs`;
+};
+
+/**
+ * Panel de latencia por etapa del firmware (última hora contra los 7 días anteriores)
+ * Datos de /api/metrics/stages, que combina los histogramas publicados por los ESP32
+ */
+export function StageLatencyPanel() {
+  const [stages, setStages] = useState<StageLatency[]>([]);
+
+  useEffect(() => {
+    const fetchStages = async () => {
+      try {
+        const response = await fetch('/api/metrics/stages');
+        if (!response.ok) throw new Error('Error de red');
+        setStages(await response.json());
+      } catch (error) {
+        console.error("❌ Error cargando latencias:", error);
+      }
+    };
+
+    fetchStages();
+    const intervalId = setInterval(fetchStages, 60000);
+    return () => clearInterval(intervalId);
+  }, []);
+
+  return (
+    <Card>
+      <CardHeader>
+        <CardTitle className="flex items-center gap-2">
+          <Timer className="h-6 w-6 text-primary" />
+          Latencia del Firmware por Etapa
+        </CardTitle>
+      </CardHeader>
+      <CardContent>
+        <Table>
+          <TableHeader>
+            <TableRow>
+              <TableHead>Etapa</TableHead>
+              <TableHead className="text-right">Muestras</TableHead>
+              <TableHead className="text-right">p50</TableHead>
+              <TableHead className="text-right">p95</TableHead>
+              <TableHead className="text-right">p95 base (7 d)</TableHead>
+              <TableHead className="text-right">Máximo</TableHead>
+            </TableRow>
+          </TableHeader>
+          <TableBody>
+            {stages.map(({ stage, recent, baseline }) => {
+              const regressed = recent.p95_us !== null && baseline.p95_us !== null &&
+                recent.p95_us > baseline.p95_us * REGRESSION_RATIO;
+              return (
+                <TableRow key={stage} className={regressed ? "bg-red-50" : undefined}>
+                  <TableCell className="font-mono text-xs">{stage}</TableCell>
+                  <TableCell className="text-right">{recent.samples}</TableCell>
+                  <TableCell className="text-right">{formatUs(recent.p50_us)}</TableCell>
+                  <TableCell className={`text-right ${regressed ? "text-red-600 font-semibold" : ""}`}>
+                    {formatUs(recent.p95_us)}{regressed && " ⚠"}
+                  </TableCell>
+                  <TableCell className="text-right text-muted-foreground">{formatUs(baseline.p95_us)}</TableCell>
+                  <TableCell className="text-right">{formatUs(recent.max_us)}</TableCell>
+                </TableRow>
+              );
+            })}
+          </TableBody>
+        </Table>
+        {stages.length === 0 && (
+          <p className="text-sm text-muted-foreground text-center py-4">Sin métricas recibidas</p>
+        )}
+      </CardContent>
+    </Card>
+  );
+}
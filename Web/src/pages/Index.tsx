@@ -4,6 +4,7 @@ import { InletFlow } from "@/components/InletFlow";
 import { PumpControlCard } from "@/components/PumpControlCard";
 import { AlertsList } from "@/components/AlertsList";
 import { LoginCard } from "@/components/LoginCard";
+import { StageLatencyPanel } from "@/components/StageLatencyPanel";
 import { Card, CardContent, CardHeader, CardTitle } from "@/components/ui/card";
 import { Button } from "@/components/ui/button";
 import { Switch } from "@/components/ui/switch";
@@ -227,6 +228,9 @@ const Index = () => {
           ))}
         </div>
 
+        {/* Diagnóstico del firmware (solo con datos reales) */}
+        {!useSimulation && <StageLatencyPanel />}
+
         {/* Alertas y Notificaciones */}
         <Card>
           <CardHeader>